@@ -0,0 +1,56 @@
+#!/bin/bash
+# Heap allocations per request, by route and stage, for a server built with
+# -DALLOCATION_ACCOUNTING=ON. Each route is requested once to warm up, the
+# counters are cleared, and then every route is requested the given number of
+# times over one keep-alive connection.
+#
+# usage : bench/alloc_bench.sh <path to jHttpServe binary> [requests per route]
+
+set -e
+
+SERVER_BINARY=$(realpath "${1:?usage: $0 <jHttpServe binary> [requests per route]}")
+REQUESTS=${2:-1000}
+PORT=${PORT:-18480}
+WORK_DIR=$(mktemp -d)
+trap 'kill $SERVER_PID 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+
+cd "$WORK_DIR"
+mkdir www uploads
+echo "<html></html>" > www/index.html
+head -c $((64 * 1024)) /dev/urandom > www/medium.bin
+cat > server.json <<JSON
+{
+    "port" : $PORT,
+    "server_name" : "jHttpServe bench",
+    "web_dir" : "www",
+    "upload_dir" : "uploads",
+    "status_route" : "/status",
+    "allocations_route" : "/debug/allocations"
+}
+JSON
+
+"$SERVER_BINARY" -f server.json > server.log 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+ROUTES="/ /medium.bin /missing /status"
+for route in $ROUTES; do
+	curl -s -o /dev/null "http://localhost:$PORT$route"
+done
+curl -s -o /dev/null "http://localhost:$PORT/debug/allocations?reset"
+
+for route in $ROUTES; do
+	# one curl, one connection, the URL repeated
+	seq "$REQUESTS" | sed "s|.*|url = \"http://localhost:$PORT$route\"\noutput = /dev/null|" | curl -s -K -
+done
+
+curl -s "http://localhost:$PORT/debug/allocations" | python3 -c '
+import json, sys
+routes = json.load(sys.stdin)["routes"]
+print("%-24s %10s %14s %14s  %s" % ("route", "requests", "allocs/req", "bytes/req", "allocs/req by stage"))
+for name, route in routes.items():
+    if route["requests"] == 0:
+        continue
+    stages = ", ".join("%s %.1f" % (stage, counts["allocations"] / route["requests"]) for stage, counts in route["stages"].items())
+    print("%-24s %10d %14.1f %14.1f  %s" % (name, route["requests"], route["allocations_per_request"], route["bytes_per_request"], stages))
+'
@@ -0,0 +1,411 @@
+#!/usr/bin/env python3
+# End-to-end benchmark scenarios on loopback.
+#
+#   bench/scenarios.py <jHttpServe binary> [--output results.json] [--baseline baseline.json]
+#                      [--tolerance 0.15] [--tolerance metric=0.5] [--duration 5] [--idle-connections 10000]
+#                      [--update-baseline] [--only scenario,...]
+#
+# Starts the server with a generated config in a temporary directory and runs
+# fixed workloads against it:
+#   static_keepalive   tiny static GET over keep-alive connections
+#   static_close       the same GET with a new connection per request
+#   json_api           GET /api over keep-alive connections
+#   download_100mb     a 100 MB static file, one download at a time
+#   multipart_upload   10 MB multipart POSTs to /upload
+#   idle_10k           thousands of idle connections held open while requests are timed
+# For each it records throughput, latency percentiles, and the server's peak RSS
+# and thread count (from /proc), and writes them to the output as JSON. Given a
+# baseline written by an earlier run, every metric is compared with it and the
+# run fails when one is worse by more than its tolerance. Load comes from
+# forked worker processes with blocking sockets, so results compare runs on the
+# same machine rather than measure the server's limits.
+import argparse
+import json
+import multiprocessing
+import os
+import platform
+import resource
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+HOST = "127.0.0.1"
+# metrics where a larger value is better, every other metric is better smaller
+HIGHER_IS_BETTER = ("requests_per_second", "megabytes_per_second", "connections_held")
+
+
+def free_port():
+    with socket.socket() as probe:
+        probe.bind((HOST, 0))
+        return probe.getsockname()[1]
+
+
+def read_response(sock, buffer):
+    # one response with a content-length, returns it and whatever follows it
+    while b"\r\n\r\n" not in buffer:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("closed before the response headers")
+        buffer += data
+    header_end = buffer.index(b"\r\n\r\n") + 4
+    head = buffer[:header_end].decode("latin-1")
+    status = int(head.split(" ", 2)[1])
+    length = 0
+    for line in head.split("\r\n")[1:]:
+        name, _, value = line.partition(":")
+        if name.strip().lower() == "content-length":
+            length = int(value.strip())
+    remaining = length - (len(buffer) - header_end)
+    while remaining > 0:
+        data = sock.recv(min(remaining, 1 << 20))
+        if not data:
+            raise ConnectionError("closed inside the response body")
+        remaining -= len(data)
+    return status, buffer[header_end + length:] if remaining == 0 else b""
+
+
+def request_loop(port, request, keep_alive, duration, results):
+    # runs in a worker process, sends the request until the time is up
+    latencies = []
+    errors = 0
+    deadline = time.monotonic() + duration
+    sock = None
+    buffer = b""
+    while time.monotonic() < deadline:
+        try:
+            if sock is None:
+                sock = socket.create_connection((HOST, port))
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                buffer = b""
+            start = time.perf_counter()
+            sock.sendall(request)
+            status, buffer = read_response(sock, buffer)
+            latencies.append(time.perf_counter() - start)
+            if status >= 400:
+                errors += 1
+            if not keep_alive:
+                sock.close()
+                sock = None
+        except OSError:
+            errors += 1
+            if sock:
+                sock.close()
+            sock = None
+    if sock:
+        sock.close()
+    results.put((latencies, errors))
+
+
+def run_load(port, request, keep_alive, duration, concurrency):
+    results = multiprocessing.Queue()
+    workers = [multiprocessing.Process(target=request_loop, args=(port, request, keep_alive, duration, results))
+               for _ in range(concurrency)]
+    for worker in workers:
+        worker.start()
+    latencies = []
+    errors = 0
+    for _ in workers:
+        worker_latencies, worker_errors = results.get()
+        latencies += worker_latencies
+        errors += worker_errors
+    for worker in workers:
+        worker.join()
+    return latencies, errors
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def latency_metrics(latencies):
+    return {
+        "latency_p50_ms": round(percentile(latencies, 0.50) * 1000, 3),
+        "latency_p90_ms": round(percentile(latencies, 0.90) * 1000, 3),
+        "latency_p99_ms": round(percentile(latencies, 0.99) * 1000, 3),
+    }
+
+
+class ProcessSampler:
+    # peak resident memory and thread count of the server while a scenario runs
+    def __init__(self, pid):
+        self.pid = pid
+        self.peak_rss_kb = 0
+        self.peak_threads = 0
+        self.running = False
+
+    def sample(self):
+        with open("/proc/%d/status" % self.pid) as status_file:
+            for line in status_file:
+                if line.startswith("VmRSS:"):
+                    self.peak_rss_kb = max(self.peak_rss_kb, int(line.split()[1]))
+                elif line.startswith("Threads:"):
+                    self.peak_threads = max(self.peak_threads, int(line.split()[1]))
+
+    def __enter__(self):
+        self.peak_rss_kb = 0
+        self.peak_threads = 0
+        self.running = True
+        self.thread = threading.Thread(target=self.run, daemon=True)
+        self.thread.start()
+        return self
+
+    def run(self):
+        while self.running:
+            self.sample()
+            time.sleep(0.05)
+
+    def __exit__(self, *exception):
+        self.running = False
+        self.thread.join()
+        self.sample()
+
+    def metrics(self):
+        return {"peak_rss_mb": round(self.peak_rss_kb / 1024, 1), "peak_threads": self.peak_threads}
+
+
+def get_request(path, keep_alive):
+    connection = "keep-alive" if keep_alive else "close"
+    return ("GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: %s\r\n\r\n" % (path, connection)).encode()
+
+
+def scenario_get(server, options, path, keep_alive):
+    with ProcessSampler(server.pid) as sampler:
+        start = time.monotonic()
+        latencies, errors = run_load(server.port, get_request(path, keep_alive), keep_alive, options.duration, options.concurrency)
+        elapsed = time.monotonic() - start
+    metrics = {"requests_per_second": round(len(latencies) / elapsed, 1), "errors": errors}
+    metrics.update(latency_metrics(latencies))
+    metrics.update(sampler.metrics())
+    return metrics
+
+
+def scenario_download(server, options):
+    size = os.path.getsize(os.path.join(server.directory, "www", "large.bin"))
+    latencies = []
+    errors = 0
+    with ProcessSampler(server.pid) as sampler:
+        for _ in range(options.downloads):
+            with socket.create_connection((HOST, server.port)) as sock:
+                start = time.perf_counter()
+                sock.sendall(get_request("/large.bin", False))
+                status, _ = read_response(sock, b"")
+                latencies.append(time.perf_counter() - start)
+                errors += status != 200
+    metrics = {"megabytes_per_second": round(size / (1 << 20) / percentile(latencies, 0.5), 1), "errors": errors}
+    metrics.update(latency_metrics(latencies))
+    metrics.update(sampler.metrics())
+    return metrics
+
+
+def scenario_upload(server, options):
+    boundary = "benchboundary7MA4YWxkTrZu0gW"
+    payload = os.urandom(10 << 20)
+    body = (("--%s\r\nContent-Disposition: form-data; name=\"file\"; filename=\"bench.bin\"\r\n"
+             "Content-Type: application/octet-stream\r\n\r\n") % boundary).encode() + payload + ("\r\n--%s--\r\n" % boundary).encode()
+    request = ("POST /upload HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n"
+               "Content-Type: multipart/form-data; boundary=%s\r\nContent-Length: %d\r\n\r\n" % (boundary, len(body))).encode() + body
+    with ProcessSampler(server.pid) as sampler:
+        start = time.monotonic()
+        latencies, errors = run_load(server.port, request, True, options.duration, max(1, options.concurrency // 4))
+        elapsed = time.monotonic() - start
+    metrics = {"megabytes_per_second": round(len(latencies) * len(payload) / (1 << 20) / elapsed, 1),
+               "requests_per_second": round(len(latencies) / elapsed, 2), "errors": errors}
+    metrics.update(latency_metrics(latencies))
+    metrics.update(sampler.metrics())
+    return metrics
+
+
+def scenario_idle(server, options):
+    idle_sockets = []
+    with ProcessSampler(server.pid) as sampler:
+        try:
+            for _ in range(options.idle_connections):
+                idle_sockets.append(socket.create_connection((HOST, server.port), timeout=5))
+        except OSError as error:
+            print("  idle connections stopped at %d: %s" % (len(idle_sockets), error))
+        # the server has to keep answering while they are open
+        latencies = []
+        errors = 0
+        with socket.create_connection((HOST, server.port)) as sock:
+            buffer = b""
+            for _ in range(1000):
+                start = time.perf_counter()
+                sock.sendall(get_request("/index.html", True))
+                status, buffer = read_response(sock, buffer)
+                latencies.append(time.perf_counter() - start)
+                errors += status != 200
+        # idle connections that were closed by the server read as ready with nothing in them
+        held = 0
+        for idle_socket in idle_sockets:
+            idle_socket.setblocking(False)
+            try:
+                held += idle_socket.recv(1) != b""
+            except BlockingIOError:
+                held += 1
+            except OSError:
+                pass
+    for idle_socket in idle_sockets:
+        idle_socket.close()
+    metrics = {"connections_held": held, "errors": errors}
+    metrics.update(latency_metrics(latencies))
+    metrics.update(sampler.metrics())
+    return metrics
+
+
+SCENARIOS = {
+    "static_keepalive": lambda server, options: scenario_get(server, options, "/index.html", True),
+    "static_close": lambda server, options: scenario_get(server, options, "/index.html", False),
+    "json_api": lambda server, options: scenario_get(server, options, "/api", True),
+    "download_100mb": scenario_download,
+    "multipart_upload": scenario_upload,
+    "idle_10k": scenario_idle,
+}
+
+
+class Server:
+    def __init__(self, binary, idle_connections):
+        self.directory = tempfile.mkdtemp(prefix="jhttpserve-bench-")
+        self.port = free_port()
+        www = os.path.join(self.directory, "www")
+        os.makedirs(www)
+        with open(os.path.join(www, "index.html"), "w") as index_file:
+            index_file.write("<html><body>jHttpServe</body></html>\n")
+        with open(os.path.join(www, "large.bin"), "wb") as large_file:
+            for _ in range(100):
+                large_file.write(os.urandom(1 << 20))
+        config = {
+            "port": self.port,
+            "server_name": "jHttpServe bench",
+            "web_dir": "www",
+            "upload_dir": "uploads",
+            "allowed_methods": ["GET", "POST"],
+            # idle connections are held for the whole scenario
+            "timeout": 600,
+            "socket": {"backlog": max(idle_connections, 4096)},
+        }
+        with open(os.path.join(self.directory, "server.json"), "w") as config_file:
+            json.dump(config, config_file, indent=4)
+        self.log = open(os.path.join(self.directory, "server.log"), "w")
+        self.process = subprocess.Popen([binary, "-f", "server.json"], cwd=self.directory, stdout=self.log, stderr=subprocess.STDOUT)
+        self.pid = self.process.pid
+        deadline = time.monotonic() + 10
+        while time.monotonic() < deadline:
+            try:
+                socket.create_connection((HOST, self.port), timeout=1).close()
+                return
+            except OSError:
+                if self.process.poll() is not None:
+                    break
+                time.sleep(0.1)
+        self.stop()
+        sys.exit("server did not start, see its log above")
+
+    def stop(self):
+        if self.process.poll() is None:
+            self.process.terminate()
+            try:
+                self.process.wait(10)
+            except subprocess.TimeoutExpired:
+                self.process.kill()
+        self.log.close()
+        if self.process.returncode not in (0, -15, None):
+            with open(os.path.join(self.directory, "server.log")) as log_file:
+                sys.stdout.write(log_file.read()[-4000:])
+        shutil.rmtree(self.directory, ignore_errors=True)
+
+
+def compare(results, baseline, tolerances):
+    # every metric found in both runs, with whether it got worse by more than its tolerance
+    regressions = 0
+    print("%-18s %-22s %12s %12s %8s" % ("scenario", "metric", "baseline", "current", "change"))
+    for name, metrics in results["scenarios"].items():
+        for metric, value in metrics.items():
+            base = baseline.get("scenarios", {}).get(name, {}).get(metric)
+            if base is None:
+                continue
+            tolerance = tolerances.get(metric, tolerances["default"])
+            if metric in HIGHER_IS_BETTER:
+                worse = value < base * (1 - tolerance)
+            else:
+                worse = value > base * (1 + tolerance)
+            change = "%+.1f%%" % ((value - base) / base * 100) if base else ("=" if value == base else "new")
+            regressions += worse
+            print("%-18s %-22s %12s %12s %8s%s" % (name, metric, base, value, change, "  REGRESSION" if worse else ""))
+    return regressions
+
+
+def parse_tolerances(values):
+    tolerances = {"default": 0.15}
+    for value in values:
+        metric, _, fraction = value.rpartition("=")
+        tolerances[metric or "default"] = float(fraction)
+    return tolerances
+
+
+def main():
+    parser = argparse.ArgumentParser(description="jHttpServe end-to-end benchmark scenarios")
+    parser.add_argument("binary")
+    parser.add_argument("--output", default="bench_results.json")
+    parser.add_argument("--baseline")
+    parser.add_argument("--update-baseline", action="store_true", help="write the results to the baseline instead of comparing")
+    parser.add_argument("--tolerance", action="append", default=[],
+                        help="fraction a metric may be worse than the baseline, metric=fraction for one metric")
+    parser.add_argument("--duration", type=float, default=5, help="seconds each timed scenario runs")
+    parser.add_argument("--concurrency", type=int, default=8, help="client processes of the request scenarios")
+    parser.add_argument("--downloads", type=int, default=5)
+    parser.add_argument("--idle-connections", type=int, default=10000)
+    parser.add_argument("--only", help="comma separated scenarios to run")
+    options = parser.parse_args()
+
+    # the client and the server, which inherits the limit, both need a descriptor per idle connection
+    soft_limit, hard_limit = resource.getrlimit(resource.RLIMIT_NOFILE)
+    wanted = options.idle_connections + 1024
+    if soft_limit < wanted:
+        soft_limit = wanted if hard_limit == resource.RLIM_INFINITY else min(wanted, hard_limit)
+        resource.setrlimit(resource.RLIMIT_NOFILE, (soft_limit, hard_limit))
+    options.idle_connections = min(options.idle_connections, soft_limit - 1024)
+
+    names = options.only.split(",") if options.only else list(SCENARIOS)
+    results = {
+        "environment": {"machine": platform.node(), "cpus": os.cpu_count(), "kernel": platform.release(),
+                        "date": time.strftime("%Y-%m-%dT%H:%M:%S")},
+        "scenarios": {},
+    }
+    server = Server(os.path.realpath(options.binary), options.idle_connections)
+    try:
+        for name in names:
+            print("== %s" % name)
+            metrics = SCENARIOS[name](server, options)
+            results["scenarios"][name] = metrics
+            print("  " + ", ".join("%s %s" % item for item in metrics.items()))
+    finally:
+        server.stop()
+
+    output = options.baseline if options.update_baseline and options.baseline else options.output
+    with open(output, "w") as output_file:
+        json.dump(results, output_file, indent=4)
+    print("results written to %s" % output)
+    if options.update_baseline or not options.baseline:
+        return 0
+    if not os.path.exists(options.baseline):
+        print("no baseline at %s, store one with --update-baseline" % options.baseline)
+        return 0
+    with open(options.baseline) as baseline_file:
+        baseline = json.load(baseline_file)
+    regressions = compare(results, baseline, parse_tolerances(options.tolerance))
+    if regressions:
+        print("%d metrics regressed" % regressions)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    multiprocessing.set_start_method("fork")
+    sys.exit(main())
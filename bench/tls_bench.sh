@@ -0,0 +1,44 @@
+#!/bin/bash
+# TLS benchmark on loopback with a throwaway self-signed certificate.
+# Reports full and resumed handshakes per second (openssl s_time) and
+# encrypted throughput for a large static file (curl).
+#
+# usage : bench/tls_bench.sh <path to jHttpServe binary> [seconds per run]
+
+set -e
+
+SERVER_BINARY=$(realpath "${1:?usage: $0 <jHttpServe binary> [seconds]}")
+RUN_SECONDS=${2:-10}
+PORT=${PORT:-18443}
+WORK_DIR=$(mktemp -d)
+trap 'kill $SERVER_PID 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+
+cd "$WORK_DIR"
+mkdir www
+openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 1 -subj /CN=localhost 2>/dev/null
+head -c 80 /dev/urandom > ticket.key
+head -c $((64 * 1024 * 1024)) /dev/urandom > www/large.bin
+echo "<html></html>" > www/index.html
+cat > server.json <<EOF
+{
+    "port" : $PORT,
+    "server_name" : "jHttpServe bench",
+    "web_dir" : "www",
+    "tls" : { "certificate" : "cert.pem", "private_key" : "key.pem", "ticket_key_file" : "ticket.key" }
+}
+EOF
+
+"$SERVER_BINARY" -f server.json > server.log 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+for protocol in tls1_2 tls1_3; do
+	echo "== $protocol handshakes"
+	openssl s_time -connect localhost:$PORT -$protocol -new -time "$RUN_SECONDS" 2>/dev/null | grep "real seconds" | sed 's/^/full    : /'
+	openssl s_time -connect localhost:$PORT -$protocol -reuse -time "$RUN_SECONDS" 2>/dev/null | grep "real seconds" | sed 's/^/resumed : /'
+done
+
+echo "== encrypted throughput, 64 MiB file"
+for http in --http1.1 --http2; do
+	curl -sk $http -o /dev/null -w "$http : %{speed_download} bytes/sec\n" https://localhost:$PORT/large.bin
+done
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+# Stand-in HTTP/1.1 backend for trying out the reverse proxy routes.
+#
+#   bench/upstream_stub.py <port> [name]
+#
+# Keeps connections alive and tags every response with x-upstream: <name>.
+#   /echo           request body sent back, request headers as x-echo-* headers
+#   /delay?ms=N     answers after N milliseconds
+#   /bytes?n=N      N bytes with a content-length
+#   /chunked?n=N    N bytes sent chunked
+#   /status/CODE    empty response with that status
+#   /close          answers with connection: close
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+NAME = sys.argv[2] if len(sys.argv) > 2 else "upstream"
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        pass
+
+    def read_body(self):
+        if "chunked" in self.headers.get("Transfer-Encoding", ""):
+            body = b""
+            while True:
+                size = int(self.rfile.readline().split(b";")[0], 16)
+                if size == 0:
+                    while self.rfile.readline() not in (b"\r\n", b""):
+                        pass
+                    return body
+                body += self.rfile.read(size)
+                self.rfile.readline()
+        return self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+    def reply(self, status, body=b"", headers=()):
+        self.send_response(status)
+        self.send_header("x-upstream", NAME)
+        for name, value in headers:
+            self.send_header(name, value)
+        if not any(name == "transfer-encoding" for name, _ in headers):
+            self.send_header("content-length", str(len(body)))
+        self.end_headers()
+        if self.command != "HEAD" and body:
+            self.wfile.write(body)
+
+    def handle_any(self):
+        url = urlparse(self.path)
+        query = parse_qs(url.query)
+        body = self.read_body()
+        if url.path.endswith("/echo"):
+            headers = [("x-echo-" + name.lower(), value) for name, value in self.headers.items()]
+            headers.append(("x-echo-target", self.path))
+            self.reply(200, body, headers)
+        elif url.path.endswith("/delay"):
+            time.sleep(int(query.get("ms", ["1000"])[0]) / 1000)
+            self.reply(200, b"late\n")
+        elif url.path.endswith("/bytes"):
+            self.reply(200, b"x" * int(query.get("n", ["1024"])[0]))
+        elif url.path.endswith("/chunked"):
+            remaining = int(query.get("n", ["100000"])[0])
+            self.send_response(200)
+            self.send_header("x-upstream", NAME)
+            self.send_header("transfer-encoding", "chunked")
+            self.end_headers()
+            while remaining > 0:
+                part = min(remaining, 4096)
+                self.wfile.write(b"%x\r\n%s\r\n" % (part, b"y" * part))
+                remaining -= part
+            self.wfile.write(b"0\r\n\r\n")
+        elif "/status/" in url.path:
+            self.reply(int(url.path.rsplit("/", 1)[1]))
+        elif url.path.endswith("/close"):
+            self.close_connection = True
+            self.reply(200, b"bye\n", [("connection", "close")])
+        else:
+            self.reply(200, ("%s %s\n" % (NAME, self.path)).encode())
+
+    do_GET = do_POST = do_PUT = do_DELETE = do_HEAD = do_OPTIONS = handle_any
+
+
+if __name__ == "__main__":
+    server = ThreadingHTTPServer(("127.0.0.1", int(sys.argv[1])), Handler)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever).start()
@@ -0,0 +1,114 @@
+#ifndef _ALLOCATION_TRACKER_H_
+#define _ALLOCATION_TRACKER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// distinct stages and routes counted apart, any beyond share the last slot
+constexpr size_t ALLOCATION_MAX_STAGES = 16;
+constexpr size_t ALLOCATION_MAX_ROUTES = 128;
+// method and pattern of a route, longer ones are cut
+constexpr size_t ALLOCATION_ROUTE_NAME_SIZE = 96;
+
+// the stage and route a thread's allocations are charged to
+struct AllocationContext
+{
+	size_t stage;
+	size_t route;
+};
+
+// Allocation accounting, built in with the ALLOCATION_ACCOUNTING option.
+// Global operator new and delete are replaced by ones that count calls and
+// bytes on the calling thread. The counts are charged to the thread's current
+// stage and route, set by AllocationStage and AllocationRequest scopes, and
+// move to the shared counters whenever either changes, so the hooks only ever
+// touch thread-local memory. A coroutine takes the context it was created in
+// along to whichever thread resumes it. Without the option the scopes are
+// empty and nothing is replaced.
+class AllocationTracker
+{
+public:
+	static constexpr bool IsEnabled()
+	{
+#ifdef ALLOCATION_ACCOUNTING
+		return true;
+#else
+		return false;
+#endif
+	};
+	// counts per route and per stage within it, as JSON
+	static std::string Dump();
+	static void Reset();
+#ifdef ALLOCATION_ACCOUNTING
+	// make the stage or route current on the calling thread, the one it replaces is returned to restore later
+	static size_t EnterStage(const char* stage);
+	static void LeaveStage(size_t previous_stage);
+	// route names the registered pattern a request matched, not its path, so one-off urls share a slot
+	static size_t EnterRoute(std::string_view method, std::string_view route);
+	static void LeaveRoute(size_t previous_route);
+	static AllocationContext CurrentContext();
+	// makes a context taken earlier current again without counting another request
+	static AllocationContext EnterContext(AllocationContext context);
+	static void LeaveContext(AllocationContext previous_context);
+#endif
+};
+
+// charges the thread's allocations to a stage from construction to End
+class AllocationStage
+{
+public:
+#ifdef ALLOCATION_ACCOUNTING
+	explicit AllocationStage(const char* stage)
+	  : _previous_stage(AllocationTracker::EnterStage(stage)){};
+	~AllocationStage()
+	{
+		End();
+	};
+	void End()
+	{
+		if (_active)
+		{
+			AllocationTracker::LeaveStage(_previous_stage);
+			_active = false;
+		}
+	};
+#else
+	explicit AllocationStage(const char*){};
+	void End(){};
+#endif
+	AllocationStage(const AllocationStage&) = delete;
+	AllocationStage& operator=(const AllocationStage&) = delete;
+
+#ifdef ALLOCATION_ACCOUNTING
+private:
+	size_t _previous_stage;
+	bool _active = true;
+#endif
+};
+
+// counts a request of the route and charges the thread's allocations to it while in scope
+class AllocationRequest
+{
+public:
+#ifdef ALLOCATION_ACCOUNTING
+	AllocationRequest(std::string_view method, std::string_view route)
+	  : _previous_route(AllocationTracker::EnterRoute(method, route)){};
+	~AllocationRequest()
+	{
+		AllocationTracker::LeaveRoute(_previous_route);
+	};
+#else
+	AllocationRequest(std::string_view, std::string_view){};
+#endif
+	AllocationRequest(const AllocationRequest&) = delete;
+	AllocationRequest& operator=(const AllocationRequest&) = delete;
+
+#ifdef ALLOCATION_ACCOUNTING
+private:
+	size_t _previous_route;
+#endif
+};
+
+#endif
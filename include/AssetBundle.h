@@ -0,0 +1,92 @@
+#ifndef _ASSET_BUNDLE_H_
+#define _ASSET_BUNDLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// A file of the asset directory as compiled into the binary by tools/pack_assets.py,
+// with the header values it is served with worked out at build time
+struct EmbeddedAsset
+{
+	// request path, "/" followed by the path inside the asset directory
+	std::string_view path;
+	std::string_view content_type;
+	// strong validator derived from the contents
+	std::string_view etag;
+	std::string_view last_modified;
+	const unsigned char* data;
+	size_t size;
+	// gzip encoding of the data, null when it would not be smaller
+	const unsigned char* gzip_data;
+	size_t gzip_size;
+};
+
+// Layout of the generated index. Assets are stored in the order of their slot
+// in a minimal perfect hash (hash and displace): the path's hash picks a
+// bucket, the bucket's seed rehashes the path to its slot.
+struct AssetBundleIndex
+{
+	const EmbeddedAsset* assets;
+	size_t asset_count;
+	const uint32_t* seeds;
+	size_t seed_count;
+};
+
+// FNV-1a started from the seed and finished with the murmur3 mixer, tools/pack_assets.py computes the same
+constexpr uint32_t AssetPathHash(uint32_t seed, std::string_view path)
+{
+	uint32_t hash = 0x811C9DC5u ^ seed;
+	for (auto character : path)
+	{
+		hash ^= static_cast<unsigned char>(character);
+		hash *= 0x01000193u;
+	}
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35u;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+// Static assets compiled into the binary when it is built with EMBED_WEB_ASSETS.
+// A lookup is two hashes of the path and one comparison, without touching the
+// filesystem or allocating.
+class AssetBundle
+{
+public:
+	// the bundle built into the binary, empty when there is none
+	static const AssetBundle& Embedded();
+	// null when the path is not in the bundle
+	const EmbeddedAsset* Find(std::string_view path) const
+	{
+		if (_index.asset_count == 0)
+		{
+			return nullptr;
+		}
+		auto seed = _index.seeds[AssetPathHash(0, path) % _index.seed_count];
+		auto& asset = _index.assets[AssetPathHash(seed, path) % _index.asset_count];
+		return asset.path == path ? &asset : nullptr;
+	};
+	size_t Size() const
+	{
+		return _index.asset_count;
+	};
+	bool IsEmpty() const
+	{
+		return _index.asset_count == 0;
+	};
+	// whether an Accept-Encoding header allows a gzip body
+	static bool AcceptsGzip(const std::string& accept_encoding);
+
+private:
+	explicit AssetBundle(const AssetBundleIndex& index)
+	  : _index(index){};
+
+private:
+	AssetBundleIndex _index;
+};
+
+#endif
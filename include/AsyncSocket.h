@@ -0,0 +1,39 @@
+#ifndef _ASYNC_SOCKET_H_
+#define _ASYNC_SOCKET_H_
+
+#include "EventLoop.h"
+#include "Task.h"
+#include "jSocket.h"
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// Non-blocking TCP client socket for coroutine handlers talking to downstream
+// services. Reads and writes suspend the coroutine on the event loop until the
+// socket is ready instead of blocking a thread. One operation at a time.
+class AsyncSocket
+{
+public:
+	AsyncSocket(EventLoop& event_loop, int socket_fd);
+	~AsyncSocket();
+	AsyncSocket(const AsyncSocket&) = delete;
+	AsyncSocket& operator=(const AsyncSocket&) = delete;
+	// nullptr when the connection could not be made within the timeout
+	static Task<std::unique_ptr<AsyncSocket>> Connect(EventLoop& event_loop,
+													  struct sockaddr_in peer_address,
+													  std::chrono::milliseconds timeout);
+	// whatever is available up to max_length, ReadError::TimeOut when nothing came within the timeout
+	Task<ReadResult> Read(size_t max_length, std::chrono::milliseconds timeout);
+	// false when the peer is gone or the data could not be written within the timeout
+	Task<bool> Write(std::vector<unsigned char> data_buffer, std::chrono::milliseconds timeout);
+	void Shutdown();
+
+private:
+	EventLoop& _event_loop;
+	int _socket_fd;
+};
+
+#endif
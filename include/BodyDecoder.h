@@ -0,0 +1,63 @@
+#ifndef _BODY_DECODER_H_
+#define _BODY_DECODER_H_
+
+#include "BufferPool.h"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class BodyFraming
+{
+	None,
+	ContentLength,
+	Chunked,
+	// no length given, the body ends when the peer closes (responses only)
+	UntilClose
+};
+
+// Frames one message body out of a byte stream (RFC 7230 section 3.3.3).
+// Bytes are taken from a buffer shared with the owner, which is refilled through
+// the fill function; whatever follows the body is left in the buffer.
+class BodyDecoder
+{
+public:
+	// appends more bytes to the buffer, returns the count added, 0 at end of stream, -1 on error
+	using FillFunction = std::function<long(ReceiveBuffer&)>;
+
+	BodyDecoder(ReceiveBuffer& input_buffer, const FillFunction& fill_function)
+	  : _input_buffer(input_buffer)
+	  , _fill_function(fill_function){};
+	void Start(BodyFraming framing, uintmax_t content_length = 0);
+	// next piece of the body, empty at its end, nullopt when the stream breaks off or is malformed
+	std::optional<std::vector<unsigned char>> Read();
+	// reads and drops the rest of the body, false when it could not be read to the end
+	bool Drain();
+	bool IsComplete() const
+	{
+		return _framing == BodyFraming::None;
+	};
+	// what is left of a content-length body, nullopt for other framings
+	std::optional<uintmax_t> RemainingLength() const
+	{
+		return _framing == BodyFraming::ContentLength ? std::optional<uintmax_t>(_remaining) : std::nullopt;
+	};
+	// counts bytes of a content-length body the owner took from the stream itself, bypassing the buffer
+	void Consume(uintmax_t length);
+
+private:
+	std::optional<std::vector<unsigned char>> ReadChunk();
+	std::optional<std::string> ReadLine();
+	std::vector<unsigned char> Take(uintmax_t length);
+	std::optional<std::vector<unsigned char>> Fail();
+
+private:
+	ReceiveBuffer& _input_buffer;
+	FillFunction _fill_function;
+	BodyFraming _framing = BodyFraming::None;
+	uintmax_t _remaining = 0;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef _BUFFER_POOL_H_
+#define _BUFFER_POOL_H_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// blocks are kept in power of two sizes between these, larger requests go to the heap
+constexpr size_t BUFFER_POOL_MIN_BLOCK = 4 * 1024;
+constexpr size_t BUFFER_POOL_MAX_BLOCK = 1024 * 1024;
+// free blocks of each size a thread keeps for itself, and the shared list behind them
+constexpr size_t BUFFER_POOL_THREAD_CACHE = 8;
+constexpr size_t BUFFER_POOL_SHARED_CACHE = 64;
+
+// Slab pool for receive buffers. Blocks come in fixed power of two sizes, each
+// with a free list per thread and a shared one behind it, so a connection that
+// reads, parses and lets go of its buffer on one thread recycles the same block
+// without taking a lock or calling the allocator.
+class BufferPool
+{
+public:
+	static void* Allocate(size_t size);
+	// size is the one the block was allocated with
+	static void Release(void* block, size_t size);
+	// size of the block a request is served from, the full block can be used
+	static size_t BlockSize(size_t size);
+};
+
+// Hands out pool blocks to a container. Elements are default initialized, so
+// growing a buffer to read into does not zero it first.
+template <typename T>
+struct PoolAllocator
+{
+	using value_type = T;
+
+	PoolAllocator() = default;
+	template <typename U>
+	PoolAllocator(const PoolAllocator<U>&)
+	{
+	}
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(BufferPool::Allocate(count * sizeof(T)));
+	}
+	void deallocate(T* block, size_t count)
+	{
+		BufferPool::Release(block, count * sizeof(T));
+	}
+	template <typename U>
+	void construct(U* element)
+	{
+		::new (static_cast<void*>(element)) U;
+	}
+	template <typename U, typename... Args>
+	void construct(U* element, Args&&... args)
+	{
+		::new (static_cast<void*>(element)) U(std::forward<Args>(args)...);
+	}
+	template <typename U>
+	bool operator==(const PoolAllocator<U>&) const
+	{
+		return true;
+	}
+};
+
+// bytes read off a socket and not parsed yet
+using ReceiveBuffer = std::vector<unsigned char, PoolAllocator<unsigned char>>;
+
+// a pool block held for the length of one read
+class PooledSlab
+{
+public:
+	explicit PooledSlab(size_t size)
+	  : _size(size)
+	  , _data(static_cast<unsigned char*>(BufferPool::Allocate(size))){};
+	~PooledSlab()
+	{
+		BufferPool::Release(_data, _size);
+	};
+	PooledSlab(const PooledSlab&) = delete;
+	PooledSlab& operator=(const PooledSlab&) = delete;
+	unsigned char* data() const
+	{
+		return _data;
+	};
+	size_t size() const
+	{
+		return _size;
+	};
+
+private:
+	size_t _size;
+	unsigned char* _data;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _CLIENT_LIMITER_H_
+#define _CLIENT_LIMITER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+constexpr size_t CLIENT_LIMITER_WAYS = 4;
+constexpr size_t CLIENT_LIMITER_SKETCH_DEPTH = 4;
+constexpr size_t CLIENT_LIMITER_DEFAULT_TABLE_SIZE = 1 << 16;
+constexpr size_t CLIENT_LIMITER_DEFAULT_SKETCH_WIDTH = 1 << 14;
+constexpr std::chrono::seconds CLIENT_LIMITER_DEFAULT_IDLE_TIMEOUT(60);
+
+struct ClientLimits
+{
+	// 0 disables the limit
+	uint32_t max_connections = 0;
+	double requests_per_second = 0;
+	uint32_t burst = 1;
+	// clients tracked exactly, everyone else shares the count-min sketches
+	size_t table_size = CLIENT_LIMITER_DEFAULT_TABLE_SIZE;
+	size_t sketch_width = CLIENT_LIMITER_DEFAULT_SKETCH_WIDTH;
+	std::chrono::seconds idle_timeout = CLIENT_LIMITER_DEFAULT_IDLE_TIMEOUT;
+};
+
+struct ClientEntry
+{
+	// address + 1 so that 0 marks a free slot
+	std::atomic<uint64_t> key = 0;
+	std::atomic<uint32_t> connections = 0;
+	// GCRA theoretical arrival time, equivalent to a token bucket in one word
+	std::atomic<int64_t> arrival_time = 0;
+	std::atomic<int64_t> last_seen = 0;
+};
+
+class ClientLimiter;
+
+// Held for as long as an accepted connection is open, gives its slot back when destroyed.
+class ClientLease
+{
+public:
+	ClientLease() = default;
+	ClientLease(ClientLimiter* limiter, uint32_t address, ClientEntry* entry)
+	  : _limiter(limiter)
+	  , _address(address)
+	  , _entry(entry){};
+	~ClientLease()
+	{
+		Release();
+	};
+	ClientLease(ClientLease&& other);
+	ClientLease& operator=(ClientLease&& other);
+	ClientLease(const ClientLease&) = delete;
+	ClientLease& operator=(const ClientLease&) = delete;
+	void Release();
+
+private:
+	ClientLimiter* _limiter = nullptr;
+	uint32_t _address = 0;
+	ClientEntry* _entry = nullptr;
+};
+
+// Per client address connection limits and request rate limits in bounded memory.
+// Recently seen addresses live in a set associative table, each set guarded by its own
+// lock that is only taken to add or evict an address; counting connections and
+// requests for an address already in the table is lock free. Addresses that find
+// their set full fall back to count-min sketches, which can only over estimate, so
+// the long tail is limited conservatively rather than not at all.
+class ClientLimiter
+{
+public:
+	ClientLimiter() = default;
+	ClientLimiter(const ClientLimiter&) = delete;
+	ClientLimiter& operator=(const ClientLimiter&) = delete;
+	void Init(const ClientLimits& limits);
+	bool IsEnabled() const
+	{
+		return _enabled;
+	};
+	// at accept time, nullopt when the address already holds max_connections
+	std::optional<ClientLease> AcquireConnection(uint32_t address);
+	// per request, false when the address is over its rate
+	bool AllowRequest(uint32_t address);
+	// frees table slots of addresses idle longer than the timeout and ages the request sketch
+	void EvictIdle();
+
+private:
+	friend class ClientLease;
+	struct ClientSet
+	{
+		std::mutex mutex;
+		std::array<ClientEntry, CLIENT_LIMITER_WAYS> entries;
+	};
+	void ReleaseConnection(uint32_t address, ClientEntry* entry);
+	ClientSet& SetFor(uint32_t address);
+	ClientEntry* Find(ClientSet& client_set, uint64_t key);
+	ClientEntry* FindOrInsert(uint32_t address);
+	size_t SketchIndex(size_t row, uint32_t address) const;
+	uint32_t SketchEstimate(const std::unique_ptr<std::atomic<uint32_t>[]>& sketch, uint32_t address) const;
+	void SketchAdd(std::unique_ptr<std::atomic<uint32_t>[]>& sketch, uint32_t address, int32_t delta);
+	static int64_t Now();
+
+private:
+	bool _enabled = false;
+	ClientLimits _limits;
+	int64_t _emission_interval = 0;
+	int64_t _burst_tolerance = 0;
+	std::unique_ptr<ClientSet[]> _sets;
+	size_t _set_count = 0;
+	std::unique_ptr<std::atomic<uint32_t>[]> _connection_sketch;
+	// requests in the current and previous one second window, for a sliding window estimate
+	std::unique_ptr<std::atomic<uint32_t>[]> _request_sketches[2];
+	std::atomic<size_t> _current_window = 0;
+	std::atomic<int64_t> _window_start = 0;
+};
+
+#endif
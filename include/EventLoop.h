@@ -0,0 +1,153 @@
+#ifndef _EVENT_LOOP_H_
+#define _EVENT_LOOP_H_
+
+#include "MessageQueue.h"
+#include "Task.h"
+
+#include <sys/epoll.h>
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+constexpr size_t EVENT_LOOP_DEFAULT_BLOCKING_THREADS = 4;
+
+// Single thread driving coroutine handlers. Coroutines suspend on timers and
+// file descriptor readiness through epoll and are resumed on the loop thread.
+// Work the kernel cannot report readiness for, like regular file I/O, runs on
+// a small pool of blocking threads and resumes the coroutine on the loop when
+// it is done.
+class EventLoop
+{
+public:
+	struct SleepAwaiter
+	{
+		bool await_ready() const noexcept
+		{
+			return false;
+		};
+		void await_suspend(std::coroutine_handle<> handle);
+		void await_resume() const noexcept {};
+
+		EventLoop& loop;
+		std::chrono::steady_clock::time_point deadline;
+	};
+	struct FdAwaiter
+	{
+		bool await_ready() const noexcept
+		{
+			return false;
+		};
+		void await_suspend(std::coroutine_handle<> handle);
+		// false when the timeout ran out first
+		bool await_resume() const noexcept
+		{
+			return ready;
+		};
+
+		EventLoop& loop;
+		int fd;
+		uint32_t events;
+		std::chrono::milliseconds timeout;
+		bool ready = false;
+	};
+	template <typename T>
+	struct BlockingAwaiter
+	{
+		bool await_ready() const noexcept
+		{
+			return false;
+		};
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			loop._blocking_queue.Send(
+				[this, handle]()
+				{
+					result.emplace(function());
+					loop.Post(
+						[handle]()
+						{
+							handle.resume();
+						});
+				});
+		};
+		T await_resume()
+		{
+			return std::move(result.value());
+		};
+
+		EventLoop& loop;
+		std::function<T()> function;
+		std::optional<T> result;
+	};
+
+	EventLoop() = default;
+	EventLoop(const EventLoop&) = delete;
+	EventLoop& operator=(const EventLoop&) = delete;
+	~EventLoop();
+	void Start(size_t blocking_threads);
+	// runs the function on the loop thread
+	void Post(std::function<void()>&& function);
+	SleepAwaiter Sleep(std::chrono::milliseconds duration);
+	// waits until the descriptor has any of the epoll events, a zero timeout waits for ever
+	FdAwaiter WaitFor(int fd, uint32_t events, std::chrono::milliseconds timeout);
+	// resumes the coroutine waiting on the descriptor as if it were ready, or the next one to wait on it
+	void Notify(int fd);
+	// runs the function on a blocking thread, for work that would stall the loop. gcc 12 destroys
+	// a capturing lambda written inside a co_await expression twice, so name the function first
+	template <typename T>
+	BlockingAwaiter<T> RunBlocking(std::function<T()> function)
+	{
+		return BlockingAwaiter<T>{ *this, std::move(function) };
+	};
+	// whole file, nullopt when it cannot be read
+	Task<std::optional<std::vector<unsigned char>>> ReadFile(std::filesystem::path path);
+	Task<bool> WriteFile(std::filesystem::path path, std::vector<unsigned char> data_buffer);
+
+private:
+	using TimerKey = std::pair<std::chrono::steady_clock::time_point, uint64_t>;
+	struct FdWait
+	{
+		std::coroutine_handle<> handle;
+		bool* ready;
+		std::optional<TimerKey> timer_key;
+	};
+	void Run(std::stop_token stop_token);
+	void RunBlockingTasks(std::stop_token stop_token);
+	void Wake();
+	// the functions below only run on the loop thread
+	TimerKey AddTimer(std::chrono::steady_clock::time_point deadline, std::function<void()>&& function);
+	void AddFdWait(FdAwaiter& awaiter, std::coroutine_handle<> handle);
+	void CompleteFdWait(int fd, bool ready);
+	int NextTimeout();
+	void RunTimers();
+	void RunPosted();
+
+private:
+	int _epoll_fd = -1;
+	// written to by Post so a sleeping epoll_wait picks up new work
+	int _wake_fd = -1;
+	std::mutex _posted_mutex;
+	std::vector<std::function<void()>> _posted;
+	std::map<TimerKey, std::function<void()>> _timers;
+	uint64_t _next_timer_id = 0;
+	std::unordered_map<int, FdWait> _fd_waits;
+	// notified while nothing waited on them
+	std::unordered_set<int> _notified_fds;
+	MessageQueue<std::function<void()>> _blocking_queue;
+	std::vector<std::jthread> _blocking_threads;
+	std::jthread _loop_thread;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _EVENT_STREAM_H_
+#define _EVENT_STREAM_H_
+
+#include "EventLoop.h"
+#include "HttpMessage.h"
+#include "Task.h"
+#include "jSocket.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// events waiting to be written to one subscriber before it counts as slow
+constexpr size_t EVENT_STREAM_DEFAULT_MAX_QUEUED = 64;
+constexpr std::chrono::seconds EVENT_STREAM_DEFAULT_HEARTBEAT(15);
+
+// an event in its wire form, encoded once and shared by the queue of every subscriber it goes to
+using EncodedEvent = std::shared_ptr<const std::vector<unsigned char>>;
+
+enum class SlowSubscriberPolicy
+{
+	// a subscriber with a full queue is disconnected, it can reconnect and catch up
+	Drop,
+	// the oldest event still waiting in a full queue gives way to the new one
+	Coalesce
+};
+
+struct EventStreamSettings
+{
+	size_t max_queued = EVENT_STREAM_DEFAULT_MAX_QUEUED;
+	SlowSubscriberPolicy slow_subscribers = SlowSubscriberPolicy::Drop;
+	// a quiet stream gets a comment line this often, so a peer that went away is noticed
+	std::chrono::milliseconds heartbeat_interval = EVENT_STREAM_DEFAULT_HEARTBEAT;
+};
+
+// text/event-stream framing of an event, every line of the data gets its own data field
+EncodedEvent EncodeServerSentEvent(const std::string& data, const std::string& event = "", const std::string& id = "");
+
+// Connection taken over by a text/event-stream response. Like a WebSocket
+// session it has no thread of its own: a coroutine on the event loop writes
+// out the queued events without waiting on the socket, TLS included, and
+// watches for the peer going away. Queueing an
+// event is a pointer push, the payload is shared with every other subscriber.
+class EventStreamSession : public UpgradedSession, public std::enable_shared_from_this<EventStreamSession>
+{
+public:
+	EventStreamSession(EventLoop& event_loop, std::unique_ptr<jSocket> socket, const EventStreamSettings& settings);
+	EventStreamSession(const EventStreamSession&) = delete;
+	EventStreamSession& operator=(const EventStreamSession&) = delete;
+	void Start();
+	// false once the session is closed, or dropped for falling behind
+	bool Enqueue(const EncodedEvent& event);
+	// ends the stream once what is queued has been written
+	void Close() override;
+	bool IsOpen() const override
+	{
+		return _is_open;
+	};
+
+private:
+	Task<bool> Run(std::shared_ptr<EventStreamSession> self);
+	// writes queued events without waiting, false when the peer is gone or the session was dropped
+	bool Flush();
+	// false when the peer closed its end
+	bool ReadAvailable();
+
+private:
+	EventLoop& _event_loop;
+	std::unique_ptr<jSocket> _socket;
+	EventStreamSettings _settings;
+	std::mutex _queue_mutex;
+	std::deque<EncodedEvent> _queue;
+	// bytes of the front event already written
+	size_t _front_written = 0;
+	// a write of the front event was begun, it has to be finished before anything else is sent
+	bool _front_started = false;
+	bool _closing = false;
+	bool _dropped = false;
+	std::atomic<bool> _is_open = true;
+};
+
+// Topics and the event streams subscribed to them. Publishing encodes the
+// event once and hands every live subscriber a reference to it.
+class EventBroker
+{
+public:
+	void Subscribe(const std::string& topic, const std::shared_ptr<EventStreamSession>& session);
+	// number of subscribers the event was queued for
+	size_t Publish(const std::string& topic, const std::string& data, const std::string& event = "", const std::string& id = "");
+	size_t SubscriberCount();
+
+private:
+	std::mutex _mutex;
+	// sessions are owned by their connections, a closed one is pruned on the next publish
+	std::unordered_map<std::string, std::vector<std::weak_ptr<EventStreamSession>>> _topics;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _FILE_CACHE_H_
+#define _FILE_CACHE_H_
+
+#include "StaticFile.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+constexpr size_t FILE_CACHE_DEFAULT_MAX_ENTRIES = 1024;
+constexpr size_t FILE_CACHE_DEFAULT_SHARDS = 16;
+constexpr std::chrono::milliseconds FILE_CACHE_DEFAULT_TTL(1000);
+// the cache holds at most this share of the open file limit, the rest is left for connections
+constexpr size_t FILE_CACHE_FD_SHARE_DIVISOR = 4;
+
+struct FileCacheStats
+{
+	uint64_t hits;
+	uint64_t misses;
+	size_t entries;
+};
+
+// Files served from disk, kept open along with their stat results so a hit
+// costs no syscalls. Entries are spread over shards by path, each with its own
+// lock and least recently used list. An entry is trusted for the ttl and then
+// opened again, and can be dropped sooner when the server changes the file.
+// Responses share the descriptor, so evicting an entry never closes a file
+// that is still being sent. Every entry holds a descriptor, so expired entries
+// are swept out periodically and the size is capped by the open file limit.
+class FileCache
+{
+public:
+	FileCache() = default;
+	FileCache(const FileCache&) = delete;
+	FileCache& operator=(const FileCache&) = delete;
+	// without Init, or with no entries, every Open goes to the disk. max_entries above a quarter of
+	// RLIMIT_NOFILE is clamped to it
+	void Init(size_t max_entries, size_t shard_count, std::chrono::milliseconds ttl);
+	// the file as StaticFile::Open gives it, from the cache while the entry is fresh
+	std::optional<StaticFile> Open(const std::string& path);
+	// the next Open of the path sees the file as it is now
+	void Invalidate(const std::string& path);
+	// drops the entries past their ttl, closing the descriptors no response still holds
+	void EvictExpired();
+	FileCacheStats Stats() const;
+
+private:
+	struct CacheEntry
+	{
+		StaticFile file;
+		std::chrono::steady_clock::time_point expires;
+		std::list<std::string>::iterator lru_position;
+	};
+	struct CacheShard
+	{
+		std::mutex mutex;
+		std::unordered_map<std::string, CacheEntry> entries;
+		// most recently used at the front
+		std::list<std::string> lru;
+	};
+	// paths naming the same file share an entry
+	static std::string Key(const std::string& path);
+	CacheShard& ShardFor(const std::string& key);
+
+private:
+	std::unique_ptr<CacheShard[]> _shards;
+	size_t _shard_count = 0;
+	size_t _shard_max_entries = 0;
+	std::chrono::milliseconds _ttl = FILE_CACHE_DEFAULT_TTL;
+	std::atomic<uint64_t> _hits = 0;
+	std::atomic<uint64_t> _misses = 0;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _FILE_HANDLE_H_
+#define _FILE_HANDLE_H_
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+// Owns an open file descriptor. Responses hold it through a shared_ptr so the
+// descriptor stays open until the last send using it has finished.
+class FileHandle
+{
+public:
+	explicit FileHandle(int file_fd)
+	  : _file_fd(file_fd){};
+	~FileHandle()
+	{
+		if (_file_fd >= 0)
+		{
+			close(_file_fd);
+		}
+	};
+	FileHandle(const FileHandle&) = delete;
+	FileHandle& operator=(const FileHandle&) = delete;
+	static std::shared_ptr<FileHandle> Open(const std::string& path)
+	{
+		int file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file_fd < 0)
+		{
+			return nullptr;
+		}
+		return std::make_shared<FileHandle>(file_fd);
+	};
+	int Get() const
+	{
+		return _file_fd;
+	};
+
+private:
+	int _file_fd;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _FILE_SYNCER_H_
+#define _FILE_SYNCER_H_
+
+#include "MessageQueue.h"
+
+#include <filesystem>
+#include <stop_token>
+#include <thread>
+
+// Flushes written files to disk off the request path. Uploads are published with
+// a rename as soon as their bytes are in the page cache and the open file is
+// handed over here. The syncer thread takes everything that queued up while it
+// was busy as one batch, fsyncs each file and then each directory of the batch
+// once, so a burst of uploads shares the directory flushes and the journal
+// commits instead of every request waiting on its own.
+class FileSyncer
+{
+public:
+	FileSyncer();
+	// flushes whatever is still queued
+	~FileSyncer();
+	// takes ownership of fd, which is closed once it has been synced along with the directory it was written to
+	void Sync(int fd, const std::filesystem::path& directory);
+
+private:
+	struct PendingSync
+	{
+		int fd;
+		std::filesystem::path directory;
+	};
+	void Worker(std::stop_token stop_token);
+	void SyncBatch(PendingSync&& first);
+
+private:
+	MessageQueue<PendingSync> _pending;
+	std::jthread _sync_thread;
+};
+
+#endif
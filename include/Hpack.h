@@ -0,0 +1,84 @@
+#ifndef _HPACK_H_
+#define _HPACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// HPACK: Header Compression for HTTP/2 (RFC 7541)
+
+constexpr size_t HPACK_DEFAULT_TABLE_SIZE = 4096;
+constexpr size_t HPACK_ENTRY_OVERHEAD = 32;
+
+using HeaderField = std::pair<std::string, std::string>;
+using HeaderList = std::vector<HeaderField>;
+
+class HpackTable
+{
+public:
+	HpackTable(size_t max_size = HPACK_DEFAULT_TABLE_SIZE)
+	  : _max_size(max_size){};
+	void Add(const std::string& name, const std::string& value);
+	void SetMaxSize(size_t max_size);
+	size_t GetMaxSize() const
+	{
+		return _max_size;
+	};
+	// index in the combined static + dynamic address space, starting at 1
+	std::optional<HeaderField> Get(size_t index) const;
+	// returns the index of an exact match, or of a name-only match with the
+	// second element set to false
+	std::optional<std::pair<size_t, bool>> Find(const std::string& name, const std::string& value) const;
+
+private:
+	void Evict();
+
+private:
+	std::deque<HeaderField> _entries;
+	size_t _size = 0;
+	size_t _max_size;
+};
+
+class HpackDecoder
+{
+public:
+	std::optional<HeaderList> Decode(const unsigned char* data, size_t length);
+	// upper bound from our SETTINGS_HEADER_TABLE_SIZE, the encoder may lower it
+	void SetMaxTableSize(size_t max_size)
+	{
+		_max_table_size = max_size;
+	};
+
+private:
+	HpackTable _table;
+	size_t _max_table_size = HPACK_DEFAULT_TABLE_SIZE;
+};
+
+class HpackEncoder
+{
+public:
+	void Encode(const HeaderList& headers, std::vector<unsigned char>& output);
+	// peer's SETTINGS_HEADER_TABLE_SIZE, signalled at the start of the next block
+	void SetMaxTableSize(size_t max_size);
+
+private:
+	HpackTable _table;
+	std::optional<size_t> _pending_table_size;
+};
+
+namespace Hpack
+{
+	void EncodeInteger(uint64_t value, uint8_t prefix_bits, uint8_t first_byte, std::vector<unsigned char>& output);
+	std::optional<uint64_t> DecodeInteger(const unsigned char*& position, const unsigned char* end, uint8_t prefix_bits);
+	void EncodeString(const std::string& value, std::vector<unsigned char>& output);
+	std::optional<std::string> DecodeString(const unsigned char*& position, const unsigned char* end);
+	void HuffmanEncode(const std::string& value, std::vector<unsigned char>& output);
+	std::optional<std::string> HuffmanDecode(const unsigned char* data, size_t length);
+	size_t HuffmanEncodedLength(const std::string& value);
+}  // namespace Hpack
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef _HTTP2_SESSION_H_
+#define _HTTP2_SESSION_H_
+
+#include "Hpack.h"
+#include "HttpMessage.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// HTTP/2 over cleartext TCP (RFC 7540), entered either with prior knowledge
+// or by upgrading an HTTP/1.1 request carrying "Upgrade: h2c".
+// The session only consumes and produces bytes; the owning connection feeds
+// it whatever it reads and supplies the function used to write frames.
+
+constexpr uint32_t HTTP2_DEFAULT_WINDOW_SIZE = 65535;
+constexpr uint32_t HTTP2_DEFAULT_MAX_FRAME_SIZE = 16384;
+constexpr uint32_t HTTP2_MAX_CONCURRENT_STREAMS = 100;
+constexpr uint32_t HTTP2_LOCAL_WINDOW_SIZE = 1 << 20;
+constexpr size_t HTTP2_FRAME_HEADER_SIZE = 9;
+// handler threads per connection, further streams wait for one to be free
+constexpr size_t HTTP2_MAX_STREAM_WORKERS = 4;
+constexpr size_t HTTP2_DEFAULT_MAX_REQUEST_BODY = 64 * 1024 * 1024;
+
+enum class Http2FrameType : uint8_t
+{
+	Data = 0x0,
+	Headers = 0x1,
+	Priority = 0x2,
+	RstStream = 0x3,
+	Settings = 0x4,
+	PushPromise = 0x5,
+	Ping = 0x6,
+	GoAway = 0x7,
+	WindowUpdate = 0x8,
+	Continuation = 0x9
+};
+
+enum class Http2Error : uint32_t
+{
+	NoError = 0x0,
+	ProtocolError = 0x1,
+	InternalError = 0x2,
+	FlowControlError = 0x3,
+	StreamClosed = 0x5,
+	FrameSizeError = 0x6,
+	RefusedStream = 0x7,
+	Cancel = 0x8,
+	CompressionError = 0x9
+};
+
+struct Http2Stream
+{
+	uint32_t id;
+	// read from the header block, the body is added once it is complete
+	HttpRequest request;
+	std::vector<unsigned char> request_body;
+	bool request_complete = false;
+	// answered before the request finished, whatever else arrives is dropped
+	bool request_refused = false;
+	int64_t send_window;
+	int64_t receive_window;
+	std::vector<unsigned char> response_body;
+	size_t response_offset = 0;
+	bool response_started = false;
+};
+
+class Http2Session
+{
+public:
+	using SendFunction = std::function<void(const std::vector<unsigned char>&)>;
+	using RequestHandler = std::function<HttpResponse(HttpRequest&&)>;
+
+	Http2Session(const SendFunction& send_function, const RequestHandler& request_handler);
+	~Http2Session();
+	Http2Session(const Http2Session&) = delete;
+	Http2Session& operator=(const Http2Session&) = delete;
+
+	static bool IsPreface(const std::vector<unsigned char>& data_buffer);
+	static bool IsUpgradeRequest(const HttpRequest& request);
+	static std::vector<unsigned char> UpgradeResponse();
+
+	// sends the server connection preface
+	void Start();
+	// continues an HTTP/1.1 request that asked for h2c as stream 1
+	void StartFromUpgrade(HttpRequest&& request);
+	// returns false once the connection should be closed
+	bool Receive(const std::vector<unsigned char>& data_buffer);
+	void SubmitResponse(uint32_t stream_id, HttpResponse&& response);
+	// largest request body buffered for a stream before it is answered with 413 and reset
+	void SetMaxRequestBody(size_t max_request_body)
+	{
+		_max_request_body = max_request_body;
+	};
+	// the check an HTTP/1.1 request passes before its body is read, run on a stream's headers and again as its DATA arrives
+	void SetBodyCheck(const BodyCheck& body_check)
+	{
+		_body_check = body_check;
+	};
+	// stops all further writes, in-flight handlers are waited for
+	void Shutdown();
+
+private:
+	bool ProcessFrame(Http2FrameType type, uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length);
+	bool OnHeaders(uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length);
+	bool OnContinuation(uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length);
+	bool OnHeaderBlock(uint32_t stream_id, bool end_stream);
+	bool OnData(uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length);
+	bool OnSettings(uint8_t flags, const unsigned char* payload, size_t length);
+	bool OnWindowUpdate(uint32_t stream_id, const unsigned char* payload, size_t length);
+	bool ApplySettings(const unsigned char* payload, size_t length);
+	void Dispatch(Http2Stream& stream);
+	void Dispatch(uint32_t stream_id, HttpRequest&& request);
+	void RunStreams();
+	void WriteResponse(uint32_t stream_id, HttpResponse&& response);
+	bool RejectBody(Http2Stream& stream, std::optional<uintmax_t> body_length);
+	void RefuseStream(Http2Stream& stream, HttpResponse&& response);
+	void Flush();
+	void SendFrame(Http2FrameType type, uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length);
+	void SendSettings();
+	void SendWindowUpdate(uint32_t stream_id, uint32_t increment);
+	void SendRstStream(uint32_t stream_id, Http2Error error);
+	bool SendGoAway(Http2Error error);
+
+private:
+	SendFunction _send_function;
+	RequestHandler _request_handler;
+	std::mutex _mutex;
+	std::vector<unsigned char> _input_buffer;
+	bool _preface_received = false;
+	bool _is_closed = false;
+	HpackDecoder _decoder;
+	HpackEncoder _encoder;
+	std::map<uint32_t, Http2Stream> _streams;
+	std::list<uint32_t> _send_queue;
+	uint32_t _last_stream_id = 0;
+	// stream whose header block is still being continued, 0 when none
+	uint32_t _continuation_stream_id = 0;
+	bool _continuation_end_stream = false;
+	std::vector<unsigned char> _header_block;
+	int64_t _send_window = HTTP2_DEFAULT_WINDOW_SIZE;
+	int64_t _receive_window = HTTP2_DEFAULT_WINDOW_SIZE;
+	uint32_t _peer_initial_window_size = HTTP2_DEFAULT_WINDOW_SIZE;
+	uint32_t _peer_max_frame_size = HTTP2_DEFAULT_MAX_FRAME_SIZE;
+	size_t _max_request_body = HTTP2_DEFAULT_MAX_REQUEST_BODY;
+	BodyCheck _body_check = nullptr;
+	// complete requests waiting for a worker
+	std::deque<std::pair<uint32_t, HttpRequest>> _pending_requests;
+	size_t _running_workers = 0;
+	std::vector<std::future<void>> _stream_tasks;
+};
+
+#endif
@@ -1,16 +1,48 @@
 #ifndef __HTTP_CONNECTION_H__
 #define __HTTP_CONNECTION_H__
 
+#include "BodyDecoder.h"
+#include "ClientLimiter.h"
+#include "Http2Session.h"
 #include "HttpMessage.h"
+#include "RequestTracer.h"
+#include "Task.h"
 #include "jSocket.h"
 
 #include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <stop_token>
 #include <thread>
+#include <variant>
 #include <vector>
 
+// largest request line and header section accepted before the request is rejected
+constexpr size_t HTTP_MAX_HEADER_SIZE = 64 * 1024;
+constexpr std::chrono::milliseconds REQUEST_DEFAULT_HEADER_TIMEOUT(10000);
+constexpr uint64_t REQUEST_DEFAULT_MIN_BODY_RATE = 240;
+constexpr std::chrono::milliseconds REQUEST_DEFAULT_BODY_GRACE(5000);
+
+// How long a client may take to send a request, counted from its first byte.
+// A request over any of them is answered with 408 and the connection closed.
+// Zero turns a limit off.
+struct RequestDeadlines
+{
+	// for the request line and headers
+	std::chrono::milliseconds header_timeout = REQUEST_DEFAULT_HEADER_TIMEOUT;
+	// bytes per second the body has to arrive at on average, once the grace period is over
+	uint64_t min_body_rate = REQUEST_DEFAULT_MIN_BODY_RATE;
+	std::chrono::milliseconds body_grace = REQUEST_DEFAULT_BODY_GRACE;
+	// for the whole request, headers and body
+	std::chrono::milliseconds request_timeout = std::chrono::milliseconds::zero();
+};
+
+// what the data handler made of a request: nothing to send, a response, or a coroutine still producing one
+using DataHandlerResult = std::variant<std::monostate, HttpResponse, Task<HttpResponse>>;
+
 class HttpConnection
 {
 public:
@@ -18,28 +50,137 @@ public:
 	~HttpConnection();
 	HttpConnection(HttpConnection&& other);
 	HttpConnection(HttpConnection& other) = delete;
+	// starts reading, call once the handlers are set
+	void Start();
 	void Close();
-	void SetDataHandler(const std::function<std::optional<HttpResponse>(const std::vector<unsigned char>&)>& data_handler);
+	// handler for each HTTP/1.1 request framed off the connection, invalid requests included
+	void SetDataHandler(const std::function<DataHandlerResult(HttpRequest&&)>& data_handler);
+	// handler for requests arriving on HTTP/2 streams once the connection switches to h2c
+	void SetRequestHandler(const std::function<HttpResponse(HttpRequest&&)>& request_handler);
+	void SetClientLease(ClientLease&& client_lease);
+	void SetDeadlines(const RequestDeadlines& deadlines)
+	{
+		_deadlines = deadlines;
+	};
+	// run before a request body is read. a request passing it that expects 100-continue is told to send the body
+	void SetBodyCheck(const BodyCheck& body_check)
+	{
+		_body_check = body_check;
+	};
+	// response for a client that missed a deadline, sent before the connection is closed
+	void SetTimeoutHandler(const std::function<HttpResponse()>& timeout_handler)
+	{
+		_timeout_handler = timeout_handler;
+	};
+	// the route pattern a request is counted under by allocation accounting, its path when unset
+	void SetRouteNamer(const std::function<std::string(const HttpRequest&)>& route_namer)
+	{
+		_route_namer = route_namer;
+	};
+	// largest body buffered for an HTTP/2 stream once the connection switches to h2
+	void SetHttp2MaxRequestBody(size_t max_request_body)
+	{
+		_http2_max_request_body = max_request_body;
+	};
 	void HandleData(const std::vector<unsigned char>& data_buffer);
+	// sampling decision made at accept for the first request, the ones after it are sampled here
+	void SetTraceId(uint64_t trace_id)
+	{
+		_trace_id = trace_id;
+	};
+	// an upgraded connection stays until the protocol it switched to is done with the socket
 	inline bool CanClose() const
 	{
-		return _can_close;
+		return _can_close && !HasOpenSession();
 	};
 	std::chrono::steady_clock::time_point LastUsedTime();
+	// a request is being handled or its response sent, so quiet time is not idle time
+	inline bool IsBusy() const
+	{
+		return _is_busy || HasOpenSession();
+	};
+	// asks the protocol the connection switched to, if any, to wind down
+	void CloseSession()
+	{
+		if (auto upgraded_session = _upgraded_session.load())
+		{
+			upgraded_session->Close();
+		}
+	};
 
 private:
-	void Start();
+	struct PendingResponse
+	{
+		std::mutex mutex;
+		std::condition_variable_any ready_cond_var;
+		bool done = false;
+		// empty when the coroutine failed without one
+		std::optional<HttpResponse> response;
+	};
 	std::optional<std::vector<unsigned char> > Receive();
 	void Send(const std::vector<unsigned char>& data_buffer);
+	void SendResponse(HttpResponse& response);
 	void Worker(std::stop_token stop_token);
+	bool TryStartHttp2(const unsigned char* data, size_t length);
+	void ProcessInput();
+	void Dispatch(HttpRequest&& request);
+	void Respond(std::optional<HttpResponse>& response);
+	// false while a coroutine handler's response is still outstanding
+	bool FinishPendingResponse();
+	long FillInput(ReceiveBuffer& input_buffer);
+	// reads into the input buffer and handles whatever can be parsed
+	void ReceiveInput();
+	// when the read in progress has to have arrived by, nullopt while waiting for the next request.
+	// body_ahead counts body bytes the caller is about to read in one go as already there
+	std::optional<std::chrono::steady_clock::time_point> ReadDeadline(uintmax_t body_ahead = 0) const;
+	// the read gave up, true when that was because the deadline passed
+	bool MissedDeadline();
+	// hands the socket and the unparsed input to the response's upgrade handler
+	void Upgrade(const UpgradeHandler& upgrade_handler);
+	bool HasOpenSession() const
+	{
+		auto upgraded_session = _upgraded_session.load();
+		return upgraded_session && upgraded_session->IsOpen();
+	};
 
 private:
+	// released once the connection is gone, after the socket is closed
+	ClientLease _client_lease;
 	std::unique_ptr<jSocket> _socket;
 	std::chrono::steady_clock::time_point _last_used_time;
 	std::mutex _last_used_mutex;
+	std::unique_ptr<Http2Session> _http2_session;
 	std::jthread _connection_thread;
-	std::function<std::optional<HttpResponse>(const std::vector<unsigned char>)> _data_handler = nullptr;
+	std::atomic<std::thread::id> _worker_thread_id;
+	std::stop_token _worker_stop_token;
+	std::function<DataHandlerResult(HttpRequest&&)> _data_handler = nullptr;
+	std::function<HttpResponse(HttpRequest&&)> _request_handler = nullptr;
 	std::atomic<bool> _can_close = false;
+	std::atomic<bool> _is_busy = false;
+	// bytes read but not yet consumed, may hold the start of the next request
+	// held only while there is unparsed input, an idle connection gives it back to the pool
+	ReceiveBuffer _input_buffer;
+	// frames the body of the request currently being handled
+	BodyDecoder _body_decoder;
+	// set while a coroutine handler works on the current request, requests behind it wait their turn
+	std::shared_ptr<PendingResponse> _pending_response;
+	// trace id of the request being handled, unset until one is read, 0 when it is not traced
+	std::optional<uint64_t> _trace_id;
+	std::chrono::steady_clock::time_point _handler_start;
+	RequestDeadlines _deadlines;
+	std::function<HttpResponse()> _timeout_handler = nullptr;
+	BodyCheck _body_check = nullptr;
+	std::function<std::string(const HttpRequest&)> _route_namer = nullptr;
+	size_t _http2_max_request_body = HTTP2_DEFAULT_MAX_REQUEST_BODY;
+	// first byte of the request being read
+	std::chrono::steady_clock::time_point _request_start;
+	// set while the body of the current request is read, with how much of it has arrived
+	std::optional<std::chrono::steady_clock::time_point> _body_start;
+	uintmax_t _body_received = 0;
+	// the request was not read in time, it is answered with the timeout handler's response
+	std::atomic<bool> _timed_out = false;
+	// set once the connection was taken over, the socket then belongs to it
+	std::atomic<std::shared_ptr<UpgradedSession>> _upgraded_session;
 };
 
 #endif
\ No newline at end of file
@@ -1,9 +1,11 @@
 #ifndef __HTTP_MSSAGE_H__
 #define __HTTP_MSSAGE_H__
 
+#include "FileHandle.h"
 #include "jjson.hpp"
 
-#include <future>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -15,19 +17,70 @@
 
 static std::vector<std::string> Methods({ "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE" });
 
-static std::unordered_map<int, std::string> ResponseCodes = { { 200, "OK" },
+static std::unordered_map<int, std::string> ResponseCodes = { { 101, "Switching Protocols" },
+															  { 200, "OK" },
+															  { 201, "Created" },
+															  { 204, "No Content" },
+															  { 206, "Partial Content" },
+															  { 301, "Moved Permanently" },
+															  { 304, "Not Modified" },
 															  { 400, "Bad Request" },
 															  { 401, "Unauthorized" },
 															  { 403, "Forbidden" },
 															  { 404, "Not Found" },
 															  { 405, "Method Not Allowed" },
+															  { 408, "Request Timeout" },
+															  { 410, "Gone" },
+															  { 413, "Payload Too Large" },
+															  { 412, "Precondition Failed" },
 															  { 415, "Unsupported Media Type" },
+															  { 416, "Range Not Satisfiable" },
+															  { 426, "Upgrade Required" },
+															  { 429, "Too Many Requests" },
 															  { 500, "Internal Server Error" },
 															  { 501, "Not Implemented" },
 															  { 502, "Bad Gateway" },
 															  { 503, "Service Unavailable" },
 															  { 504, "Gateway Timeout" },
-															  { 505, "HTTP Version Not Supported" } };
+															  { 505, "HTTP Version Not Supported" },
+															  { 507, "Insufficient Storage" } };
+// a body served straight from an open file, so it can be sent with sendfile
+struct FileBody
+{
+	std::shared_ptr<FileHandle> file;
+	uintmax_t offset;
+	uintmax_t length;
+};
+
+// a body in memory that outlives every response, such as an asset compiled into the binary, written
+// from where it lies without a copy
+struct StaticBody
+{
+	const unsigned char* data;
+	size_t length;
+};
+
+// supplies a body that is not held in memory piece by piece : an empty
+// buffer marks the end of the body, nullopt a failure part way through
+using BodyReader = std::function<std::optional<std::vector<unsigned char>>()>;
+// moves the rest of a body into the file descriptor at the offset without passing it through
+// userspace, returns the number of bytes moved, nullopt on failure
+using BodySplicer = std::function<std::optional<uintmax_t>(int, uintmax_t)>;
+
+class jSocket;
+
+// what a connection turned into after its response, a protocol switched to with a 101 or a stream of
+// events, served without the connection's thread
+class UpgradedSession
+{
+public:
+	virtual ~UpgradedSession(){};
+	virtual bool IsOpen() const = 0;
+	virtual void Close() = 0;
+};
+// takes the socket over once the response is out, along with whatever the client sent after its request
+using UpgradeHandler = std::function<std::shared_ptr<UpgradedSession>(std::unique_ptr<jSocket>, std::vector<unsigned char>&&)>;
+
 class HttpMessage
 {
 public:
@@ -35,12 +88,58 @@ public:
 	virtual ~HttpMessage(){};
 	std::string ToString() const;
 	std::vector<unsigned char> ToBuffer() const;
+	// start line and headers only, the body is written separately
+	std::vector<unsigned char> ToHeaderBuffer() const;
 	void SetHeader(std::string, std::string);
 	void SetBody(const jjson::value&);
 	void SetBody(const std::vector<unsigned char>&);
+	void SetBody(const FileBody&);
+	void SetBody(const StaticBody&);
+	// streamed body, sent with transfer-encoding chunked when the length is not known up front
+	void SetBody(const BodyReader&, std::optional<uintmax_t>);
+	// the rest of a body whose start is already in the message
+	void SetBodyReader(const BodyReader&);
+	bool HasBodyReader() const
+	{
+		return _body_reader != nullptr;
+	};
+	// next piece of the body, empty once it has all been read
+	std::optional<std::vector<unsigned char>> ReadBody();
+	// set next to the body reader when the rest of the body can be spliced from the socket
+	void SetBodySplicer(const BodySplicer&);
+	// writes the rest of the body to the file at offset, spliced when possible and read otherwise.
+	// returns the number of bytes written, nullopt on failure
+	std::optional<uintmax_t> SpliceBody(int fd, uintmax_t offset);
 	std::optional<std::string> GetHeader(std::string) const;
+	const std::unordered_map<std::string, std::string>& GetHeaders() const
+	{
+		return _headers;
+	};
+	// a streamed body is read into memory the first time it is asked for whole
 	std::vector<unsigned char> GetBody() const;
+	const std::vector<unsigned char>& GetBodyBuffer() const
+	{
+		return _body;
+	};
+	const std::optional<FileBody>& GetFileBody() const
+	{
+		return _file_body;
+	};
+	const std::optional<StaticBody>& GetStaticBody() const
+	{
+		return _static_body;
+	};
+	// the whole message serialized ahead of time and shared, written out as it is
+	void SetPrepared(const std::shared_ptr<const std::vector<unsigned char>>& message_buffer, size_t header_length);
+	const std::shared_ptr<const std::vector<unsigned char>>& GetPrepared() const
+	{
+		return _prepared;
+	};
 	void SetVersion(std::string);
+	std::string GetVersion() const
+	{
+		return _http_version;
+	};
 	virtual std::string GetStartLine() const
 	{
 		return "";
@@ -48,8 +147,18 @@ public:
 
 protected:
 	std::unordered_map<std::string, std::string> _headers;
-	std::vector<unsigned char> _body;
+	mutable std::vector<unsigned char> _body;
+	std::optional<FileBody> _file_body;
+	std::optional<StaticBody> _static_body;
+	mutable BodyReader _body_reader;
+	BodySplicer _body_splicer;
+	std::shared_ptr<const std::vector<unsigned char>> _prepared;
+	size_t _prepared_header_length = 0;
 	std::string _http_version = "HTTP/1.1";
+
+private:
+	// back to separate headers and body before the message is changed
+	void Unprepare();
 };
 class HttpRequest : public HttpMessage
 {
@@ -63,6 +172,12 @@ public:
 		this->_method = B._method;
 		this->_headers = B._headers;
 		this->_body = B._body;
+		this->_file_body = B._file_body;
+		this->_static_body = B._static_body;
+		this->_body_reader = B._body_reader;
+		this->_body_splicer = B._body_splicer;
+		this->_prepared = B._prepared;
+		this->_prepared_header_length = B._prepared_header_length;
 		this->_http_version = B._http_version;
 		this->_request_target = B._request_target;
 		this->isValid = B.isValid;
@@ -74,6 +189,12 @@ public:
 		this->isValid = B.isValid;
 		this->_headers = B._headers;
 		this->_body = B._body;
+		this->_file_body = B._file_body;
+		this->_static_body = B._static_body;
+		this->_body_reader = B._body_reader;
+		this->_body_splicer = B._body_splicer;
+		this->_prepared = B._prepared;
+		this->_prepared_header_length = B._prepared_header_length;
 		this->_http_version = B._http_version;
 	};
 	HttpRequest& operator=(const HttpRequest& B) = delete;
@@ -84,6 +205,12 @@ public:
 		this->isValid = B.isValid;
 		this->_headers = B._headers;
 		this->_body = B._body;
+		this->_file_body = B._file_body;
+		this->_static_body = B._static_body;
+		this->_body_reader = B._body_reader;
+		this->_body_splicer = B._body_splicer;
+		this->_prepared = B._prepared;
+		this->_prepared_header_length = B._prepared_header_length;
 		this->_http_version = B._http_version;
 		return *this;
 	};
@@ -99,7 +226,11 @@ public:
 	{
 		return _request_target;
 	};
-	bool isValid;
+	// target without the query string
+	std::string GetPath() const;
+	// percent decoded value of the query parameter, nullopt when it is absent
+	std::optional<std::string> GetQueryParameter(const std::string& name) const;
+	bool isValid = false;
 
 private:
 	std::string _method;
@@ -118,10 +249,14 @@ public:
 		this->_http_version = B._http_version;
 		this->_headers = B._headers;
 		this->_body = B._body;
+		this->_file_body = B._file_body;
+		this->_static_body = B._static_body;
+		this->_body_reader = B._body_reader;
+		this->_prepared = B._prepared;
+		this->_prepared_header_length = B._prepared_header_length;
 		this->_http_version = B._http_version;
+		this->_upgrade_handler = B._upgrade_handler;
 	};
-	HttpResponse(std::promise<std::vector<unsigned char> >&& promise)
-	  : _http_version("HTTP/1.1"){};
 	HttpResponse(std::string);
 	HttpResponse& operator=(HttpResponse&& B)
 	{
@@ -130,12 +265,27 @@ public:
 		this->_http_version = B._http_version;
 		this->_headers = B._headers;
 		this->_body = B._body;
+		this->_file_body = B._file_body;
+		this->_static_body = B._static_body;
+		this->_body_reader = B._body_reader;
+		this->_prepared = B._prepared;
+		this->_prepared_header_length = B._prepared_header_length;
 		this->_http_version = B._http_version;
+		this->_upgrade_handler = B._upgrade_handler;
 		return *this;
 	};
 	~HttpResponse(){};
 	void SetStatusCode(int);
 	void SetReasonPhrase(std::string);
+	// the connection hands its socket to the handler after sending the response
+	void SetUpgradeHandler(const UpgradeHandler& upgrade_handler)
+	{
+		_upgrade_handler = upgrade_handler;
+	};
+	const UpgradeHandler& GetUpgradeHandler() const
+	{
+		return _upgrade_handler;
+	};
 	inline int GetStatusCode() const
 	{
 		return _status_code;
@@ -146,5 +296,10 @@ private:
 	int _status_code;
 	std::string _reason_phrase;
 	std::string _http_version;
+	UpgradeHandler _upgrade_handler;
 };
+
+// looks at a request whose body has not been read yet, with its Content-Length (nullopt when chunked).
+// a response turns the request down before the body is sent
+using BodyCheck = std::function<std::optional<HttpResponse>(const HttpRequest&, std::optional<uintmax_t>)>;
 #endif
\ No newline at end of file
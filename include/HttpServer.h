@@ -1,11 +1,30 @@
 #ifndef _HTTPSERVER_H_
 #define _HTTPSERVER_H_
 
+#include "AllocationTracker.h"
+#include "AssetBundle.h"
+#include "ClientLimiter.h"
+#include "EventLoop.h"
+#include "EventStream.h"
+#include "FileCache.h"
+#include "FileSyncer.h"
 #include "HttpConnection.h"
 #include "HttpMessage.h"
-#include "MessageQueue.h"
+#include "ListenerHandoff.h"
+#include "LoadShedder.h"
+#include "MultipartReader.h"
+#include "PriorityScheduler.h"
+#include "ResponseCache.h"
+#include "ReverseProxy.h"
+#include "RequestTracer.h"
 #include "RouteMap.h"
 #include "SocketServer.h"
+#include "StaticFile.h"
+#include "Task.h"
+#include "TlsContext.h"
+#include "UploadIndex.h"
+#include "UploadStore.h"
+#include "WebSocketSession.h"
 #include "jSocket.h"
 #include "jjson.hpp"
 
@@ -21,26 +40,136 @@
 #include <thread>
 
 constexpr std::chrono::seconds CONNECTION_TIMEOUT(5);
+constexpr std::chrono::seconds DRAIN_DEFAULT_TIMEOUT(30);
+constexpr int LOAD_SHEDDING_DEFAULT_RETRY_AFTER = 1;
+constexpr int HANDLER_DEFAULT_THREADS = 1;
+
+// what requests under a path prefix may send as a body, checked before any of it is read
+struct BodyLimit
+{
+	std::string prefix;
+	// largest Content-Length accepted, 0 for no limit
+	uintmax_t max_size = 0;
+	// media types accepted, "type/*" matches a whole type. empty accepts any
+	std::vector<std::string> content_types;
+	// methods that may send a body, empty for any allowed method
+	std::vector<std::string> methods;
+};
+
+// everything a SIGHUP reload can change, replaced as a whole so a request never sees half an update
+struct ServerSettings
+{
+	std::string server_name;
+	// empty when only embedded assets are served
+	std::string web_dir;
+	// a path found in the assets built into the binary is served from there instead of web_dir
+	bool embedded_assets = true;
+	std::string upload_dir;
+	std::vector<std::string> allowed_methods;
+	// idle keep-alive connections are closed after this long
+	std::chrono::seconds connection_timeout = CONNECTION_TIMEOUT;
+	// how long a client may take over a request once it has started sending it
+	RequestDeadlines deadlines;
+	// the longest prefix matching a request's path applies, default_body_limit when none does
+	std::vector<BodyLimit> body_limits;
+	BodyLimit default_body_limit;
+	// empty when there is no status route
+	std::string status_route;
+	// a target shorter than a first request sheds healthy clients, so shedding is only on when configured
+	bool load_shedding_enabled = false;
+	std::chrono::milliseconds load_shedding_target = LOAD_SHEDDING_DEFAULT_TARGET;
+	std::chrono::milliseconds load_shedding_interval = LOAD_SHEDDING_DEFAULT_INTERVAL;
+	int retry_after = LOAD_SHEDDING_DEFAULT_RETRY_AFTER;
+	// uploads are stored once per distinct content, see UploadStore
+	bool content_addressed_uploads = false;
+	// fraction of requests traced, see RequestTracer
+	double trace_sample_rate = 0;
+	// empty when the trace is not served
+	std::string trace_route;
+	// empty when allocation counts are not served, see AllocationTracker
+	std::string allocations_route;
+	// requests in flight keep the proxy they started on, with its upstream pools
+	std::shared_ptr<ReverseProxy> reverse_proxy;
+};
+
+struct QueuedRequest
+{
+	HttpRequest request;
+	// bytes read at accept, handed to the connection as they arrived
+	std::vector<unsigned char> data_buffer;
+	std::unique_ptr<jSocket> socket;
+	std::chrono::steady_clock::time_point enqueue_time;
+	ClientLease client_lease;
+	// 0 when the request is not traced
+	uint64_t trace_id = 0;
+};
+// held while a request of a priority lane is handled
+using LaneSlot = PriorityScheduler<QueuedRequest>::Slot;
+
 class HttpServer
 {
 public:
 	HttpServer(){};
 	~HttpServer(){};
+	// serves until the server stops or hands its socket to a replacement and drains, throws when the config is unusable
 	void Init(std::string);
 	void Get(std::string, std::function<HttpResponse(HttpRequest&&)>);
+	// the handler's responses are cached under the policy
+	void Get(std::string, std::function<HttpResponse(HttpRequest&&)>, const CachePolicy&);
 	void Post(std::string, std::function<HttpResponse(HttpRequest&&)>);
+	// coroutine handlers, run without holding a thread while they wait on the event loop
+	void Get(std::string, std::function<Task<HttpResponse>(HttpRequest&&)>);
+	void Post(std::string, std::function<Task<HttpResponse>(HttpRequest&&)>);
+	// a GET on the target may upgrade to a WebSocket, each message the client sends is passed to the handler
+	// on the event loop thread
+	void WebSocket(std::string, WebSocketSession::MessageHandler);
+	// a text/event-stream response subscribing the connection to the topics, for a handler to return
+	HttpResponse Subscribe(const HttpRequest& request, const std::vector<std::string>& topics);
+	// queues the event for every subscriber of the topic, the number reached
+	size_t Publish(const std::string& topic, const std::string& data, const std::string& event = "", const std::string& id = "");
+	// timers, socket and file I/O for coroutine handlers to await
+	EventLoop& GetEventLoop()
+	{
+		return _event_loop;
+	};
 
 private:
-	void ParseConfigFile(std::string);
+	static jjson::value ReadConfigFile(const std::string& file_name);
+	// the "socket" section, defaults for whatever it leaves out
+	static SocketOptions ReadSocketOptions(jjson::value& config);
+	// validated settings from the config, throws std::runtime_error naming the problem
+	std::shared_ptr<const ServerSettings> ParseSettings(jjson::value& config);
+	// parts of the config only read at startup
+	void ApplyStartupConfig();
+	// re-reads the config file on SIGHUP, the running settings stay when the new ones are invalid
+	void ReloadConfig();
+	void OpenListener();
+	void ServeHandoff(std::stop_token stop_token);
+	std::shared_ptr<const ServerSettings> Settings() const
+	{
+		return _settings.load();
+	};
 	void HandleApplicationLayer(std::stop_token stop_token);
 	HttpResponse HandleUpload(HttpRequest&&);
 	HttpResponse HandleGetUploads(HttpRequest&&);
+	// PUT of a raw body to upload_dir, spliced from the socket straight into the file
+	HttpResponse HandleRawUpload(HttpRequest&&, const std::string& file_name);
+	// the digest when uploads are content addressed, otherwise empty. nullopt when the upload could not be written
+	std::optional<std::string> SaveUpload(const ServerSettings& settings, const std::string& file_name, const BodyReader& body_reader);
+	// a non empty etag is used as the file's validator instead of one derived from its metadata
+	HttpResponse ServeFile(HttpRequest&&, HttpResponse&&, const std::string&, const std::string&, const std::string& etag = "");
+	HttpResponse ServeAsset(HttpRequest&&, HttpResponse&&, const EmbeddedAsset& asset);
 	void Log(const HttpRequest&, const HttpResponse&);
-	bool ValidateMethod(std::string method)
+	// a Content-Type HandleUpload can store
+	static bool IsUploadContentType(const std::string& content_type)
+	{
+		return content_type.empty() || content_type.find("multipart/form-data") != std::string::npos ||
+			   content_type.find("text/plain") != std::string::npos;
+	};
+	static bool ValidateMethod(const ServerSettings& settings, std::string method)
 	{
-		std::stringstream body_stream;
-		auto method_itr = std::find(_allowed_methods.begin(), _allowed_methods.end(), method);
-		return method_itr != _allowed_methods.end();
+		auto method_itr = std::find(settings.allowed_methods.begin(), settings.allowed_methods.end(), method);
+		return method_itr != settings.allowed_methods.end();
 	}
 	static std::string GetDate()
 	{
@@ -59,19 +188,78 @@ private:
 		return date_stream.str();
 	};
 	void PerformSocketTask(std::stop_token stop_token);
-	void ParseData(std::vector<unsigned char>&& message_buffer, std::unique_ptr<jSocket> socket);
-	HttpResponse HandleHttpRequest(HttpRequest&& request);
+	void ParseData(std::vector<unsigned char>&& message_buffer, std::unique_ptr<jSocket> socket, ClientLease&& client_lease,
+				   uint64_t trace_id);
+	HttpResponse HandleHttpRequest(HttpRequest&& request, const std::string& peer_name);
+	// the route a request is dispatched to as the pattern it matched, such as /upload/* or a proxy prefix,
+	// so allocation accounting keeps one slot per route whatever urls arrive
+	std::string RoutePattern(const HttpRequest& request);
+	// nullopt when no coroutine handler is registered for the request
+	std::optional<Task<HttpResponse>> HandleAsyncRoute(HttpRequest& request);
+	Task<HttpResponse> RunAsyncHandler(std::function<Task<HttpResponse>(HttpRequest&&)> handler, HttpRequest request);
+	HttpResponse HandleProxyResponse(const HttpRequest& request, HttpResponse&& response);
+	HttpResponse HandleStatus(HttpRequest&& request);
+	// spans recorded so far as Chrome trace-event JSON
+	HttpResponse HandleTrace(HttpRequest&& request);
+	// allocation counts per route and stage, cleared after they are read when the query has reset
+	HttpResponse HandleAllocations(HttpRequest&& request);
+	HttpResponse BadRequest(const HttpRequest& request);
+	// final response for a request whose body is not wanted, nullopt when it may be sent
+	std::optional<HttpResponse> CheckRequestBody(const HttpRequest& request, std::optional<uintmax_t> content_length);
+	HttpResponse MethodNotAllowed(const HttpRequest& request, const std::vector<std::string>& allowed_methods);
+	// turns down a body before it is read, the connection is closed as the body may already be on its way
+	HttpResponse RejectBody(const HttpRequest& request, int status_code);
+	HttpResponse TooManyRequests(const HttpRequest& request);
+	// 408 for a client too slow sending its request, counted as a connection closed for slowness
+	HttpResponse RequestTimeout(const HttpRequest& request);
+	// 101 handing the connection to a WebSocketSession, or why the handshake was refused
+	HttpResponse UpgradeWebSocket(HttpRequest&& request, const WebSocketSession::MessageHandler& message_handler);
+	void ShedRequest(QueuedRequest&& queued_request);
+	// requests on the connection each take a slot of their lane, except one handled while queue_slot, the slot
+	// the first request was dequeued with, is still held
+	std::unique_ptr<HttpConnection> CreateConnection(std::unique_ptr<jSocket> socket, ClientLease&& client_lease,
+													 std::shared_ptr<LaneSlot> queue_slot = nullptr);
 
 private:
+	std::string _config_file_name;
 	jjson::value _config;
-	MessageQueue<std::pair<HttpRequest, std::unique_ptr<jSocket>>> _request_queue;
+	std::atomic<std::shared_ptr<const ServerSettings>> _settings;
+	// declared ahead of everything holding a ClientLease so it outlives them
+	ClientLimiter _client_limiter;
+	// split into the lanes of the "priority" section
+	PriorityScheduler<QueuedRequest> _request_queue;
+	LoadShedder _load_shedder;
+	// connections closed because the client missed a request deadline
+	std::atomic<uint64_t> _slow_client_count = 0;
+	// tells apart unnamed uploads stored within the same second
+	std::atomic<uint64_t> _upload_sequence = 0;
 	jSocket _server_socket;
+	// set when the config names a "handoff_socket"
+	std::unique_ptr<ListenerHandoff> _listener_handoff;
+	std::jthread _handoff_thread;
+	// the socket went to a replacement, finish what is in flight and stop
+	std::atomic<bool> _draining = false;
+	std::chrono::seconds _drain_timeout = DRAIN_DEFAULT_TIMEOUT;
+	// set when the config has a "tls" section
+	std::unique_ptr<TlsContext> _tls_context;
 	RouteMap _route_map;
+	EventLoop _event_loop;
+	ResponseCache _response_cache;
+	// descriptors of files served from web_dir and upload_dir
+	FileCache _file_cache;
+	WebSocketSettings _websocket_settings;
+	EventStreamSettings _event_stream_settings;
+	size_t _http2_max_request_body = HTTP2_DEFAULT_MAX_REQUEST_BODY;
+	EventBroker _event_broker;
+	UploadIndex _upload_index;
+	// raw uploads are flushed to disk in batches after they are published
+	FileSyncer _file_syncer;
 	std::mutex _logger_mutex;
-	std::vector<std::string> _allowed_methods;
 	std::jthread _socket_thread;
-	std::jthread _app_logic_thread;
+	int _handler_threads = HANDLER_DEFAULT_THREADS;
+	std::vector<std::jthread> _app_logic_threads;
 	std::vector<std::unique_ptr<HttpConnection>> _connections = {};
+	std::mutex _connections_mutex;
 	std::atomic<bool> _is_server_running = true;
 	std::condition_variable _application_state_cond_var;
 };
@@ -0,0 +1,36 @@
+#ifndef _LISTENER_HANDOFF_H_
+#define _LISTENER_HANDOFF_H_
+
+#include <chrono>
+#include <string>
+
+constexpr std::chrono::milliseconds HANDOFF_TIMEOUT(2000);
+
+// Passes the listening socket of a running server to the process replacing it,
+// over a Unix domain socket with SCM_RIGHTS. Both processes accept from the same
+// socket while the old one drains, so no connection is refused during an upgrade.
+//
+// The new process connects, receives the descriptor and acknowledges it; only
+// then does the old process stop accepting and leave the path to the new one.
+class ListenerHandoff
+{
+public:
+	ListenerHandoff() = default;
+	ListenerHandoff(const ListenerHandoff&) = delete;
+	ListenerHandoff& operator=(const ListenerHandoff&) = delete;
+	~ListenerHandoff();
+	// asks the server behind path for its listening socket, -1 when no server answers
+	static int Receive(const std::string& path, std::chrono::milliseconds timeout);
+	// binds path so the next replacement can find this process, replacing whatever was there
+	bool Listen(const std::string& path);
+	// waits up to timeout for a replacement and hands it listen_fd, true once it acknowledged
+	bool Offer(int listen_fd, std::chrono::milliseconds timeout);
+	// lets go of path without removing it, it now belongs to the replacement
+	void Release();
+
+private:
+	int _socket_fd = -1;
+	std::string _path;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _LOAD_SHEDDER_H_
+#define _LOAD_SHEDDER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+constexpr std::chrono::milliseconds LOAD_SHEDDING_DEFAULT_TARGET(5);
+constexpr std::chrono::milliseconds LOAD_SHEDDING_DEFAULT_INTERVAL(100);
+
+// Admission control on queue sojourn time, after CoDel (RFC 8289).
+// A queue that drains within an interval is absorbing a burst and only requests
+// older than the interval are shed. Once every request has waited longer than
+// the target for a whole interval the delay is standing, and anything older
+// than the target is shed so the queue drains back down instead of growing.
+class LoadShedder
+{
+public:
+	LoadShedder(std::chrono::milliseconds target = LOAD_SHEDDING_DEFAULT_TARGET,
+				std::chrono::milliseconds interval = LOAD_SHEDDING_DEFAULT_INTERVAL)
+	  : _target(target)
+	  , _interval(interval){};
+	void SetThresholds(std::chrono::milliseconds target, std::chrono::milliseconds interval);
+	// called as a request leaves the queue, true when it should be rejected
+	bool ShouldShed(std::chrono::steady_clock::time_point enqueue_time, std::chrono::steady_clock::time_point now);
+	bool IsOverloaded() const
+	{
+		return _overloaded;
+	};
+	uint64_t ShedCount() const
+	{
+		return _shed_count;
+	};
+
+private:
+	std::mutex _mutex;
+	std::chrono::steady_clock::duration _target;
+	std::chrono::steady_clock::duration _interval;
+	// end of the interval the sojourn time has to stay above target for, unset while below
+	std::chrono::steady_clock::time_point _first_above_time = {};
+	std::atomic<bool> _overloaded = false;
+	std::atomic<uint64_t> _shed_count = 0;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define _MESSAGE_QUEUE_H_
 
 #include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <mutex>
 #include <optional>
@@ -42,6 +43,11 @@ public:
 
 		return message;
 	};
+	bool IsEmpty()
+	{
+		std::lock_guard<std::mutex> Lock(_mutex);
+		return _messages.empty();
+	};
 	void Send(T&& message)
 	{
 		std::lock_guard<std::mutex> Lock(_mutex);
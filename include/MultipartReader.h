@@ -0,0 +1,75 @@
+#ifndef _MULTIPART_READER_H_
+#define _MULTIPART_READER_H_
+
+#include "HttpMessage.h"
+
+#include <array>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// longest header section of a single part
+constexpr size_t MULTIPART_MAX_HEADER_SIZE = 16 * 1024;
+
+struct MultipartPart
+{
+	// names in lower case
+	std::unordered_map<std::string, std::string> headers;
+	// from content-disposition, empty when not given
+	std::string name;
+	// set for file parts, may be empty when a form was sent without choosing a file
+	std::optional<std::string> file_name;
+};
+
+// Streaming multipart/form-data reader (RFC 7578, RFC 2046 section 5.1).
+// Reads the request body piece by piece and hands out one part at a time, its
+// headers first and then its body through ReadPartBody, so a part of any size
+// passes through a buffer of roughly one read. Boundaries are found with a
+// Boyer-Moore-Horspool search, which skips ahead up to the delimiter's length
+// for every byte compared.
+class MultipartReader
+{
+public:
+	MultipartReader(const std::string& boundary, const BodyReader& body_reader);
+	// boundary parameter of a multipart content-type, nullopt when missing or malformed
+	static std::optional<std::string> GetBoundary(const std::string& content_type);
+	// headers of the next part, skipping whatever is left of the current one. nullopt after the last part or on failure
+	std::optional<MultipartPart> NextPart();
+	// next piece of the current part's body, empty at its end, nullopt when the body breaks off or is malformed
+	std::optional<std::vector<unsigned char>> ReadPartBody();
+	bool HasFailed() const
+	{
+		return _state == State::Failed;
+	};
+
+private:
+	enum class State
+	{
+		// before a delimiter, the preamble or a part's body
+		Body,
+		// a delimiter was just consumed
+		Delimiter,
+		Done,
+		Failed
+	};
+	// position of the delimiter in the unread input, npos when it is not there
+	size_t FindDelimiter() const;
+	// adds to the input, false at the end of the body or on a read failure
+	bool Fill();
+	std::optional<std::string> ReadLine();
+	std::optional<MultipartPart> ReadHeaders();
+	std::optional<std::vector<unsigned char>> Fail();
+
+private:
+	// CRLF "--" boundary, the CRLF belongs to the delimiter rather than to the part before it
+	std::string _delimiter;
+	std::array<size_t, 256> _skip_table;
+	BodyReader _body_reader;
+	std::vector<unsigned char> _input;
+	// start of the unread input, consumed bytes are only dropped once they are the larger part of the buffer
+	size_t _position = 0;
+	State _state = State::Body;
+};
+
+#endif
@@ -0,0 +1,297 @@
+#ifndef _PRIORITY_SCHEDULER_H_
+#define _PRIORITY_SCHEDULER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// lane taking every request no configured route matches
+constexpr const char* PRIORITY_DEFAULT_LANE = "default";
+
+enum class SchedulingPolicy
+{
+	// lanes take turns in proportion to their weights
+	WeightedFair,
+	// a lane is only served while every lane listed before it is empty or at its limit
+	Strict
+};
+
+struct LaneConfig
+{
+	std::string name;
+	// path prefixes served in the lane, the longest match over all lanes wins
+	std::vector<std::string> routes;
+	int weight = 1;
+	// requests of the lane handled at once, 0 for no limit
+	int max_concurrency = 0;
+};
+
+struct LaneStats
+{
+	std::string name;
+	size_t queued = 0;
+	size_t running = 0;
+	uint64_t dispatched = 0;
+};
+
+// Request queue split into priority lanes, in front of the handler threads.
+// Each lane has its own FIFO and concurrency limit. A receiving thread takes
+// the next message from a lane that is not at its limit, chosen by strict
+// priority or by smooth weighted round robin, so a burst of slow requests in
+// one lane cannot hold up the others. Work that arrives some other way takes
+// a slot of its lane with Acquire and counts against the same limit.
+template <typename T>
+class PriorityScheduler
+{
+public:
+	// held while a received message is handled, frees its lane's concurrency slot when dropped
+	class Slot
+	{
+	public:
+		Slot() = default;
+		Slot(PriorityScheduler* scheduler, size_t lane)
+		  : _scheduler(scheduler)
+		  , _lane(lane){};
+		Slot(Slot&& other) noexcept
+		  : _scheduler(std::exchange(other._scheduler, nullptr))
+		  , _lane(other._lane){};
+		Slot& operator=(Slot&& other) noexcept
+		{
+			Release();
+			_scheduler = std::exchange(other._scheduler, nullptr);
+			_lane = other._lane;
+			return *this;
+		};
+		Slot(const Slot&) = delete;
+		Slot& operator=(const Slot&) = delete;
+		~Slot()
+		{
+			Release();
+		};
+		void Release()
+		{
+			if (_scheduler)
+			{
+				std::exchange(_scheduler, nullptr)->Finish(_lane);
+			}
+		};
+		bool IsHeld() const
+		{
+			return _scheduler != nullptr;
+		};
+
+	private:
+		PriorityScheduler* _scheduler = nullptr;
+		size_t _lane = 0;
+	};
+
+	PriorityScheduler()
+	{
+		Configure({}, SchedulingPolicy::WeightedFair);
+	};
+	// call before any message is sent, a default lane is added when none is configured
+	void Configure(const std::vector<LaneConfig>& lane_configs, SchedulingPolicy policy)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_policy = policy;
+		_lanes.clear();
+		_default_lane = lane_configs.size();
+		for (auto& lane_config : lane_configs)
+		{
+			if (lane_config.name == PRIORITY_DEFAULT_LANE)
+			{
+				_default_lane = _lanes.size();
+			}
+			_lanes.emplace_back(Lane{ lane_config });
+		}
+		if (_default_lane == _lanes.size())
+		{
+			_lanes.emplace_back(Lane{ LaneConfig{ PRIORITY_DEFAULT_LANE } });
+		}
+	};
+	// lane of the longest route prefix matching the path
+	size_t LaneOf(const std::string& path) const
+	{
+		auto lane = _default_lane;
+		size_t match_length = 0;
+		for (size_t i = 0; i < _lanes.size(); i++)
+		{
+			for (auto& route : _lanes[i].config.routes)
+			{
+				if (route.size() > match_length && path.compare(0, route.size(), route) == 0)
+				{
+					lane = i;
+					match_length = route.size();
+				}
+			}
+		}
+		return lane;
+	};
+	void Send(size_t lane, T&& message)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_lanes[lane].messages.push_back(std::move(message));
+		_message_receive_con.notify_one();
+	};
+	// the next message and the slot it runs under, nullopt when none could be taken in time
+	std::optional<std::pair<T, Slot>> TryReceive(std::chrono::milliseconds time_out)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_message_receive_con.wait_for(lock,
+									  time_out,
+									  [this]
+									  {
+										  return HasReady();
+									  });
+		if (!HasReady())
+		{
+			return std::nullopt;
+		}
+		auto lane = NextLane();
+		auto& selected = _lanes[lane];
+		auto message = std::move(selected.messages.front());
+		selected.messages.pop_front();
+		selected.running++;
+		selected.dispatched++;
+		// with strict priority, a request waiting in Acquire may have been held back by this one
+		_slot_con.notify_all();
+		return std::make_pair(std::move(message), Slot(this, lane));
+	};
+	// a slot of the lane for work that did not come through the queue, e.g. the next request on a
+	// connection. waits until the lane is under its limit and, with strict priority, until no lane
+	// listed before it has a request it could serve
+	Slot Acquire(size_t lane)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		auto& selected = _lanes[lane];
+		selected.waiting++;
+		_slot_con.wait(lock,
+					   [this, lane]
+					   {
+						   return CanAcquire(lane);
+					   });
+		selected.waiting--;
+		selected.running++;
+		selected.dispatched++;
+		return Slot(this, lane);
+	};
+	bool IsEmpty()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto& lane : _lanes)
+		{
+			if (!lane.messages.empty())
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+	std::vector<LaneStats> Stats()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::vector<LaneStats> stats;
+		for (auto& lane : _lanes)
+		{
+			stats.push_back({ lane.config.name, lane.messages.size() + lane.waiting, lane.running, lane.dispatched });
+		}
+		return stats;
+	};
+
+private:
+	struct Lane
+	{
+		LaneConfig config;
+		std::deque<T> messages;
+		size_t running = 0;
+		// blocked in Acquire
+		size_t waiting = 0;
+		uint64_t dispatched = 0;
+		// smooth weighted round robin credit
+		int64_t current_weight = 0;
+	};
+	bool IsReady(const Lane& lane) const
+	{
+		return !lane.messages.empty() &&
+			   (lane.config.max_concurrency <= 0 || lane.running < static_cast<size_t>(lane.config.max_concurrency));
+	};
+	bool CanAcquire(size_t lane) const
+	{
+		auto& selected = _lanes[lane];
+		if (selected.config.max_concurrency > 0 && selected.running >= static_cast<size_t>(selected.config.max_concurrency))
+		{
+			return false;
+		}
+		for (size_t i = 0; _policy == SchedulingPolicy::Strict && i < lane; i++)
+		{
+			if (IsReady(_lanes[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+	bool HasReady() const
+	{
+		for (auto& lane : _lanes)
+		{
+			if (IsReady(lane))
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+	// call with a lane ready
+	size_t NextLane()
+	{
+		size_t selected = _lanes.size();
+		int64_t total_weight = 0;
+		for (size_t i = 0; i < _lanes.size(); i++)
+		{
+			auto& lane = _lanes[i];
+			if (!IsReady(lane))
+			{
+				continue;
+			}
+			if (_policy == SchedulingPolicy::Strict)
+			{
+				return i;
+			}
+			// every ready lane earns its weight, the richest is served and pays for the round
+			lane.current_weight += lane.config.weight;
+			total_weight += lane.config.weight;
+			if (selected == _lanes.size() || lane.current_weight > _lanes[selected].current_weight)
+			{
+				selected = i;
+			}
+		}
+		_lanes[selected].current_weight -= total_weight;
+		return selected;
+	};
+	void Finish(size_t lane)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_lanes[lane].running--;
+		// a lane back under its limit may be what a waiting thread needs
+		_message_receive_con.notify_all();
+		_slot_con.notify_all();
+	};
+
+private:
+	std::mutex _mutex;
+	std::condition_variable _message_receive_con;
+	std::condition_variable _slot_con;
+	// a deque, lanes hold move-only messages and are never relocated
+	std::deque<Lane> _lanes;
+	size_t _default_lane = 0;
+	SchedulingPolicy _policy = SchedulingPolicy::WeightedFair;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef _REQUEST_TRACER_H_
+#define _REQUEST_TRACER_H_
+
+#include "AllocationTracker.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// spans each thread keeps before the oldest are overwritten
+constexpr size_t TRACE_DEFAULT_RING_EVENTS = 4096;
+
+// Per-request stage tracing. A sampled request gets a non-zero trace id at
+// accept, and every stage it passes through (the first read, parsing, waiting
+// in the request queue, the handler, serializing and writing the response)
+// records a span with monotonic timestamps into a ring buffer owned by the
+// thread it ran on. Dump collects the rings as Chrome trace-event JSON, which
+// Perfetto and chrome://tracing open as is. With sampling off, Sample is a
+// single branch and every span sees a zero id and records nothing.
+class RequestTracer
+{
+public:
+	// fraction of requests traced, 0 turns tracing off
+	static void SetSampleRate(double sample_rate);
+	// for rings created after the call
+	static void SetRingEvents(size_t ring_events);
+	// trace id for a new request, 0 when it is not sampled
+	static uint64_t Sample()
+	{
+		auto sample_interval = _sample_interval.load(std::memory_order_relaxed);
+		if (sample_interval == 0)
+		{
+			return 0;
+		}
+		return NextSample(sample_interval);
+	}
+	static void Record(uint64_t trace_id, const char* stage, std::chrono::steady_clock::time_point start,
+					   std::chrono::steady_clock::time_point end);
+	// labels the calling thread in the trace
+	static void NameThread(const char* thread_name);
+	// every span still held, as a Chrome trace-event JSON document
+	static std::string Dump();
+
+private:
+	static uint64_t NextSample(uint64_t sample_interval);
+
+private:
+	// every n-th request is traced, 0 when tracing is off
+	static std::atomic<uint64_t> _sample_interval;
+};
+
+// records a stage from construction to destruction, nothing when the trace id is 0.
+// allocations made meanwhile are charged to the stage whether the request is traced or not
+class TraceSpan
+{
+public:
+	TraceSpan(uint64_t trace_id, const char* stage)
+	  : _trace_id(trace_id)
+	  , _stage(stage)
+	  , _allocation_stage(stage)
+	{
+		if (_trace_id != 0)
+		{
+			_start = std::chrono::steady_clock::now();
+		}
+	};
+	~TraceSpan()
+	{
+		End();
+	};
+	// ends the stage before the span goes out of scope
+	void End()
+	{
+		_allocation_stage.End();
+		if (_trace_id != 0)
+		{
+			RequestTracer::Record(_trace_id, _stage, _start, std::chrono::steady_clock::now());
+			_trace_id = 0;
+		}
+	};
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	uint64_t _trace_id;
+	const char* _stage;
+	std::chrono::steady_clock::time_point _start;
+	[[no_unique_address]] AllocationStage _allocation_stage;
+};
+
+#endif
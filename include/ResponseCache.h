@@ -0,0 +1,110 @@
+#ifndef _RESPONSE_CACHE_H_
+#define _RESPONSE_CACHE_H_
+
+#include "HttpMessage.h"
+#include "MessageQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+constexpr size_t RESPONSE_CACHE_DEFAULT_MAX_BYTES = 16 * 1024 * 1024;
+constexpr size_t RESPONSE_CACHE_DEFAULT_SHARDS = 16;
+
+// opt-in caching for one route
+struct CachePolicy
+{
+	// how long a stored response is served without running the handler
+	std::chrono::milliseconds ttl;
+	// how long past the ttl it is still served while one background refresh runs
+	std::chrono::milliseconds stale_while_revalidate = std::chrono::milliseconds(0);
+	// request headers whose values become part of the key, e.g. Accept-Encoding
+	std::vector<std::string> vary_headers = {};
+};
+
+struct CachedResponse
+{
+	int status_code;
+	std::unordered_map<std::string, std::string> headers;
+	// status line, headers and body serialized once when stored
+	std::shared_ptr<const std::vector<unsigned char>> message_buffer;
+	size_t header_length;
+};
+
+struct CacheStats
+{
+	uint64_t hits;
+	uint64_t stale_hits;
+	uint64_t misses;
+	uint64_t refreshes;
+	size_t bytes;
+};
+
+// Micro-cache for route handler responses. Entries are spread over shards by key,
+// each with its own lock and least recently used list and an equal share of the
+// memory budget. A hit hands out the stored message to be written as it is.
+class ResponseCache
+{
+public:
+	using Handler = std::function<HttpResponse(HttpRequest&&)>;
+
+	ResponseCache() = default;
+	ResponseCache(const ResponseCache&) = delete;
+	ResponseCache& operator=(const ResponseCache&) = delete;
+	void Init(size_t max_bytes, size_t shard_count);
+	// answers from the cache when it can, runs the handler and stores its response otherwise
+	HttpResponse Serve(HttpRequest&& request, const CachePolicy& policy, const Handler& handler);
+	CacheStats Stats() const;
+
+private:
+	struct CacheEntry
+	{
+		std::shared_ptr<const CachedResponse> response;
+		std::chrono::steady_clock::time_point expires;
+		std::chrono::steady_clock::time_point stale_until;
+		size_t size;
+		bool refreshing;
+		std::list<std::string>::iterator lru_position;
+	};
+	struct CacheShard
+	{
+		std::mutex mutex;
+		std::unordered_map<std::string, CacheEntry> entries;
+		// most recently used at the front
+		std::list<std::string> lru;
+		size_t bytes = 0;
+	};
+	static bool IsCacheable(const HttpRequest& request);
+	static bool IsCacheable(const HttpResponse& response);
+	static std::string Key(const HttpRequest& request, const CachePolicy& policy);
+	static HttpResponse ToResponse(const CachedResponse& cached_response);
+	CacheShard& ShardFor(const std::string& key);
+	// nullptr when the response is too large for the budget
+	std::shared_ptr<const CachedResponse> Store(const std::string& key, const HttpResponse& response, const CachePolicy& policy);
+	void Refresh(const std::string& key, HttpRequest&& request, const CachePolicy& policy, const Handler& handler);
+	void RemoveLocked(CacheShard& shard, std::unordered_map<std::string, CacheEntry>::iterator entry_itr);
+	void RunRefreshes(std::stop_token stop_token);
+
+private:
+	std::unique_ptr<CacheShard[]> _shards;
+	size_t _shard_count = 0;
+	size_t _shard_max_bytes = 0;
+	std::atomic<uint64_t> _hits = 0;
+	std::atomic<uint64_t> _stale_hits = 0;
+	std::atomic<uint64_t> _misses = 0;
+	std::atomic<uint64_t> _refreshes = 0;
+	// stale entries are refreshed one at a time off the request path
+	MessageQueue<std::function<void()>> _refresh_queue;
+	std::jthread _refresh_thread;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _REVERSE_PROXY_H_
+#define _REVERSE_PROXY_H_
+
+#include "BodyDecoder.h"
+#include "HttpMessage.h"
+#include "jSocket.h"
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+constexpr std::chrono::milliseconds PROXY_DEFAULT_CONNECT_TIMEOUT(1000);
+constexpr std::chrono::milliseconds PROXY_DEFAULT_TIMEOUT(30000);
+constexpr size_t PROXY_DEFAULT_MAX_IDLE_CONNECTIONS = 32;
+constexpr int PROXY_DEFAULT_MAX_FAILS = 3;
+constexpr std::chrono::seconds PROXY_DEFAULT_FAIL_TIMEOUT(10);
+// largest upstream status line and header section accepted
+constexpr size_t PROXY_MAX_RESPONSE_HEADER_SIZE = 64 * 1024;
+
+struct ProxyRouteConfig
+{
+	std::string prefix;
+	// host:port of each backend
+	std::vector<std::string> upstreams;
+	// forward /prefix/rest as /rest
+	bool strip_prefix = false;
+	std::chrono::milliseconds connect_timeout = PROXY_DEFAULT_CONNECT_TIMEOUT;
+	// longest an upstream read or write may block, a response head not arriving in time is a 504
+	std::chrono::milliseconds timeout = PROXY_DEFAULT_TIMEOUT;
+	size_t max_idle_connections = PROXY_DEFAULT_MAX_IDLE_CONNECTIONS;
+	// consecutive failures after which an upstream is left out for fail_timeout
+	int max_fails = PROXY_DEFAULT_MAX_FAILS;
+	std::chrono::seconds fail_timeout = PROXY_DEFAULT_FAIL_TIMEOUT;
+};
+
+struct Upstream
+{
+	std::string name;
+	struct sockaddr_in address;
+	std::atomic<int> outstanding = 0;
+	std::atomic<int> failures = 0;
+	std::atomic<int64_t> ejected_until = 0;
+	// keep-alive connections not carrying a request
+	std::mutex idle_mutex;
+	std::vector<std::unique_ptr<jSocket>> idle_sockets;
+};
+
+struct ProxyRoute
+{
+	ProxyRouteConfig config;
+	// shared with the proxy a reload replaced, so pools and failure counts carry over
+	std::vector<std::shared_ptr<Upstream>> upstreams;
+	// where the search for the least loaded upstream starts, so ties are spread out
+	std::atomic<size_t> next_upstream = 0;
+};
+
+// Forwards requests under configured path prefixes to HTTP/1.1 backends.
+// Each upstream keeps a pool of keep-alive connections; a request goes to the
+// upstream with the fewest requests in flight, skipping upstreams ejected after
+// repeated failures. Request and response bodies are streamed, never held whole.
+class ReverseProxy
+{
+public:
+	ReverseProxy() = default;
+	ReverseProxy(const ReverseProxy&) = delete;
+	ReverseProxy& operator=(const ReverseProxy&) = delete;
+	// false when an upstream address cannot be resolved
+	bool AddRoute(const ProxyRouteConfig& config);
+	// reuses the upstreams of previous that have the same route prefix and address, with their idle connections
+	void AdoptUpstreams(const ReverseProxy& previous);
+	// nullopt when no route covers the request target
+	std::optional<HttpResponse> Forward(HttpRequest& request, const std::string& client_name, const std::string& server_name);
+	// prefix of the route covering the request target, nullopt when there is none
+	std::optional<std::string> MatchRoute(const std::string& target) const;
+
+private:
+	ProxyRoute* FindRoute(const std::string& target) const;
+	// least loaded upstream, passing over ejected ones and the one that just failed while others remain
+	Upstream* PickUpstream(ProxyRoute& route, const Upstream* avoid);
+	std::unique_ptr<jSocket> TakeIdleSocket(Upstream& upstream);
+	void MarkFailed(ProxyRoute& route, Upstream& upstream);
+	std::vector<unsigned char> BuildRequestHead(const HttpRequest& request,
+												const ProxyRoute& route,
+												const Upstream& upstream,
+												const std::string& client_name,
+												const std::string& server_name,
+												BodyFraming framing,
+												uintmax_t content_length) const;
+	static HttpResponse ErrorResponse(int status_code);
+	static int64_t Now();
+
+private:
+	std::vector<std::unique_ptr<ProxyRoute>> _routes;
+};
+
+#endif
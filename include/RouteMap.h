@@ -2,6 +2,7 @@
 #define _ROUTEMAP_H_
 
 #include "HttpMessage.h"
+#include "Task.h"
 
 #include <functional>
 #include <optional>
@@ -14,12 +15,16 @@ public:
 	void RegisterRoute(std::string, std::function<HttpResponse(HttpRequest&&)>);
 	void UnregisterRoute(std::string);
 	std::optional<std::function<HttpResponse(HttpRequest&&)>> GetRouteHandler(std::string);
+	// routes served by coroutine handlers
+	void RegisterAsyncRoute(std::string, std::function<Task<HttpResponse>(HttpRequest&&)>);
+	std::optional<std::function<Task<HttpResponse>(HttpRequest&&)>> GetAsyncRouteHandler(std::string);
 	bool HasRoute(std::string);
 	std::string GetRoutes();
 	void ShowRoutes();
 
 private:
 	std::unordered_map<std::string, std::function<HttpResponse(HttpRequest&&)>> routes;
+	std::unordered_map<std::string, std::function<Task<HttpResponse>(HttpRequest&&)>> async_routes;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef _STATIC_FILE_H_
+#define _STATIC_FILE_H_
+
+#include "FileHandle.h"
+#include "HttpMessage.h"
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <vector>
+
+// maximum number of ranges served from a single Range header before it is
+// ignored and the full representation is sent instead
+constexpr size_t MAX_BYTE_RANGES = 32;
+
+struct ByteRange
+{
+	uintmax_t first;
+	uintmax_t last;
+	uintmax_t Length() const
+	{
+		return last - first + 1;
+	};
+};
+
+// A file on disk served as an HTTP representation. Validators are derived from
+// the inode metadata so they can be computed without reading the file.
+class StaticFile
+{
+public:
+	static std::optional<StaticFile> Open(const std::string& path);
+	static std::string FormatHttpDate(std::time_t time);
+	static std::optional<std::time_t> ParseHttpDate(const std::string& date);
+	// returns std::nullopt when the header is malformed and must be ignored,
+	// an empty vector when none of the ranges can be satisfied
+	static std::optional<std::vector<ByteRange>> ParseRange(const std::string& range_header, uintmax_t size);
+	// whether an If-None-Match or If-Range value lists the etag (RFC 7232 section 2.3.2)
+	static bool ETagMatches(const std::string& header_value, const std::string& etag, bool weak_comparison);
+	// the status the conditional headers call for (RFC 7232 section 6), 304 when a GET or HEAD finds the
+	// representation unchanged, 412 when another method's If-None-Match matches, std::nullopt to go on
+	static std::optional<int> EvaluatePreconditions(const HttpRequest& request, const std::string& etag, std::time_t mtime);
+	// whether a Range applies, true without If-Range or when its validator still matches
+	static bool IfRangeMatches(const HttpRequest& request, const std::string& etag, std::time_t mtime);
+
+	const std::string& GetPath() const
+	{
+		return _path;
+	};
+	const std::string& GetETag() const
+	{
+		return _etag;
+	};
+	// replaces the validator derived from the metadata, e.g. with a digest of the contents
+	void SetETag(const std::string& etag)
+	{
+		_etag = etag;
+	};
+	const std::string& GetLastModified() const
+	{
+		return _last_modified;
+	};
+	uintmax_t GetSize() const
+	{
+		return _size;
+	};
+	std::optional<int> EvaluatePreconditions(const HttpRequest& request) const;
+	bool IfRangeMatches(const HttpRequest& request) const;
+	std::optional<std::vector<unsigned char>> Read(uintmax_t offset, uintmax_t length) const;
+	std::optional<std::vector<unsigned char>> Read() const;
+	// a body referencing the open file, sent without copying through userspace
+	FileBody Body(uintmax_t offset, uintmax_t length) const;
+	FileBody Body() const;
+
+private:
+	StaticFile(const std::string& path, std::shared_ptr<FileHandle> file, const struct stat& file_stat);
+
+private:
+	std::string _path;
+	std::shared_ptr<FileHandle> _file;
+	std::string _etag;
+	std::string _last_modified;
+	std::time_t _mtime;
+	uintmax_t _size;
+};
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef _TASK_H_
+#define _TASK_H_
+
+#include "AllocationTracker.h"
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <future>
+#include <optional>
+#include <utility>
+
+template <typename T>
+class Task;
+
+namespace task_detail
+{
+	// when a task finishes, whoever awaited it carries on from here
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept
+		{
+			return false;
+		};
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+		{
+#ifdef ALLOCATION_ACCOUNTING
+			handle.promise().LeaveAllocationContext();
+#endif
+			auto continuation = handle.promise().continuation;
+			return continuation ? continuation : std::noop_coroutine();
+		};
+		void await_resume() const noexcept {};
+	};
+
+#ifdef ALLOCATION_ACCOUNTING
+	template <typename Awaitable>
+	struct AllocationAwaiter;
+#endif
+
+	struct PromiseBase
+	{
+#ifdef ALLOCATION_ACCOUNTING
+		PromiseBase()
+		  : allocation_context(AllocationTracker::CurrentContext()){};
+		AllocationAwaiter<std::suspend_always> initial_suspend() noexcept;
+		// every await hands the thread back its own context and picks the coroutine's up again when resumed
+		template <typename Awaitable>
+		AllocationAwaiter<Awaitable> await_transform(Awaitable&& awaitable) noexcept;
+		void EnterAllocationContext()
+		{
+			previous_allocation_context = AllocationTracker::EnterContext(allocation_context);
+			allocation_context_entered = true;
+		};
+		void LeaveAllocationContext()
+		{
+			if (allocation_context_entered)
+			{
+				AllocationTracker::LeaveContext(previous_allocation_context);
+				allocation_context_entered = false;
+			}
+		};
+#else
+		std::suspend_always initial_suspend() const noexcept
+		{
+			return {};
+		};
+#endif
+		FinalAwaiter final_suspend() const noexcept
+		{
+			return {};
+		};
+		void unhandled_exception()
+		{
+			exception = std::current_exception();
+		};
+
+		std::coroutine_handle<> continuation;
+		std::exception_ptr exception;
+#ifdef ALLOCATION_ACCOUNTING
+		// stage and route of the request the coroutine was created for, charged on whichever thread resumes it
+		AllocationContext allocation_context;
+		AllocationContext previous_allocation_context = {};
+		bool allocation_context_entered = false;
+#endif
+	};
+
+#ifdef ALLOCATION_ACCOUNTING
+	// passes an await through, leaving the coroutine's allocation context before it suspends and entering it
+	// again once it is resumed, on the resuming thread
+	template <typename Awaitable>
+	struct AllocationAwaiter
+	{
+		bool await_ready()
+		{
+			return awaitable.await_ready();
+		};
+		template <typename Promise>
+		decltype(auto) await_suspend(std::coroutine_handle<Promise> handle)
+		{
+			promise.LeaveAllocationContext();
+			return awaitable.await_suspend(handle);
+		};
+		decltype(auto) await_resume()
+		{
+			promise.EnterAllocationContext();
+			return awaitable.await_resume();
+		};
+
+		Awaitable awaitable;
+		PromiseBase& promise;
+	};
+
+	inline AllocationAwaiter<std::suspend_always> PromiseBase::initial_suspend() noexcept
+	{
+		return { {}, *this };
+	}
+
+	template <typename Awaitable>
+	AllocationAwaiter<Awaitable> PromiseBase::await_transform(Awaitable&& awaitable) noexcept
+	{
+		return { std::forward<Awaitable>(awaitable), *this };
+	}
+#endif
+
+	template <typename T>
+	struct Promise : PromiseBase
+	{
+		Task<T> get_return_object();
+		void return_value(T value)
+		{
+			result.emplace(std::move(value));
+		};
+		T Result()
+		{
+			if (exception)
+			{
+				std::rethrow_exception(exception);
+			}
+			return std::move(result.value());
+		};
+
+		std::optional<T> result;
+	};
+
+	template <>
+	struct Promise<void> : PromiseBase
+	{
+		Task<void> get_return_object();
+		void return_void() const noexcept {};
+		void Result()
+		{
+			if (exception)
+			{
+				std::rethrow_exception(exception);
+			}
+		};
+	};
+
+	// fire and forget coroutine used to start a task from plain code
+	struct DetachedTask
+	{
+		struct promise_type
+		{
+			DetachedTask get_return_object() const noexcept
+			{
+				return {};
+			};
+			std::suspend_never initial_suspend() const noexcept
+			{
+				return {};
+			};
+			std::suspend_never final_suspend() const noexcept
+			{
+				return {};
+			};
+			void return_void() const noexcept {};
+			void unhandled_exception() const noexcept
+			{
+				std::terminate();
+			};
+		};
+	};
+}  // namespace task_detail
+
+// Lazily started coroutine producing a T. It runs when first awaited, on the
+// awaiting thread, and hands control back to the awaiting coroutine when it
+// finishes, on whichever thread resumed it last (the event loop for anything
+// that waited on I/O or a timer).
+template <typename T>
+class Task
+{
+public:
+	using promise_type = task_detail::Promise<T>;
+
+	explicit Task(std::coroutine_handle<promise_type> handle)
+	  : _handle(handle){};
+	Task(Task&& other) noexcept
+	  : _handle(std::exchange(other._handle, nullptr)){};
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (_handle)
+			{
+				_handle.destroy();
+			}
+			_handle = std::exchange(other._handle, nullptr);
+		}
+		return *this;
+	};
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	~Task()
+	{
+		if (_handle)
+		{
+			_handle.destroy();
+		}
+	};
+	bool await_ready() const noexcept
+	{
+		return false;
+	};
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		_handle.promise().continuation = awaiting;
+		return _handle;
+	};
+	T await_resume()
+	{
+		return _handle.promise().Result();
+	};
+
+private:
+	std::coroutine_handle<promise_type> _handle;
+};
+
+template <typename T>
+Task<T> task_detail::Promise<T>::get_return_object()
+{
+	return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> task_detail::Promise<void>::get_return_object()
+{
+	return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// starts a task without awaiting it, on_complete gets the result or the exception it ended with
+template <typename T>
+task_detail::DetachedTask Spawn(Task<T> task, std::function<void(std::optional<T>&&, std::exception_ptr)> on_complete)
+{
+	std::optional<T> result;
+	std::exception_ptr exception;
+	try
+	{
+		result.emplace(co_await task);
+	}
+	catch (...)
+	{
+		exception = std::current_exception();
+	}
+	on_complete(std::move(result), exception);
+}
+
+// blocks the calling thread until the task is done, for callers that are not coroutines
+template <typename T>
+T SyncWait(Task<T> task)
+{
+	std::promise<T> result_promise;
+	auto result_future = result_promise.get_future();
+	Spawn<T>(std::move(task),
+			 [&result_promise](std::optional<T>&& result, std::exception_ptr exception)
+			 {
+				 if (exception)
+				 {
+					 result_promise.set_exception(exception);
+					 return;
+				 }
+				 result_promise.set_value(std::move(result.value()));
+			 });
+	return result_future.get();
+}
+
+#endif
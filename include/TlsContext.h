@@ -0,0 +1,64 @@
+#ifndef _TLS_CONTEXT_H_
+#define _TLS_CONTEXT_H_
+
+#include <openssl/ssl.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+constexpr size_t TLS_TICKET_KEY_SIZE = 80;
+constexpr long TLS_DEFAULT_SESSION_CACHE_SIZE = 20480;
+constexpr long TLS_DEFAULT_SESSION_TIMEOUT = 300;
+
+struct TlsConfig
+{
+	std::string certificate_file;
+	std::string private_key_file;
+	long session_cache_size = TLS_DEFAULT_SESSION_CACHE_SIZE;
+	long session_timeout = TLS_DEFAULT_SESSION_TIMEOUT;
+	// 80 bytes shared by every process terminating TLS for the same site, so a
+	// ticket issued by one can be resumed by another
+	std::string ticket_key_file;
+	bool enable_ktls = true;
+};
+
+// Server side SSL_CTX shared by every accepted connection. The session cache
+// and ticket keys live here so resumption works across connections.
+class TlsContext
+{
+public:
+	TlsContext() = default;
+	~TlsContext();
+	TlsContext(const TlsContext&) = delete;
+	TlsContext& operator=(const TlsContext&) = delete;
+	bool Init(const TlsConfig& config);
+	SSL* CreateSession(int socket_fd) const;
+	bool IsKtlsEnabled() const
+	{
+		return _ktls_enabled;
+	};
+
+private:
+	bool LoadTicketKey(const std::string& file_name);
+	static int TicketKeyCallback(SSL* ssl,
+								 unsigned char key_name[16],
+								 unsigned char iv[EVP_MAX_IV_LENGTH],
+								 EVP_CIPHER_CTX* cipher_context,
+								 EVP_MAC_CTX* hmac_context,
+								 int encrypt);
+	static int AlpnSelectCallback(SSL* ssl,
+								  const unsigned char** out,
+								  unsigned char* out_length,
+								  const unsigned char* in,
+								  unsigned int in_length,
+								  void* arg);
+
+private:
+	SSL_CTX* _context = nullptr;
+	std::optional<std::array<unsigned char, TLS_TICKET_KEY_SIZE>> _ticket_key;
+	bool _ktls_enabled = false;
+};
+
+#endif
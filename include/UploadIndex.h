@@ -0,0 +1,81 @@
+#ifndef _UPLOAD_INDEX_H_
+#define _UPLOAD_INDEX_H_
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+constexpr size_t UPLOAD_INDEX_DEFAULT_PAGE_SIZE = 100;
+constexpr size_t UPLOAD_INDEX_MAX_PAGE_SIZE = 1000;
+
+enum class UploadSort
+{
+	Name,
+	Size,
+	Modified
+};
+
+struct UploadEntry
+{
+	std::string name;
+	uintmax_t size = 0;
+	// seconds since the epoch
+	int64_t modified = 0;
+};
+
+struct UploadPage
+{
+	std::vector<UploadEntry> entries;
+	// passed back to get the page after this one, unset on the last page
+	std::optional<std::string> next_cursor;
+};
+
+// In memory listing of the upload directory. The directory is scanned once when
+// opened, then kept current by the upload handler and by inotify for files that
+// change behind the server's back. Every sort order is kept as an ordered set
+// and pages resume after a cursor, so a page costs its size, not the directory's.
+class UploadIndex
+{
+public:
+	UploadIndex() = default;
+	UploadIndex(const UploadIndex&) = delete;
+	UploadIndex& operator=(const UploadIndex&) = delete;
+	~UploadIndex();
+	// indexes directory, creating it when missing, and watches it. Opening the directory already open does nothing
+	void Open(const std::filesystem::path& directory);
+	// records the file's current size and time, or drops it when it is gone
+	void Update(const std::filesystem::path& file_path);
+	UploadPage GetPage(UploadSort sort, bool descending, const std::string& cursor, size_t limit) const;
+	size_t Size() const;
+
+private:
+	// sort value first, then the name so that keys are unique
+	using SortKey = std::pair<int64_t, std::string>;
+	static SortKey MakeKey(UploadSort sort, const UploadEntry& entry);
+	static std::optional<SortKey> ParseCursor(UploadSort sort, const std::string& cursor);
+	static std::string MakeCursor(const SortKey& key);
+	void Scan();
+	void Insert(UploadEntry&& entry);
+	void Remove(const std::string& name);
+	void Watch(std::stop_token stop_token);
+
+private:
+	mutable std::shared_mutex _mutex;
+	std::filesystem::path _directory;
+	std::map<std::string, UploadEntry> _entries;
+	// indexed by UploadSort
+	std::array<std::set<SortKey>, 3> _orders;
+	int _inotify_fd = -1;
+	std::jthread _watch_thread;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _UPLOAD_STORE_H_
+#define _UPLOAD_STORE_H_
+
+#include "HttpMessage.h"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// blobs live in a hidden directory so the upload listing only shows names
+constexpr const char* UPLOAD_STORE_BLOB_DIR = ".blobs";
+
+// Content addressed storage for uploads. Each body is hashed with SHA-256 as it
+// is written and kept once under its digest in upload_dir/.blobs. The upload's
+// name is a symbolic link to the blob, so identical uploads share one copy on
+// disk and the name is resolved back to its digest with a readlink.
+class UploadStore
+{
+public:
+	UploadStore(const std::filesystem::path& upload_dir)
+	  : _upload_dir(upload_dir){};
+	// writes the body, points name at its blob and returns the digest, nullopt when it could not be stored
+	std::optional<std::string> Store(const std::string& name, const BodyReader& body_reader);
+	// digest of the blob name points at, nullopt when name is not in the store
+	std::optional<std::string> GetDigest(const std::string& name) const;
+	// location of the blob, nullopt when digest is not a well formed SHA-256 digest
+	std::optional<std::filesystem::path> GetBlobPath(const std::string& digest) const;
+	static bool IsDigest(const std::string& digest);
+
+private:
+	std::optional<std::string> WriteBlob(const BodyReader& body_reader);
+	bool Link(const std::string& name, const std::string& digest);
+
+private:
+	std::filesystem::path _upload_dir;
+};
+
+#endif
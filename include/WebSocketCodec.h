@@ -0,0 +1,88 @@
+#ifndef _WEBSOCKET_CODEC_H_
+#define _WEBSOCKET_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// largest message, joined from its fragments, accepted from a client
+constexpr size_t WEBSOCKET_DEFAULT_MAX_MESSAGE = 1024 * 1024;
+
+enum class WebSocketOpcode : uint8_t
+{
+	Continuation = 0x0,
+	Text = 0x1,
+	Binary = 0x2,
+	Close = 0x8,
+	Ping = 0x9,
+	Pong = 0xA
+};
+
+// status codes of a close frame (RFC 6455 section 7.4.1)
+enum class WebSocketCloseCode : uint16_t
+{
+	Normal = 1000,
+	GoingAway = 1001,
+	ProtocolError = 1002,
+	InvalidPayload = 1007,
+	PolicyViolation = 1008,
+	MessageTooBig = 1009
+};
+
+struct WebSocketMessage
+{
+	// Text or Binary for data messages, the opcode of a control frame otherwise
+	WebSocketOpcode opcode;
+	std::vector<unsigned char> payload;
+	std::string Text() const
+	{
+		return std::string(payload.begin(), payload.end());
+	};
+};
+
+// Sec-WebSocket-Accept answering a client's Sec-WebSocket-Key
+std::string WebSocketAcceptKey(const std::string& client_key);
+// XORs the data with the 4 byte masking key, position bytes into the key's cycle.
+// Works through 16 or 32 bytes at a time with SSE2, AVX2 or NEON where the build targets them
+void UnmaskWebSocketPayload(unsigned char* data, size_t length, const unsigned char mask[4], size_t position = 0);
+// a frame as the server sends it, unmasked
+std::vector<unsigned char> EncodeWebSocketFrame(WebSocketOpcode opcode, const unsigned char* payload, size_t length, bool fin = true);
+
+// Decoder for the frames a client sends (RFC 6455 section 5). Payloads are
+// unmasked as they are copied out. The fragments of a data message are joined
+// into one message, and control frames arriving between them are handed out
+// as they come.
+class WebSocketDecoder
+{
+public:
+	enum class Result
+	{
+		Message,
+		// the rest of a frame has not arrived yet
+		NeedMore,
+		// the connection has to be closed with ErrorCode
+		Error
+	};
+	explicit WebSocketDecoder(size_t max_message_size = WEBSOCKET_DEFAULT_MAX_MESSAGE)
+	  : _max_message_size(max_message_size){};
+	// consumed is set to the bytes of input taken, whole frames only, whatever the result
+	Result Decode(const unsigned char* data, size_t length, size_t& consumed, WebSocketMessage& message);
+	WebSocketCloseCode ErrorCode() const
+	{
+		return _error_code;
+	};
+
+private:
+	Result Fail(WebSocketCloseCode error_code);
+
+private:
+	size_t _max_message_size;
+	// opcode of the data message whose fragments are being joined
+	std::optional<WebSocketOpcode> _fragmented_opcode;
+	std::vector<unsigned char> _fragments;
+	WebSocketCloseCode _error_code = WebSocketCloseCode::Normal;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef _WEBSOCKET_SESSION_H_
+#define _WEBSOCKET_SESSION_H_
+
+#include "EventLoop.h"
+#include "HttpMessage.h"
+#include "Task.h"
+#include "WebSocketCodec.h"
+#include "jSocket.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+constexpr std::chrono::seconds WEBSOCKET_DEFAULT_PING_INTERVAL(30);
+// read off the socket at a time
+constexpr size_t WEBSOCKET_READ_SIZE = 64 * 1024;
+// bytes queued for a client that is not reading before its session is closed
+constexpr size_t WEBSOCKET_DEFAULT_MAX_QUEUED_BYTES = 4 * 1024 * 1024;
+
+struct WebSocketSettings
+{
+	// a session quiet this long is pinged, and closed when it stays quiet as long again
+	std::chrono::milliseconds ping_interval = WEBSOCKET_DEFAULT_PING_INTERVAL;
+	size_t max_message_size = WEBSOCKET_DEFAULT_MAX_MESSAGE;
+	size_t max_queued_bytes = WEBSOCKET_DEFAULT_MAX_QUEUED_BYTES;
+};
+
+// Connection upgraded to the WebSocket protocol (RFC 6455). It has no thread
+// of its own: a coroutine on the event loop waits for the socket, decodes
+// frames, answers pings and closes, and passes each data message to the
+// handler on the loop thread. Messages can be sent from any thread, they are
+// queued and written out by the loop without blocking it, TLS sessions
+// included. A client that lets too much pile up is closed with 1008.
+class WebSocketSession : public UpgradedSession, public std::enable_shared_from_this<WebSocketSession>
+{
+public:
+	using MessageHandler = std::function<void(WebSocketSession&, WebSocketMessage&&)>;
+
+	WebSocketSession(EventLoop& event_loop,
+					 std::unique_ptr<jSocket> socket,
+					 const std::string& path,
+					 const MessageHandler& message_handler,
+					 const WebSocketSettings& settings);
+	WebSocketSession(const WebSocketSession&) = delete;
+	WebSocketSession& operator=(const WebSocketSession&) = delete;
+	// runs the session on the event loop, input is what the client sent after its upgrade request
+	void Start(std::vector<unsigned char>&& input);
+	// false once the session is closing
+	bool Send(const std::string& text);
+	bool SendBinary(const std::vector<unsigned char>& data);
+	// starts the closing handshake, the session ends when the client answers or stops responding
+	void Close(WebSocketCloseCode close_code);
+	void Close() override
+	{
+		Close(WebSocketCloseCode::GoingAway);
+	};
+	bool IsOpen() const override
+	{
+		return _is_open;
+	};
+	// request path the session was opened on
+	const std::string& GetPath() const
+	{
+		return _path;
+	};
+
+private:
+	Task<bool> Run(std::shared_ptr<WebSocketSession> self);
+	bool Queue(WebSocketOpcode opcode, const unsigned char* payload, size_t length);
+	void QueueClose(WebSocketCloseCode close_code);
+	// call with the output mutex held
+	void AppendClose(WebSocketCloseCode close_code);
+	bool HasOutput();
+	// writes queued frames without waiting, false when the peer is gone
+	bool Flush();
+	// false when the peer closed or the read failed
+	bool ReadAvailable();
+	// false once the session should end
+	bool HandleInput();
+
+private:
+	EventLoop& _event_loop;
+	std::unique_ptr<jSocket> _socket;
+	std::string _path;
+	MessageHandler _message_handler;
+	WebSocketSettings _settings;
+	WebSocketDecoder _decoder;
+	// received and not yet decoded, only touched on the loop thread
+	std::vector<unsigned char> _input;
+	bool _ping_outstanding = false;
+	std::mutex _output_mutex;
+	// frames queued and not yet written
+	std::vector<unsigned char> _output;
+	bool _close_sent = false;
+	// more was queued than the client took, the session ends without waiting for it
+	std::atomic<bool> _overflowed = false;
+	std::atomic<bool> _is_open = true;
+};
+
+#endif
@@ -1,12 +1,15 @@
 #ifndef _J_SOCKET_H_
 #define _J_SOCKET_H_
 
+#include "BufferPool.h"
 #include "MessageQueue.h"
+#include "TlsContext.h"
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <stdlib.h>
 #include <unistd.h>
@@ -25,6 +28,15 @@
 
 #define STDOUT_FD 1
 #define MAX_UDP_BUFF_LEN 1024
+// free space a buffer is grown to before ReadInto, and the slab a read spills into past it
+#define RECEIVE_MIN_SPACE (16 * 1024)
+#define RECEIVE_SLAB_SIZE (64 * 1024)
+// pipe capacity asked for when splicing a body from the socket
+#define SPLICE_PIPE_SIZE (1024 * 1024)
+// how long the listener rests when even the spare descriptor cannot take a connection, and how often
+// connections closed for a lack of descriptors are logged
+constexpr std::chrono::milliseconds ACCEPT_BACKOFF(100);
+constexpr std::chrono::seconds ACCEPT_SHED_LOG_INTERVAL(1);
 
 typedef struct sockaddr_in sockaddr_in_t;
 enum class PROTO
@@ -41,6 +53,31 @@ enum class ReadError
 };
 
 using ReadResult = std::variant<std::vector<unsigned char>, ReadError>;
+
+// connections taken off the listener each time it wakes the acceptor
+constexpr size_t SOCKET_DEFAULT_ACCEPT_BATCH = 64;
+
+// Tuning for the listening socket and the connections accepted on it, the
+// "socket" section of the config. 0 leaves an option at the kernel's default.
+struct SocketOptions
+{
+	int backlog = SOMAXCONN;
+	bool reuse_address = true;
+	bool no_delay = true;
+	// seconds a connection is held back in the kernel until its first bytes arrive
+	int defer_accept = 0;
+	// length of the TCP Fast Open queue, data in the SYN is accepted when set
+	int fast_open = 0;
+	int receive_buffer = 0;
+	int send_buffer = 0;
+	bool keep_alive = false;
+	// seconds idle before the first probe, seconds between probes and probes lost before the peer is given up on
+	int keep_alive_idle = 0;
+	int keep_alive_interval = 0;
+	int keep_alive_count = 0;
+	size_t accept_batch = SOCKET_DEFAULT_ACCEPT_BATCH;
+};
+
 class jSocket
 {
 public:
@@ -53,21 +90,111 @@ public:
 		_port = PORT;
 		_proto = proto;
 	};
+	// takes effect for a listener created or adopted afterwards
+	void SetOptions(const SocketOptions& options)
+	{
+		_options = options;
+	};
 	void CreateSocket(void);
+	// takes over a socket that is already bound and listening, e.g. one handed over by a previous server
+	bool AdoptListener(int listen_fd);
+	int GetFd() const
+	{
+		return _socket_fd;
+	};
 	void Listen();
-	std::unique_ptr<jSocket> Accept(std::chrono::milliseconds timeout = std::chrono::milliseconds(500));
-	void Write(const std::vector<unsigned char>& data_buffer);
-	ReadResult Read();
+	// connections already queued on the listener, up to the accept batch, without waiting.
+	// they are non-blocking, reads and writes wait with poll for as long as the timeout allows
+	std::vector<std::unique_ptr<jSocket>> Accept();
+	// true while Accept backs off after running out of descriptors, the listener need not be polled
+	bool IsAcceptPaused() const
+	{
+		return std::chrono::steady_clock::now() < _accept_paused_until;
+	};
+	// outgoing TCP connection, nullptr when it could not be made within the timeout
+	static std::unique_ptr<jSocket> Connect(const struct sockaddr_in& peer_address, std::chrono::milliseconds timeout);
+	// reads and writes blocked longer than this give up, reads with ReadError::TimeOut
+	void SetTimeout(std::chrono::milliseconds timeout);
+	// reads waiting past the deadline give up with ReadError::TimeOut, however long the timeout. nullopt clears it
+	void SetReadDeadline(std::optional<std::chrono::steady_clock::time_point> read_deadline)
+	{
+		_read_deadline = read_deadline;
+	};
+	// true while an idle keep-alive connection has neither been closed nor written to by the peer
+	bool IsIdle() const;
+	bool Write(const std::vector<unsigned char>& data_buffer);
+	// header and body leave in one writev without being joined first
+	bool Write(const std::vector<unsigned char>& header_buffer, const std::vector<unsigned char>& body_buffer);
+	bool Write(const std::vector<unsigned char>& header_buffer, const unsigned char* body, size_t body_length);
+	// as much as the socket takes without waiting, nullopt when the peer is gone. on a TLS socket a record can be
+	// left half sent, the next call has to start with the same bytes as this one did past what it wrote
+	std::optional<size_t> TryWrite(const unsigned char* data, size_t length);
+	bool SendFile(int file_fd, uintmax_t offset, uintmax_t length);
+	// moves length bytes read from the socket into the file at offset, through a pipe with splice on plain
+	// Linux sockets and read and written otherwise
+	bool SpliceTo(int file_fd, uintmax_t offset, uintmax_t length);
+	ReadResult Read(size_t max_length = 1024);
+	// a single read, ReadError::TimeOut instead of waiting when nothing has arrived. on a TLS socket also
+	// when only part of a record has, or the handshake is waiting for the peer
+	ReadResult TryRead(size_t max_length = 1024);
+	// appends what has arrived straight into the buffer's free space and a pooled slab behind it with one
+	// readv, the count read or why nothing was
+	std::variant<size_t, ReadError> ReadInto(ReceiveBuffer& buffer);
+	// the handshake runs on the first reads, a TryRead moves it on as far as the peer allows without waiting
+	bool StartTls(const TlsContext& tls_context);
+	bool IsTls() const
+	{
+		return _ssl != nullptr;
+	};
+	// read by the thread that reads the socket, true on a plain one
+	bool IsHandshakeComplete() const
+	{
+		return !_ssl || _handshake_complete;
+	};
+	// peer IPv4 address in network byte order, as resolved when the socket was accepted
+	uint32_t GetPeerAddress() const
+	{
+		return address.sin_addr.s_addr;
+	};
+	std::string GetPeerName() const;
 	bool Bind();
 	bool IsTcp() const;
 	bool IsSCTP() const;
 	bool IsUdp() const;
+	void Shutdown();
 	void Close();
 
 private:
-	int _socket_fd;
+	bool WriteV(struct iovec* io_vectors, int count);
+	bool TlsWrite(const unsigned char* data, size_t length);
+	std::optional<size_t> TlsTryWrite(const unsigned char* data, size_t length);
+	bool WaitFor(short events);
+	ReadResult ReadCopy(size_t max_length, bool wait);
+	std::variant<size_t, ReadError> ReadV(struct iovec* io_vectors, int count, bool wait);
+	std::variant<size_t, ReadError> TlsRead(struct iovec* io_vectors, int count, bool wait);
+	void ApplyListenerOptions();
+	void ApplyConnectionOptions();
+	// out of descriptors, accepts a queued connection on the spare one and closes it straight away
+	void ShedConnection();
+
+private:
+	int _socket_fd = -1;
 	uint16_t _port;
 	PROTO _proto;
 	struct sockaddr_in address;
+	SSL* _ssl = nullptr;
+	bool _handshake_complete = false;
+	bool _ktls_send = false;
+	int _timeout_ms = -1;
+	std::optional<std::chrono::steady_clock::time_point> _read_deadline;
+	bool _non_blocking = false;
+	SocketOptions _options;
+	// held by a listener so that a connection can still be taken off the queue when descriptors run out
+	int _reserve_fd = -1;
+	std::chrono::steady_clock::time_point _accept_paused_until;
+	uint64_t _shed_connections = 0;
+	std::chrono::steady_clock::time_point _shed_logged;
+	// SSL objects are not safe for a concurrent read and write
+	std::mutex _tls_mutex;
 };
 #endif
\ No newline at end of file
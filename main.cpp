@@ -38,6 +38,25 @@ int main(int argc, char* argv[])
 		response.SetBody(api_object);
 		return response;
 	};
-	server.Get("/api", get_api);
-	server.Init(file_name);
+	// changes rarely, so a second's worth of requests share one handler call
+	server.Get("/api", get_api, CachePolicy{ std::chrono::seconds(1), std::chrono::seconds(5) });
+	server.WebSocket("/echo",
+					 [](WebSocketSession& session, WebSocketMessage&& message)
+					 {
+						 if (message.opcode == WebSocketOpcode::Text)
+						 {
+							 session.Send(message.Text());
+							 return;
+						 }
+						 session.SendBinary(message.payload);
+					 });
+	try
+	{
+		server.Init(file_name);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
 }
\ No newline at end of file
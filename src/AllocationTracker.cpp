@@ -0,0 +1,399 @@
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <sstream>
+
+#ifdef ALLOCATION_ACCOUNTING
+namespace
+{
+	struct AllocationCounter
+	{
+		std::atomic<uint64_t> allocations;
+		std::atomic<uint64_t> bytes;
+		std::atomic<uint64_t> frees;
+	};
+
+	struct RouteCounters
+	{
+		char name[ALLOCATION_ROUTE_NAME_SIZE];
+		std::atomic<uint64_t> requests;
+		std::array<AllocationCounter, ALLOCATION_MAX_STAGES> stages;
+	};
+
+	// what a thread allocated since its stage or route last changed
+	struct ThreadAllocations
+	{
+		size_t stage;
+		size_t route;
+		uint64_t allocations;
+		uint64_t bytes;
+		uint64_t frees;
+	};
+
+	// slot 0 of both takes whatever happens outside a stage or a request. names are only
+	// written under the lock, before the count that makes them visible is raised
+	std::array<const char*, ALLOCATION_MAX_STAGES> stage_names = { "(no stage)" };
+	std::atomic<size_t> stage_count = 1;
+	std::array<RouteCounters, ALLOCATION_MAX_ROUTES> routes = { { { "(no request)" } } };
+	std::atomic<size_t> route_count = 1;
+	std::mutex registration_mutex;
+
+	// trivial, so the hooks can use it at any point of a thread's life
+	constinit thread_local ThreadAllocations thread_allocations = { 0, 0, 0, 0, 0 };
+
+	void CountAllocation(size_t size)
+	{
+		thread_allocations.allocations++;
+		thread_allocations.bytes += size;
+	}
+
+	void CountFree(void* pointer)
+	{
+		if (pointer)
+		{
+			thread_allocations.frees++;
+		}
+	}
+
+	void Flush()
+	{
+		auto& allocations = thread_allocations;
+		if (allocations.allocations == 0 && allocations.frees == 0)
+		{
+			return;
+		}
+		auto& counter = routes[allocations.route].stages[allocations.stage];
+		counter.allocations.fetch_add(allocations.allocations, std::memory_order_relaxed);
+		counter.bytes.fetch_add(allocations.bytes, std::memory_order_relaxed);
+		counter.frees.fetch_add(allocations.frees, std::memory_order_relaxed);
+		allocations.allocations = 0;
+		allocations.bytes = 0;
+		allocations.frees = 0;
+	}
+
+	size_t StageIndex(const char* stage)
+	{
+		// stages are string literals, so the pointer nearly always matches
+		auto count = stage_count.load(std::memory_order_acquire);
+		for (size_t index = 0; index < count; index++)
+		{
+			if (stage_names[index] == stage || std::strcmp(stage_names[index], stage) == 0)
+			{
+				return index;
+			}
+		}
+		std::lock_guard<std::mutex> lock(registration_mutex);
+		count = stage_count.load(std::memory_order_relaxed);
+		for (size_t index = 0; index < count; index++)
+		{
+			if (std::strcmp(stage_names[index], stage) == 0)
+			{
+				return index;
+			}
+		}
+		if (count == ALLOCATION_MAX_STAGES)
+		{
+			return count - 1;
+		}
+		stage_names[count] = stage;
+		stage_count.store(count + 1, std::memory_order_release);
+		return count;
+	}
+
+	size_t RouteIndex(std::string_view method, std::string_view route)
+	{
+		// built in place, finding the route must not allocate
+		char name[ALLOCATION_ROUTE_NAME_SIZE] = {};
+		auto method_length = std::min(method.size(), sizeof(name) - 2);
+		std::memcpy(name, method.data(), method_length);
+		name[method_length] = ' ';
+		auto route_length = std::min(route.size(), sizeof(name) - method_length - 2);
+		std::memcpy(name + method_length + 1, route.data(), route_length);
+		auto count = route_count.load(std::memory_order_acquire);
+		for (size_t index = 1; index < count; index++)
+		{
+			if (std::strcmp(routes[index].name, name) == 0)
+			{
+				return index;
+			}
+		}
+		std::lock_guard<std::mutex> lock(registration_mutex);
+		count = route_count.load(std::memory_order_relaxed);
+		for (size_t index = 1; index < count; index++)
+		{
+			if (std::strcmp(routes[index].name, name) == 0)
+			{
+				return index;
+			}
+		}
+		if (count == ALLOCATION_MAX_ROUTES)
+		{
+			return count - 1;
+		}
+		// the last slot is shared by every route past the limit
+		std::strcpy(routes[count].name, count == ALLOCATION_MAX_ROUTES - 1 ? "(other routes)" : name);
+		route_count.store(count + 1, std::memory_order_release);
+		return count;
+	}
+
+	void WriteJsonString(std::stringstream& json_stream, const char* text)
+	{
+		json_stream << '"';
+		for (; *text; text++)
+		{
+			auto character = static_cast<unsigned char>(*text);
+			if (character == '"' || character == '\\')
+			{
+				json_stream << '\\' << *text;
+			}
+			else if (character < 0x20)
+			{
+				json_stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(character) << std::dec;
+			}
+			else
+			{
+				json_stream << *text;
+			}
+		}
+		json_stream << '"';
+	}
+}  // namespace
+
+size_t AllocationTracker::EnterStage(const char* stage)
+{
+	Flush();
+	auto previous_stage = thread_allocations.stage;
+	thread_allocations.stage = StageIndex(stage);
+	return previous_stage;
+}
+
+void AllocationTracker::LeaveStage(size_t previous_stage)
+{
+	Flush();
+	thread_allocations.stage = previous_stage;
+}
+
+size_t AllocationTracker::EnterRoute(std::string_view method, std::string_view route)
+{
+	Flush();
+	auto previous_route = thread_allocations.route;
+	thread_allocations.route = RouteIndex(method, route);
+	routes[thread_allocations.route].requests.fetch_add(1, std::memory_order_relaxed);
+	return previous_route;
+}
+
+void AllocationTracker::LeaveRoute(size_t previous_route)
+{
+	Flush();
+	thread_allocations.route = previous_route;
+}
+
+AllocationContext AllocationTracker::CurrentContext()
+{
+	return { thread_allocations.stage, thread_allocations.route };
+}
+
+AllocationContext AllocationTracker::EnterContext(AllocationContext context)
+{
+	Flush();
+	auto previous_context = CurrentContext();
+	thread_allocations.stage = context.stage;
+	thread_allocations.route = context.route;
+	return previous_context;
+}
+
+void AllocationTracker::LeaveContext(AllocationContext previous_context)
+{
+	EnterContext(previous_context);
+}
+
+std::string AllocationTracker::Dump()
+{
+	Flush();
+	auto stages = stage_count.load(std::memory_order_acquire);
+	auto route_total = route_count.load(std::memory_order_acquire);
+	std::stringstream json_stream;
+	json_stream << std::fixed << std::setprecision(2) << "{\"routes\":{";
+	for (size_t route_index = 0; route_index < route_total; route_index++)
+	{
+		auto& route = routes[route_index];
+		auto requests = route.requests.load(std::memory_order_relaxed);
+		uint64_t allocations = 0;
+		uint64_t bytes = 0;
+		std::stringstream stage_stream;
+		for (size_t stage_index = 0; stage_index < stages; stage_index++)
+		{
+			auto& counter = route.stages[stage_index];
+			auto stage_allocations = counter.allocations.load(std::memory_order_relaxed);
+			auto stage_bytes = counter.bytes.load(std::memory_order_relaxed);
+			auto stage_frees = counter.frees.load(std::memory_order_relaxed);
+			if (stage_allocations == 0 && stage_frees == 0)
+			{
+				continue;
+			}
+			allocations += stage_allocations;
+			bytes += stage_bytes;
+			stage_stream << (stage_stream.tellp() > 0 ? "," : "") << "\"" << stage_names[stage_index]
+						 << "\":{\"allocations\":" << stage_allocations << ",\"bytes\":" << stage_bytes << ",\"frees\":" << stage_frees
+						 << "}";
+		}
+		json_stream << (route_index == 0 ? "" : ",");
+		WriteJsonString(json_stream, route.name);
+		json_stream << ":{\"requests\":" << requests << ",\"allocations\":" << allocations << ",\"bytes\":" << bytes;
+		if (requests > 0)
+		{
+			json_stream << ",\"allocations_per_request\":" << static_cast<double>(allocations) / requests
+						<< ",\"bytes_per_request\":" << static_cast<double>(bytes) / requests;
+		}
+		json_stream << ",\"stages\":{" << stage_stream.str() << "}}";
+	}
+	json_stream << "}}";
+	return json_stream.str();
+}
+
+void AllocationTracker::Reset()
+{
+	Flush();
+	for (auto& route : routes)
+	{
+		route.requests = 0;
+		for (auto& counter : route.stages)
+		{
+			counter.allocations = 0;
+			counter.bytes = 0;
+			counter.frees = 0;
+		}
+	}
+}
+
+// replacements of the global allocation functions, every form ends up in one of these two
+namespace
+{
+	void* Allocate(std::size_t size, std::size_t alignment, bool nothrow)
+	{
+		void* pointer = nullptr;
+		if (alignment <= alignof(std::max_align_t))
+		{
+			pointer = std::malloc(size == 0 ? 1 : size);
+		}
+		else
+		{
+			// aligned_alloc wants a size that is a multiple of the alignment
+			pointer = std::aligned_alloc(alignment, (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment);
+		}
+		if (!pointer)
+		{
+			if (nothrow)
+			{
+				return nullptr;
+			}
+			throw std::bad_alloc();
+		}
+		CountAllocation(size);
+		return pointer;
+	}
+
+	void Free(void* pointer)
+	{
+		CountFree(pointer);
+		std::free(pointer);
+	}
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+	return Allocate(size, 0, false);
+}
+void* operator new[](std::size_t size)
+{
+	return Allocate(size, 0, false);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size, 0, true);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size, 0, true);
+}
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	return Allocate(size, static_cast<std::size_t>(alignment), false);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return Allocate(size, static_cast<std::size_t>(alignment), false);
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return Allocate(size, static_cast<std::size_t>(alignment), true);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return Allocate(size, static_cast<std::size_t>(alignment), true);
+}
+void operator delete(void* pointer) noexcept
+{
+	Free(pointer);
+}
+void operator delete[](void* pointer) noexcept
+{
+	Free(pointer);
+}
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	Free(pointer);
+}
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+	Free(pointer);
+}
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	Free(pointer);
+}
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	Free(pointer);
+}
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+	Free(pointer);
+}
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+	Free(pointer);
+}
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+	Free(pointer);
+}
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+	Free(pointer);
+}
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	Free(pointer);
+}
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	Free(pointer);
+}
+#else
+std::string AllocationTracker::Dump()
+{
+	return "{\"routes\":{}}";
+}
+
+void AllocationTracker::Reset()
+{
+}
+#endif
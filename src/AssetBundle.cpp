@@ -0,0 +1,57 @@
+#include "AssetBundle.h"
+
+#include <strings.h>
+
+#include <cstdlib>
+
+#ifdef EMBEDDED_ASSETS
+// defined in the source generated by tools/pack_assets.py
+extern const AssetBundleIndex EmbeddedAssetIndex;
+#endif
+
+const AssetBundle& AssetBundle::Embedded()
+{
+#ifdef EMBEDDED_ASSETS
+	static const AssetBundle bundle(EmbeddedAssetIndex);
+#else
+	static const AssetBundle bundle(AssetBundleIndex{ nullptr, 0, nullptr, 0 });
+#endif
+	return bundle;
+}
+
+bool AssetBundle::AcceptsGzip(const std::string& accept_encoding)
+{
+	auto accepted = false;
+	size_t position = 0;
+	while (position < accept_encoding.size())
+	{
+		auto item_end = accept_encoding.find(',', position);
+		if (item_end == std::string::npos)
+		{
+			item_end = accept_encoding.size();
+		}
+		auto item = accept_encoding.substr(position, item_end - position);
+		position = item_end + 1;
+		auto coding_end = item.find(';');
+		auto coding = item.substr(0, coding_end);
+		coding.erase(0, coding.find_first_not_of(" \t"));
+		coding.erase(coding.find_last_not_of(" \t") + 1);
+		// q=0 marks a coding as not acceptable (RFC 7231 section 5.3.4)
+		auto weight = 1.0;
+		auto weight_start = coding_end == std::string::npos ? std::string::npos : item.find("q=", coding_end);
+		if (weight_start != std::string::npos)
+		{
+			weight = std::strtod(item.c_str() + weight_start + 2, nullptr);
+		}
+		if (strcasecmp(coding.c_str(), "gzip") == 0 || strcasecmp(coding.c_str(), "x-gzip") == 0)
+		{
+			// an explicit entry wins over a wildcard
+			return weight > 0;
+		}
+		if (coding == "*")
+		{
+			accepted = weight > 0;
+		}
+	}
+	return accepted;
+}
@@ -0,0 +1,112 @@
+#include "AsyncSocket.h"
+
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+AsyncSocket::AsyncSocket(EventLoop& event_loop, int socket_fd)
+  : _event_loop(event_loop)
+  , _socket_fd(socket_fd)
+{
+}
+
+AsyncSocket::~AsyncSocket()
+{
+	if (_socket_fd != -1)
+	{
+		close(_socket_fd);
+	}
+}
+
+Task<std::unique_ptr<AsyncSocket>> AsyncSocket::Connect(EventLoop& event_loop,
+														 struct sockaddr_in peer_address,
+														 std::chrono::milliseconds timeout)
+{
+	int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+	if (socket_fd < 0)
+	{
+		co_return nullptr;
+	}
+	auto async_socket = std::make_unique<AsyncSocket>(event_loop, socket_fd);
+	if (connect(socket_fd, (struct sockaddr*)&peer_address, sizeof(peer_address)) < 0)
+	{
+		if (errno != EINPROGRESS || !co_await event_loop.WaitFor(socket_fd, EPOLLOUT, timeout))
+		{
+			co_return nullptr;
+		}
+		int connect_error = 0;
+		socklen_t error_length = sizeof(connect_error);
+		getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &connect_error, &error_length);
+		if (connect_error != 0)
+		{
+			co_return nullptr;
+		}
+	}
+	int no_delay = 1;
+	setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	co_return std::move(async_socket);
+}
+
+Task<ReadResult> AsyncSocket::Read(size_t max_length, std::chrono::milliseconds timeout)
+{
+	std::vector<unsigned char> data_buffer(max_length);
+	while (true)
+	{
+		auto bytes_read = read(_socket_fd, data_buffer.data(), max_length);
+		if (bytes_read > 0)
+		{
+			data_buffer.resize(bytes_read);
+			co_return data_buffer;
+		}
+		if (bytes_read == 0)
+		{
+			co_return ReadError::ConnectionClosed;
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			co_return ReadError::UnknownError;
+		}
+		if (!co_await _event_loop.WaitFor(_socket_fd, EPOLLIN | EPOLLRDHUP, timeout))
+		{
+			co_return ReadError::TimeOut;
+		}
+	}
+}
+
+Task<bool> AsyncSocket::Write(std::vector<unsigned char> data_buffer, std::chrono::milliseconds timeout)
+{
+	size_t bytes_sent = 0;
+	while (bytes_sent < data_buffer.size())
+	{
+		auto bytes_written = send(_socket_fd, data_buffer.data() + bytes_sent, data_buffer.size() - bytes_sent, MSG_NOSIGNAL);
+		if (bytes_written > 0)
+		{
+			bytes_sent += bytes_written;
+			continue;
+		}
+		if (bytes_written == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (bytes_written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && co_await _event_loop.WaitFor(_socket_fd, EPOLLOUT, timeout))
+		{
+			continue;
+		}
+		co_return false;
+	}
+	co_return true;
+}
+
+void AsyncSocket::Shutdown()
+{
+	shutdown(_socket_fd, SHUT_RDWR);
+}
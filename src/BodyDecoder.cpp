@@ -0,0 +1,193 @@
+#include "BodyDecoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <utility>
+
+namespace
+{
+	// chunk-size lines and trailer fields longer than this are treated as malformed
+	constexpr size_t MaxLineLength = 8 * 1024;
+}  // namespace
+
+void BodyDecoder::Start(BodyFraming framing, uintmax_t content_length)
+{
+	_framing = framing;
+	_remaining = 0;
+	if (framing == BodyFraming::ContentLength)
+	{
+		_remaining = content_length;
+		if (content_length == 0)
+		{
+			_framing = BodyFraming::None;
+		}
+	}
+}
+
+std::optional<std::vector<unsigned char>> BodyDecoder::Read()
+{
+	switch (_framing)
+	{
+	case BodyFraming::None:
+		return std::vector<unsigned char>();
+
+	case BodyFraming::Chunked:
+		return ReadChunk();
+
+	case BodyFraming::UntilClose:
+		if (_input_buffer.empty())
+		{
+			auto filled = _fill_function(_input_buffer);
+			if (filled == 0)
+			{
+				_framing = BodyFraming::None;
+				return std::vector<unsigned char>();
+			}
+			if (filled < 0)
+			{
+				return Fail();
+			}
+		}
+		return Take(_input_buffer.size());
+
+	case BodyFraming::ContentLength:
+		if (_input_buffer.empty() && _fill_function(_input_buffer) <= 0)
+		{
+			return Fail();
+		}
+		auto body_part = Take(std::min<uintmax_t>(_remaining, _input_buffer.size()));
+		_remaining -= body_part.size();
+		if (_remaining == 0)
+		{
+			_framing = BodyFraming::None;
+		}
+		return body_part;
+	}
+	return Fail();
+}
+
+void BodyDecoder::Consume(uintmax_t length)
+{
+	if (_framing != BodyFraming::ContentLength)
+	{
+		return;
+	}
+	_remaining -= std::min(length, _remaining);
+	if (_remaining == 0)
+	{
+		_framing = BodyFraming::None;
+	}
+}
+
+bool BodyDecoder::Drain()
+{
+	while (!IsComplete())
+	{
+		if (!Read().has_value())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+std::optional<std::vector<unsigned char>> BodyDecoder::ReadChunk()
+{
+	if (_remaining == 0)
+	{
+		// chunk-size [ chunk-ext ] CRLF (RFC 7230 section 4.1)
+		auto size_line = ReadLine();
+		if (!size_line.has_value() || size_line->empty() || !std::isxdigit(static_cast<unsigned char>(size_line->front())))
+		{
+			return Fail();
+		}
+		try
+		{
+			_remaining = std::stoull(size_line.value(), nullptr, 16);
+		}
+		catch (...)
+		{
+			return Fail();
+		}
+		if (_remaining == 0)
+		{
+			// last-chunk, trailer fields are read and dropped up to the empty line
+			while (true)
+			{
+				auto trailer_line = ReadLine();
+				if (!trailer_line.has_value())
+				{
+					return Fail();
+				}
+				if (trailer_line->empty())
+				{
+					break;
+				}
+			}
+			_framing = BodyFraming::None;
+			return std::vector<unsigned char>();
+		}
+	}
+	if (_input_buffer.empty() && _fill_function(_input_buffer) <= 0)
+	{
+		return Fail();
+	}
+	auto body_part = Take(std::min<uintmax_t>(_remaining, _input_buffer.size()));
+	_remaining -= body_part.size();
+	if (_remaining == 0)
+	{
+		auto chunk_end = ReadLine();
+		if (!chunk_end.has_value() || !chunk_end->empty())
+		{
+			return Fail();
+		}
+	}
+	return body_part;
+}
+
+std::optional<std::string> BodyDecoder::ReadLine()
+{
+	const std::string line_terminator = "\r\n";
+	size_t search_start = 0;
+	while (true)
+	{
+		auto line_end =
+			std::search(_input_buffer.begin() + search_start, _input_buffer.end(), line_terminator.begin(), line_terminator.end());
+		if (line_end != _input_buffer.end())
+		{
+			std::string line(_input_buffer.begin(), line_end);
+			_input_buffer.erase(_input_buffer.begin(), line_end + line_terminator.size());
+			return line;
+		}
+		if (_input_buffer.size() > MaxLineLength)
+		{
+			return std::nullopt;
+		}
+		// a terminator split across reads starts in the last byte already seen
+		search_start = _input_buffer.empty() ? 0 : _input_buffer.size() - 1;
+		if (_fill_function(_input_buffer) <= 0)
+		{
+			return std::nullopt;
+		}
+	}
+}
+
+std::vector<unsigned char> BodyDecoder::Take(uintmax_t length)
+{
+	auto take_end = _input_buffer.begin() + static_cast<std::ptrdiff_t>(length);
+	std::vector<unsigned char> body_part(_input_buffer.begin(), take_end);
+	if (length == _input_buffer.size())
+	{
+		// the buffer keeps its block for the next read
+		_input_buffer.clear();
+		return body_part;
+	}
+	_input_buffer.erase(_input_buffer.begin(), take_end);
+	return body_part;
+}
+
+std::optional<std::vector<unsigned char>> BodyDecoder::Fail()
+{
+	_framing = BodyFraming::None;
+	return std::nullopt;
+}
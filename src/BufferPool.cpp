@@ -0,0 +1,131 @@
+#include "BufferPool.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <mutex>
+
+namespace
+{
+	constexpr size_t BlockClasses = std::countr_zero(BUFFER_POOL_MAX_BLOCK) - std::countr_zero(BUFFER_POOL_MIN_BLOCK) + 1;
+
+	size_t ClassOf(size_t block_size)
+	{
+		return std::countr_zero(block_size) - std::countr_zero(BUFFER_POOL_MIN_BLOCK);
+	}
+
+	struct SharedCache
+	{
+		std::mutex mutex;
+		std::array<std::vector<void*>, BlockClasses> free_blocks;
+	};
+
+	SharedCache& Shared()
+	{
+		// never destroyed, threads still running at exit may hand blocks back to it
+		static auto shared_cache = new SharedCache();
+		return *shared_cache;
+	}
+
+	void Free(void* block, size_t block_size)
+	{
+		::operator delete(block, block_size);
+	}
+
+	// pushes a block to the shared list, freeing it when that is full
+	void ReleaseShared(void* block, size_t block_size)
+	{
+		auto& shared_cache = Shared();
+		{
+			std::lock_guard<std::mutex> lock(shared_cache.mutex);
+			auto& free_blocks = shared_cache.free_blocks[ClassOf(block_size)];
+			if (free_blocks.size() < BUFFER_POOL_SHARED_CACHE)
+			{
+				free_blocks.push_back(block);
+				return;
+			}
+		}
+		Free(block, block_size);
+	}
+
+	// set once the thread's cache is gone, buffers freed by destructors that run later skip it
+	thread_local bool thread_cache_destroyed = false;
+
+	struct ThreadCache
+	{
+		std::array<std::vector<void*>, BlockClasses> free_blocks;
+		// what an exiting thread kept goes to the threads still running
+		~ThreadCache()
+		{
+			thread_cache_destroyed = true;
+			for (size_t block_class = 0; block_class < BlockClasses; block_class++)
+			{
+				for (auto block : free_blocks[block_class])
+				{
+					ReleaseShared(block, BUFFER_POOL_MIN_BLOCK << block_class);
+				}
+			}
+		}
+	};
+
+	thread_local ThreadCache thread_cache;
+
+	std::vector<void*>* LocalBlocks(size_t block_size)
+	{
+		return thread_cache_destroyed ? nullptr : &thread_cache.free_blocks[ClassOf(block_size)];
+	}
+}  // namespace
+
+size_t BufferPool::BlockSize(size_t size)
+{
+	return size > BUFFER_POOL_MAX_BLOCK ? size : std::bit_ceil(std::max(size, BUFFER_POOL_MIN_BLOCK));
+}
+
+void* BufferPool::Allocate(size_t size)
+{
+	auto block_size = BlockSize(size);
+	if (block_size > BUFFER_POOL_MAX_BLOCK)
+	{
+		return ::operator new(block_size);
+	}
+	auto local_blocks = LocalBlocks(block_size);
+	if (local_blocks && !local_blocks->empty())
+	{
+		auto block = local_blocks->back();
+		local_blocks->pop_back();
+		return block;
+	}
+	auto& shared_cache = Shared();
+	{
+		std::lock_guard<std::mutex> lock(shared_cache.mutex);
+		auto& shared_blocks = shared_cache.free_blocks[ClassOf(block_size)];
+		if (!shared_blocks.empty())
+		{
+			auto block = shared_blocks.back();
+			shared_blocks.pop_back();
+			return block;
+		}
+	}
+	return ::operator new(block_size);
+}
+
+void BufferPool::Release(void* block, size_t size)
+{
+	if (!block)
+	{
+		return;
+	}
+	auto block_size = BlockSize(size);
+	if (block_size > BUFFER_POOL_MAX_BLOCK)
+	{
+		Free(block, block_size);
+		return;
+	}
+	auto local_blocks = LocalBlocks(block_size);
+	if (local_blocks && local_blocks->size() < BUFFER_POOL_THREAD_CACHE)
+	{
+		local_blocks->push_back(block);
+		return;
+	}
+	ReleaseShared(block, block_size);
+}
@@ -0,0 +1,268 @@
+#include "ClientLimiter.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace
+{
+	// a key that never matches an address, held while a slot is being evicted
+	constexpr uint64_t EvictingKey = UINT64_MAX;
+	constexpr uint64_t SketchSeeds[CLIENT_LIMITER_SKETCH_DEPTH] = { 0x9e3779b97f4a7c15,
+																	0xc2b2ae3d27d4eb4f,
+																	0x165667b19e3779f9,
+																	0x27d4eb2f165667c5 };
+	constexpr int64_t WindowLength = std::chrono::nanoseconds(std::chrono::seconds(1)).count();
+
+	uint64_t Mix(uint64_t value)
+	{
+		// splitmix64 finaliser
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+		return value ^ (value >> 31);
+	}
+}  // namespace
+
+ClientLease::ClientLease(ClientLease&& other)
+  : _limiter(std::exchange(other._limiter, nullptr))
+  , _address(other._address)
+  , _entry(std::exchange(other._entry, nullptr))
+{
+}
+
+ClientLease& ClientLease::operator=(ClientLease&& other)
+{
+	if (this != &other)
+	{
+		Release();
+		_limiter = std::exchange(other._limiter, nullptr);
+		_address = other._address;
+		_entry = std::exchange(other._entry, nullptr);
+	}
+	return *this;
+}
+
+void ClientLease::Release()
+{
+	if (_limiter)
+	{
+		_limiter->ReleaseConnection(_address, _entry);
+		_limiter = nullptr;
+		_entry = nullptr;
+	}
+}
+
+void ClientLimiter::Init(const ClientLimits& limits)
+{
+	_limits = limits;
+	_limits.burst = std::max<uint32_t>(_limits.burst, 1);
+	if (_limits.requests_per_second > 0)
+	{
+		_emission_interval = static_cast<int64_t>(WindowLength / _limits.requests_per_second);
+		_burst_tolerance = _emission_interval * (_limits.burst - 1);
+	}
+	_set_count = std::bit_ceil(std::max<size_t>(_limits.table_size / CLIENT_LIMITER_WAYS, 1));
+	_sets = std::make_unique<ClientSet[]>(_set_count);
+	_limits.sketch_width = std::bit_ceil(std::max<size_t>(_limits.sketch_width, 64));
+	auto sketch_size = CLIENT_LIMITER_SKETCH_DEPTH * _limits.sketch_width;
+	_connection_sketch = std::make_unique<std::atomic<uint32_t>[]>(sketch_size);
+	_request_sketches[0] = std::make_unique<std::atomic<uint32_t>[]>(sketch_size);
+	_request_sketches[1] = std::make_unique<std::atomic<uint32_t>[]>(sketch_size);
+	_window_start = Now();
+	_enabled = _limits.max_connections > 0 || _limits.requests_per_second > 0;
+}
+
+std::optional<ClientLease> ClientLimiter::AcquireConnection(uint32_t address)
+{
+	if (!_enabled)
+	{
+		return ClientLease();
+	}
+	auto key = static_cast<uint64_t>(address) + 1;
+	while (auto entry = FindOrInsert(address))
+	{
+		auto connections = entry->connections.fetch_add(1);
+		if (entry->key != key)
+		{
+			// evicted between lookup and increment, look again
+			entry->connections--;
+			continue;
+		}
+		if (_limits.max_connections > 0 && connections >= _limits.max_connections)
+		{
+			entry->connections--;
+			return std::nullopt;
+		}
+		entry->last_seen = Now();
+		return ClientLease(this, address, entry);
+	}
+	if (_limits.max_connections > 0 && SketchEstimate(_connection_sketch, address) >= _limits.max_connections)
+	{
+		return std::nullopt;
+	}
+	SketchAdd(_connection_sketch, address, 1);
+	return ClientLease(this, address, nullptr);
+}
+
+void ClientLimiter::ReleaseConnection(uint32_t address, ClientEntry* entry)
+{
+	if (entry)
+	{
+		entry->last_seen = Now();
+		entry->connections--;
+		return;
+	}
+	SketchAdd(_connection_sketch, address, -1);
+}
+
+bool ClientLimiter::AllowRequest(uint32_t address)
+{
+	if (!_enabled || _limits.requests_per_second <= 0)
+	{
+		return true;
+	}
+	auto now = Now();
+	auto entry = Find(SetFor(address), static_cast<uint64_t>(address) + 1);
+	if (entry)
+	{
+		entry->last_seen = now;
+		auto arrival_time = entry->arrival_time.load();
+		while (true)
+		{
+			auto start = std::max(arrival_time, now);
+			if (start - now > _burst_tolerance)
+			{
+				return false;
+			}
+			if (entry->arrival_time.compare_exchange_weak(arrival_time, start + _emission_interval))
+			{
+				return true;
+			}
+		}
+	}
+	// sliding window over the last two one second windows
+	auto current_window = _current_window.load();
+	auto elapsed = std::clamp<int64_t>(now - _window_start, 0, WindowLength);
+	auto previous_weight = static_cast<double>(WindowLength - elapsed) / WindowLength;
+	auto estimate = SketchEstimate(_request_sketches[current_window], address) +
+					previous_weight * SketchEstimate(_request_sketches[1 - current_window], address);
+	if (estimate >= _limits.requests_per_second + _limits.burst)
+	{
+		return false;
+	}
+	SketchAdd(_request_sketches[current_window], address, 1);
+	return true;
+}
+
+void ClientLimiter::EvictIdle()
+{
+	if (!_enabled)
+	{
+		return;
+	}
+	auto now = Now();
+	auto idle_timeout = std::chrono::nanoseconds(_limits.idle_timeout).count();
+	for (size_t set_index = 0; set_index < _set_count; set_index++)
+	{
+		auto& client_set = _sets[set_index];
+		std::lock_guard<std::mutex> lock(client_set.mutex);
+		for (auto& entry : client_set.entries)
+		{
+			auto key = entry.key.load();
+			if (key == 0 || entry.connections != 0 || now - entry.last_seen < idle_timeout)
+			{
+				continue;
+			}
+			entry.key = EvictingKey;
+			if (entry.connections != 0)
+			{
+				// a connection slipped in after the check above
+				entry.key = key;
+				continue;
+			}
+			entry.arrival_time = 0;
+			entry.last_seen = 0;
+			entry.key = 0;
+		}
+	}
+	if (now - _window_start >= WindowLength)
+	{
+		auto next_window = 1 - _current_window.load();
+		auto& sketch = _request_sketches[next_window];
+		for (size_t i = 0; i < CLIENT_LIMITER_SKETCH_DEPTH * _limits.sketch_width; i++)
+		{
+			sketch[i].store(0, std::memory_order_relaxed);
+		}
+		_current_window = next_window;
+		_window_start = now;
+	}
+}
+
+ClientLimiter::ClientSet& ClientLimiter::SetFor(uint32_t address)
+{
+	return _sets[Mix(address) & (_set_count - 1)];
+}
+
+ClientEntry* ClientLimiter::Find(ClientSet& client_set, uint64_t key)
+{
+	for (auto& entry : client_set.entries)
+	{
+		if (entry.key == key)
+		{
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+ClientEntry* ClientLimiter::FindOrInsert(uint32_t address)
+{
+	auto key = static_cast<uint64_t>(address) + 1;
+	auto& client_set = SetFor(address);
+	auto entry = Find(client_set, key);
+	if (entry)
+	{
+		return entry;
+	}
+	std::lock_guard<std::mutex> lock(client_set.mutex);
+	entry = Find(client_set, key);
+	if (entry)
+	{
+		return entry;
+	}
+	entry = Find(client_set, 0);
+	if (entry)
+	{
+		entry->last_seen = Now();
+		entry->key = key;
+	}
+	return entry;
+}
+
+size_t ClientLimiter::SketchIndex(size_t row, uint32_t address) const
+{
+	return row * _limits.sketch_width + (Mix(address ^ SketchSeeds[row]) & (_limits.sketch_width - 1));
+}
+
+uint32_t ClientLimiter::SketchEstimate(const std::unique_ptr<std::atomic<uint32_t>[]>& sketch, uint32_t address) const
+{
+	uint32_t estimate = UINT32_MAX;
+	for (size_t row = 0; row < CLIENT_LIMITER_SKETCH_DEPTH; row++)
+	{
+		estimate = std::min(estimate, sketch[SketchIndex(row, address)].load(std::memory_order_relaxed));
+	}
+	return estimate;
+}
+
+void ClientLimiter::SketchAdd(std::unique_ptr<std::atomic<uint32_t>[]>& sketch, uint32_t address, int32_t delta)
+{
+	for (size_t row = 0; row < CLIENT_LIMITER_SKETCH_DEPTH; row++)
+	{
+		sketch[SketchIndex(row, address)].fetch_add(static_cast<uint32_t>(delta), std::memory_order_relaxed);
+	}
+}
+
+int64_t ClientLimiter::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
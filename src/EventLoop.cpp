@@ -0,0 +1,291 @@
+#include "EventLoop.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+namespace
+{
+	constexpr int MaxEvents = 64;
+}  // namespace
+
+void EventLoop::SleepAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+	// timers are only touched on the loop thread, so the registration is handed over to it
+	loop.Post(
+		[this, handle]()
+		{
+			loop.AddTimer(deadline,
+						  [handle]()
+						  {
+							  handle.resume();
+						  });
+		});
+}
+
+void EventLoop::FdAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+	loop.Post(
+		[this, handle]()
+		{
+			loop.AddFdWait(*this, handle);
+		});
+}
+
+EventLoop::~EventLoop()
+{
+	if (_loop_thread.joinable())
+	{
+		_loop_thread.request_stop();
+		Wake();
+		_loop_thread.join();
+	}
+	for (auto& blocking_thread : _blocking_threads)
+	{
+		blocking_thread.request_stop();
+	}
+	_blocking_threads.clear();
+	if (_epoll_fd != -1)
+	{
+		close(_epoll_fd);
+	}
+	if (_wake_fd != -1)
+	{
+		close(_wake_fd);
+	}
+}
+
+void EventLoop::Start(size_t blocking_threads)
+{
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_epoll_fd == -1 || _wake_fd == -1)
+	{
+		throw std::runtime_error("Unable to create event loop");
+	}
+	struct epoll_event wake_event = {};
+	wake_event.events = EPOLLIN;
+	wake_event.data.fd = _wake_fd;
+	if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &wake_event) == -1)
+	{
+		throw std::runtime_error("Unable to create event loop");
+	}
+	for (size_t thread_index = 0; thread_index < std::max<size_t>(blocking_threads, 1); thread_index++)
+	{
+		_blocking_threads.emplace_back(std::bind_front(&EventLoop::RunBlockingTasks, this));
+	}
+	_loop_thread = std::jthread(std::bind_front(&EventLoop::Run, this));
+}
+
+void EventLoop::Post(std::function<void()>&& function)
+{
+	{
+		std::lock_guard<std::mutex> lock(_posted_mutex);
+		_posted.push_back(std::move(function));
+	}
+	Wake();
+}
+
+EventLoop::SleepAwaiter EventLoop::Sleep(std::chrono::milliseconds duration)
+{
+	return SleepAwaiter{ *this, std::chrono::steady_clock::now() + duration };
+}
+
+EventLoop::FdAwaiter EventLoop::WaitFor(int fd, uint32_t events, std::chrono::milliseconds timeout)
+{
+	return FdAwaiter{ *this, fd, events, timeout };
+}
+
+void EventLoop::Notify(int fd)
+{
+	Post(
+		[this, fd]()
+		{
+			if (_fd_waits.find(fd) == _fd_waits.end())
+			{
+				_notified_fds.insert(fd);
+				return;
+			}
+			CompleteFdWait(fd, true);
+		});
+}
+
+Task<std::optional<std::vector<unsigned char>>> EventLoop::ReadFile(std::filesystem::path path)
+{
+	std::function<std::optional<std::vector<unsigned char>>()> read_file = [path]() -> std::optional<std::vector<unsigned char>>
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			return std::nullopt;
+		}
+		return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	};
+	co_return co_await RunBlocking(std::move(read_file));
+}
+
+Task<bool> EventLoop::WriteFile(std::filesystem::path path, std::vector<unsigned char> data_buffer)
+{
+	std::function<bool()> write_file = [path, data_buffer = std::move(data_buffer)]() -> bool
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data_buffer.data()), data_buffer.size());
+		return static_cast<bool>(file);
+	};
+	co_return co_await RunBlocking(std::move(write_file));
+}
+
+void EventLoop::Run(std::stop_token stop_token)
+{
+	struct epoll_event events[MaxEvents];
+	while (!stop_token.stop_requested())
+	{
+		auto event_count = epoll_wait(_epoll_fd, events, MaxEvents, NextTimeout());
+		if (event_count == -1 && errno != EINTR)
+		{
+			std::cout << "[EventLoop] - epoll_wait failed (" << errno << ")\n";
+			return;
+		}
+		for (int event_index = 0; event_index < event_count; event_index++)
+		{
+			auto fd = events[event_index].data.fd;
+			if (fd == _wake_fd)
+			{
+				uint64_t wake_count;
+				while (read(_wake_fd, &wake_count, sizeof(wake_count)) > 0)
+				{
+				}
+				continue;
+			}
+			CompleteFdWait(fd, true);
+		}
+		RunTimers();
+		RunPosted();
+	}
+}
+
+void EventLoop::RunBlockingTasks(std::stop_token stop_token)
+{
+	while (!stop_token.stop_requested())
+	{
+		auto blocking_task = _blocking_queue.TryReceive(std::chrono::milliseconds(500));
+		if (blocking_task.has_value())
+		{
+			blocking_task.value()();
+		}
+	}
+}
+
+void EventLoop::Wake()
+{
+	uint64_t wake_count = 1;
+	if (write(_wake_fd, &wake_count, sizeof(wake_count)) == -1)
+	{
+		// the counter is already non zero, the loop wakes up anyway
+	}
+}
+
+EventLoop::TimerKey EventLoop::AddTimer(std::chrono::steady_clock::time_point deadline, std::function<void()>&& function)
+{
+	auto timer_key = TimerKey(deadline, _next_timer_id++);
+	_timers.emplace(timer_key, std::move(function));
+	return timer_key;
+}
+
+void EventLoop::AddFdWait(FdAwaiter& awaiter, std::coroutine_handle<> handle)
+{
+	auto fd = awaiter.fd;
+	if (_notified_fds.erase(fd) > 0)
+	{
+		awaiter.ready = true;
+		handle.resume();
+		return;
+	}
+	struct epoll_event fd_event = {};
+	fd_event.events = awaiter.events | EPOLLONESHOT;
+	fd_event.data.fd = fd;
+	if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &fd_event) == -1 &&
+		(errno != EEXIST || epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &fd_event) == -1))
+	{
+		// not pollable, let the coroutine try the operation and see for itself
+		awaiter.ready = true;
+		handle.resume();
+		return;
+	}
+	std::optional<TimerKey> timer_key;
+	if (awaiter.timeout.count() > 0)
+	{
+		timer_key = AddTimer(std::chrono::steady_clock::now() + awaiter.timeout,
+							 [this, fd]()
+							 {
+								 CompleteFdWait(fd, false);
+							 });
+	}
+	_fd_waits[fd] = FdWait{ handle, &awaiter.ready, timer_key };
+}
+
+void EventLoop::CompleteFdWait(int fd, bool ready)
+{
+	auto fd_wait_itr = _fd_waits.find(fd);
+	if (fd_wait_itr == _fd_waits.end())
+	{
+		return;
+	}
+	auto fd_wait = fd_wait_itr->second;
+	_fd_waits.erase(fd_wait_itr);
+	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+	if (ready && fd_wait.timer_key.has_value())
+	{
+		_timers.erase(fd_wait.timer_key.value());
+	}
+	*fd_wait.ready = ready;
+	fd_wait.handle.resume();
+}
+
+int EventLoop::NextTimeout()
+{
+	{
+		std::lock_guard<std::mutex> lock(_posted_mutex);
+		if (!_posted.empty())
+		{
+			return 0;
+		}
+	}
+	if (_timers.empty())
+	{
+		return -1;
+	}
+	auto wait_time = _timers.begin()->first.first - std::chrono::steady_clock::now();
+	// rounded up so the timer is due when the loop wakes
+	auto wait_ms = std::chrono::ceil<std::chrono::milliseconds>(wait_time).count();
+	return static_cast<int>(std::clamp<long long>(wait_ms, 0, 60 * 1000));
+}
+
+void EventLoop::RunTimers()
+{
+	auto now = std::chrono::steady_clock::now();
+	while (!_timers.empty() && _timers.begin()->first.first <= now)
+	{
+		auto function = std::move(_timers.begin()->second);
+		_timers.erase(_timers.begin());
+		function();
+	}
+}
+
+void EventLoop::RunPosted()
+{
+	std::vector<std::function<void()>> posted;
+	{
+		std::lock_guard<std::mutex> lock(_posted_mutex);
+		posted.swap(_posted);
+	}
+	for (auto& function : posted)
+	{
+		function();
+	}
+}
@@ -0,0 +1,245 @@
+#include "EventStream.h"
+
+#include <sys/epoll.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+	// a comment line, ignored by the client
+	const EncodedEvent Heartbeat = std::make_shared<const std::vector<unsigned char>>(std::vector<unsigned char>{ ':', '\n', '\n' });
+	constexpr size_t ReadSize = 4096;
+
+	void AppendField(std::string& encoded, const char* name, const std::string& value)
+	{
+		encoded += name;
+		encoded += ": ";
+		encoded += value;
+		encoded += '\n';
+	}
+}  // namespace
+
+EncodedEvent EncodeServerSentEvent(const std::string& data, const std::string& event, const std::string& id)
+{
+	std::string encoded;
+	encoded.reserve(data.size() + event.size() + id.size() + 32);
+	if (!event.empty())
+	{
+		AppendField(encoded, "event", event);
+	}
+	if (!id.empty())
+	{
+		AppendField(encoded, "id", id);
+	}
+	size_t line_start = 0;
+	while (true)
+	{
+		auto line_end = data.find('\n', line_start);
+		auto line = data.substr(line_start, line_end == std::string::npos ? std::string::npos : line_end - line_start);
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		AppendField(encoded, "data", line);
+		if (line_end == std::string::npos)
+		{
+			break;
+		}
+		line_start = line_end + 1;
+	}
+	encoded += '\n';
+	return std::make_shared<const std::vector<unsigned char>>(encoded.begin(), encoded.end());
+}
+
+EventStreamSession::EventStreamSession(EventLoop& event_loop, std::unique_ptr<jSocket> socket, const EventStreamSettings& settings)
+  : _event_loop(event_loop)
+  , _socket(std::move(socket))
+  , _settings(settings)
+{
+}
+
+void EventStreamSession::Start()
+{
+	_event_loop.Post(
+		[self = shared_from_this()]()
+		{
+			Spawn<bool>(self->Run(self), [](std::optional<bool>&&, std::exception_ptr) {});
+		});
+}
+
+bool EventStreamSession::Enqueue(const EncodedEvent& event)
+{
+	std::lock_guard<std::mutex> lock(_queue_mutex);
+	if (_closing || _dropped || !_is_open)
+	{
+		return false;
+	}
+	if (_queue.size() >= _settings.max_queued)
+	{
+		if (_settings.slow_subscribers == SlowSubscriberPolicy::Drop)
+		{
+			_dropped = true;
+			_event_loop.Notify(_socket->GetFd());
+			return false;
+		}
+		// an event partly written has to be finished, the one behind it is the oldest that can go. over TLS the
+		// front may sit in a record that has not left yet even when nothing of it was counted as written
+		auto oldest = _queue.begin() + (_front_started ? 1 : 0);
+		if (oldest != _queue.end())
+		{
+			_queue.erase(oldest);
+		}
+	}
+	_queue.push_back(event);
+	// a queue that already had events is being written out and needs no wake up
+	if (_queue.size() == 1)
+	{
+		_event_loop.Notify(_socket->GetFd());
+	}
+	return true;
+}
+
+void EventStreamSession::Close()
+{
+	std::lock_guard<std::mutex> lock(_queue_mutex);
+	_closing = true;
+	_event_loop.Notify(_socket->GetFd());
+}
+
+Task<bool> EventStreamSession::Run(std::shared_ptr<EventStreamSession> self)
+{
+	auto socket_fd = _socket->GetFd();
+	while (Flush())
+	{
+		bool has_output;
+		{
+			std::lock_guard<std::mutex> lock(_queue_mutex);
+			has_output = !_queue.empty();
+			if (_closing && !has_output)
+			{
+				break;
+			}
+		}
+		uint32_t events = EPOLLIN | EPOLLRDHUP | (has_output ? EPOLLOUT : 0);
+		auto ready = co_await _event_loop.WaitFor(socket_fd, events, _settings.heartbeat_interval);
+		if (ready)
+		{
+			if (!ReadAvailable())
+			{
+				break;
+			}
+			continue;
+		}
+		if (!has_output)
+		{
+			std::lock_guard<std::mutex> lock(_queue_mutex);
+			_queue.push_back(Heartbeat);
+		}
+	}
+	_socket->Shutdown();
+	_is_open = false;
+	co_return true;
+}
+
+bool EventStreamSession::Flush()
+{
+	std::lock_guard<std::mutex> lock(_queue_mutex);
+	if (_dropped)
+	{
+		return false;
+	}
+	while (!_queue.empty())
+	{
+		auto& event = *_queue.front();
+		_front_started = true;
+		auto bytes_written = _socket->TryWrite(event.data() + _front_written, event.size() - _front_written);
+		if (!bytes_written.has_value())
+		{
+			return false;
+		}
+		_front_written += bytes_written.value();
+		if (_front_written < event.size())
+		{
+			// the socket buffer is full, the loop waits for it to drain
+			return true;
+		}
+		_queue.pop_front();
+		_front_written = 0;
+		_front_started = false;
+	}
+	return true;
+}
+
+bool EventStreamSession::ReadAvailable()
+{
+	// the client has nothing to say on an event stream, whatever it sends is dropped. the wake up may have
+	// come from Notify, a read with nothing there gives TimeOut
+	while (true)
+	{
+		auto read_result = _socket->TryRead(ReadSize);
+		auto read_error = std::get_if<ReadError>(&read_result);
+		if (read_error)
+		{
+			return *read_error == ReadError::TimeOut;
+		}
+		if (std::get<std::vector<unsigned char>>(read_result).size() < ReadSize && !_socket->IsTls())
+		{
+			return true;
+		}
+	}
+}
+
+void EventBroker::Subscribe(const std::string& topic, const std::shared_ptr<EventStreamSession>& session)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_topics[topic].push_back(session);
+}
+
+size_t EventBroker::Publish(const std::string& topic, const std::string& data, const std::string& event, const std::string& id)
+{
+	auto encoded_event = EncodeServerSentEvent(data, event, id);
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto topic_itr = _topics.find(topic);
+	if (topic_itr == _topics.end())
+	{
+		return 0;
+	}
+	auto& subscribers = topic_itr->second;
+	size_t delivered = 0;
+	subscribers.erase(std::remove_if(subscribers.begin(),
+									 subscribers.end(),
+									 [&encoded_event, &delivered](auto& subscriber)
+									 {
+										 auto session = subscriber.lock();
+										 if (!session || !session->Enqueue(encoded_event))
+										 {
+											 return true;
+										 }
+										 delivered++;
+										 return false;
+									 }),
+					  subscribers.end());
+	if (subscribers.empty())
+	{
+		_topics.erase(topic_itr);
+	}
+	return delivered;
+}
+
+size_t EventBroker::SubscriberCount()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	size_t subscriber_count = 0;
+	for (auto& [topic, subscribers] : _topics)
+	{
+		subscriber_count += std::count_if(subscribers.begin(),
+										  subscribers.end(),
+										  [](auto& subscriber)
+										  {
+											  auto session = subscriber.lock();
+											  return session && session->IsOpen();
+										  });
+	}
+	return subscriber_count;
+}
@@ -0,0 +1,144 @@
+#include "FileCache.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <bit>
+#include <filesystem>
+#include <iostream>
+
+void FileCache::Init(size_t max_entries, size_t shard_count, std::chrono::milliseconds ttl)
+{
+	struct rlimit file_limit;
+	if (getrlimit(RLIMIT_NOFILE, &file_limit) == 0 && file_limit.rlim_cur != RLIM_INFINITY)
+	{
+		auto entry_limit = static_cast<size_t>(file_limit.rlim_cur / FILE_CACHE_FD_SHARE_DIVISOR);
+		if (max_entries > entry_limit)
+		{
+			std::cout << "[FileCache] - max_entries " << max_entries << " clamped to " << entry_limit << ", a quarter of the open file limit "
+					  << file_limit.rlim_cur << "\n";
+			max_entries = entry_limit;
+		}
+	}
+	_shard_count = std::bit_ceil(std::max<size_t>(shard_count, 1));
+	_shard_max_entries = max_entries / _shard_count;
+	_ttl = ttl;
+	if (_shard_max_entries == 0)
+	{
+		_shards.reset();
+		return;
+	}
+	_shards = std::make_unique<CacheShard[]>(_shard_count);
+}
+
+std::optional<StaticFile> FileCache::Open(const std::string& path)
+{
+	if (!_shards)
+	{
+		return StaticFile::Open(path);
+	}
+	auto key = Key(path);
+	auto now = std::chrono::steady_clock::now();
+	auto& shard = ShardFor(key);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto entry_itr = shard.entries.find(key);
+		if (entry_itr != shard.entries.end())
+		{
+			auto& entry = entry_itr->second;
+			if (now < entry.expires)
+			{
+				_hits++;
+				shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru_position);
+				return entry.file;
+			}
+			shard.lru.erase(entry.lru_position);
+			shard.entries.erase(entry_itr);
+		}
+	}
+	_misses++;
+	// opened outside the lock, a slow disk holds up no other path of the shard
+	auto static_file = StaticFile::Open(path);
+	if (!static_file.has_value())
+	{
+		return std::nullopt;
+	}
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto entry_itr = shard.entries.find(key);
+	if (entry_itr != shard.entries.end())
+	{
+		// another request opened it meanwhile, the newer open replaces it
+		shard.lru.erase(entry_itr->second.lru_position);
+		shard.entries.erase(entry_itr);
+	}
+	while (shard.entries.size() >= _shard_max_entries && !shard.lru.empty())
+	{
+		shard.entries.erase(shard.lru.back());
+		shard.lru.pop_back();
+	}
+	shard.lru.push_front(key);
+	shard.entries.emplace(key, CacheEntry{ static_file.value(), now + _ttl, shard.lru.begin() });
+	return static_file;
+}
+
+void FileCache::Invalidate(const std::string& path)
+{
+	if (!_shards)
+	{
+		return;
+	}
+	auto key = Key(path);
+	auto& shard = ShardFor(key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto entry_itr = shard.entries.find(key);
+	if (entry_itr != shard.entries.end())
+	{
+		shard.lru.erase(entry_itr->second.lru_position);
+		shard.entries.erase(entry_itr);
+	}
+}
+
+void FileCache::EvictExpired()
+{
+	if (!_shards)
+	{
+		return;
+	}
+	auto now = std::chrono::steady_clock::now();
+	for (size_t shard_index = 0; shard_index < _shard_count; shard_index++)
+	{
+		auto& shard = _shards[shard_index];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		for (auto entry_itr = shard.entries.begin(); entry_itr != shard.entries.end();)
+		{
+			if (now < entry_itr->second.expires)
+			{
+				entry_itr++;
+				continue;
+			}
+			shard.lru.erase(entry_itr->second.lru_position);
+			entry_itr = shard.entries.erase(entry_itr);
+		}
+	}
+}
+
+FileCacheStats FileCache::Stats() const
+{
+	FileCacheStats stats = { _hits, _misses, 0 };
+	for (size_t shard_index = 0; shard_index < (_shards ? _shard_count : 0); shard_index++)
+	{
+		std::lock_guard<std::mutex> lock(_shards[shard_index].mutex);
+		stats.entries += _shards[shard_index].entries.size();
+	}
+	return stats;
+}
+
+std::string FileCache::Key(const std::string& path)
+{
+	return std::filesystem::path(path).lexically_normal().string();
+}
+
+FileCache::CacheShard& FileCache::ShardFor(const std::string& key)
+{
+	return _shards[std::hash<std::string>{}(key) & (_shard_count - 1)];
+}
@@ -0,0 +1,73 @@
+#include "FileSyncer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <vector>
+
+FileSyncer::FileSyncer()
+  : _sync_thread(std::bind_front(&FileSyncer::Worker, this))
+{
+}
+
+FileSyncer::~FileSyncer()
+{
+	_sync_thread.request_stop();
+	_sync_thread.join();
+	while (auto pending = _pending.TryReceive(std::chrono::milliseconds(0)))
+	{
+		SyncBatch(std::move(pending.value()));
+	}
+}
+
+void FileSyncer::Sync(int fd, const std::filesystem::path& directory)
+{
+	_pending.Send(PendingSync{ fd, directory });
+}
+
+void FileSyncer::Worker(std::stop_token stop_token)
+{
+	while (!stop_token.stop_requested())
+	{
+		auto pending = _pending.TryReceive(std::chrono::milliseconds(500));
+		if (pending.has_value())
+		{
+			SyncBatch(std::move(pending.value()));
+		}
+	}
+}
+
+void FileSyncer::SyncBatch(PendingSync&& first)
+{
+	std::vector<PendingSync> batch;
+	batch.push_back(std::move(first));
+	while (auto pending = _pending.TryReceive(std::chrono::milliseconds(0)))
+	{
+		batch.push_back(std::move(pending.value()));
+	}
+	std::set<std::filesystem::path> directories;
+	for (auto& pending : batch)
+	{
+		if (fsync(pending.fd) != 0)
+		{
+			std::cout << "[FileSyncer] - Unable to sync a file in " << pending.directory << "\n";
+		}
+		close(pending.fd);
+		directories.insert(pending.directory);
+	}
+	// the renames that published the files are only durable once their directories are synced
+	for (auto& directory : directories)
+	{
+		int directory_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (directory_fd < 0)
+		{
+			continue;
+		}
+		fsync(directory_fd);
+		close(directory_fd);
+	}
+}
@@ -0,0 +1,526 @@
+#include "Hpack.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+	const std::array<HeaderField, 61> StaticTable = { {
+		{ ":authority", "" },
+		{ ":method", "GET" },
+		{ ":method", "POST" },
+		{ ":path", "/" },
+		{ ":path", "/index.html" },
+		{ ":scheme", "http" },
+		{ ":scheme", "https" },
+		{ ":status", "200" },
+		{ ":status", "204" },
+		{ ":status", "206" },
+		{ ":status", "304" },
+		{ ":status", "400" },
+		{ ":status", "404" },
+		{ ":status", "500" },
+		{ "accept-charset", "" },
+		{ "accept-encoding", "gzip, deflate" },
+		{ "accept-language", "" },
+		{ "accept-ranges", "" },
+		{ "accept", "" },
+		{ "access-control-allow-origin", "" },
+		{ "age", "" },
+		{ "allow", "" },
+		{ "authorization", "" },
+		{ "cache-control", "" },
+		{ "content-disposition", "" },
+		{ "content-encoding", "" },
+		{ "content-language", "" },
+		{ "content-length", "" },
+		{ "content-location", "" },
+		{ "content-range", "" },
+		{ "content-type", "" },
+		{ "cookie", "" },
+		{ "date", "" },
+		{ "etag", "" },
+		{ "expect", "" },
+		{ "expires", "" },
+		{ "from", "" },
+		{ "host", "" },
+		{ "if-match", "" },
+		{ "if-modified-since", "" },
+		{ "if-none-match", "" },
+		{ "if-range", "" },
+		{ "if-unmodified-since", "" },
+		{ "last-modified", "" },
+		{ "link", "" },
+		{ "location", "" },
+		{ "max-forwards", "" },
+		{ "proxy-authenticate", "" },
+		{ "proxy-authorization", "" },
+		{ "range", "" },
+		{ "referer", "" },
+		{ "refresh", "" },
+		{ "retry-after", "" },
+		{ "server", "" },
+		{ "set-cookie", "" },
+		{ "strict-transport-security", "" },
+		{ "transfer-encoding", "" },
+		{ "user-agent", "" },
+		{ "vary", "" },
+		{ "via", "" },
+		{ "www-authenticate", "" },
+	} };
+
+	struct HuffmanCode
+	{
+		uint32_t code;
+		uint8_t bits;
+	};
+
+	// RFC 7541 appendix B, indexed by symbol, entry 256 is EOS
+	const std::array<HuffmanCode, 257> HuffmanCodes = { {
+		{ 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 }, { 0xfffffe4, 28 }, { 0xfffffe5, 28 },
+		{ 0xfffffe6, 28 }, { 0xfffffe7, 28 }, { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+		{ 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 }, { 0xfffffed, 28 }, { 0xfffffee, 28 },
+		{ 0xfffffef, 28 }, { 0xffffff0, 28 }, { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+		{ 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 }, { 0xffffff8, 28 }, { 0xffffff9, 28 },
+		{ 0xffffffa, 28 }, { 0xffffffb, 28 }, { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+		{ 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 }, { 0x3fa, 10 }, { 0x3fb, 10 },
+		{ 0xf9, 8 }, { 0x7fb, 11 }, { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+		{ 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 }, { 0x1a, 6 }, { 0x1b, 6 },
+		{ 0x1c, 6 }, { 0x1d, 6 }, { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+		{ 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 }, { 0x1ffa, 13 }, { 0x21, 6 },
+		{ 0x5d, 7 }, { 0x5e, 7 }, { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+		{ 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 }, { 0x67, 7 }, { 0x68, 7 },
+		{ 0x69, 7 }, { 0x6a, 7 }, { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+		{ 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 }, { 0xfc, 8 }, { 0x73, 7 },
+		{ 0xfd, 8 }, { 0x1ffb, 13 }, { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+		{ 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 }, { 0x24, 6 }, { 0x5, 5 },
+		{ 0x25, 6 }, { 0x26, 6 }, { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+		{ 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 }, { 0x2b, 6 }, { 0x76, 7 },
+		{ 0x2c, 6 }, { 0x8, 5 }, { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+		{ 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 }, { 0x7fc, 11 }, { 0x3ffd, 14 },
+		{ 0x1ffd, 13 }, { 0xffffffc, 28 }, { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+		{ 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 }, { 0x3fffd6, 22 }, { 0x7fffda, 23 },
+		{ 0x7fffdb, 23 }, { 0x7fffdc, 23 }, { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+		{ 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 }, { 0xffffee, 24 }, { 0x7fffe1, 23 },
+		{ 0x7fffe2, 23 }, { 0x7fffe3, 23 }, { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+		{ 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 }, { 0x3fffda, 22 }, { 0x1fffdd, 21 },
+		{ 0xfffe9, 20 }, { 0x3fffdb, 22 }, { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+		{ 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 }, { 0x1fffdf, 21 }, { 0x3fffdf, 22 },
+		{ 0x7fffeb, 23 }, { 0x7fffec, 23 }, { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+		{ 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 }, { 0xfffea, 20 }, { 0x3fffe2, 22 },
+		{ 0x3fffe3, 22 }, { 0x3fffe4, 22 }, { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+		{ 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 }, { 0x3fffe7, 22 }, { 0x7ffff2, 23 },
+		{ 0x3fffe8, 22 }, { 0x1ffffec, 25 }, { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+		{ 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 }, { 0x7fff2, 19 }, { 0x1fffe3, 21 },
+		{ 0x3ffffe6, 26 }, { 0x7ffffe0, 27 }, { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+		{ 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 }, { 0xffffffd, 28 }, { 0x7ffffe3, 27 },
+		{ 0x7ffffe4, 27 }, { 0x7ffffe5, 27 }, { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+		{ 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 }, { 0x3fffea, 22 }, { 0x3fffeb, 22 },
+		{ 0x1ffffee, 25 }, { 0x1ffffef, 25 }, { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+		{ 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 }, { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 },
+		{ 0x7ffffe9, 27 }, { 0x7ffffea, 27 }, { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+		{ 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 }, { 0x3fffffff, 30 },
+	} };
+
+	constexpr int HUFFMAN_EOS = 256;
+
+	struct HuffmanNode
+	{
+		int children[2] = { -1, -1 };
+		int symbol = -1;
+	};
+
+	const std::vector<HuffmanNode>& HuffmanTree()
+	{
+		static const std::vector<HuffmanNode> tree = []
+		{
+			std::vector<HuffmanNode> nodes(1);
+			for (int symbol = 0; symbol < static_cast<int>(HuffmanCodes.size()); symbol++)
+			{
+				auto [code, bits] = HuffmanCodes[symbol];
+				int node = 0;
+				for (int bit = bits - 1; bit >= 0; bit--)
+				{
+					auto direction = (code >> bit) & 1;
+					if (nodes[node].children[direction] < 0)
+					{
+						nodes[node].children[direction] = static_cast<int>(nodes.size());
+						nodes.emplace_back();
+					}
+					node = nodes[node].children[direction];
+				}
+				nodes[node].symbol = symbol;
+			}
+			return nodes;
+		}();
+		return tree;
+	}
+
+	// fields whose values rarely repeat are not worth a dynamic table slot
+	bool ShouldIndex(const std::string& name)
+	{
+		return name != "content-length" && name != "content-range" && name != "etag" && name != "last-modified" && name != "set-cookie";
+	}
+}  // namespace
+
+void HpackTable::Add(const std::string& name, const std::string& value)
+{
+	auto entry_size = name.size() + value.size() + HPACK_ENTRY_OVERHEAD;
+	if (entry_size > _max_size)
+	{
+		// an entry larger than the table empties it (RFC 7541 section 4.4)
+		_entries.clear();
+		_size = 0;
+		return;
+	}
+	_entries.emplace_front(name, value);
+	_size += entry_size;
+	Evict();
+}
+
+void HpackTable::SetMaxSize(size_t max_size)
+{
+	_max_size = max_size;
+	Evict();
+}
+
+void HpackTable::Evict()
+{
+	while (_size > _max_size && !_entries.empty())
+	{
+		auto& oldest = _entries.back();
+		_size -= oldest.first.size() + oldest.second.size() + HPACK_ENTRY_OVERHEAD;
+		_entries.pop_back();
+	}
+}
+
+std::optional<HeaderField> HpackTable::Get(size_t index) const
+{
+	if (index == 0)
+	{
+		return std::nullopt;
+	}
+	if (index <= StaticTable.size())
+	{
+		return StaticTable[index - 1];
+	}
+	auto dynamic_index = index - StaticTable.size() - 1;
+	if (dynamic_index >= _entries.size())
+	{
+		return std::nullopt;
+	}
+	return _entries[dynamic_index];
+}
+
+std::optional<std::pair<size_t, bool>> HpackTable::Find(const std::string& name, const std::string& value) const
+{
+	std::optional<std::pair<size_t, bool>> name_match;
+	for (size_t i = 0; i < StaticTable.size(); i++)
+	{
+		if (StaticTable[i].first != name)
+		{
+			continue;
+		}
+		if (StaticTable[i].second == value)
+		{
+			return std::make_pair(i + 1, true);
+		}
+		if (!name_match.has_value())
+		{
+			name_match = std::make_pair(i + 1, false);
+		}
+	}
+	for (size_t i = 0; i < _entries.size(); i++)
+	{
+		if (_entries[i].first != name)
+		{
+			continue;
+		}
+		if (_entries[i].second == value)
+		{
+			return std::make_pair(StaticTable.size() + i + 1, true);
+		}
+		if (!name_match.has_value())
+		{
+			name_match = std::make_pair(StaticTable.size() + i + 1, false);
+		}
+	}
+	return name_match;
+}
+
+void Hpack::EncodeInteger(uint64_t value, uint8_t prefix_bits, uint8_t first_byte, std::vector<unsigned char>& output)
+{
+	uint64_t prefix_max = (1u << prefix_bits) - 1;
+	if (value < prefix_max)
+	{
+		output.push_back(static_cast<unsigned char>(first_byte | value));
+		return;
+	}
+	output.push_back(static_cast<unsigned char>(first_byte | prefix_max));
+	value -= prefix_max;
+	while (value >= 128)
+	{
+		output.push_back(static_cast<unsigned char>((value % 128) + 128));
+		value /= 128;
+	}
+	output.push_back(static_cast<unsigned char>(value));
+}
+
+std::optional<uint64_t> Hpack::DecodeInteger(const unsigned char*& position, const unsigned char* end, uint8_t prefix_bits)
+{
+	if (position >= end)
+	{
+		return std::nullopt;
+	}
+	uint64_t prefix_max = (1u << prefix_bits) - 1;
+	uint64_t value = *position & prefix_max;
+	position++;
+	if (value < prefix_max)
+	{
+		return value;
+	}
+	unsigned shift = 0;
+	while (position < end)
+	{
+		auto byte = *position++;
+		if (shift > 56)
+		{
+			return std::nullopt;
+		}
+		value += static_cast<uint64_t>(byte & 0x7f) << shift;
+		shift += 7;
+		if ((byte & 0x80) == 0)
+		{
+			return value;
+		}
+	}
+	return std::nullopt;
+}
+
+size_t Hpack::HuffmanEncodedLength(const std::string& value)
+{
+	size_t bits = 0;
+	for (unsigned char c : value)
+	{
+		bits += HuffmanCodes[c].bits;
+	}
+	return (bits + 7) / 8;
+}
+
+void Hpack::HuffmanEncode(const std::string& value, std::vector<unsigned char>& output)
+{
+	uint64_t pending = 0;
+	int pending_bits = 0;
+	for (unsigned char c : value)
+	{
+		auto [code, bits] = HuffmanCodes[c];
+		pending = (pending << bits) | code;
+		pending_bits += bits;
+		while (pending_bits >= 8)
+		{
+			pending_bits -= 8;
+			output.push_back(static_cast<unsigned char>(pending >> pending_bits));
+		}
+	}
+	if (pending_bits > 0)
+	{
+		// pad with the most significant bits of EOS, which are all ones
+		pending = (pending << (8 - pending_bits)) | (0xff >> pending_bits);
+		output.push_back(static_cast<unsigned char>(pending));
+	}
+}
+
+std::optional<std::string> Hpack::HuffmanDecode(const unsigned char* data, size_t length)
+{
+	auto& tree = HuffmanTree();
+	std::string decoded;
+	int node = 0;
+	int bits_since_symbol = 0;
+	bool padding_all_ones = true;
+	for (size_t i = 0; i < length; i++)
+	{
+		for (int bit = 7; bit >= 0; bit--)
+		{
+			auto direction = (data[i] >> bit) & 1;
+			node = tree[node].children[direction];
+			if (node < 0)
+			{
+				return std::nullopt;
+			}
+			bits_since_symbol++;
+			padding_all_ones = padding_all_ones && direction == 1;
+			if (tree[node].symbol >= 0)
+			{
+				if (tree[node].symbol == HUFFMAN_EOS)
+				{
+					return std::nullopt;
+				}
+				decoded.push_back(static_cast<char>(tree[node].symbol));
+				node = 0;
+				bits_since_symbol = 0;
+				padding_all_ones = true;
+			}
+		}
+	}
+	// padding longer than 7 bits or not a prefix of EOS is a decoding error
+	if (bits_since_symbol > 7 || !padding_all_ones)
+	{
+		return std::nullopt;
+	}
+	return decoded;
+}
+
+void Hpack::EncodeString(const std::string& value, std::vector<unsigned char>& output)
+{
+	auto huffman_length = HuffmanEncodedLength(value);
+	if (huffman_length < value.size())
+	{
+		EncodeInteger(huffman_length, 7, 0x80, output);
+		HuffmanEncode(value, output);
+		return;
+	}
+	EncodeInteger(value.size(), 7, 0x00, output);
+	output.insert(output.end(), value.begin(), value.end());
+}
+
+std::optional<std::string> Hpack::DecodeString(const unsigned char*& position, const unsigned char* end)
+{
+	if (position >= end)
+	{
+		return std::nullopt;
+	}
+	bool is_huffman = (*position & 0x80) != 0;
+	auto length = DecodeInteger(position, end, 7);
+	if (!length.has_value() || length.value() > static_cast<uint64_t>(end - position))
+	{
+		return std::nullopt;
+	}
+	auto string_start = position;
+	position += length.value();
+	if (is_huffman)
+	{
+		return HuffmanDecode(string_start, length.value());
+	}
+	return std::string(string_start, position);
+}
+
+std::optional<HeaderList> HpackDecoder::Decode(const unsigned char* data, size_t length)
+{
+	HeaderList headers;
+	auto position = data;
+	auto end = data + length;
+	bool header_seen = false;
+	while (position < end)
+	{
+		auto first_byte = *position;
+		if (first_byte & 0x80)
+		{
+			// indexed header field
+			auto index = Hpack::DecodeInteger(position, end, 7);
+			if (!index.has_value())
+			{
+				return std::nullopt;
+			}
+			auto field = _table.Get(index.value());
+			if (!field.has_value())
+			{
+				return std::nullopt;
+			}
+			headers.emplace_back(field.value());
+			header_seen = true;
+			continue;
+		}
+		if ((first_byte & 0xe0) == 0x20)
+		{
+			// dynamic table size update, only allowed before the first field
+			auto max_size = Hpack::DecodeInteger(position, end, 5);
+			if (!max_size.has_value() || max_size.value() > _max_table_size || header_seen)
+			{
+				return std::nullopt;
+			}
+			_table.SetMaxSize(max_size.value());
+			continue;
+		}
+		// literal header field with incremental indexing, without indexing or never indexed
+		bool add_to_table = (first_byte & 0xc0) == 0x40;
+		auto index = Hpack::DecodeInteger(position, end, add_to_table ? 6 : 4);
+		if (!index.has_value())
+		{
+			return std::nullopt;
+		}
+		std::string name;
+		if (index.value() == 0)
+		{
+			auto literal_name = Hpack::DecodeString(position, end);
+			if (!literal_name.has_value())
+			{
+				return std::nullopt;
+			}
+			name = std::move(literal_name.value());
+		}
+		else
+		{
+			auto field = _table.Get(index.value());
+			if (!field.has_value())
+			{
+				return std::nullopt;
+			}
+			name = field->first;
+		}
+		auto value = Hpack::DecodeString(position, end);
+		if (!value.has_value())
+		{
+			return std::nullopt;
+		}
+		if (add_to_table)
+		{
+			_table.Add(name, value.value());
+		}
+		headers.emplace_back(std::move(name), std::move(value.value()));
+		header_seen = true;
+	}
+	return headers;
+}
+
+void HpackEncoder::SetMaxTableSize(size_t max_size)
+{
+	auto table_size = std::min(max_size, HPACK_DEFAULT_TABLE_SIZE);
+	if (table_size != _table.GetMaxSize())
+	{
+		_pending_table_size = table_size;
+	}
+}
+
+void HpackEncoder::Encode(const HeaderList& headers, std::vector<unsigned char>& output)
+{
+	if (_pending_table_size.has_value())
+	{
+		_table.SetMaxSize(_pending_table_size.value());
+		Hpack::EncodeInteger(_pending_table_size.value(), 5, 0x20, output);
+		_pending_table_size.reset();
+	}
+	for (auto& [name, value] : headers)
+	{
+		auto match = _table.Find(name, value);
+		if (match.has_value() && match->second)
+		{
+			Hpack::EncodeInteger(match->first, 7, 0x80, output);
+			continue;
+		}
+		auto name_index = match.has_value() ? match->first : 0;
+		if (ShouldIndex(name))
+		{
+			Hpack::EncodeInteger(name_index, 6, 0x40, output);
+			_table.Add(name, value);
+		}
+		else
+		{
+			Hpack::EncodeInteger(name_index, 4, 0x00, output);
+		}
+		if (name_index == 0)
+		{
+			Hpack::EncodeString(name, output);
+		}
+		Hpack::EncodeString(value, output);
+	}
+}
@@ -0,0 +1,897 @@
+#include "Http2Session.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	const std::string ConnectionPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+	constexpr uint8_t FLAG_END_STREAM = 0x1;
+	constexpr uint8_t FLAG_ACK = 0x1;
+	constexpr uint8_t FLAG_END_HEADERS = 0x4;
+	constexpr uint8_t FLAG_PADDED = 0x8;
+	constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+	constexpr uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+	constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+	constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+	constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+	constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+	constexpr int64_t MAX_WINDOW_SIZE = 0x7fffffff;
+	constexpr uint32_t MAX_ALLOWED_FRAME_SIZE = 0xffffff;
+
+	uint32_t ReadUint32(const unsigned char* data)
+	{
+		return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) |
+			   static_cast<uint32_t>(data[3]);
+	}
+
+	void WriteUint32(uint32_t value, std::vector<unsigned char>& output)
+	{
+		output.push_back(static_cast<unsigned char>(value >> 24));
+		output.push_back(static_cast<unsigned char>(value >> 16));
+		output.push_back(static_cast<unsigned char>(value >> 8));
+		output.push_back(static_cast<unsigned char>(value));
+	}
+
+	void WriteSetting(uint16_t identifier, uint32_t value, std::vector<unsigned char>& output)
+	{
+		output.push_back(static_cast<unsigned char>(identifier >> 8));
+		output.push_back(static_cast<unsigned char>(identifier));
+		WriteUint32(value, output);
+	}
+
+	std::optional<std::vector<unsigned char>> DecodeBase64Url(const std::string& encoded)
+	{
+		std::vector<unsigned char> decoded;
+		uint32_t accumulator = 0;
+		int bits = 0;
+		for (auto c : encoded)
+		{
+			int value;
+			if (c >= 'A' && c <= 'Z')
+				value = c - 'A';
+			else if (c >= 'a' && c <= 'z')
+				value = c - 'a' + 26;
+			else if (c >= '0' && c <= '9')
+				value = c - '0' + 52;
+			else if (c == '-' || c == '+')
+				value = 62;
+			else if (c == '_' || c == '/')
+				value = 63;
+			else if (c == '=')
+				break;
+			else
+				return std::nullopt;
+			accumulator = (accumulator << 6) | value;
+			bits += 6;
+			if (bits >= 8)
+			{
+				bits -= 8;
+				decoded.push_back(static_cast<unsigned char>(accumulator >> bits));
+			}
+		}
+		return decoded;
+	}
+
+	// nullopt when a pseudo-header the request cannot do without is missing
+	std::optional<HttpRequest> ReadRequest(const HeaderList& headers)
+	{
+		HttpRequest request;
+		request.SetVersion("HTTP/2.0");
+		std::string method;
+		std::string target;
+		for (auto& [name, value] : headers)
+		{
+			if (name == ":method")
+			{
+				method = value;
+			}
+			else if (name == ":path")
+			{
+				target = value;
+			}
+			else if (name == ":authority")
+			{
+				request.SetHeader("host", value);
+			}
+			else if (!name.empty() && name[0] != ':')
+			{
+				// repeated fields are folded, cookie crumbs are rejoined with "; "
+				auto existing = request.GetHeader(name);
+				auto separator = name == "cookie" ? "; " : ", ";
+				request.SetHeader(name, existing.has_value() ? existing.value() + separator + value : value);
+			}
+		}
+		if (method.empty() || target.empty())
+		{
+			return std::nullopt;
+		}
+		request.SetMethod(method);
+		request.SetTarget(target);
+		request.isValid = true;
+		return request;
+	}
+
+	// nullopt when the request does not declare its length
+	std::optional<uintmax_t> ContentLength(const HttpRequest& request)
+	{
+		auto content_length = request.GetHeader("content-length");
+		if (!content_length.has_value())
+		{
+			return std::nullopt;
+		}
+		try
+		{
+			size_t parsed_length = 0;
+			auto length = std::stoull(content_length.value(), &parsed_length);
+			return parsed_length == content_length->size() ? std::optional<uintmax_t>(length) : std::nullopt;
+		}
+		catch (...)
+		{
+			return std::nullopt;
+		}
+	}
+
+	// connection-specific fields are not allowed in HTTP/2 (RFC 7540 section 8.1.2.2)
+	bool IsConnectionSpecific(const std::string& name)
+	{
+		return name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" ||
+			   name == "upgrade";
+	}
+}  // namespace
+
+Http2Session::Http2Session(const SendFunction& send_function, const RequestHandler& request_handler)
+  : _send_function(send_function)
+  , _request_handler(request_handler)
+{
+}
+
+Http2Session::~Http2Session()
+{
+	Shutdown();
+}
+
+bool Http2Session::IsPreface(const std::vector<unsigned char>& data_buffer)
+{
+	return data_buffer.size() >= ConnectionPreface.size() && std::equal(ConnectionPreface.begin(), ConnectionPreface.end(), data_buffer.begin());
+}
+
+bool Http2Session::IsUpgradeRequest(const HttpRequest& request)
+{
+	auto upgrade = request.GetHeader("Upgrade").value_or("");
+	return upgrade.find("h2c") != std::string::npos && request.GetHeader("HTTP2-Settings").has_value();
+}
+
+std::vector<unsigned char> Http2Session::UpgradeResponse()
+{
+	HttpResponse response;
+	response.SetStatusCode(101);
+	response.SetHeader("connection", "Upgrade");
+	response.SetHeader("upgrade", "h2c");
+	return response.ToBuffer();
+}
+
+void Http2Session::Start()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	SendSettings();
+	// open the connection window beyond the 64KB the peer assumes
+	SendWindowUpdate(0, HTTP2_LOCAL_WINDOW_SIZE - HTTP2_DEFAULT_WINDOW_SIZE);
+	_receive_window = HTTP2_LOCAL_WINDOW_SIZE;
+}
+
+void Http2Session::StartFromUpgrade(HttpRequest&& request)
+{
+	auto settings = DecodeBase64Url(request.GetHeader("HTTP2-Settings").value_or(""));
+	Start();
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!settings.has_value() || settings->size() % 6 != 0 || !ApplySettings(settings->data(), settings->size()))
+	{
+		SendGoAway(Http2Error::ProtocolError);
+		return;
+	}
+	// the upgraded request is stream 1, already half-closed by the client
+	auto& stream = _streams[1];
+	stream.id = 1;
+	stream.request = std::move(request);
+	stream.request_complete = true;
+	stream.send_window = _peer_initial_window_size;
+	stream.receive_window = 0;
+	_last_stream_id = 1;
+	auto content_length = ContentLength(stream.request);
+	if (content_length.value_or(0) > 0 && RejectBody(stream, content_length))
+	{
+		return;
+	}
+	Dispatch(stream);
+}
+
+bool Http2Session::Receive(const std::vector<unsigned char>& data_buffer)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_is_closed)
+	{
+		return false;
+	}
+	_input_buffer.insert(_input_buffer.end(), data_buffer.begin(), data_buffer.end());
+	size_t offset = 0;
+	if (!_preface_received)
+	{
+		auto compared = std::min(_input_buffer.size(), ConnectionPreface.size());
+		if (!std::equal(_input_buffer.begin(), _input_buffer.begin() + compared, ConnectionPreface.begin()))
+		{
+			return SendGoAway(Http2Error::ProtocolError);
+		}
+		if (compared < ConnectionPreface.size())
+		{
+			return true;
+		}
+		offset = ConnectionPreface.size();
+		_preface_received = true;
+	}
+	while (_input_buffer.size() - offset >= HTTP2_FRAME_HEADER_SIZE)
+	{
+		auto frame = _input_buffer.data() + offset;
+		uint32_t length = (static_cast<uint32_t>(frame[0]) << 16) | (static_cast<uint32_t>(frame[1]) << 8) | frame[2];
+		if (length > HTTP2_DEFAULT_MAX_FRAME_SIZE)
+		{
+			return SendGoAway(Http2Error::FrameSizeError);
+		}
+		if (_input_buffer.size() - offset < HTTP2_FRAME_HEADER_SIZE + length)
+		{
+			break;
+		}
+		auto type = static_cast<Http2FrameType>(frame[3]);
+		auto flags = frame[4];
+		auto stream_id = ReadUint32(frame + 5) & 0x7fffffff;
+		if (!ProcessFrame(type, flags, stream_id, frame + HTTP2_FRAME_HEADER_SIZE, length))
+		{
+			_input_buffer.clear();
+			return false;
+		}
+		offset += HTTP2_FRAME_HEADER_SIZE + length;
+	}
+	_input_buffer.erase(_input_buffer.begin(), _input_buffer.begin() + offset);
+	return true;
+}
+
+bool Http2Session::ProcessFrame(Http2FrameType type, uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length)
+{
+	if (_continuation_stream_id != 0 && (type != Http2FrameType::Continuation || stream_id != _continuation_stream_id))
+	{
+		return SendGoAway(Http2Error::ProtocolError);
+	}
+	switch (type)
+	{
+	case Http2FrameType::Data:
+		return OnData(flags, stream_id, payload, length);
+
+	case Http2FrameType::Headers:
+		return OnHeaders(flags, stream_id, payload, length);
+
+	case Http2FrameType::Continuation:
+		return OnContinuation(flags, stream_id, payload, length);
+
+	case Http2FrameType::Settings:
+		if (stream_id != 0)
+		{
+			return SendGoAway(Http2Error::ProtocolError);
+		}
+		return OnSettings(flags, payload, length);
+
+	case Http2FrameType::WindowUpdate:
+		return OnWindowUpdate(stream_id, payload, length);
+
+	case Http2FrameType::Ping:
+		if (stream_id != 0)
+		{
+			return SendGoAway(Http2Error::ProtocolError);
+		}
+		if (length != 8)
+		{
+			return SendGoAway(Http2Error::FrameSizeError);
+		}
+		if ((flags & FLAG_ACK) == 0)
+		{
+			SendFrame(Http2FrameType::Ping, FLAG_ACK, 0, payload, length);
+		}
+		return true;
+
+	case Http2FrameType::RstStream:
+		if (stream_id == 0)
+		{
+			return SendGoAway(Http2Error::ProtocolError);
+		}
+		if (length != 4)
+		{
+			return SendGoAway(Http2Error::FrameSizeError);
+		}
+		_streams.erase(stream_id);
+		_send_queue.remove(stream_id);
+		return true;
+
+	case Http2FrameType::GoAway:
+		_is_closed = true;
+		return false;
+
+	case Http2FrameType::PushPromise:
+		// clients never push
+		return SendGoAway(Http2Error::ProtocolError);
+
+	case Http2FrameType::Priority:
+	default:
+		// prioritisation is advisory, unknown frame types must be ignored
+		return true;
+	}
+}
+
+bool Http2Session::OnHeaders(uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length)
+{
+	if (stream_id == 0 || stream_id % 2 == 0)
+	{
+		return SendGoAway(Http2Error::ProtocolError);
+	}
+	size_t padding = 0;
+	if (flags & FLAG_PADDED)
+	{
+		if (length < 1)
+		{
+			return SendGoAway(Http2Error::FrameSizeError);
+		}
+		padding = payload[0];
+		payload++;
+		length--;
+	}
+	if (flags & FLAG_PRIORITY)
+	{
+		if (length < 5)
+		{
+			return SendGoAway(Http2Error::FrameSizeError);
+		}
+		payload += 5;
+		length -= 5;
+	}
+	if (padding > length)
+	{
+		return SendGoAway(Http2Error::ProtocolError);
+	}
+	_header_block.assign(payload, payload + length - padding);
+	if (flags & FLAG_END_HEADERS)
+	{
+		return OnHeaderBlock(stream_id, flags & FLAG_END_STREAM);
+	}
+	_continuation_stream_id = stream_id;
+	_continuation_end_stream = flags & FLAG_END_STREAM;
+	return true;
+}
+
+bool Http2Session::OnContinuation(uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length)
+{
+	if (_continuation_stream_id == 0 || stream_id != _continuation_stream_id)
+	{
+		return SendGoAway(Http2Error::ProtocolError);
+	}
+	_header_block.insert(_header_block.end(), payload, payload + length);
+	if (flags & FLAG_END_HEADERS)
+	{
+		_continuation_stream_id = 0;
+		return OnHeaderBlock(stream_id, _continuation_end_stream);
+	}
+	return true;
+}
+
+bool Http2Session::OnHeaderBlock(uint32_t stream_id, bool end_stream)
+{
+	// the block is always decoded to keep the HPACK context in sync
+	auto headers = _decoder.Decode(_header_block.data(), _header_block.size());
+	_header_block.clear();
+	if (!headers.has_value())
+	{
+		return SendGoAway(Http2Error::CompressionError);
+	}
+	auto stream_itr = _streams.find(stream_id);
+	if (stream_itr != _streams.end())
+	{
+		// trailers: only valid as the final frame of an open request
+		if (stream_itr->second.request_complete || !end_stream)
+		{
+			SendRstStream(stream_id, Http2Error::StreamClosed);
+			return true;
+		}
+		stream_itr->second.request_complete = true;
+		Dispatch(stream_itr->second);
+		return true;
+	}
+	if (stream_id <= _last_stream_id)
+	{
+		return SendGoAway(Http2Error::ProtocolError);
+	}
+	_last_stream_id = stream_id;
+	if (_streams.size() >= HTTP2_MAX_CONCURRENT_STREAMS)
+	{
+		SendRstStream(stream_id, Http2Error::RefusedStream);
+		return true;
+	}
+	auto request = ReadRequest(headers.value());
+	if (!request.has_value())
+	{
+		SendRstStream(stream_id, Http2Error::ProtocolError);
+		return true;
+	}
+	auto& stream = _streams[stream_id];
+	stream.id = stream_id;
+	stream.request = std::move(request.value());
+	stream.send_window = _peer_initial_window_size;
+	stream.receive_window = HTTP2_LOCAL_WINDOW_SIZE;
+	stream.request_complete = end_stream;
+	if (end_stream)
+	{
+		Dispatch(stream);
+		return true;
+	}
+	// turned down from its headers as an HTTP/1.1 request would be, before any of the body is buffered
+	auto content_length = ContentLength(stream.request);
+	if (content_length.value_or(1) > 0)
+	{
+		RejectBody(stream, content_length);
+	}
+	return true;
+}
+
+bool Http2Session::OnData(uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length)
+{
+	if (stream_id == 0)
+	{
+		return SendGoAway(Http2Error::ProtocolError);
+	}
+	// padding counts against flow control, so account for the full length
+	_receive_window -= length;
+	if (_receive_window < HTTP2_LOCAL_WINDOW_SIZE / 2)
+	{
+		SendWindowUpdate(0, static_cast<uint32_t>(HTTP2_LOCAL_WINDOW_SIZE - _receive_window));
+		_receive_window = HTTP2_LOCAL_WINDOW_SIZE;
+	}
+	size_t padding = 0;
+	if (flags & FLAG_PADDED)
+	{
+		if (length < 1)
+		{
+			return SendGoAway(Http2Error::FrameSizeError);
+		}
+		padding = payload[0] + 1;
+		if (padding > length)
+		{
+			return SendGoAway(Http2Error::ProtocolError);
+		}
+	}
+	auto stream_itr = _streams.find(stream_id);
+	if (stream_itr == _streams.end() && stream_id <= _last_stream_id)
+	{
+		// sent before the client saw the stream being reset, ignored (RFC 7540 section 5.1)
+		return true;
+	}
+	if (stream_itr == _streams.end() || stream_itr->second.request_complete)
+	{
+		SendRstStream(stream_id, Http2Error::StreamClosed);
+		return true;
+	}
+	auto& stream = stream_itr->second;
+	if (stream.request_refused)
+	{
+		// already answered, the rest of the body is read and dropped until the reset is sent
+		stream.request_complete = (flags & FLAG_END_STREAM) != 0;
+		return true;
+	}
+	auto data_start = payload + ((flags & FLAG_PADDED) ? 1 : 0);
+	auto data_end = payload + length - (padding > 0 ? padding - 1 : 0);
+	stream.request_complete = (flags & FLAG_END_STREAM) != 0;
+	if (RejectBody(stream, stream.request_body.size() + (data_end - data_start)))
+	{
+		return true;
+	}
+	stream.request_body.insert(stream.request_body.end(), data_start, data_end);
+	stream.receive_window -= length;
+	if (stream.request_complete)
+	{
+		Dispatch(stream);
+		return true;
+	}
+	if (stream.receive_window < HTTP2_LOCAL_WINDOW_SIZE / 2)
+	{
+		SendWindowUpdate(stream_id, static_cast<uint32_t>(HTTP2_LOCAL_WINDOW_SIZE - stream.receive_window));
+		stream.receive_window = HTTP2_LOCAL_WINDOW_SIZE;
+	}
+	return true;
+}
+
+bool Http2Session::OnSettings(uint8_t flags, const unsigned char* payload, size_t length)
+{
+	if (flags & FLAG_ACK)
+	{
+		if (length != 0)
+		{
+			return SendGoAway(Http2Error::FrameSizeError);
+		}
+		return true;
+	}
+	if (length % 6 != 0)
+	{
+		return SendGoAway(Http2Error::FrameSizeError);
+	}
+	if (!ApplySettings(payload, length))
+	{
+		return false;
+	}
+	SendFrame(Http2FrameType::Settings, FLAG_ACK, 0, nullptr, 0);
+	Flush();
+	return true;
+}
+
+bool Http2Session::ApplySettings(const unsigned char* payload, size_t length)
+{
+	for (size_t offset = 0; offset + 6 <= length; offset += 6)
+	{
+		uint16_t identifier = (static_cast<uint16_t>(payload[offset]) << 8) | payload[offset + 1];
+		uint32_t value = ReadUint32(payload + offset + 2);
+		switch (identifier)
+		{
+		case SETTINGS_HEADER_TABLE_SIZE:
+			_encoder.SetMaxTableSize(value);
+			break;
+
+		case SETTINGS_ENABLE_PUSH:
+			if (value > 1)
+			{
+				return SendGoAway(Http2Error::ProtocolError);
+			}
+			break;
+
+		case SETTINGS_INITIAL_WINDOW_SIZE:
+		{
+			if (value > MAX_WINDOW_SIZE)
+			{
+				return SendGoAway(Http2Error::FlowControlError);
+			}
+			// the change applies to every open stream (RFC 7540 section 6.9.2)
+			int64_t delta = static_cast<int64_t>(value) - _peer_initial_window_size;
+			for (auto& [id, stream] : _streams)
+			{
+				stream.send_window += delta;
+			}
+			_peer_initial_window_size = value;
+			break;
+		}
+
+		case SETTINGS_MAX_FRAME_SIZE:
+			if (value < HTTP2_DEFAULT_MAX_FRAME_SIZE || value > MAX_ALLOWED_FRAME_SIZE)
+			{
+				return SendGoAway(Http2Error::ProtocolError);
+			}
+			_peer_max_frame_size = value;
+			break;
+
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+bool Http2Session::OnWindowUpdate(uint32_t stream_id, const unsigned char* payload, size_t length)
+{
+	if (length != 4)
+	{
+		return SendGoAway(Http2Error::FrameSizeError);
+	}
+	auto increment = ReadUint32(payload) & 0x7fffffff;
+	if (stream_id == 0)
+	{
+		if (increment == 0)
+		{
+			return SendGoAway(Http2Error::ProtocolError);
+		}
+		_send_window += increment;
+		if (_send_window > MAX_WINDOW_SIZE)
+		{
+			return SendGoAway(Http2Error::FlowControlError);
+		}
+		Flush();
+		return true;
+	}
+	auto stream_itr = _streams.find(stream_id);
+	if (stream_itr == _streams.end())
+	{
+		return true;
+	}
+	if (increment == 0)
+	{
+		SendRstStream(stream_id, Http2Error::ProtocolError);
+		return true;
+	}
+	stream_itr->second.send_window += increment;
+	if (stream_itr->second.send_window > MAX_WINDOW_SIZE)
+	{
+		SendRstStream(stream_id, Http2Error::FlowControlError);
+		return true;
+	}
+	Flush();
+	return true;
+}
+
+void Http2Session::Dispatch(Http2Stream& stream)
+{
+	auto request = std::move(stream.request);
+	if (!stream.request_body.empty())
+	{
+		request.SetBody(stream.request_body);
+		stream.request_body.clear();
+	}
+	Dispatch(stream.id, std::move(request));
+}
+
+void Http2Session::Dispatch(uint32_t stream_id, HttpRequest&& request)
+{
+	if (_is_closed)
+	{
+		return;
+	}
+	// streams are handled by a few workers per connection so a slow one does
+	// not hold up the others, without a thread for every open stream
+	_pending_requests.emplace_back(stream_id, std::move(request));
+	if (_running_workers >= HTTP2_MAX_STREAM_WORKERS)
+	{
+		return;
+	}
+	_running_workers++;
+	_stream_tasks.erase(std::remove_if(_stream_tasks.begin(),
+									   _stream_tasks.end(),
+									   [](auto& task)
+									   {
+										   return task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+									   }),
+						_stream_tasks.end());
+	_stream_tasks.emplace_back(std::async(std::launch::async, &Http2Session::RunStreams, this));
+}
+
+void Http2Session::RunStreams()
+{
+	while (true)
+	{
+		uint32_t stream_id;
+		HttpRequest request;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_is_closed || _pending_requests.empty())
+			{
+				_running_workers--;
+				return;
+			}
+			stream_id = _pending_requests.front().first;
+			request = std::move(_pending_requests.front().second);
+			_pending_requests.pop_front();
+		}
+		try
+		{
+			SubmitResponse(stream_id, _request_handler(std::move(request)));
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "[Http2Session] - handler failed on stream " << stream_id << " (" << e.what() << ")\n";
+			HttpResponse response;
+			response.SetStatusCode(500);
+			SubmitResponse(stream_id, std::move(response));
+		}
+	}
+}
+
+void Http2Session::SubmitResponse(uint32_t stream_id, HttpResponse&& response)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	WriteResponse(stream_id, std::move(response));
+}
+
+void Http2Session::WriteResponse(uint32_t stream_id, HttpResponse&& response)
+{
+	if (_is_closed)
+	{
+		return;
+	}
+	auto stream_itr = _streams.find(stream_id);
+	if (stream_itr == _streams.end() || stream_itr->second.response_started)
+	{
+		return;
+	}
+	HeaderList headers;
+	headers.emplace_back(":status", std::to_string(response.GetStatusCode()));
+	for (auto& [name, value] : response.GetHeaders())
+	{
+		std::string field_name = name;
+		std::transform(field_name.begin(), field_name.end(), field_name.begin(), ::tolower);
+		if (!IsConnectionSpecific(field_name))
+		{
+			headers.emplace_back(std::move(field_name), value);
+		}
+	}
+	std::vector<unsigned char> header_block;
+	_encoder.Encode(headers, header_block);
+
+	auto& stream = stream_itr->second;
+	stream.response_body = response.GetBody();
+	stream.response_started = true;
+	bool end_stream = stream.response_body.empty();
+	size_t offset = 0;
+	do
+	{
+		auto fragment_length = std::min<size_t>(header_block.size() - offset, _peer_max_frame_size);
+		bool end_headers = offset + fragment_length == header_block.size();
+		auto type = offset == 0 ? Http2FrameType::Headers : Http2FrameType::Continuation;
+		uint8_t flags = (end_headers ? FLAG_END_HEADERS : 0) | ((offset == 0 && end_stream) ? FLAG_END_STREAM : 0);
+		SendFrame(type, flags, stream_id, header_block.data() + offset, fragment_length);
+		offset += fragment_length;
+	} while (offset < header_block.size());
+
+	if (end_stream)
+	{
+		if (!stream.request_complete)
+		{
+			// the client may stop sending once the response is complete (RFC 7540 section 8.1)
+			SendRstStream(stream_id, Http2Error::NoError);
+		}
+		_streams.erase(stream_itr);
+		return;
+	}
+	_send_queue.push_back(stream_id);
+	Flush();
+}
+
+bool Http2Session::RejectBody(Http2Stream& stream, std::optional<uintmax_t> body_length)
+{
+	std::optional<HttpResponse> rejection;
+	if (body_length.value_or(0) > _max_request_body)
+	{
+		std::cout << "[Http2Session] - request body on stream " << stream.id << " exceeds " << _max_request_body << " bytes\n";
+		rejection.emplace();
+		rejection->SetStatusCode(413);
+	}
+	else if (_body_check)
+	{
+		rejection = _body_check(stream.request, body_length);
+	}
+	if (!rejection.has_value())
+	{
+		return false;
+	}
+	RefuseStream(stream, std::move(rejection.value()));
+	return true;
+}
+
+void Http2Session::RefuseStream(Http2Stream& stream, HttpResponse&& response)
+{
+	stream.request_refused = true;
+	stream.request_body.clear();
+	stream.request_body.shrink_to_fit();
+	WriteResponse(stream.id, std::move(response));
+}
+
+void Http2Session::Flush()
+{
+	// round robin over streams with pending DATA, one frame each per pass
+	bool progress = true;
+	while (progress && _send_window > 0 && !_send_queue.empty())
+	{
+		progress = false;
+		for (auto queue_itr = _send_queue.begin(); queue_itr != _send_queue.end() && _send_window > 0;)
+		{
+			auto stream_itr = _streams.find(*queue_itr);
+			if (stream_itr == _streams.end())
+			{
+				queue_itr = _send_queue.erase(queue_itr);
+				continue;
+			}
+			auto& stream = stream_itr->second;
+			auto remaining = static_cast<int64_t>(stream.response_body.size() - stream.response_offset);
+			auto chunk = std::min({ remaining, static_cast<int64_t>(_peer_max_frame_size), _send_window, stream.send_window });
+			if (chunk <= 0)
+			{
+				queue_itr++;
+				continue;
+			}
+			bool end_stream = chunk == remaining;
+			SendFrame(Http2FrameType::Data,
+					  end_stream ? FLAG_END_STREAM : 0,
+					  stream.id,
+					  stream.response_body.data() + stream.response_offset,
+					  static_cast<size_t>(chunk));
+			stream.response_offset += chunk;
+			stream.send_window -= chunk;
+			_send_window -= chunk;
+			progress = true;
+			if (end_stream)
+			{
+				if (!stream.request_complete)
+				{
+					SendRstStream(stream.id, Http2Error::NoError);
+				}
+				_streams.erase(stream_itr);
+				queue_itr = _send_queue.erase(queue_itr);
+				continue;
+			}
+			queue_itr++;
+		}
+	}
+}
+
+void Http2Session::SendFrame(Http2FrameType type, uint8_t flags, uint32_t stream_id, const unsigned char* payload, size_t length)
+{
+	if (_is_closed)
+	{
+		return;
+	}
+	std::vector<unsigned char> frame;
+	frame.reserve(HTTP2_FRAME_HEADER_SIZE + length);
+	frame.push_back(static_cast<unsigned char>(length >> 16));
+	frame.push_back(static_cast<unsigned char>(length >> 8));
+	frame.push_back(static_cast<unsigned char>(length));
+	frame.push_back(static_cast<unsigned char>(type));
+	frame.push_back(flags);
+	WriteUint32(stream_id & 0x7fffffff, frame);
+	if (length > 0)
+	{
+		frame.insert(frame.end(), payload, payload + length);
+	}
+	_send_function(frame);
+}
+
+void Http2Session::SendSettings()
+{
+	std::vector<unsigned char> settings;
+	WriteSetting(SETTINGS_MAX_CONCURRENT_STREAMS, HTTP2_MAX_CONCURRENT_STREAMS, settings);
+	WriteSetting(SETTINGS_INITIAL_WINDOW_SIZE, HTTP2_LOCAL_WINDOW_SIZE, settings);
+	WriteSetting(SETTINGS_ENABLE_PUSH, 0, settings);
+	SendFrame(Http2FrameType::Settings, 0, 0, settings.data(), settings.size());
+}
+
+void Http2Session::SendWindowUpdate(uint32_t stream_id, uint32_t increment)
+{
+	std::vector<unsigned char> payload;
+	WriteUint32(increment & 0x7fffffff, payload);
+	SendFrame(Http2FrameType::WindowUpdate, 0, stream_id, payload.data(), payload.size());
+}
+
+void Http2Session::SendRstStream(uint32_t stream_id, Http2Error error)
+{
+	std::vector<unsigned char> payload;
+	WriteUint32(static_cast<uint32_t>(error), payload);
+	SendFrame(Http2FrameType::RstStream, 0, stream_id, payload.data(), payload.size());
+}
+
+bool Http2Session::SendGoAway(Http2Error error)
+{
+	std::vector<unsigned char> payload;
+	WriteUint32(_last_stream_id, payload);
+	WriteUint32(static_cast<uint32_t>(error), payload);
+	SendFrame(Http2FrameType::GoAway, 0, 0, payload.data(), payload.size());
+	_is_closed = true;
+	return false;
+}
+
+void Http2Session::Shutdown()
+{
+	std::vector<std::future<void>> stream_tasks;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_is_closed = true;
+		stream_tasks = std::move(_stream_tasks);
+	}
+	for (auto& task : stream_tasks)
+	{
+		if (task.valid())
+		{
+			task.wait();
+		}
+	}
+}
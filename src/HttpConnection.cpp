@@ -1,12 +1,22 @@
 #include "HttpConnection.h"
 
+#include <strings.h>
+
+#include <algorithm>
+#include <sstream>
 #include <utility>
 
 
 HttpConnection::HttpConnection(std::unique_ptr<jSocket> socket)
   : _socket(std::move(socket))
+  , _last_used_time(std::chrono::steady_clock::now())
+  , _body_decoder(_input_buffer,
+				  [this](ReceiveBuffer& input_buffer)
+				  {
+					  return FillInput(input_buffer);
+				  })
+  , _request_start(_last_used_time)
 {
-	Start();
 }
 
 HttpConnection::~HttpConnection()
@@ -14,17 +24,38 @@ HttpConnection::~HttpConnection()
 	if (_connection_thread.joinable())
 	{
 		_connection_thread.request_stop();
+		if (_socket)
+		{
+			_socket->Shutdown();
+		}
+		if (_connection_thread.get_id() != std::this_thread::get_id())
+		{
+			_connection_thread.join();
+		}
 	}
+	if (_http2_session)
+	{
+		_http2_session->Shutdown();
+	}
+	CloseSession();
 	if (_socket)
 	{
 		_socket->Close();
 	}
 }
 HttpConnection::HttpConnection(HttpConnection&& other)
+  : _last_used_time(std::chrono::steady_clock::now())
+  , _body_decoder(_input_buffer,
+				  [this](ReceiveBuffer& input_buffer)
+				  {
+					  return FillInput(input_buffer);
+				  })
 {
 	this->_socket = std::move(other._socket);
 	this->_connection_thread = std::move(other._connection_thread);
 	this->_data_handler = std::move(other._data_handler);
+	this->_request_handler = std::move(other._request_handler);
+	this->_client_lease = std::move(other._client_lease);
 	Start();
 }
 
@@ -61,28 +92,432 @@ std::optional<std::vector<unsigned char>> HttpConnection::Receive()
 	return *(std::get_if<std::vector<unsigned char>>(&read_result));
 }
 
-void HttpConnection::SetDataHandler(const std::function<std::optional<HttpResponse>(const std::vector<unsigned char>&)>& data_handler)
+void HttpConnection::SetDataHandler(const std::function<DataHandlerResult(HttpRequest&&)>& data_handler)
 {
 	_data_handler = data_handler;
 }
+void HttpConnection::SetRequestHandler(const std::function<HttpResponse(HttpRequest&&)>& request_handler)
+{
+	_request_handler = request_handler;
+}
+
+void HttpConnection::SetClientLease(ClientLease&& client_lease)
+{
+	_client_lease = std::move(client_lease);
+}
+
+bool HttpConnection::TryStartHttp2(const unsigned char* data, size_t length)
+{
+	if (!_request_handler)
+	{
+		return false;
+	}
+	// only looked at closely when the bytes could be a preface or an h2c upgrade
+	const std::string upgrade_token = "h2c";
+	const std::string preface_start = "PRI ";
+	auto could_be_preface = length >= preface_start.size() && std::equal(preface_start.begin(), preface_start.end(), data);
+	if (!could_be_preface && std::search(data, data + length, upgrade_token.begin(), upgrade_token.end()) == data + length)
+	{
+		return false;
+	}
+	auto data_buffer = std::vector<unsigned char>(data, data + length);
+	auto send_function = [this](const std::vector<unsigned char>& frame_buffer)
+	{
+		Send(frame_buffer);
+	};
+	if (Http2Session::IsPreface(data_buffer))
+	{
+		_http2_session = std::make_unique<Http2Session>(send_function, _request_handler);
+		_http2_session->SetMaxRequestBody(_http2_max_request_body);
+		_http2_session->SetBodyCheck(_body_check);
+		_http2_session->Start();
+		if (!_http2_session->Receive(data_buffer))
+		{
+			_can_close = true;
+		}
+		return true;
+	}
+	HttpRequest request(data_buffer);
+	if (!request.isValid || !Http2Session::IsUpgradeRequest(request))
+	{
+		return false;
+	}
+	Send(Http2Session::UpgradeResponse());
+	_http2_session = std::make_unique<Http2Session>(send_function, _request_handler);
+	_http2_session->SetMaxRequestBody(_http2_max_request_body);
+	_http2_session->SetBodyCheck(_body_check);
+	_http2_session->StartFromUpgrade(std::move(request));
+	return true;
+}
+
 void HttpConnection::HandleData(const std::vector<unsigned char>& data_buffer)
 {
-	if (_data_handler)
+	if (_http2_session)
 	{
-		auto response = _data_handler(data_buffer);
-		if (response.has_value())
+		if (!_http2_session->Receive(data_buffer))
 		{
-			auto connectionHeaderLower = response.value().GetHeader("connection").value_or("");
-			auto connectionHeaderUpper = response.value().GetHeader("Connection").value_or("");
+			_can_close = true;
+		}
+		return;
+	}
+	if (_input_buffer.empty() && TryStartHttp2(data_buffer.data(), data_buffer.size()))
+	{
+		return;
+	}
+	_input_buffer.insert(_input_buffer.end(), data_buffer.begin(), data_buffer.end());
+	ProcessInput();
+}
 
-			if (connectionHeaderLower == "Close" || connectionHeaderLower == "close" || connectionHeaderUpper == "Close" ||
-				connectionHeaderUpper == "close")
+void HttpConnection::ProcessInput()
+{
+	const std::string header_terminator = "\r\n\r\n";
+	// a body still to come is only waited for on the connection's own thread
+	auto can_block = std::this_thread::get_id() == _worker_thread_id.load();
+	if (!FinishPendingResponse())
+	{
+		return;
+	}
+	while (!_can_close && !_input_buffer.empty() && !_pending_response)
+	{
+		auto header_end = std::search(_input_buffer.begin(), _input_buffer.end(), header_terminator.begin(), header_terminator.end());
+		if (header_end == _input_buffer.end())
+		{
+			if (_input_buffer.size() > HTTP_MAX_HEADER_SIZE)
 			{
+				_input_buffer.clear();
+				Dispatch(HttpRequest());
+			}
+			return;
+		}
+		auto header_length = static_cast<size_t>(header_end - _input_buffer.begin()) + header_terminator.size();
+		if (!_trace_id.has_value())
+		{
+			_trace_id = RequestTracer::Sample();
+		}
+		TraceSpan parse_span(_trace_id.value(), "parse");
+		HttpRequest request(std::vector<unsigned char>(_input_buffer.begin(), _input_buffer.begin() + header_length));
+		parse_span.End();
+		// message body length (RFC 7230 section 3.3.3)
+		uintmax_t content_length = 0;
+		auto transfer_encoding = request.GetHeader("Transfer-Encoding");
+		auto chunked = transfer_encoding.has_value() && transfer_encoding->find("chunked") != std::string::npos;
+		auto content_length_header = request.GetHeader("Content-Length");
+		if (request.isValid && !chunked && content_length_header.has_value())
+		{
+			try
+			{
+				size_t parsed_length = 0;
+				content_length = std::stoull(content_length_header.value(), &parsed_length);
+				request.isValid = parsed_length == content_length_header->size();
+			}
+			catch (...)
+			{
+				request.isValid = false;
+			}
+		}
+		if (!request.isValid)
+		{
+			// framing is lost, nothing after this point can be trusted
+			_input_buffer.clear();
+			_can_close = true;
+			Dispatch(std::move(request));
+			return;
+		}
+		auto complete = !chunked && _input_buffer.size() - header_length >= content_length;
+		if (!complete && !can_block)
+		{
+			return;
+		}
+		if ((chunked || content_length > 0) && _body_check)
+		{
+			auto rejection = _body_check(request, chunked ? std::nullopt : std::optional<uintmax_t>(content_length));
+			if (rejection.has_value())
+			{
+				// the body is never read, so nothing behind it can be framed
+				_input_buffer.clear();
 				_can_close = true;
+				_is_busy = true;
+				Respond(rejection);
+				return;
 			}
-			Send(response.value().ToBuffer());
+			auto expect = request.GetHeader("Expect");
+			if (expect.has_value() && strcasecmp(expect->c_str(), "100-continue") == 0 && request.GetVersion() == "HTTP/1.1" &&
+				_input_buffer.size() == header_length)
+			{
+				// the client holds the body back until it knows it is wanted (RFC 7231 section 5.1.1)
+				const std::string continue_line = "HTTP/1.1 100 Continue\r\n\r\n";
+				Send(std::vector<unsigned char>(continue_line.begin(), continue_line.end()));
+			}
+		}
+		_input_buffer.erase(_input_buffer.begin(), _input_buffer.begin() + header_length);
+		_body_decoder.Start(chunked ? BodyFraming::Chunked : BodyFraming::ContentLength, content_length);
+		if (!_body_decoder.IsComplete())
+		{
+			_body_start = std::chrono::steady_clock::now();
+			_body_received = _input_buffer.size();
+			request.SetBodyReader(
+				[this]()
+				{
+					auto body_part = _body_decoder.Read();
+					if (!body_part.has_value())
+					{
+						_can_close = true;
+					}
+					return body_part;
+				});
+			if (!chunked && !_socket->IsTls())
+			{
+				request.SetBodySplicer(
+					[this](int fd, uintmax_t offset) -> std::optional<uintmax_t>
+					{
+						// what arrived with the headers is already in the buffer and is written out first
+						uintmax_t bytes_written = 0;
+						while (!_input_buffer.empty() && !_body_decoder.IsComplete())
+						{
+							auto body_part = _body_decoder.Read();
+							if (!body_part.has_value() ||
+								pwrite(fd, body_part->data(), body_part->size(), static_cast<off_t>(offset + bytes_written)) !=
+									static_cast<ssize_t>(body_part->size()))
+							{
+								_can_close = true;
+								return std::nullopt;
+							}
+							bytes_written += body_part->size();
+						}
+						auto remaining = _body_decoder.RemainingLength().value_or(0);
+						// the rest is taken in one go, so the minimum rate applies to it as a whole
+						_socket->SetReadDeadline(ReadDeadline(remaining));
+						auto spliced = remaining == 0 || _socket->SpliceTo(fd, offset + bytes_written, remaining);
+						_body_decoder.Consume(remaining);
+						if (!spliced)
+						{
+							MissedDeadline();
+							// how much of the body was taken off the socket is unknown, so the connection cannot be reused
+							_can_close = true;
+							return std::nullopt;
+						}
+						return bytes_written + remaining;
+					});
+			}
+		}
+		Dispatch(std::move(request));
+	}
+}
+
+void HttpConnection::Dispatch(HttpRequest&& request)
+{
+	if (!_data_handler)
+	{
+		return;
+	}
+	_is_busy = true;
+	auto trace_id = _trace_id.value_or(0);
+	if (trace_id != 0)
+	{
+		_handler_start = std::chrono::steady_clock::now();
+	}
+	// from here until the response is written, allocations are charged to the request's route
+	auto route_name = AllocationTracker::IsEnabled() && _route_namer ? _route_namer(request) : request.GetPath();
+	AllocationRequest allocation_request(request.GetMethod(), route_name);
+	AllocationStage handler_stage("handler");
+	auto handler_result = _data_handler(std::move(request));
+	handler_stage.End();
+	// whatever the handler left unread is discarded so the next request starts in the right place
+	if (!_body_decoder.Drain())
+	{
+		_can_close = true;
+	}
+	_body_start.reset();
+	// input already buffered behind the request is the start of the next one
+	_request_start = std::chrono::steady_clock::now();
+	auto task = std::get_if<Task<HttpResponse>>(&handler_result);
+	if (task)
+	{
+		auto pending_response = std::make_shared<PendingResponse>();
+		_pending_response = pending_response;
+		// runs on the event loop once the coroutine is done, possibly after the connection is gone
+		Spawn<HttpResponse>(std::move(*task),
+							[pending_response](std::optional<HttpResponse>&& response, std::exception_ptr)
+							{
+								std::lock_guard<std::mutex> lock(pending_response->mutex);
+								pending_response->response = std::move(response);
+								pending_response->done = true;
+								pending_response->ready_cond_var.notify_all();
+							});
+		FinishPendingResponse();
+		return;
+	}
+	if (trace_id != 0)
+	{
+		RequestTracer::Record(trace_id, "handler", _handler_start, std::chrono::steady_clock::now());
+	}
+	std::optional<HttpResponse> response;
+	if (auto ready_response = std::get_if<HttpResponse>(&handler_result))
+	{
+		response.emplace(std::move(*ready_response));
+	}
+	Respond(response);
+}
+
+void HttpConnection::Respond(std::optional<HttpResponse>& response)
+{
+	if (_timed_out.exchange(false))
+	{
+		// whatever the handler made of the part that arrived, the client is told it was too slow
+		_can_close = true;
+		response.reset();
+		if (_timeout_handler)
+		{
+			response.emplace(_timeout_handler());
+		}
+	}
+	if (response.has_value())
+	{
+		auto connection_header = response.value().GetHeader("connection").value_or("");
+		SendResponse(response.value());
+		if (response->GetUpgradeHandler() && !_can_close)
+		{
+			Upgrade(response->GetUpgradeHandler());
+			_trace_id.reset();
+			_is_busy = false;
+			return;
+		}
+		// only once the response is out, the sweep removes a connection that can close even while it is writing
+		if (strcasecmp(connection_header.c_str(), "close") == 0)
+		{
+			_can_close = true;
+		}
+	}
+	if (_can_close)
+	{
+		// the client waits for the close to know the exchange is over, do not leave it to the sweep
+		_socket->Shutdown();
+	}
+	// the next request read is sampled on its own
+	_trace_id.reset();
+	_is_busy = false;
+}
+
+void HttpConnection::Upgrade(const UpgradeHandler& upgrade_handler)
+{
+	// anything the client sent after its request already belongs to the new protocol
+	std::vector<unsigned char> buffered_input(_input_buffer.begin(), _input_buffer.end());
+	ReceiveBuffer().swap(_input_buffer);
+	_socket->SetReadDeadline(std::nullopt);
+	_upgraded_session = upgrade_handler(std::move(_socket), std::move(buffered_input));
+	// the worker stops reading, the connection only stays while the session is open
+	_can_close = true;
+}
+
+bool HttpConnection::FinishPendingResponse()
+{
+	if (!_pending_response)
+	{
+		return true;
+	}
+	auto pending_response = _pending_response;
+	std::unique_lock<std::mutex> lock(pending_response->mutex);
+	if (!pending_response->done)
+	{
+		// only the connection's own thread waits, anywhere else the worker picks the response up later
+		if (std::this_thread::get_id() != _worker_thread_id.load())
+		{
+			return false;
+		}
+		pending_response->ready_cond_var.wait(lock,
+											  _worker_stop_token,
+											  [&pending_response]()
+											  {
+												  return pending_response->done;
+											  });
+		if (!pending_response->done)
+		{
+			return false;
+		}
+	}
+	auto response = std::move(pending_response->response);
+	lock.unlock();
+	_pending_response = nullptr;
+	if (_trace_id.value_or(0) != 0)
+	{
+		// a coroutine handler's stage lasts until its response is ready
+		RequestTracer::Record(_trace_id.value(), "handler", _handler_start, std::chrono::steady_clock::now());
+	}
+	if (!response.has_value())
+	{
+		// the client is owed a response it will never get, closing is the only way to tell it
+		_can_close = true;
+	}
+	Respond(response);
+	return true;
+}
+
+long HttpConnection::FillInput(ReceiveBuffer& input_buffer)
+{
+	_socket->SetReadDeadline(ReadDeadline());
+	auto read_result = _socket->ReadInto(input_buffer);
+	auto read_error = std::get_if<ReadError>(&read_result);
+	if (read_error)
+	{
+		if (*read_error == ReadError::TimeOut)
+		{
+			MissedDeadline();
 		}
+		return *read_error == ReadError::ConnectionClosed ? 0 : -1;
 	}
+	auto bytes_read = std::get<size_t>(read_result);
+	_body_received += bytes_read;
+	std::unique_lock lock(_last_used_mutex);
+	_last_used_time = std::chrono::steady_clock::now();
+	return static_cast<long>(bytes_read);
+}
+
+std::optional<std::chrono::steady_clock::time_point> HttpConnection::ReadDeadline(uintmax_t body_ahead) const
+{
+	std::optional<std::chrono::steady_clock::time_point> deadline;
+	auto limit = [&deadline](std::chrono::steady_clock::time_point time_point)
+	{
+		if (!deadline.has_value() || time_point < deadline.value())
+		{
+			deadline = time_point;
+		}
+	};
+	if (_body_start.has_value())
+	{
+		if (_deadlines.min_body_rate > 0)
+		{
+			// past this point what has arrived no longer averages the minimum rate. capped, so a
+			// made up content length cannot overflow the clock
+			auto body_seconds = static_cast<double>(_body_received + body_ahead) / static_cast<double>(_deadlines.min_body_rate);
+			limit(_body_start.value() + _deadlines.body_grace +
+				  std::chrono::milliseconds(static_cast<int64_t>(std::min(body_seconds, 1e9) * 1000)));
+		}
+	}
+	else if (_input_buffer.empty())
+	{
+		// between requests the connection is idle, that is left to the sweep
+		return std::nullopt;
+	}
+	else if (_deadlines.header_timeout.count() > 0)
+	{
+		limit(_request_start + _deadlines.header_timeout);
+	}
+	if (_deadlines.request_timeout.count() > 0)
+	{
+		limit(_request_start + _deadlines.request_timeout);
+	}
+	return deadline;
+}
+
+bool HttpConnection::MissedDeadline()
+{
+	auto deadline = ReadDeadline();
+	if (!deadline.has_value() || std::chrono::steady_clock::now() < deadline.value())
+	{
+		return false;
+	}
+	_timed_out = true;
+	return true;
 }
 
 void HttpConnection::Send(const std::vector<unsigned char>& data_buffer)
@@ -92,25 +527,184 @@ void HttpConnection::Send(const std::vector<unsigned char>& data_buffer)
 	_last_used_time = std::chrono::steady_clock::now();
 }
 
+void HttpConnection::SendResponse(HttpResponse& response)
+{
+	auto trace_id = _trace_id.value_or(0);
+	auto file_body = response.GetFileBody();
+	if (response.GetPrepared())
+	{
+		TraceSpan write_span(trace_id, "write");
+		_socket->Write(*response.GetPrepared());
+	}
+	else if (file_body.has_value())
+	{
+		TraceSpan serialize_span(trace_id, "serialize");
+		auto header_buffer = response.ToHeaderBuffer();
+		serialize_span.End();
+		TraceSpan write_span(trace_id, "write");
+		_socket->Write(header_buffer);
+		_socket->SendFile(file_body->file->Get(), file_body->offset, file_body->length);
+	}
+	else if (response.HasBodyReader())
+	{
+		auto chunked = response.GetHeader("transfer-encoding").value_or("") == "chunked";
+		TraceSpan serialize_span(trace_id, "serialize");
+		auto header_buffer = response.ToHeaderBuffer();
+		serialize_span.End();
+		// the body is produced as it is written, so both count as writing
+		TraceSpan write_span(trace_id, "write");
+		if (!_socket->Write(header_buffer))
+		{
+			_can_close = true;
+			return;
+		}
+		// each chunk's closing CRLF goes out in front of the next chunk's size line
+		std::string chunk_prefix;
+		while (true)
+		{
+			auto body_part = response.ReadBody();
+			if (!body_part.has_value())
+			{
+				// the body broke off, the client can only tell from the connection closing
+				_can_close = true;
+				_socket->Shutdown();
+				return;
+			}
+			if (body_part->empty())
+			{
+				break;
+			}
+			if (!chunked)
+			{
+				if (!_socket->Write(body_part.value()))
+				{
+					_can_close = true;
+					return;
+				}
+				continue;
+			}
+			std::stringstream size_stream;
+			size_stream << chunk_prefix << std::hex << body_part->size() << "\r\n";
+			auto size_line = size_stream.str();
+			if (!_socket->Write(std::vector<unsigned char>(size_line.begin(), size_line.end()), body_part.value()))
+			{
+				_can_close = true;
+				return;
+			}
+			chunk_prefix = "\r\n";
+		}
+		if (chunked)
+		{
+			auto last_chunk = chunk_prefix + "0\r\n\r\n";
+			_socket->Write(std::vector<unsigned char>(last_chunk.begin(), last_chunk.end()));
+		}
+	}
+	else if (response.GetStaticBody().has_value())
+	{
+		TraceSpan serialize_span(trace_id, "serialize");
+		auto header_buffer = response.ToHeaderBuffer();
+		serialize_span.End();
+		TraceSpan write_span(trace_id, "write");
+		_socket->Write(header_buffer, response.GetStaticBody()->data, response.GetStaticBody()->length);
+	}
+	else
+	{
+		TraceSpan serialize_span(trace_id, "serialize");
+		auto header_buffer = response.ToHeaderBuffer();
+		serialize_span.End();
+		TraceSpan write_span(trace_id, "write");
+		_socket->Write(header_buffer, response.GetBodyBuffer());
+	}
+	std::unique_lock lock(_last_used_mutex);
+	_last_used_time = std::chrono::steady_clock::now();
+}
+
 void HttpConnection::Worker(std::stop_token stop_token)
 {
+	_worker_stop_token = stop_token;
+	_worker_thread_id = std::this_thread::get_id();
+	RequestTracer::NameThread("connection");
 	try
 	{
-		while (!stop_token.stop_requested())
+		// a request whose body had not arrived yet when the connection was handed over
+		ProcessInput();
+		while (!stop_token.stop_requested() && _socket)
 		{
-			auto read_buffer = Receive();
-			if (read_buffer.has_value())
+			if (_http2_session)
 			{
-				HandleData(read_buffer.value());
-				std::unique_lock lock(_last_used_mutex);
-				_last_used_time = std::chrono::steady_clock::now();
+				// streams are not held to the deadlines of an HTTP/1.1 request
+				_socket->SetReadDeadline(std::nullopt);
+				auto read_buffer = Receive();
+				if (read_buffer.has_value())
+				{
+					HandleData(read_buffer.value());
+				}
+				continue;
 			}
+			ReceiveInput();
 		}
 	}
 	catch (const std::exception& e)
 	{
 		std::cout << "[Http Connection] - caught an exception (" << e.what() << ")\n";
 	}
+	// the peer is gone, its slot need not wait for the connection to be swept. an upgraded
+	// connection keeps it for as long as its session is open
+	if (!_upgraded_session.load())
+	{
+		_client_lease.Release();
+	}
+	_can_close = true;
+}
+
+void HttpConnection::ReceiveInput()
+{
+	// HTTP/1.1 input is read straight into the connection's buffer rather than handed over in a copy
+	auto was_empty = _input_buffer.empty();
+	_socket->SetReadDeadline(ReadDeadline());
+	auto read_result = _socket->ReadInto(_input_buffer);
+	auto read_error = std::get_if<ReadError>(&read_result);
+	if (read_error)
+	{
+		switch (*read_error)
+		{
+		case ReadError::ConnectionClosed:
+			throw std::runtime_error("Socket closed by peer");
+
+		case ReadError::TimeOut:
+			if (MissedDeadline())
+			{
+				// the headers never completed, there is no request to hand to the handler
+				std::optional<HttpResponse> response;
+				Respond(response);
+			}
+			return;
+
+		default:
+			throw std::runtime_error("Error reading");
+		}
+	}
+	{
+		std::unique_lock lock(_last_used_mutex);
+		_last_used_time = std::chrono::steady_clock::now();
+		if (was_empty)
+		{
+			_request_start = _last_used_time;
+		}
+	}
+	if (was_empty && TryStartHttp2(_input_buffer.data(), _input_buffer.size()))
+	{
+		_input_buffer.clear();
+	}
+	else
+	{
+		ProcessInput();
+	}
+	if (_input_buffer.empty())
+	{
+		// nothing is left to parse, the connection waits for its next request without a buffer
+		ReceiveBuffer().swap(_input_buffer);
+	}
 }
 
 std::chrono::steady_clock::time_point HttpConnection::LastUsedTime()
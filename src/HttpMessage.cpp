@@ -1,8 +1,14 @@
 #include "HttpMessage.h"
 
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <iterator>
 #include <sstream>
+#include <utility>
 
 std::string HttpMessage::ToString() const
 {
@@ -22,8 +28,12 @@ std::string HttpMessage::ToString() const
 	return http_stream.str().data();
 };
 
-std::vector<unsigned char> HttpMessage::ToBuffer() const
+std::vector<unsigned char> HttpMessage::ToHeaderBuffer() const
 {
+	if (_prepared)
+	{
+		return std::vector<unsigned char>(_prepared->begin(), _prepared->begin() + _prepared_header_length);
+	}
 	std::vector<unsigned char> message_buffer;
 	auto start_line = GetStartLine();
 	message_buffer.insert(message_buffer.end(), start_line.begin(), start_line.end());
@@ -40,8 +50,26 @@ std::vector<unsigned char> HttpMessage::ToBuffer() const
 	}
 	message_buffer.insert(message_buffer.end(), CR);
 	message_buffer.insert(message_buffer.end(), LF);
+	return message_buffer;
+};
 
-	if (_body.size() > 0)
+std::vector<unsigned char> HttpMessage::ToBuffer() const
+{
+	if (_prepared)
+	{
+		return *_prepared;
+	}
+	auto message_buffer = ToHeaderBuffer();
+	if (_file_body.has_value())
+	{
+		auto file_contents = GetBody();
+		message_buffer.insert(message_buffer.end(), file_contents.begin(), file_contents.end());
+	}
+	else if (_static_body.has_value())
+	{
+		message_buffer.insert(message_buffer.end(), _static_body->data, _static_body->data + _static_body->length);
+	}
+	else if (_body.size() > 0)
 	{
 		message_buffer.insert(message_buffer.end(), _body.begin(), _body.end());
 	}
@@ -51,11 +79,16 @@ std::vector<unsigned char> HttpMessage::ToBuffer() const
 
 void HttpMessage::SetHeader(std::string header_name, std::string header_value)
 {
+	Unprepare();
 	_headers[header_name] = header_value;
 };
 
 void HttpMessage::SetBody(const std::vector<unsigned char>& body)
 {
+	_prepared.reset();
+	_file_body.reset();
+	_static_body.reset();
+	_body_reader = nullptr;
 	_body = body;
 	auto body_length_char = _body.size();
 	auto body_length_bytes = body_length_char * sizeof(_body[0]);
@@ -64,25 +97,200 @@ void HttpMessage::SetBody(const std::vector<unsigned char>& body)
 
 void HttpMessage::SetBody(const jjson::value& json_body)
 {
-	auto json_buffer = json_body.to_string().c_str();
-	auto json_buffer_size = json_body.to_string().size() * sizeof(char);
-	_body = std::vector<unsigned char>(json_buffer, json_buffer + json_buffer_size);
-	SetHeader("content-length", std::to_string(json_buffer_size));
+	_prepared.reset();
+	auto json_string = json_body.to_string();
+	_file_body.reset();
+	_static_body.reset();
+	_body_reader = nullptr;
+	_body = std::vector<unsigned char>(json_string.begin(), json_string.end());
+	SetHeader("content-length", std::to_string(_body.size()));
 };
 
 std::optional<std::string> HttpMessage::GetHeader(std::string header_name) const
 {
 	auto kv_pair = _headers.find(header_name);
-	if (kv_pair == _headers.end())
+	if (kv_pair != _headers.end())
 	{
-		return std::nullopt;
+		return kv_pair->second;
+	}
+	// field names are case-insensitive (RFC 7230 section 3.2)
+	for (auto& header : _headers)
+	{
+		if (strcasecmp(header.first.c_str(), header_name.c_str()) == 0)
+		{
+			return header.second;
+		}
 	}
-	return kv_pair->second;
+	return std::nullopt;
+};
+
+void HttpMessage::SetBody(const FileBody& file_body)
+{
+	_prepared.reset();
+	_body.clear();
+	_body_reader = nullptr;
+	_static_body.reset();
+	_file_body = file_body;
+	SetHeader("content-length", std::to_string(file_body.length));
 };
 
+void HttpMessage::SetBody(const StaticBody& static_body)
+{
+	_prepared.reset();
+	_body.clear();
+	_file_body.reset();
+	_body_reader = nullptr;
+	_static_body = static_body;
+	SetHeader("content-length", std::to_string(static_body.length));
+};
+
+void HttpMessage::SetBody(const BodyReader& body_reader, std::optional<uintmax_t> length)
+{
+	_prepared.reset();
+	_body.clear();
+	_file_body.reset();
+	_static_body.reset();
+	_body_reader = body_reader;
+	if (length.has_value())
+	{
+		_headers.erase("transfer-encoding");
+		SetHeader("content-length", std::to_string(length.value()));
+		return;
+	}
+	_headers.erase("content-length");
+	SetHeader("transfer-encoding", "chunked");
+};
+
+void HttpMessage::SetBodyReader(const BodyReader& body_reader)
+{
+	_body_reader = body_reader;
+};
+
+std::optional<std::vector<unsigned char>> HttpMessage::ReadBody()
+{
+	if (!_body.empty())
+	{
+		return std::exchange(_body, {});
+	}
+	if (!_body_reader)
+	{
+		return std::vector<unsigned char>();
+	}
+	auto body_part = _body_reader();
+	if (!body_part.has_value() || body_part->empty())
+	{
+		_body_reader = nullptr;
+	}
+	return body_part;
+};
+
+void HttpMessage::SetBodySplicer(const BodySplicer& body_splicer)
+{
+	_body_splicer = body_splicer;
+};
+
+std::optional<uintmax_t> HttpMessage::SpliceBody(int fd, uintmax_t offset)
+{
+	uintmax_t bytes_written = 0;
+	// whatever is already in memory goes first, the splicer takes over from the socket
+	while (true)
+	{
+		if (_body.empty() && _body_reader && _body_splicer)
+		{
+			auto bytes_spliced = _body_splicer(fd, offset + bytes_written);
+			_body_reader = nullptr;
+			_body_splicer = nullptr;
+			if (!bytes_spliced.has_value())
+			{
+				return std::nullopt;
+			}
+			return bytes_written + bytes_spliced.value();
+		}
+		auto body_part = ReadBody();
+		if (!body_part.has_value())
+		{
+			return std::nullopt;
+		}
+		if (body_part->empty())
+		{
+			return bytes_written;
+		}
+		size_t part_written = 0;
+		while (part_written < body_part->size())
+		{
+			auto result = pwrite(fd,
+								 body_part->data() + part_written,
+								 body_part->size() - part_written,
+								 static_cast<off_t>(offset + bytes_written + part_written));
+			if (result <= 0)
+			{
+				return std::nullopt;
+			}
+			part_written += result;
+		}
+		bytes_written += part_written;
+	}
+}
+
 std::vector<unsigned char> HttpMessage::GetBody() const
 {
-	return _body;
+	if (_prepared)
+	{
+		return std::vector<unsigned char>(_prepared->begin() + _prepared_header_length, _prepared->end());
+	}
+	while (_body_reader)
+	{
+		auto body_part = _body_reader();
+		if (!body_part.has_value() || body_part->empty())
+		{
+			_body_reader = nullptr;
+			break;
+		}
+		_body.insert(_body.end(), body_part->begin(), body_part->end());
+	}
+	if (_static_body.has_value())
+	{
+		return std::vector<unsigned char>(_static_body->data, _static_body->data + _static_body->length);
+	}
+	if (!_file_body.has_value())
+	{
+		return _body;
+	}
+	std::vector<unsigned char> file_contents(_file_body->length);
+	size_t bytes_read = 0;
+	while (bytes_read < file_contents.size())
+	{
+		auto result = pread(_file_body->file->Get(),
+							file_contents.data() + bytes_read,
+							file_contents.size() - bytes_read,
+							static_cast<off_t>(_file_body->offset + bytes_read));
+		if (result <= 0)
+		{
+			file_contents.resize(bytes_read);
+			break;
+		}
+		bytes_read += result;
+	}
+	return file_contents;
+};
+
+void HttpMessage::SetPrepared(const std::shared_ptr<const std::vector<unsigned char>>& message_buffer, size_t header_length)
+{
+	_body.clear();
+	_file_body.reset();
+	_static_body.reset();
+	_body_reader = nullptr;
+	_prepared = message_buffer;
+	_prepared_header_length = header_length;
+};
+
+void HttpMessage::Unprepare()
+{
+	if (_prepared)
+	{
+		_body.assign(_prepared->begin() + _prepared_header_length, _prepared->end());
+		_prepared.reset();
+	}
 };
 
 void HttpMessage::SetVersion(std::string version)
@@ -114,7 +322,7 @@ HttpRequest::HttpRequest(std::vector<unsigned char> request_buffer)
 		return;
 	}
 	request_buffer.erase(request_buffer.begin(), line_end + 2);
-	line_end = std::find(request_buffer.begin(), request_buffer.end(), '\n');
+	line_end = std::find(request_buffer.begin(), request_buffer.end(), '\r');
 	// headers
 	while (line_end != request_buffer.end())
 	{
@@ -128,6 +336,9 @@ HttpRequest::HttpRequest(std::vector<unsigned char> request_buffer)
 					  });
 		std::getline(header_line_stream, header_name, ':');
 		std::getline(header_line_stream, header_value, '\r');
+		// strip optional whitespace around the field value
+		header_value.erase(0, header_value.find_first_not_of(" \t"));
+		header_value.erase(header_value.find_last_not_of(" \t") + 1);
 		SetHeader(header_name, header_value);
 		request_buffer.erase(request_buffer.begin(), line_end + 2);
 		auto next_char = request_buffer[0];
@@ -138,8 +349,8 @@ HttpRequest::HttpRequest(std::vector<unsigned char> request_buffer)
 		}
 		line_end = std::find(request_buffer.begin(), request_buffer.end(), '\r');
 	}
-	// body
-	SetBody(request_buffer);
+	// body, content-length is left as sent so it still describes the whole body
+	_body = std::move(request_buffer);
 	isValid = true;
 };
 
@@ -153,6 +364,48 @@ void HttpRequest::SetTarget(std::string target)
 	_request_target = target;
 };
 
+std::string HttpRequest::GetPath() const
+{
+	return _request_target.substr(0, _request_target.find('?'));
+}
+
+std::optional<std::string> HttpRequest::GetQueryParameter(const std::string& name) const
+{
+	auto query_start = _request_target.find('?');
+	while (query_start != std::string::npos)
+	{
+		auto parameter_start = query_start + 1;
+		auto parameter_end = std::min(_request_target.find('&', parameter_start), _request_target.size());
+		auto parameter = _request_target.substr(parameter_start, parameter_end - parameter_start);
+		auto value_start = parameter.find('=');
+		if (parameter.substr(0, value_start) == name)
+		{
+			auto encoded_value = value_start == std::string::npos ? std::string() : parameter.substr(value_start + 1);
+			std::string value;
+			for (size_t i = 0; i < encoded_value.size(); i++)
+			{
+				if (encoded_value[i] == '+')
+				{
+					value += ' ';
+				}
+				else if (encoded_value[i] == '%' && i + 2 < encoded_value.size() && std::isxdigit((unsigned char)encoded_value[i + 1]) &&
+						 std::isxdigit((unsigned char)encoded_value[i + 2]))
+				{
+					value += static_cast<char>(std::stoi(encoded_value.substr(i + 1, 2), nullptr, 16));
+					i += 2;
+				}
+				else
+				{
+					value += encoded_value[i];
+				}
+			}
+			return value;
+		}
+		query_start = parameter_end < _request_target.size() ? parameter_end : std::string::npos;
+	}
+	return std::nullopt;
+}
+
 std::string HttpRequest::GetStartLine() const
 {
 	std::stringstream start_line_stream;
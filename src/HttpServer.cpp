@@ -1,37 +1,188 @@
 #include "HttpServer.h"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <optional>
+#include <stdexcept>
 #include <utility>
 
 namespace fs = std::filesystem;
 
+namespace
+{
+	// set from the SIGHUP handler, picked up by the main loop
+	std::atomic<bool> reload_requested = false;
+
+	std::string EncodeQueryValue(const std::string& value)
+	{
+		static const char* HexDigits = "0123456789ABCDEF";
+		std::string encoded;
+		for (unsigned char character : value)
+		{
+			if (std::isalnum(character) || character == '-' || character == '_' || character == '.' || character == '~')
+			{
+				encoded += static_cast<char>(character);
+				continue;
+			}
+			encoded += '%';
+			encoded += HexDigits[character >> 4];
+			encoded += HexDigits[character & 0x0F];
+		}
+		return encoded;
+	}
+
+	// the request path with "." and ".." segments and doubled slashes folded, so it can be joined to a root
+	// without leaving it. nullopt for a path that does not start at the root
+	std::optional<std::string> NormalizePath(const std::string& path)
+	{
+		if (path.empty() || path.front() != '/')
+		{
+			return std::nullopt;
+		}
+		// ".." at the root stays at the root
+		auto normalized = fs::path(path).lexically_normal().string();
+		if (normalized.empty() || normalized.front() != '/' || normalized.starts_with("/.."))
+		{
+			return std::nullopt;
+		}
+		return normalized;
+	}
+
+	std::string EscapeHtml(const std::string& text)
+	{
+		std::string escaped;
+		for (auto character : text)
+		{
+			switch (character)
+			{
+			case '&':
+				escaped += "&amp;";
+				break;
+			case '<':
+				escaped += "&lt;";
+				break;
+			case '>':
+				escaped += "&gt;";
+				break;
+			case '"':
+				escaped += "&quot;";
+				break;
+			default:
+				escaped += character;
+				break;
+			}
+		}
+		return escaped;
+	}
+
+	std::string EscapeJson(const std::string& text)
+	{
+		static const char* HexDigits = "0123456789abcdef";
+		std::string escaped;
+		for (unsigned char character : text)
+		{
+			if (character == '"' || character == '\\')
+			{
+				escaped += '\\';
+				escaped += static_cast<char>(character);
+			}
+			else if (character < 0x20)
+			{
+				escaped += "\\u00";
+				escaped += HexDigits[character >> 4];
+				escaped += HexDigits[character & 0x0F];
+			}
+			else
+			{
+				escaped += static_cast<char>(character);
+			}
+		}
+		return escaped;
+	}
+
+	void RequestReload(int)
+	{
+		reload_requested = true;
+	}
+}  // namespace
+
 void HttpServer::Get(std::string target, std::function<HttpResponse(HttpRequest&&)> get_handler)
 {
 	_route_map.RegisterRoute("GET" + target, get_handler);
 }
 
+void HttpServer::Get(std::string target, std::function<HttpResponse(HttpRequest&&)> get_handler, const CachePolicy& cache_policy)
+{
+	_route_map.RegisterRoute("GET" + target,
+							 [this, get_handler, cache_policy](HttpRequest&& request) -> HttpResponse
+							 {
+								 return _response_cache.Serve(std::move(request), cache_policy, get_handler);
+							 });
+}
+
 void HttpServer::Post(std::string target, std::function<HttpResponse(HttpRequest&&)> post_handler)
 {
 	_route_map.RegisterRoute("POST" + target, post_handler);
 }
 
+void HttpServer::WebSocket(std::string target, WebSocketSession::MessageHandler message_handler)
+{
+	_route_map.RegisterRoute("GET" + target,
+							 [this, message_handler](HttpRequest&& request) -> HttpResponse
+							 {
+								 return UpgradeWebSocket(std::move(request), message_handler);
+							 });
+}
+
+void HttpServer::Get(std::string target, std::function<Task<HttpResponse>(HttpRequest&&)> get_handler)
+{
+	_route_map.RegisterAsyncRoute("GET" + target, get_handler);
+}
+
+void HttpServer::Post(std::string target, std::function<Task<HttpResponse>(HttpRequest&&)> post_handler)
+{
+	_route_map.RegisterAsyncRoute("POST" + target, post_handler);
+}
+
 void HttpServer::Init(std::string config_file_name)
 {
-	ParseConfigFile(config_file_name);
-	if (!_config.HasKey("upload_dir"))
-	{
-		_config["upload_dir"] = "../uploads";
-	}
-	int port = static_cast<int>(_config["port"]);
-	_server_socket.SetPort(port, PROTO::TCP);
-	_server_socket.CreateSocket();
+	_config_file_name = config_file_name;
+	_config = ReadConfigFile(_config_file_name);
+	auto settings = ParseSettings(_config);
+	_settings.store(settings);
+	_load_shedder.SetThresholds(settings->load_shedding_target, settings->load_shedding_interval);
+	RequestTracer::SetSampleRate(settings->trace_sample_rate);
+	_upload_index.Open(settings->upload_dir);
+	ApplyStartupConfig();
+	std::cout << "Config file loaded!\n";
+	// a peer closing mid response must surface as a write error, not kill the process
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGHUP, RequestReload);
+	OpenListener();
 
 	_socket_thread = std::jthread(std::bind_front(&HttpServer::PerformSocketTask, this));
-	_app_logic_thread = std::jthread(std::bind_front(&HttpServer::HandleApplicationLayer, this));
+	for (int i = 0; i < _handler_threads; i++)
+	{
+		_app_logic_threads.emplace_back(std::bind_front(&HttpServer::HandleApplicationLayer, this));
+	}
+	if (_listener_handoff)
+	{
+		_handoff_thread = std::jthread(std::bind_front(&HttpServer::ServeHandoff, this));
+	}
+	uint64_t reported_shed_count = 0;
+	std::optional<std::chrono::steady_clock::time_point> drain_deadline;
+	auto was_idle = false;
 	while (_is_server_running)
 	{
 		std::mutex application_state_mutex;
@@ -49,39 +200,145 @@ void HttpServer::Init(std::string config_file_name)
 			std::cout << "[HttpServer] - Server Closing down\n";
 			return;
 		}
+		if (reload_requested.exchange(false))
+		{
+			ReloadConfig();
+		}
+		if (_draining && !drain_deadline.has_value())
+		{
+			std::cout << "[HttpServer] - Listener handed over, draining connections\n";
+			drain_deadline = std::chrono::steady_clock::now() + _drain_timeout;
+			// sessions never go idle on their own, they are told the server is going away
+			std::lock_guard<std::mutex> lock(_connections_mutex);
+			for (auto& connection : _connections)
+			{
+				connection->CloseSession();
+			}
+		}
+		_client_limiter.EvictIdle();
+		_file_cache.EvictExpired();
+		auto shed_count = _load_shedder.ShedCount();
+		if (shed_count != reported_shed_count)
+		{
+			std::cout << "[HttpServer] - overloaded, shed " << shed_count - reported_shed_count << " requests (" << shed_count
+					  << " total)\n";
+			reported_shed_count = shed_count;
+		}
+		auto connection_timeout = Settings()->connection_timeout;
+		auto draining = drain_deadline.has_value();
+		std::lock_guard<std::mutex> lock(_connections_mutex);
 		if (!_connections.empty())
 		{
 			_connections.erase(std::remove_if(_connections.begin(),
 											  _connections.end(),
-											  [](auto& connection)
+											  [connection_timeout, draining](auto& connection)
 											  {
+												  // while draining an idle keep-alive connection is not waited for
 												  auto can_remove =
 													  (connection->CanClose() ||
-													   std::chrono::steady_clock::now() - connection->LastUsedTime() > CONNECTION_TIMEOUT);
+													   (!connection->IsBusy() &&
+														(draining ||
+														 std::chrono::steady_clock::now() - connection->LastUsedTime() > connection_timeout)));
 												  return can_remove;
 											  }),
 							   _connections.end());
 		}
+		if (draining)
+		{
+			// a request taken off the queue reaches _connections a moment later, so idle has to be seen twice
+			auto is_idle = _connections.empty() && _request_queue.IsEmpty();
+			if ((is_idle && was_idle) || std::chrono::steady_clock::now() > drain_deadline.value())
+			{
+				std::cout << "[HttpServer] - Drained, " << _connections.size() << " connections left\n";
+				_is_server_running = false;
+				return;
+			}
+			was_idle = is_idle;
+		}
 	}
 };
 
 void HttpServer::PerformSocketTask(std::stop_token stop_token)
 {
 	std::cout << "[HttpServer] - Starting socket receiver\n";
-	try
+	RequestTracer::NameThread("acceptor");
+	// accepted connections whose first request has not arrived yet, watched here alongside the
+	// listener so that a slow client never holds the acceptor up or a thread. a TLS handshake runs
+	// here too, one non-blocking step each time the socket wakes up
+	struct AwaitingSocket
 	{
-		if (!_server_socket.Bind())
+		std::unique_ptr<jSocket> socket;
+		ClientLease client_lease;
+		std::chrono::steady_clock::time_point deadline;
+		std::chrono::steady_clock::time_point accept_time;
+		uint64_t trace_id;
+		// the request so far, handed on once its headers are complete
+		std::vector<unsigned char> buffer = {};
+	};
+	const std::string header_terminator = "\r\n\r\n";
+	const std::string preface_start = "PRI ";
+	auto is_request_head = [&header_terminator, &preface_start](const std::vector<unsigned char>& buffer)
+	{
+		if (buffer.size() > HTTP_MAX_HEADER_SIZE)
 		{
-			throw std::runtime_error("Unable to bind to port\n");
+			// too long to be headers, the parser rejects it
+			return true;
 		}
-		_server_socket.Listen();
-		while (!stop_token.stop_requested() && _is_server_running)
+		if (buffer.size() >= preface_start.size() && std::equal(preface_start.begin(), preface_start.end(), buffer.begin()))
+		{
+			// an HTTP/2 preface has a blank line of its own before it is complete
+			return Http2Session::IsPreface(buffer);
+		}
+		return std::search(buffer.begin(), buffer.end(), header_terminator.begin(), header_terminator.end()) != buffer.end();
+	};
+	std::vector<AwaitingSocket> awaiting_sockets;
+	std::vector<struct pollfd> poll_fds;
+	try
+	{
+		while (!stop_token.stop_requested() && _is_server_running && !_draining)
 		{
-			auto accept_result = _server_socket.Accept();
-			if (accept_result)
+			poll_fds.clear();
+			// out of descriptors the listener stays readable, it is left out until the backoff is over
+			auto accept_paused = _server_socket.IsAcceptPaused();
+			poll_fds.push_back({ _server_socket.GetFd(), static_cast<short>(accept_paused ? 0 : POLLIN), 0 });
+			for (auto& awaiting : awaiting_sockets)
+			{
+				poll_fds.push_back({ awaiting.socket->GetFd(), POLLIN, 0 });
+			}
+			// bounded so the loop gets to check whether it should still be accepting
+			auto poll_timeout = accept_paused ? static_cast<int>(ACCEPT_BACKOFF.count()) : 500;
+			if (poll(poll_fds.data(), poll_fds.size(), poll_timeout) < 0 && errno != EINTR)
+			{
+				break;
+			}
+			auto now = std::chrono::steady_clock::now();
+			std::vector<AwaitingSocket> still_awaiting;
+			for (size_t i = 0; i < awaiting_sockets.size(); i++)
 			{
-				std::unique_ptr<jSocket> connection_socket = std::move(accept_result);
-				auto socket_read_result = connection_socket->Read();
+				auto& awaiting = awaiting_sockets[i];
+				if (now >= awaiting.deadline)
+				{
+					if (!awaiting.buffer.empty())
+					{
+						// started a request and did not finish its headers in time, however much it keeps trickling in
+						awaiting.socket->Write(RequestTimeout(HttpRequest()).ToBuffer());
+					}
+					continue;
+				}
+				if (poll_fds[i + 1].revents == 0)
+				{
+					still_awaiting.emplace_back(std::move(awaiting));
+					continue;
+				}
+				auto was_handshaking = !awaiting.socket->IsHandshakeComplete();
+				TraceSpan read_span(awaiting.trace_id, "read");
+				auto socket_read_result = awaiting.socket->TryRead();
+				read_span.End();
+				if (was_handshaking && awaiting.socket->IsHandshakeComplete())
+				{
+					// the handshake was held to the header deadline, the first request gets the idle timeout
+					awaiting.deadline = awaiting.accept_time + Settings()->connection_timeout;
+				}
 				auto read_error = std::get_if<ReadError>(&socket_read_result);
 				if (read_error)
 				{
@@ -92,6 +349,8 @@ void HttpServer::PerformSocketTask(std::stop_token stop_token)
 						break;
 
 					case ReadError::TimeOut:
+						// woken without data, keep waiting
+						still_awaiting.emplace_back(std::move(awaiting));
 						break;
 
 					default:
@@ -100,11 +359,83 @@ void HttpServer::PerformSocketTask(std::stop_token stop_token)
 					}
 					continue;
 				}
-				auto buffer = *(std::get_if<std::vector<unsigned char>>(&socket_read_result));
-				if (!buffer.empty())
+				if (awaiting.trace_id != 0)
+				{
+					// from the listener waking up until the request could be read
+					RequestTracer::Record(awaiting.trace_id, "accept", awaiting.accept_time, now);
+				}
+				auto& buffer = *(std::get_if<std::vector<unsigned char>>(&socket_read_result));
+				if (awaiting.buffer.empty())
+				{
+					// the idle wait is over, the headers have to follow within the request deadlines
+					auto settings = Settings();
+					auto& deadlines = settings->deadlines;
+					awaiting.deadline = std::chrono::steady_clock::time_point::max();
+					if (deadlines.header_timeout.count() > 0)
+					{
+						awaiting.deadline = now + deadlines.header_timeout;
+					}
+					if (deadlines.request_timeout.count() > 0)
+					{
+						awaiting.deadline = std::min(awaiting.deadline, now + deadlines.request_timeout);
+					}
+				}
+				// decrypted bytes left in the TLS session would not wake the poll, so they are taken now
+				while (awaiting.socket->IsTls() && !is_request_head(awaiting.buffer) && !buffer.empty())
+				{
+					awaiting.buffer.insert(awaiting.buffer.end(), buffer.begin(), buffer.end());
+					buffer.clear();
+					auto pending_read_result = awaiting.socket->TryRead();
+					if (std::holds_alternative<std::vector<unsigned char>>(pending_read_result))
+					{
+						buffer = std::move(std::get<std::vector<unsigned char>>(pending_read_result));
+					}
+				}
+				awaiting.buffer.insert(awaiting.buffer.end(), buffer.begin(), buffer.end());
+				if (!is_request_head(awaiting.buffer))
+				{
+					still_awaiting.emplace_back(std::move(awaiting));
+					continue;
+				}
+				ParseData(std::move(awaiting.buffer), std::move(awaiting.socket), std::move(awaiting.client_lease), awaiting.trace_id);
+			}
+			awaiting_sockets = std::move(still_awaiting);
+			if (poll_fds[0].revents == 0)
+			{
+				continue;
+			}
+			auto first_request_deadline = now + Settings()->connection_timeout;
+			for (auto& connection_socket : _server_socket.Accept())
+			{
+				auto client_lease = _client_limiter.AcquireConnection(connection_socket->GetPeerAddress());
+				if (!client_lease.has_value())
+				{
+					std::cout << "[HttpServer] - Connection limit reached for " << connection_socket->GetPeerName() << "\n";
+					continue;
+				}
+				auto deadline = first_request_deadline;
+				if (_tls_context)
 				{
-					ParseData(std::move(buffer), std::move(connection_socket));
+					if (!connection_socket->StartTls(*_tls_context))
+					{
+						std::cout << "[HttpServer] - Unable to start TLS session\n";
+						continue;
+					}
+					// the handshake counts as part of the request head, a peer dragging it out is dropped
+					auto settings = Settings();
+					auto& deadlines = settings->deadlines;
+					if (deadlines.header_timeout.count() > 0)
+					{
+						deadline = std::min(deadline, now + deadlines.header_timeout);
+					}
+					if (deadlines.request_timeout.count() > 0)
+					{
+						deadline = std::min(deadline, now + deadlines.request_timeout);
+					}
 				}
+				// with defer_accept the request is usually there already and is read on the next poll
+				awaiting_sockets.push_back(
+					{ std::move(connection_socket), std::move(client_lease.value()), deadline, now, RequestTracer::Sample() });
 			}
 		}
 	}
@@ -112,27 +443,112 @@ void HttpServer::PerformSocketTask(std::stop_token stop_token)
 	{
 		std::cout << "[HTTPServer] - error " << e.what();
 	}
-	_is_server_running = false;
+	// connections accepted before a handover are still served, on their own threads
+	for (auto& awaiting : awaiting_sockets)
+	{
+		auto connection = CreateConnection(std::move(awaiting.socket), std::move(awaiting.client_lease));
+		connection->SetTraceId(awaiting.trace_id);
+		if (!awaiting.buffer.empty())
+		{
+			connection->HandleData(awaiting.buffer);
+		}
+		connection->Start();
+		std::lock_guard<std::mutex> lock(_connections_mutex);
+		_connections.emplace_back(std::move(connection));
+	}
+	if (!_draining)
+	{
+		_is_server_running = false;
+	}
 	std::cout << "[HttpServer] - Ending socket receiver\n";
 }
 
-void HttpServer::ParseData(std::vector<unsigned char>&& message_buffer, std::unique_ptr<jSocket> socket)
+void HttpServer::OpenListener()
+{
+	// an inherited listener takes the options of this configuration as well
+	_server_socket.SetOptions(ReadSocketOptions(_config));
+	std::string handoff_path;
+	if (_config.HasKey("handoff_socket"))
+	{
+		handoff_path = (std::string)_config["handoff_socket"];
+		// a server already running on the path gives up its socket, connections queued on it are not lost
+		auto listen_fd = ListenerHandoff::Receive(handoff_path, HANDOFF_TIMEOUT);
+		if (listen_fd != -1 && !_server_socket.AdoptListener(listen_fd))
+		{
+			std::cout << "[HttpServer] - Handed over socket is not listening, opening a new one\n";
+			close(listen_fd);
+			listen_fd = -1;
+		}
+		if (listen_fd != -1)
+		{
+			std::cout << "[HttpServer] - Took over listening socket from running server\n";
+		}
+	}
+	if (_server_socket.GetFd() == -1)
+	{
+		int port = static_cast<int>(_config["port"]);
+		_server_socket.SetPort(port, PROTO::TCP);
+		_server_socket.CreateSocket();
+		if (!_server_socket.Bind())
+		{
+			throw std::runtime_error("Unable to bind to port " + std::to_string(port));
+		}
+		_server_socket.Listen();
+	}
+	if (!handoff_path.empty())
+	{
+		_listener_handoff = std::make_unique<ListenerHandoff>();
+		if (!_listener_handoff->Listen(handoff_path))
+		{
+			throw std::runtime_error("Unable to listen on handoff_socket " + handoff_path);
+		}
+	}
+}
+
+void HttpServer::ServeHandoff(std::stop_token stop_token)
+{
+	while (!stop_token.stop_requested() && _is_server_running)
+	{
+		if (_listener_handoff->Offer(_server_socket.GetFd(), std::chrono::milliseconds(500)))
+		{
+			_listener_handoff->Release();
+			_draining = true;
+			_application_state_cond_var.notify_all();
+			return;
+		}
+	}
+}
+
+void HttpServer::ParseData(
+	std::vector<unsigned char>&& message_buffer, std::unique_ptr<jSocket> socket, ClientLease&& client_lease, uint64_t trace_id)
 {
-	HttpRequest request = HttpRequest(std::move(message_buffer));
+	if (Http2Session::IsPreface(message_buffer))
+	{
+		// HTTP/2 with prior knowledge is not an HTTP/1.1 request, hand the raw bytes straight to a connection
+		auto connection = CreateConnection(std::move(socket), std::move(client_lease));
+		connection->HandleData(message_buffer);
+		connection->Start();
+		std::lock_guard<std::mutex> lock(_connections_mutex);
+		_connections.emplace_back(std::move(connection));
+		return;
+	}
+	TraceSpan parse_span(trace_id, "parse");
+	HttpRequest request = HttpRequest(message_buffer);
+	parse_span.End();
 	if (!request.isValid)
 	{
 		std::cout << "[HttpServer] - Unable to parse data as http request\n";
-		HttpResponse response = HttpResponse();
-		response.SetHeader("server", (std::string)_config["server_name"]);
-		response.SetHeader("date", GetDate());
-		response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
-		response.SetStatusCode(400);
-		Log(request, response);
-		socket->Write(response.ToBuffer());
+		socket->Write(BadRequest(request).ToBuffer());
 		return;
 	}
-	auto req_res = std::make_pair(std::move(request), std::move(socket));
-	_request_queue.Send(std::move(req_res));
+	auto lane = _request_queue.LaneOf(request.GetPath());
+	_request_queue.Send(lane,
+						QueuedRequest{ std::move(request),
+									   std::move(message_buffer),
+									   std::move(socket),
+									   std::chrono::steady_clock::now(),
+									   std::move(client_lease),
+									   trace_id });
 	return;
 }
 
@@ -153,6 +569,7 @@ void HttpServer::Log(const HttpRequest& request, const HttpResponse& response)
 void HttpServer::HandleApplicationLayer(std::stop_token stop_token)
 {
 	std::cout << "[HttpServer] - Application Layer Started\n";
+	RequestTracer::NameThread("application");
 	std::stringstream body_stream;
 	while (!stop_token.stop_requested() && _is_server_running)
 	{
@@ -162,373 +579,1698 @@ void HttpServer::HandleApplicationLayer(std::stop_token stop_token)
 			continue;
 		}
 		std::cout << "[HttpServer] - received request\n";
-		auto [request, socket] = std::move(receiveResult.value());
-		std::unique_ptr<HttpConnection> connection = std::make_unique<HttpConnection>(std::move(socket));
-		connection->SetDataHandler(
-			[this](const std::vector<unsigned char>& data_buffer) -> std::optional<HttpResponse>
-			{
-				{
-					HttpRequest http_request(data_buffer);
-					if (http_request.isValid)
-					{
-						return HandleHttpRequest(std::move(http_request));
-					}
-				}
-				std::cout << "[HttpServer] - Unknown data received\n";
-				return std::nullopt;
-			});
-		connection->HandleData(request.ToBuffer());
+		auto& [queued_request, queue_slot] = receiveResult.value();
+		auto dequeue_time = std::chrono::steady_clock::now();
+		if (queued_request.trace_id != 0)
+		{
+			RequestTracer::Record(queued_request.trace_id, "queue", queued_request.enqueue_time, dequeue_time);
+		}
+		if (Settings()->load_shedding_enabled && _load_shedder.ShouldShed(queued_request.enqueue_time, dequeue_time))
+		{
+			ShedRequest(std::move(queued_request));
+			continue;
+		}
+		auto socket = std::move(queued_request.socket);
+		// the first request runs under the slot it was dequeued with, the ones after it take their own
+		auto lane_slot = std::make_shared<LaneSlot>(std::move(queue_slot));
+		auto connection = CreateConnection(std::move(socket), std::move(queued_request.client_lease), lane_slot);
+		connection->SetTraceId(queued_request.trace_id);
+		connection->HandleData(queued_request.data_buffer);
+		lane_slot->Release();
+		connection->Start();
+		std::lock_guard<std::mutex> lock(_connections_mutex);
 		_connections.emplace_back(std::move(connection));
 	}
 	std::cout << "[HttpServer] - Application Layer Ending\n";
 	_is_server_running = false;
 };
 
-HttpResponse HttpServer::HandleHttpRequest(HttpRequest&& request)
+void HttpServer::ShedRequest(QueuedRequest&& queued_request)
 {
+	auto settings = Settings();
+	// answering right away is cheaper than serving a client that has likely given up
 	HttpResponse response = HttpResponse();
-	response.SetHeader("server", (std::string)_config["server_name"]);
+	response.SetHeader("server", settings->server_name);
 	response.SetHeader("date", GetDate());
-	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
-	std::stringstream body_stream;
-	auto method = request.GetMethod();
-	auto target = request.GetTarget();
-	// check method allowed
-	if (!ValidateMethod(method))
-	{
-		std::cout << "[HttpServer] - Http Validation failed for method " << method << "\n";
-		response.SetStatusCode(405);
-		response.SetHeader("connection", "close");
-		std::stringstream allowed_stream;
-		std::ostream_iterator<std::string> outputString(allowed_stream, ",");
-		std::copy(_allowed_methods.begin(), _allowed_methods.end(), outputString);
-		response.SetHeader("allow", allowed_stream.str());
-		body_stream << "<body><div><H1>405 Method Not Allowed</H1>" << allowed_stream.str() << "</div></body>";
-		response.SetBody(body_stream.str());
-		Log(request, response);
-		return response;
-	}
-	// check route map for requested resource
-	auto request_handler = _route_map.GetRouteHandler(method + target).value_or(nullptr);
-	if (request_handler)
-	{
-		return request_handler(std::move(request));
-	}
-	target = target == "/" ? "/index.html" : target;
-	if (target == "/upload")
-	{
-		if (method == "POST")
+	response.SetHeader("connection", "close");
+	response.SetHeader("retry-after", std::to_string(settings->retry_after));
+	response.SetStatusCode(503);
+	response.SetBody(std::string("<body><div><H1>503 Service Unavailable</H1>Server overloaded, retry later.</div></body>"));
+	Log(queued_request.request, response);
+	queued_request.socket->Write(response.ToBuffer());
+}
+
+std::unique_ptr<HttpConnection> HttpServer::CreateConnection(std::unique_ptr<jSocket> socket,
+															ClientLease&& client_lease,
+															std::shared_ptr<LaneSlot> queue_slot)
+{
+	auto peer_address = socket->GetPeerAddress();
+	auto peer_name = socket->GetPeerName();
+	auto connection = std::make_unique<HttpConnection>(std::move(socket));
+	connection->SetClientLease(std::move(client_lease));
+	connection->SetDeadlines(Settings()->deadlines);
+	connection->SetBodyCheck(
+		[this](const HttpRequest& request, std::optional<uintmax_t> content_length) -> std::optional<HttpResponse>
 		{
-			return HandleUpload(std::move(request));
-		}
-		if (method == "GET")
+			return CheckRequestBody(request, content_length);
+		});
+	connection->SetTimeoutHandler(
+		[this]() -> HttpResponse
 		{
-			return HandleGetUploads(std::move(request));
-		}
-	}
-	if (auto pos = target.find("/upload/") != std::string::npos)
-	{
-		if (method == "GET")
+			return RequestTimeout(HttpRequest());
+		});
+	connection->SetRouteNamer(
+		[this](const HttpRequest& request) -> std::string
 		{
-			auto filename = std::string(target.begin() + 8, target.end());
-			auto file_location = (std::string)_config["upload_dir"] + "/" + filename;
-			if (!fs::exists(fs::path(file_location)))
+			return RoutePattern(request);
+		});
+	connection->SetHttp2MaxRequestBody(_http2_max_request_body);
+	connection->SetDataHandler(
+		[this, peer_address, peer_name, queue_slot](HttpRequest&& request) -> DataHandlerResult
+		{
+			if (!request.isValid)
 			{
-				response.SetStatusCode(404);
-				response.SetHeader("content-type", "text/html;charset=utf-8");
-				body_stream << "<body><div><H1>404 Not Found</H1>" << filename << " not found.</div></body>";
-				std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
-				response.SetBody(body_vec);
-				Log(request, response);
-				return response;
+				std::cout << "[HttpServer] - Unable to parse data as http request\n";
+				return BadRequest(request);
 			}
-			std::ifstream target_file(file_location, std::ios::binary);
-			if (!target_file.is_open())
+			if (!_client_limiter.AllowRequest(peer_address))
 			{
-				response.SetStatusCode(500);
-				response.SetHeader("content-type", "text/html;charset=utf-8");
-				body_stream << "<body><H1>500 Internal Server Error</H1><div>.</div></body>";
-				std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
-				response.SetBody(body_vec);
-				Log(request, response);
-				return response;
+				return TooManyRequests(request);
 			}
+			// held until the handler returns, a coroutine route gives it up once its task is made
+			LaneSlot lane_slot;
+			if (!queue_slot || !queue_slot->IsHeld())
+			{
+				lane_slot = _request_queue.Acquire(_request_queue.LaneOf(request.GetPath()));
+			}
+			auto async_response = HandleAsyncRoute(request);
+			if (async_response.has_value())
+			{
+				return std::move(async_response.value());
+			}
+			return HandleHttpRequest(std::move(request), peer_name);
+		});
+	connection->SetRequestHandler(
+		[this, peer_address, peer_name](HttpRequest&& request) -> HttpResponse
+		{
+			if (!_client_limiter.AllowRequest(peer_address))
+			{
+				return TooManyRequests(request);
+			}
+			auto lane_slot = _request_queue.Acquire(_request_queue.LaneOf(request.GetPath()));
+			// streams already run on a thread of their own, so it can wait for the coroutine
+			auto async_response = HandleAsyncRoute(request);
+			if (async_response.has_value())
+			{
+				return SyncWait(std::move(async_response.value()));
+			}
+			return HandleHttpRequest(std::move(request), peer_name);
+		});
+	return connection;
+}
 
-			target_file.unsetf(std::ios::skipws);
-			std::vector<unsigned char> target_file_contents((std::istream_iterator<char>(target_file)), std::istream_iterator<char>());
-
-			response.SetStatusCode(200);
-			response.SetHeader("content-type", "application/octet-stream");
-			response.SetHeader("Content-Disposition", R"(inline; filename=")" + filename + R"(")");
-			response.SetBody(target_file_contents);
-			Log(request, response);
-			return response;
-		}
+HttpResponse HttpServer::BadRequest(const HttpRequest& request)
+{
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	// the request could not be framed, so nothing after it on the connection can be either
+	response.SetHeader("connection", "close");
+	response.SetStatusCode(400);
+	response.SetBody(std::vector<unsigned char>());
+	Log(request, response);
+	return response;
+}
 
-		response.SetStatusCode(405);
-		response.SetHeader("allow", "GET");
-		body_stream << "<body><div><H1>405 Method Not Allowed</H1><p>The request method " << method << " is not appropriate for the target "
-					<< target << ".</p></div></body>";
-		response.SetBody(body_stream.str());
-		Log(request, response);
-		return response;
-	}
-	// fall back to web dir
-	auto target_location = (std::string)_config["web_dir"] + "/" + target;
-	if (!fs::exists(fs::path(target_location)))
+HttpResponse HttpServer::UpgradeWebSocket(HttpRequest&& request, const WebSocketSession::MessageHandler& message_handler)
+{
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	auto upgrade = request.GetHeader("Upgrade").value_or("");
+	std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(), ::tolower);
+	auto client_key = request.GetHeader("Sec-WebSocket-Key");
+	// RFC 6455 section 4.2.1
+	if (upgrade.find("websocket") == std::string::npos || !client_key.has_value())
 	{
-		response.SetStatusCode(404);
-		response.SetHeader("content-type", "text/html;charset=utf-8");
-		body_stream << "<body><div><H1>404 Not Found</H1>" << target << " not found.</div></body>";
-		std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
-		response.SetBody(body_vec);
+		response.SetHeader("connection", "close");
+		response.SetStatusCode(400);
+		response.SetBody(std::vector<unsigned char>());
 		Log(request, response);
 		return response;
 	}
-	std::ifstream target_file(target_location, std::ios::binary);
-	if (!target_file.is_open())
+	if (request.GetHeader("Sec-WebSocket-Version").value_or("") != "13")
 	{
-		response.SetStatusCode(500);
-		response.SetHeader("content-type", "text/html;charset=utf-8");
-		body_stream << "<body><H1>500 Internal Server Error</H1><div>.</div></body>";
-		std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
-		response.SetBody(body_vec);
+		response.SetHeader("connection", "close");
+		response.SetHeader("sec-websocket-version", "13");
+		response.SetStatusCode(426);
+		response.SetBody(std::vector<unsigned char>());
 		Log(request, response);
 		return response;
 	}
-	std::vector<unsigned char> target_file_contents((std::istreambuf_iterator<char>(target_file)), std::istreambuf_iterator<char>());
-	response.SetStatusCode(200);
-	response.SetHeader("content-type", "text/html;charset=utf-8");
-	response.SetBody(target_file_contents);
+	// no body, a 1xx response must not carry a content-length (RFC 7230 section 3.3.2)
+	response.SetStatusCode(101);
+	response.SetHeader("connection", "Upgrade");
+	response.SetHeader("upgrade", "websocket");
+	response.SetHeader("sec-websocket-accept", WebSocketAcceptKey(client_key.value()));
+	response.SetUpgradeHandler(
+		[this, path = request.GetPath(), message_handler](std::unique_ptr<jSocket> socket,
+														  std::vector<unsigned char>&& input) -> std::shared_ptr<UpgradedSession>
+		{
+			auto session = std::make_shared<WebSocketSession>(_event_loop, std::move(socket), path, message_handler, _websocket_settings);
+			session->Start(std::move(input));
+			return session;
+		});
 	Log(request, response);
 	return response;
 }
 
-HttpResponse HttpServer::HandleUpload(HttpRequest&& request)
+HttpResponse HttpServer::Subscribe(const HttpRequest& request, const std::vector<std::string>& topics)
 {
-	HttpResponse response;
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	response.SetStatusCode(200);
+	// the stream has no length, it ends when the connection closes
+	response.SetHeader("connection", "close");
+	response.SetHeader("content-type", "text/event-stream");
+	response.SetHeader("cache-control", "no-store");
+	response.SetUpgradeHandler(
+		[this, topics](std::unique_ptr<jSocket> socket, std::vector<unsigned char>&&) -> std::shared_ptr<UpgradedSession>
+		{
+			auto session = std::make_shared<EventStreamSession>(_event_loop, std::move(socket), _event_stream_settings);
+			for (auto& topic : topics)
+			{
+				_event_broker.Subscribe(topic, session);
+			}
+			session->Start();
+			return session;
+		});
+	Log(request, response);
+	return response;
+}
+
+size_t HttpServer::Publish(const std::string& topic, const std::string& data, const std::string& event, const std::string& id)
+{
+	return _event_broker.Publish(topic, data, event, id);
+}
+
+HttpResponse HttpServer::TooManyRequests(const HttpRequest& request)
+{
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
 	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
-	response.SetHeader("server", (std::string)_config["server_name"]);
+	response.SetHeader("retry-after", "1");
+	response.SetStatusCode(429);
+	response.SetBody(std::string("<body><div><H1>429 Too Many Requests</H1>Request rate limit exceeded, retry later.</div></body>"));
+	Log(request, response);
+	return response;
+}
+
+std::optional<HttpResponse> HttpServer::CheckRequestBody(const HttpRequest& request, std::optional<uintmax_t> content_length)
+{
+	auto settings = Settings();
+	auto method = request.GetMethod();
+	if (!ValidateMethod(*settings, method))
+	{
+		return MethodNotAllowed(request, settings->allowed_methods);
+	}
+	auto path = request.GetPath();
+	auto body_limit = &settings->default_body_limit;
+	for (auto& route_limit : settings->body_limits)
+	{
+		// a prefix covers whole path segments, the longest match wins
+		auto& prefix = route_limit.prefix;
+		if (path.compare(0, prefix.size(), prefix) != 0)
+		{
+			continue;
+		}
+		auto boundary = prefix.back() == '/' || path.size() == prefix.size() || path[prefix.size()] == '/';
+		if (boundary && prefix.size() > body_limit->prefix.size())
+		{
+			body_limit = &route_limit;
+		}
+	}
+	if (!body_limit->methods.empty() && std::find(body_limit->methods.begin(), body_limit->methods.end(), method) == body_limit->methods.end())
+	{
+		return MethodNotAllowed(request, body_limit->methods);
+	}
+	auto content_type = request.GetHeader("Content-Type").value_or("");
+	auto media_type = content_type.substr(0, content_type.find(';'));
+	media_type.erase(media_type.find_last_not_of(" \t") + 1);
+	std::transform(media_type.begin(), media_type.end(), media_type.begin(), ::tolower);
+	auto type_accepted = body_limit->content_types.empty() ||
+						 std::any_of(body_limit->content_types.begin(),
+									 body_limit->content_types.end(),
+									 [&media_type](const std::string& accepted_type)
+									 {
+										 return accepted_type == media_type ||
+												(accepted_type.ends_with("/*") &&
+												 media_type.starts_with(accepted_type.substr(0, accepted_type.size() - 1)));
+									 });
+	// the upload route only stores what HandleUpload understands
+	if (type_accepted && method == "POST" && path == "/upload")
+	{
+		type_accepted = IsUploadContentType(content_type);
+	}
+	if (!type_accepted)
+	{
+		auto response = RejectBody(request, 415);
+		std::string accepted_types;
+		for (auto& accepted_type : body_limit->content_types.empty() ? std::vector<std::string>{ "multipart/form-data", "text/plain" } :
+																		body_limit->content_types)
+		{
+			accepted_types += (accepted_types.empty() ? "" : " , ") + accepted_type;
+		}
+		response.SetHeader("accept", accepted_types);
+		return response;
+	}
+	if (body_limit->max_size > 0 && content_length.value_or(0) > body_limit->max_size)
+	{
+		return RejectBody(request, 413);
+	}
+	return std::nullopt;
+}
+
+HttpResponse HttpServer::MethodNotAllowed(const HttpRequest& request, const std::vector<std::string>& allowed_methods)
+{
+	std::cout << "[HttpServer] - Http Validation failed for method " << request.GetMethod() << "\n";
+	auto response = RejectBody(request, 405);
+	std::stringstream allowed_stream;
+	std::ostream_iterator<std::string> outputString(allowed_stream, ",");
+	std::copy(allowed_methods.begin(), allowed_methods.end(), outputString);
+	response.SetHeader("allow", allowed_stream.str());
+	response.SetBody("<body><div><H1>405 Method Not Allowed</H1>" + allowed_stream.str() + "</div></body>");
+	return response;
+}
+
+HttpResponse HttpServer::RejectBody(const HttpRequest& request, int status_code)
+{
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	response.SetHeader("connection", "close");
+	response.SetStatusCode(status_code);
+	response.SetBody(std::vector<unsigned char>());
+	Log(request, response);
+	return response;
+}
+
+HttpResponse HttpServer::RequestTimeout(const HttpRequest& request)
+{
+	_slow_client_count++;
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	// the rest of the request may still be on its way, so the connection cannot be reused
+	response.SetHeader("connection", "close");
+	response.SetStatusCode(408);
+	response.SetBody(std::vector<unsigned char>());
+	Log(request, response);
+	return response;
+}
+
+HttpResponse HttpServer::HandleHttpRequest(HttpRequest&& request, const std::string& peer_name)
+{
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
+	std::stringstream body_stream;
+	auto method = request.GetMethod();
+	auto target = request.GetTarget();
+	// check method allowed
+	if (!ValidateMethod(*settings, method))
+	{
+		return MethodNotAllowed(request, settings->allowed_methods);
+	}
+	if (method == "GET" && !settings->status_route.empty() && target == settings->status_route)
+	{
+		return HandleStatus(std::move(request));
+	}
+	if (method == "GET" && !settings->trace_route.empty() && target == settings->trace_route)
+	{
+		return HandleTrace(std::move(request));
+	}
+	if (method == "GET" && !settings->allocations_route.empty() && request.GetPath() == settings->allocations_route)
+	{
+		return HandleAllocations(std::move(request));
+	}
+	// check route map for requested resource
+	auto request_handler = _route_map.GetRouteHandler(method + target).value_or(nullptr);
+	if (request_handler)
+	{
+		return request_handler(std::move(request));
+	}
+	auto proxy_response = settings->reverse_proxy->Forward(request, peer_name, settings->server_name);
+	if (proxy_response.has_value())
+	{
+		return HandleProxyResponse(request, std::move(proxy_response.value()));
+	}
+	auto path = NormalizePath(request.GetPath());
+	if (!path.has_value())
+	{
+		return BadRequest(request);
+	}
+	if (path.value() == "/upload")
+	{
+		if (method == "POST")
+		{
+			return HandleUpload(std::move(request));
+		}
+		if (method == "GET")
+		{
+			return HandleGetUploads(std::move(request));
+		}
+	}
+	if (path->starts_with("/upload/"))
+	{
+		auto upload_store = UploadStore(settings->upload_dir);
+		// uploads are stored flat, only the last segment names one
+		auto filename = fs::path(*path).filename().string();
+		if (method == "GET" && path->starts_with("/upload/sha256/"))
+		{
+			// a blob never changes, its digest is a strong validator for good
+			auto digest = filename;
+			auto blob_path = upload_store.GetBlobPath(digest);
+			if (blob_path.has_value() && _file_cache.Open(blob_path->string()).has_value())
+			{
+				response.SetHeader("cache-control", "public, max-age=31536000, immutable");
+			}
+			return ServeFile(std::move(request),
+							 std::move(response),
+							 blob_path.value_or(fs::path()).string(),
+							 "application/octet-stream",
+							 "\"" + digest + "\"");
+		}
+		if (method == "GET")
+		{
+			auto file_location = settings->upload_dir + "/" + filename;
+			auto digest = upload_store.GetDigest(filename);
+			response.SetHeader("Content-Disposition", R"(inline; filename=")" + filename + R"(")");
+			return ServeFile(std::move(request),
+							 std::move(response),
+							 file_location,
+							 "application/octet-stream",
+							 digest.has_value() ? "\"" + digest.value() + "\"" : "");
+		}
+
+		if (method == "PUT")
+		{
+			return HandleRawUpload(std::move(request), filename);
+		}
+
+		response.SetStatusCode(405);
+		response.SetHeader("allow", "GET, PUT");
+		body_stream << "<body><div><H1>405 Method Not Allowed</H1><p>The request method " << method << " is not appropriate for the target "
+					<< target << ".</p></div></body>";
+		response.SetBody(body_stream.str());
+		Log(request, response);
+		return response;
+	}
+	if (settings->embedded_assets)
+	{
+		// every spelling of a path finds the same asset
+		auto asset = AssetBundle::Embedded().Find(path->back() == '/' ? *path + "index.html" : *path);
+		if (asset)
+		{
+			return ServeAsset(std::move(request), std::move(response), *asset);
+		}
+	}
+	// fall back to web dir, without one nothing is found
+	auto target_location = settings->web_dir.empty() ? std::string() : settings->web_dir + (path->back() == '/' ? *path + "index.html" : *path);
+	return ServeFile(std::move(request), std::move(response), target_location, "text/html;charset=utf-8");
+}
+
+std::string HttpServer::RoutePattern(const HttpRequest& request)
+{
+	auto settings = Settings();
+	auto method = request.GetMethod();
+	auto target = request.GetTarget();
+	// registered routes match the whole target, so there are only as many names as routes
+	if (_route_map.HasRoute(method + target) || target == settings->status_route || target == settings->trace_route ||
+		request.GetPath() == settings->allocations_route)
+	{
+		return target;
+	}
+	auto proxy_prefix = settings->reverse_proxy->MatchRoute(target);
+	if (proxy_prefix.has_value())
+	{
+		return proxy_prefix->back() == '/' ? proxy_prefix.value() + "*" : proxy_prefix.value() + "/*";
+	}
+	auto path = NormalizePath(request.GetPath()).value_or("");
+	if (path == "/upload")
+	{
+		return "/upload";
+	}
+	if (path.starts_with("/upload/sha256/"))
+	{
+		return "/upload/sha256/*";
+	}
+	if (path.starts_with("/upload/"))
+	{
+		return "/upload/*";
+	}
+	return "/*";
+}
+
+std::optional<Task<HttpResponse>> HttpServer::HandleAsyncRoute(HttpRequest& request)
+{
+	auto settings = Settings();
+	auto method = request.GetMethod();
+	if (!ValidateMethod(*settings, method))
+	{
+		return std::nullopt;
+	}
+	auto request_handler = _route_map.GetAsyncRouteHandler(method + request.GetTarget()).value_or(nullptr);
+	if (!request_handler)
+	{
+		return std::nullopt;
+	}
+	// the body is read on the connection's thread before the coroutine starts, it must not block the event loop
+	request.GetBody();
+	return RunAsyncHandler(std::move(request_handler), std::move(request));
+}
+
+Task<HttpResponse> HttpServer::RunAsyncHandler(std::function<Task<HttpResponse>(HttpRequest&&)> handler, HttpRequest request)
+{
+	auto settings = Settings();
+	std::string error;
+	try
+	{
+		// handlers take the request by reference, it has to outlive the handler's own frame
+		HttpRequest handler_request(request);
+		auto handler_task = handler(std::move(handler_request));
+		auto response = co_await handler_task;
+		// fill in what the handler left out, as the proxy does
+		co_return HandleProxyResponse(request, std::move(response));
+	}
+	catch (const std::exception& e)
+	{
+		error = e.what();
+	}
+	std::cout << "[HttpServer] - coroutine handler failed (" << error << ")\n";
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	response.SetHeader("connection", "close");
+	response.SetStatusCode(500);
+	response.SetBody(std::string("<body><H1>500 Internal Server Error</H1><div>.</div></body>"));
+	Log(request, response);
+	co_return response;
+}
+
+HttpResponse HttpServer::HandleProxyResponse(const HttpRequest& request, HttpResponse&& response)
+{
+	auto settings = Settings();
+	// the upstream's own date and server headers are passed through as they came
+	if (!response.GetHeader("date").has_value())
+	{
+		response.SetHeader("date", GetDate());
+	}
+	if (!response.GetHeader("server").has_value())
+	{
+		response.SetHeader("server", settings->server_name);
+	}
+	if (!response.GetHeader("connection").has_value())
+	{
+		response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
+	}
+	Log(request, response);
+	return std::move(response);
+}
+
+HttpResponse HttpServer::HandleStatus(HttpRequest&& request)
+{
+	auto settings = Settings();
+	auto status_object = jjson::Object();
+	{
+		std::lock_guard<std::mutex> lock(_connections_mutex);
+		status_object["connections"] = static_cast<int>(_connections.size());
+	}
+	status_object["overloaded"] = _load_shedder.IsOverloaded();
+	status_object["shed_requests"] = static_cast<int>(_load_shedder.ShedCount());
+	auto cache_stats = _response_cache.Stats();
+	status_object["cache_hits"] = static_cast<int>(cache_stats.hits);
+	status_object["cache_stale_hits"] = static_cast<int>(cache_stats.stale_hits);
+	status_object["cache_misses"] = static_cast<int>(cache_stats.misses);
+	status_object["cache_bytes"] = static_cast<int>(cache_stats.bytes);
+	auto file_cache_stats = _file_cache.Stats();
+	status_object["file_cache_hits"] = static_cast<int>(file_cache_stats.hits);
+	status_object["file_cache_misses"] = static_cast<int>(file_cache_stats.misses);
+	status_object["file_cache_entries"] = static_cast<int>(file_cache_stats.entries);
+	status_object["event_subscribers"] = static_cast<int>(_event_broker.SubscriberCount());
+	status_object["slow_clients_closed"] = static_cast<int>(_slow_client_count.load());
+	for (auto& lane_stats : _request_queue.Stats())
+	{
+		status_object["lanes"][lane_stats.name]["queued"] = static_cast<int>(lane_stats.queued);
+		status_object["lanes"][lane_stats.name]["running"] = static_cast<int>(lane_stats.running);
+		status_object["lanes"][lane_stats.name]["dispatched"] = static_cast<int>(lane_stats.dispatched);
+	}
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
+	response.SetHeader("content-type", "application/json");
+	response.SetHeader("cache-control", "no-store");
+	response.SetStatusCode(200);
+	response.SetBody(status_object);
+	Log(request, response);
+	return response;
+}
+
+HttpResponse HttpServer::HandleTrace(HttpRequest&& request)
+{
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
+	response.SetHeader("content-type", "application/json");
+	response.SetHeader("cache-control", "no-store");
+	response.SetStatusCode(200);
+	auto trace = RequestTracer::Dump();
+	response.SetBody(std::vector<unsigned char>(trace.begin(), trace.end()));
+	Log(request, response);
+	return response;
+}
+
+HttpResponse HttpServer::HandleAllocations(HttpRequest&& request)
+{
+	auto settings = Settings();
+	HttpResponse response = HttpResponse();
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
+	response.SetHeader("content-type", "application/json");
+	response.SetHeader("cache-control", "no-store");
+	response.SetStatusCode(200);
+	auto allocations = AllocationTracker::Dump();
+	if (request.GetQueryParameter("reset").has_value())
+	{
+		AllocationTracker::Reset();
+	}
+	response.SetBody(std::vector<unsigned char>(allocations.begin(), allocations.end()));
+	Log(request, response);
+	return response;
+}
+
+HttpResponse HttpServer::ServeFile(
+	HttpRequest&& request, HttpResponse&& response, const std::string& file_location, const std::string& content_type, const std::string& etag)
+{
+	std::stringstream body_stream;
+	auto static_file = _file_cache.Open(file_location);
+	if (static_file.has_value() && !etag.empty())
+	{
+		static_file->SetETag(etag);
+	}
+	if (!static_file.has_value())
+	{
+		response.SetStatusCode(404);
+		response.SetHeader("content-type", "text/html;charset=utf-8");
+		body_stream << "<body><div><H1>404 Not Found</H1>" << request.GetTarget() << " not found.</div></body>";
+		std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
+		response.SetBody(body_vec);
+		Log(request, response);
+		return response;
+	}
+	response.SetHeader("etag", static_file->GetETag());
+	response.SetHeader("last-modified", static_file->GetLastModified());
+	response.SetHeader("accept-ranges", "bytes");
+	auto precondition_status = static_file->EvaluatePreconditions(request);
+	if (precondition_status.has_value())
+	{
+		response.SetStatusCode(precondition_status.value());
+		if (precondition_status.value() == 412)
+		{
+			response.SetBody(std::vector<unsigned char>());
+		}
+		Log(request, response);
+		return response;
+	}
+
+	auto file_size = static_file->GetSize();
+	std::vector<ByteRange> ranges;
+	auto range_header = request.GetHeader("Range");
+	if (range_header.has_value() && static_file->IfRangeMatches(request))
+	{
+		auto parsed_ranges = StaticFile::ParseRange(range_header.value(), file_size);
+		if (parsed_ranges.has_value())
+		{
+			if (parsed_ranges->empty())
+			{
+				response.SetStatusCode(416);
+				response.SetHeader("content-range", "bytes */" + std::to_string(file_size));
+				response.SetBody(std::vector<unsigned char>());
+				Log(request, response);
+				return response;
+			}
+			ranges = std::move(parsed_ranges.value());
+		}
+	}
+
+	if (ranges.empty())
+	{
+		response.SetStatusCode(200);
+		response.SetHeader("content-type", content_type);
+		response.SetBody(static_file->Body());
+		Log(request, response);
+		return response;
+	}
+
+	if (ranges.size() == 1)
+	{
+		auto range = ranges.front();
+		response.SetStatusCode(206);
+		response.SetHeader("content-type", content_type);
+		response.SetHeader("content-range",
+						   "bytes " + std::to_string(range.first) + "-" + std::to_string(range.last) + "/" + std::to_string(file_size));
+		response.SetBody(static_file->Body(range.first, range.Length()));
+		Log(request, response);
+		return response;
+	}
+
+	// multiple ranges are sent as multipart/byteranges (RFC 7233 appendix A)
+	std::vector<unsigned char> range_body;
+	auto boundary = "jHttpServe" + std::to_string(std::hash<std::string>{}(static_file->GetETag() + GetDate()));
+	response.SetHeader("content-type", "multipart/byteranges; boundary=" + boundary);
+	for (auto& range : ranges)
+	{
+		auto range_contents = static_file->Read(range.first, range.Length());
+		if (!range_contents.has_value())
+		{
+			range_body.clear();
+			break;
+		}
+		std::stringstream part_stream;
+		part_stream << "--" << boundary << CR << LF;
+		part_stream << "content-type: " << content_type << CR << LF;
+		part_stream << "content-range: bytes " << range.first << "-" << range.last << "/" << file_size << CR << LF << CR << LF;
+		auto part_header = part_stream.str();
+		range_body.insert(range_body.end(), part_header.begin(), part_header.end());
+		range_body.insert(range_body.end(), range_contents->begin(), range_contents->end());
+		range_body.insert(range_body.end(), { CR, LF });
+	}
+	if (!range_body.empty())
+	{
+		auto closing_boundary = "--" + boundary + "--\r\n";
+		range_body.insert(range_body.end(), closing_boundary.begin(), closing_boundary.end());
+	}
+	if (range_body.empty())
+	{
+		response.SetStatusCode(500);
+		response.SetHeader("content-type", "text/html;charset=utf-8");
+		body_stream << "<body><H1>500 Internal Server Error</H1><div>.</div></body>";
+		std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
+		response.SetBody(body_vec);
+		Log(request, response);
+		return response;
+	}
+	response.SetStatusCode(206);
+	response.SetBody(range_body);
+	Log(request, response);
+	return response;
+}
+
+HttpResponse HttpServer::ServeAsset(HttpRequest&& request, HttpResponse&& response, const EmbeddedAsset& asset)
+{
+	auto etag = std::string(asset.etag);
+	auto last_modified = std::string(asset.last_modified);
+	response.SetHeader("etag", etag);
+	response.SetHeader("last-modified", last_modified);
+	if (asset.gzip_data)
+	{
+		// caches have to keep the encodings apart
+		response.SetHeader("vary", "accept-encoding");
+	}
+	auto precondition_status = StaticFile::EvaluatePreconditions(request, etag, StaticFile::ParseHttpDate(last_modified).value_or(0));
+	if (precondition_status.has_value())
+	{
+		response.SetStatusCode(precondition_status.value());
+		if (precondition_status.value() == 412)
+		{
+			response.SetBody(std::vector<unsigned char>());
+		}
+		Log(request, response);
+		return response;
+	}
+	response.SetHeader("content-type", std::string(asset.content_type));
+	response.SetHeader("accept-ranges", "bytes");
+
+	// a range is served from the identity encoding. several ranges are answered with the whole asset,
+	// which RFC 7233 allows, rather than building a multipart body for something already in memory
+	auto range_header = request.GetHeader("Range");
+	if (range_header.has_value() && StaticFile::IfRangeMatches(request, etag, StaticFile::ParseHttpDate(last_modified).value_or(0)))
+	{
+		auto ranges = StaticFile::ParseRange(range_header.value(), asset.size);
+		if (ranges.has_value() && ranges->empty())
+		{
+			response.SetStatusCode(416);
+			response.SetHeader("content-range", "bytes */" + std::to_string(asset.size));
+			response.SetBody(std::vector<unsigned char>());
+			Log(request, response);
+			return response;
+		}
+		if (ranges.has_value() && ranges->size() == 1)
+		{
+			auto range = ranges->front();
+			response.SetStatusCode(206);
+			response.SetHeader("content-range",
+							   "bytes " + std::to_string(range.first) + "-" + std::to_string(range.last) + "/" + std::to_string(asset.size));
+			response.SetBody(StaticBody{ asset.data + range.first, static_cast<size_t>(range.Length()) });
+			Log(request, response);
+			return response;
+		}
+	}
+
+	// the body is written from the binary's read-only data, never copied
+	response.SetStatusCode(200);
+	if (asset.gzip_data && AssetBundle::AcceptsGzip(request.GetHeader("Accept-Encoding").value_or("")))
+	{
+		response.SetHeader("content-encoding", "gzip");
+		response.SetBody(StaticBody{ asset.gzip_data, asset.gzip_size });
+	}
+	else
+	{
+		response.SetBody(StaticBody{ asset.data, asset.size });
+	}
+	Log(request, response);
+	return response;
+}
+
+HttpResponse HttpServer::HandleUpload(HttpRequest&& request)
+{
+	auto settings = Settings();
+	HttpResponse response;
+	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
+	response.SetHeader("server", settings->server_name);
 	response.SetHeader("date", GetDate());
-	auto accepted_content_type = std::vector<std::string>{ "multipart/form-data", "text/plain" };
 	auto content_type = request.GetHeader("Content-Type").value_or("");
-	bool acceptable_type = false;
-	if (content_type == "")
+	if (!IsUploadContentType(content_type))
+	{
+		response.SetStatusCode(415);
+		response.SetHeader("accept", "multipart/form-data , text/plain");
+		Log(request, response);
+		return response;
+	}
+	if (content_type.empty())
+	{
+		content_type = "text/plain";
+	}
+	if (!fs::exists(fs::path(settings->upload_dir)))
+	{
+		fs::create_directory(settings->upload_dir);
+	}
+	std::optional<std::string> digest;
+	// name and digest of each file of a multipart upload
+	std::vector<std::pair<std::string, std::string>> stored_files;
+	if (content_type.find("text/plain") != std::string::npos)
+	{
+		// content addressed uploads without a name are known by their digest, others by the time and a sequence number
+		auto file_name =
+			settings->content_addressed_uploads ? std::string() : "file" + GetshortDate() + "_" + std::to_string(++_upload_sequence);
+		digest = SaveUpload(*settings,
+							file_name,
+							[&request]()
+							{
+								return request.ReadBody();
+							});
+		if (!digest.has_value())
+		{
+			response.SetStatusCode(500);
+			Log(request, response);
+			return response;
+		}
+	}
+	else if (content_type.find("multipart/form-data") != std::string::npos)
+	{
+		auto boundary = MultipartReader::GetBoundary(content_type);
+		if (!boundary.has_value())
+		{
+			response.SetStatusCode(400);
+			Log(request, response);
+			return response;
+		}
+		auto multipart_reader = MultipartReader(boundary.value(),
+												[&request]()
+												{
+													return request.ReadBody();
+												});
+		// every file part streams to its own file, other form fields are skipped
+		for (auto part = multipart_reader.NextPart(); part.has_value(); part = multipart_reader.NextPart())
+		{
+			auto file_name = fs::path(part->file_name.value_or("")).filename().string();
+			if (file_name.empty() || file_name[0] == '.')
+			{
+				continue;
+			}
+			auto part_digest = SaveUpload(*settings,
+										  file_name,
+										  [&multipart_reader]()
+										  {
+											  return multipart_reader.ReadPartBody();
+										  });
+			if (!part_digest.has_value())
+			{
+				response.SetStatusCode(multipart_reader.HasFailed() ? 400 : 500);
+				Log(request, response);
+				return response;
+			}
+			stored_files.emplace_back(file_name, part_digest.value());
+		}
+		if (multipart_reader.HasFailed())
+		{
+			response.SetStatusCode(400);
+			Log(request, response);
+			return response;
+		}
+		if (stored_files.size() == 1)
+		{
+			digest = stored_files.front().second;
+		}
+	}
+	response.SetHeader("content-type", "application/json");
+	auto api_object = jjson::Object();
+	api_object["status"] = "Success!!!";
+	api_object["message"] = "Upload Complete";
+	if (!stored_files.empty())
+	{
+		api_object["files"] = static_cast<int>(stored_files.size());
+	}
+	for (auto& [file_name, file_digest] : stored_files)
+	{
+		if (!file_digest.empty())
+		{
+			api_object["digests"][file_name] = file_digest;
+		}
+	}
+	if (digest.has_value() && !digest->empty())
+	{
+		api_object["digest"] = digest.value();
+		response.SetHeader("etag", "\"" + digest.value() + "\"");
+	}
+	response.SetBody(api_object);
+	response.SetStatusCode(200);
+	Log(request, response);
+	return response;
+}
+
+HttpResponse HttpServer::HandleRawUpload(HttpRequest&& request, const std::string& file_name)
+{
+	auto settings = Settings();
+	HttpResponse response;
+	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	auto stored_name = fs::path(file_name).filename().string();
+	if (stored_name.empty() || stored_name[0] == '.')
+	{
+		response.SetStatusCode(400);
+		Log(request, response);
+		return response;
+	}
+	std::error_code error;
+	fs::create_directories(settings->upload_dir, error);
+	if (settings->content_addressed_uploads)
+	{
+		// the digest needs every byte, so the body is read through userspace to be hashed
+		auto digest = SaveUpload(*settings,
+								 stored_name,
+								 [&request]()
+								 {
+									 return request.ReadBody();
+								 });
+		response.SetStatusCode(digest.has_value() ? 201 : 500);
+		if (digest.has_value())
+		{
+			response.SetHeader("location", "/upload/" + stored_name);
+			response.SetHeader("etag", "\"" + digest.value() + "\"");
+			response.SetHeader("content-type", "application/json");
+			auto api_object = jjson::Object();
+			api_object["status"] = "Success!!!";
+			api_object["message"] = "Upload Complete";
+			api_object["digest"] = digest.value();
+			response.SetBody(api_object);
+		}
+		Log(request, response);
+		return response;
+	}
+	// written under a hidden temporary name and renamed into place, so a reader never sees a partial upload
+	auto temp_path = settings->upload_dir + "/.upload-XXXXXX";
+	int upload_fd = mkstemp(temp_path.data());
+	if (upload_fd < 0)
+	{
+		std::cout << "[HttpServer] - Unable to create file in " << settings->upload_dir << "\n";
+		response.SetStatusCode(500);
+		Log(request, response);
+		return response;
+	}
+	std::optional<uintmax_t> content_length;
+	try
+	{
+		content_length = std::stoull(request.GetHeader("Content-Length").value_or(""));
+	}
+	catch (...)
+	{
+	}
+	// reserving the blocks up front keeps the file contiguous and fails early when the disk is full
+	if (content_length.value_or(0) > 0 && fallocate(upload_fd, 0, 0, static_cast<off_t>(content_length.value())) != 0 &&
+		errno != EOPNOTSUPP)
+	{
+		close(upload_fd);
+		unlink(temp_path.c_str());
+		response.SetStatusCode(507);
+		Log(request, response);
+		return response;
+	}
+	auto bytes_written = request.SpliceBody(upload_fd, 0);
+	auto file_location = settings->upload_dir + "/" + stored_name;
+	if (!bytes_written.has_value() || (content_length.has_value() && bytes_written.value() != content_length.value()) ||
+		fchmod(upload_fd, 0644) != 0 || rename(temp_path.c_str(), file_location.c_str()) != 0)
+	{
+		close(upload_fd);
+		unlink(temp_path.c_str());
+		response.SetStatusCode(bytes_written.has_value() ? 500 : 400);
+		Log(request, response);
+		return response;
+	}
+	_upload_index.Update(file_location);
+	_file_cache.Invalidate(file_location);
+	_file_syncer.Sync(upload_fd, settings->upload_dir);
+	response.SetHeader("location", "/upload/" + stored_name);
+	response.SetHeader("content-type", "application/json");
+	auto api_object = jjson::Object();
+	api_object["status"] = "Success!!!";
+	api_object["message"] = "Upload Complete";
+	response.SetBody(api_object);
+	response.SetStatusCode(201);
+	Log(request, response);
+	return response;
+}
+
+std::optional<std::string> HttpServer::SaveUpload(const ServerSettings& settings, const std::string& file_name, const BodyReader& body_reader)
+{
+	if (settings.content_addressed_uploads)
+	{
+		auto digest = UploadStore(settings.upload_dir).Store(file_name, body_reader);
+		if (digest.has_value())
+		{
+			auto stored_name = fs::path(file_name.empty() ? digest.value() : file_name).filename();
+			_upload_index.Update(fs::path(settings.upload_dir) / stored_name);
+			_file_cache.Invalidate((fs::path(settings.upload_dir) / stored_name).string());
+		}
+		return digest;
+	}
+	auto file_location = settings.upload_dir + "/" + file_name;
+	auto upload_file = std::ofstream(file_location, std::ios::binary);
+	if (!upload_file)
+	{
+		return std::nullopt;
+	}
+	while (true)
+	{
+		auto body_part = body_reader();
+		if (!body_part.has_value() || !upload_file.write((char*)body_part->data(), body_part->size()))
+		{
+			// a partial upload is not left looking like a complete one
+			upload_file.close();
+			fs::remove(file_location);
+			_file_cache.Invalidate(file_location);
+			return std::nullopt;
+		}
+		if (body_part->empty())
+		{
+			break;
+		}
+	}
+	upload_file.close();
+	_upload_index.Update(file_location);
+	_file_cache.Invalidate(file_location);
+	return std::string();
+}
+
+HttpResponse HttpServer::HandleGetUploads(HttpRequest&& request)
+{
+	auto settings = Settings();
+	HttpResponse response;
+	response.SetHeader("server", settings->server_name);
+	response.SetHeader("date", GetDate());
+	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
+	response.SetHeader("cache-control", "no-store");
+	auto sort_name = request.GetQueryParameter("sort").value_or("name");
+	auto order = request.GetQueryParameter("order").value_or("asc");
+	auto cursor = request.GetQueryParameter("cursor").value_or("");
+	auto format = request.GetQueryParameter("format").value_or("");
+	auto limit = UPLOAD_INDEX_DEFAULT_PAGE_SIZE;
+	auto sort = sort_name == "size" ? UploadSort::Size : sort_name == "modified" ? UploadSort::Modified : UploadSort::Name;
+	auto limit_parameter = request.GetQueryParameter("limit");
+	if (limit_parameter.has_value())
+	{
+		auto parse_result = std::from_chars(limit_parameter->data(), limit_parameter->data() + limit_parameter->size(), limit);
+		if (parse_result.ec != std::errc() || parse_result.ptr != limit_parameter->data() + limit_parameter->size())
+		{
+			limit = 0;
+		}
+	}
+	if ((sort == UploadSort::Name && sort_name != "name") || (order != "asc" && order != "desc") || limit == 0 ||
+		limit > UPLOAD_INDEX_MAX_PAGE_SIZE)
+	{
+		response.SetStatusCode(400);
+		response.SetHeader("content-type", "text/html;charset=utf-8");
+		response.SetBody("<body><H1>400 Bad Request</H1><div>sort is name, size or modified, order is asc or desc and limit is 1 to " +
+						 std::to_string(UPLOAD_INDEX_MAX_PAGE_SIZE) + "</div></body>");
+		Log(request, response);
+		return response;
+	}
+	auto page = _upload_index.GetPage(sort, order == "desc", cursor, limit);
+	std::string next_target;
+	if (page.next_cursor.has_value())
+	{
+		next_target = "/upload?sort=" + sort_name + "&order=" + order + "&limit=" + std::to_string(limit) +
+					  "&cursor=" + EncodeQueryValue(page.next_cursor.value()) + (format.empty() ? "" : "&format=" + format);
+		response.SetHeader("link", "<" + next_target + ">; rel=\"next\"");
+	}
+	std::string body;
+	auto accept = request.GetHeader("Accept").value_or("");
+	auto wants_json = format == "json" || (format.empty() && accept.find("application/json") != std::string::npos);
+	if (wants_json)
+	{
+		body = R"({"uploads":[)";
+		for (auto& entry : page.entries)
+		{
+			body += (&entry == &page.entries.front() ? "" : ",");
+			body += R"({"name":")" + EscapeJson(entry.name) + R"(","size":)" + std::to_string(entry.size) +
+					R"(,"modified":)" + std::to_string(entry.modified) + "}";
+		}
+		body += "]";
+		if (page.next_cursor.has_value())
+		{
+			body += R"(,"next_cursor":")" + EscapeJson(page.next_cursor.value()) + "\"";
+		}
+		body += "}";
+		response.SetHeader("content-type", "application/json");
+	}
+	else
+	{
+		body = "<!DOCTYPE html><html><body><H1>List of Uploads</H1><div><ul>";
+		for (auto& entry : page.entries)
+		{
+			body += R"(<li><a href="/upload/)" + EscapeHtml(EncodeQueryValue(entry.name)) + R"(">)" + EscapeHtml(entry.name) + "</a></li>";
+		}
+		body += "</ul>";
+		if (page.next_cursor.has_value())
+		{
+			body += R"(<a href=")" + EscapeHtml(next_target) + R"(">Next page</a>)";
+		}
+		body += "</div></body></html>";
+		response.SetHeader("content-type", "text/html;charset=utf-8");
+	}
+	response.SetBody(std::vector<unsigned char>(body.begin(), body.end()));
+	response.SetStatusCode(200);
+	Log(request, response);
+	return response;
+}
+
+SocketOptions HttpServer::ReadSocketOptions(jjson::value& config)
+{
+	SocketOptions options;
+	if (!config.HasKey("socket"))
+	{
+		return options;
+	}
+	auto socket_config = config["socket"];
+	if (socket_config.HasKey("backlog"))
+	{
+		options.backlog = static_cast<int>(socket_config["backlog"]);
+	}
+	if (socket_config.HasKey("reuse_address"))
+	{
+		options.reuse_address = static_cast<bool>(socket_config["reuse_address"]);
+	}
+	if (socket_config.HasKey("no_delay"))
+	{
+		options.no_delay = static_cast<bool>(socket_config["no_delay"]);
+	}
+	if (socket_config.HasKey("defer_accept"))
+	{
+		options.defer_accept = static_cast<int>(socket_config["defer_accept"]);
+	}
+	if (socket_config.HasKey("fast_open"))
+	{
+		options.fast_open = static_cast<int>(socket_config["fast_open"]);
+	}
+	if (socket_config.HasKey("receive_buffer"))
+	{
+		options.receive_buffer = static_cast<int>(socket_config["receive_buffer"]);
+	}
+	if (socket_config.HasKey("send_buffer"))
+	{
+		options.send_buffer = static_cast<int>(socket_config["send_buffer"]);
+	}
+	if (socket_config.HasKey("keep_alive"))
 	{
-		content_type = "text/plain";
-		acceptable_type = true;
+		auto keep_alive_config = socket_config["keep_alive"];
+		options.keep_alive = true;
+		if (keep_alive_config.HasKey("idle"))
+		{
+			options.keep_alive_idle = static_cast<int>(keep_alive_config["idle"]);
+		}
+		if (keep_alive_config.HasKey("interval"))
+		{
+			options.keep_alive_interval = static_cast<int>(keep_alive_config["interval"]);
+		}
+		if (keep_alive_config.HasKey("count"))
+		{
+			options.keep_alive_count = static_cast<int>(keep_alive_config["count"]);
+		}
+	}
+	if (socket_config.HasKey("accept_batch"))
+	{
+		options.accept_batch = static_cast<int>(socket_config["accept_batch"]);
+	}
+	return options;
+}
+
+jjson::value HttpServer::ReadConfigFile(const std::string& file_name)
+{
+	if (!fs::exists(fs::path(file_name)))
+	{
+		throw std::runtime_error("Config file could not be found!!");
+	}
+
+	std::ifstream config_file(file_name);
+	if (!config_file.is_open())
+	{
+		throw std::runtime_error("Error Opening Config file!");
+	}
+
+	std::string config_string;
+	std::string line;
+	while (std::getline(config_file, line))
+	{
+		config_string.append(line);
+	}
+
+	auto config = jjson::value::parse_from_string(config_string);
+	if (!config.is_valid())
+	{
+		throw std::runtime_error("Error Parsing Config file. Please verify valid JSON");
+	}
+	if (!config.HasKey("port"))
+	{
+		throw std::runtime_error("port is required in config file");
+	}
+	return config;
+}
+
+std::shared_ptr<const ServerSettings> HttpServer::ParseSettings(jjson::value& config)
+{
+	auto settings = std::make_shared<ServerSettings>();
+	settings->embedded_assets = config.HasKey("embedded_assets") ? static_cast<bool>(config["embedded_assets"]) : true;
+	// a binary with its assets built in can do without a web dir
+	if (!config.HasKey("web_dir") && !(settings->embedded_assets && !AssetBundle::Embedded().IsEmpty()))
+	{
+		throw std::runtime_error("web_dir location is required in config file");
+	}
+	settings->web_dir = config.HasKey("web_dir") ? (std::string)config["web_dir"] : std::string();
+	if (!settings->web_dir.empty() && !fs::exists(fs::path(settings->web_dir)))
+	{
+		throw std::runtime_error("web dir could not be found!");
+	}
+	settings->upload_dir = config.HasKey("upload_dir") ? (std::string)config["upload_dir"] : std::string("../uploads");
+	settings->server_name = config.HasKey("server_name") ? (std::string)config["server_name"] : std::string();
+	if (config.HasKey("allowed_methods"))
+	{
+		settings->allowed_methods = (std::vector<std::string>)config["allowed_methods"];
 	}
 	else
 	{
-		for (auto type : accepted_content_type)
+		settings->allowed_methods = Methods;
+	}
+	if (config.HasKey("timeout"))
+	{
+		settings->connection_timeout = std::chrono::seconds(static_cast<int>(config["timeout"]));
+		if (settings->connection_timeout.count() <= 0)
+		{
+			throw std::runtime_error("timeout must be a positive number of seconds");
+		}
+	}
+	if (config.HasKey("deadlines"))
+	{
+		auto deadlines_config = config["deadlines"];
+		auto& deadlines = settings->deadlines;
+		if (deadlines_config.HasKey("header_ms"))
 		{
-			if (content_type.find(type) != std::string::npos)
+			deadlines.header_timeout = std::chrono::milliseconds(static_cast<int>(deadlines_config["header_ms"]));
+		}
+		if (deadlines_config.HasKey("min_body_rate"))
+		{
+			auto min_body_rate = static_cast<int>(deadlines_config["min_body_rate"]);
+			if (min_body_rate < 0)
 			{
-				acceptable_type = true;
+				throw std::runtime_error("deadlines.min_body_rate cannot be negative");
 			}
+			deadlines.min_body_rate = static_cast<uint64_t>(min_body_rate);
+		}
+		if (deadlines_config.HasKey("body_grace_ms"))
+		{
+			deadlines.body_grace = std::chrono::milliseconds(static_cast<int>(deadlines_config["body_grace_ms"]));
+		}
+		if (deadlines_config.HasKey("request_ms"))
+		{
+			deadlines.request_timeout = std::chrono::milliseconds(static_cast<int>(deadlines_config["request_ms"]));
+		}
+		if (deadlines.header_timeout.count() < 0 || deadlines.body_grace.count() < 0 || deadlines.request_timeout.count() < 0)
+		{
+			throw std::runtime_error("deadlines cannot be negative");
 		}
 	}
-	if (!acceptable_type)
+	if (config.HasKey("body_limits"))
 	{
-		response.SetStatusCode(415);
-		response.SetHeader("accept", "multipart/form-data , text/plain");
-		Log(request, response);
-		return response;
+		auto body_limits_config = config["body_limits"];
+		auto read_body_limit = [](jjson::value& limit_config, BodyLimit& body_limit)
+		{
+			if (limit_config.HasKey("max_size"))
+			{
+				// read as a double so sizes past 2 GiB can be given
+				auto max_size = static_cast<double>(limit_config["max_size"]);
+				if (max_size < 0)
+				{
+					throw std::runtime_error("body_limits max_size cannot be negative");
+				}
+				body_limit.max_size = static_cast<uintmax_t>(max_size);
+			}
+			if (limit_config.HasKey("content_types"))
+			{
+				body_limit.content_types = (std::vector<std::string>)limit_config["content_types"];
+				for (auto& content_type : body_limit.content_types)
+				{
+					std::transform(content_type.begin(), content_type.end(), content_type.begin(), ::tolower);
+				}
+			}
+			if (limit_config.HasKey("methods"))
+			{
+				body_limit.methods = (std::vector<std::string>)limit_config["methods"];
+			}
+		};
+		read_body_limit(body_limits_config, settings->default_body_limit);
+		auto prefixes = body_limits_config.HasKey("routes") ? (std::vector<std::string>)body_limits_config["routes"] : std::vector<std::string>();
+		for (auto& prefix : prefixes)
+		{
+			if (prefix.empty() || prefix.front() != '/')
+			{
+				throw std::runtime_error("body_limits route " + prefix + " must start with /");
+			}
+			// what a route leaves out is taken from the defaults
+			auto body_limit = settings->default_body_limit;
+			body_limit.prefix = prefix;
+			if (body_limits_config.HasKey(prefix))
+			{
+				auto limit_config = body_limits_config[prefix];
+				read_body_limit(limit_config, body_limit);
+			}
+			settings->body_limits.push_back(body_limit);
+		}
 	}
-	if (!fs::exists(fs::path(_config["upload_dir"])))
+	if (config.HasKey("content_addressed_uploads"))
 	{
-		fs::create_directory((std::string)_config["upload_dir"]);
+		settings->content_addressed_uploads = static_cast<bool>(config["content_addressed_uploads"]);
 	}
-	if (content_type.find("text/plain") != std::string::npos)
+	if (config.HasKey("status_route"))
 	{
-		auto file_location = (std::string)_config["upload_dir"] + "/" + "file" + GetshortDate();
-		auto upload_file = std::ofstream(file_location, std::ios::binary);
-		if (!upload_file)
-		{
-			response.SetStatusCode(500);
-			Log(request, response);
-			return response;
-		}
-		try
+		settings->status_route = (std::string)config["status_route"];
+	}
+	if (config.HasKey("allocations_route"))
+	{
+		if (AllocationTracker::IsEnabled())
 		{
-			auto body_buffer = request.GetBody();
-			upload_file.write(((char*)body_buffer.data()), body_buffer.size());
+			settings->allocations_route = (std::string)config["allocations_route"];
 		}
-		catch (...)
+		else
 		{
-			response.SetStatusCode(500);
-			Log(request, response);
-			return response;
+			std::cout << "[HttpServer] - Built without ALLOCATION_ACCOUNTING, allocations_route is not served\n";
 		}
 	}
-	else if (content_type.find("multipart/form-data") != std::string::npos)
+	if (config.HasKey("tracing"))
 	{
-		auto boundary_start = content_type.find("boundary");
-		if (boundary_start == std::string::npos)
+		auto tracing_config = config["tracing"];
+		if (tracing_config.HasKey("sample_rate"))
 		{
-			response.SetStatusCode(400);
-			Log(request, response);
-			return response;
+			settings->trace_sample_rate = static_cast<double>(tracing_config["sample_rate"]);
+			if (settings->trace_sample_rate < 0 || settings->trace_sample_rate > 1)
+			{
+				throw std::runtime_error("tracing sample_rate must be between 0 and 1");
+			}
 		}
-		auto boundary_param = std::string(content_type.begin() + boundary_start, content_type.end());
-		boundary_start = boundary_param.find("=");
-		if (boundary_start == std::string::npos)
+		if (tracing_config.HasKey("route"))
 		{
-			response.SetStatusCode(400);
-			Log(request, response);
-			return response;
+			settings->trace_route = (std::string)tracing_config["route"];
 		}
-		auto boundary_value = std::string(boundary_param.begin() + boundary_start + 1, boundary_param.end());
-		auto body_buffer = request.GetBody();
-		body_buffer.erase(body_buffer.begin(), body_buffer.begin() + boundary_value.size() + 4);
-		body_buffer.erase(std::search(body_buffer.begin(), body_buffer.end(), boundary_value.begin(), boundary_value.end()) - 2,
-						  body_buffer.end());
-		// get headers
-		auto headers_end = std::string((char*)body_buffer.data()).find("\r\n\r\n");
-		if (headers_end == std::string::npos)
+	}
+	if (config.HasKey("load_shedding"))
+	{
+		auto load_shedding_config = config["load_shedding"];
+		if (load_shedding_config.HasKey("enabled"))
 		{
-			response.SetStatusCode(500);
-			Log(request, response);
-			return response;
+			settings->load_shedding_enabled = static_cast<bool>(load_shedding_config["enabled"]);
 		}
-		auto headers_string = std::string((char*)body_buffer.data(), ((char*)body_buffer.data()) + headers_end);
-		body_buffer.erase(body_buffer.begin(), body_buffer.begin() + headers_end + 4);
-		std::string file_name;
-		ssize_t f_start;
-		if ((f_start = headers_string.find("filename")) != std::string::npos)
+		if (load_shedding_config.HasKey("target_ms"))
 		{
-			auto name_start = headers_string.find_first_of('"', f_start);
-			auto name_end = headers_string.find_first_of('"', name_start + 1);
-			file_name = std::string(headers_string.begin() + name_start + 1, headers_string.begin() + name_end);
+			settings->load_shedding_target = std::chrono::milliseconds(static_cast<int>(load_shedding_config["target_ms"]));
 		}
-		else if ((f_start = headers_string.find("name=")) != std::string::npos)
+		if (load_shedding_config.HasKey("interval_ms"))
 		{
-			auto name_start = headers_string.find_first_of('"', f_start);
-			auto name_end = headers_string.find_first_of('"', name_start);
-			file_name = std::string(headers_string.begin() + name_start, headers_string.begin() + name_end);
+			settings->load_shedding_interval = std::chrono::milliseconds(static_cast<int>(load_shedding_config["interval_ms"]));
 		}
-		else
+		if (settings->load_shedding_target.count() <= 0 || settings->load_shedding_interval < settings->load_shedding_target)
 		{
-			file_name = "file" + GetshortDate();
+			throw std::runtime_error("load_shedding requires 0 < target_ms <= interval_ms");
 		}
-		auto file_location = (std::string)_config["upload_dir"] + "/" + file_name;
-		auto upload_file = std::ofstream(file_location, std::ios::binary);
-		if (!upload_file)
+		if (load_shedding_config.HasKey("retry_after"))
 		{
-			response.SetStatusCode(500);
-			Log(request, response);
-			return response;
+			settings->retry_after = static_cast<int>(load_shedding_config["retry_after"]);
 		}
-		try
+	}
+	settings->reverse_proxy = std::make_shared<ReverseProxy>();
+	if (config.HasKey("proxy"))
+	{
+		auto proxy_config = config["proxy"];
+		if (!proxy_config.HasKey("routes"))
 		{
-			upload_file.write(((char*)body_buffer.data()), body_buffer.size());
+			throw std::runtime_error("proxy requires a list of routes in config file");
 		}
-		catch (...)
+		// each prefix listed in routes has its settings under the prefix itself
+		for (auto& prefix : (std::vector<std::string>)proxy_config["routes"])
 		{
-			response.SetStatusCode(500);
-			Log(request, response);
-			return response;
+			if (!proxy_config.HasKey(prefix) || !proxy_config[prefix].HasKey("upstreams"))
+			{
+				throw std::runtime_error(std::string("proxy route ") + prefix + " requires upstreams in config file");
+			}
+			auto route_config = proxy_config[prefix];
+			ProxyRouteConfig route_settings;
+			route_settings.prefix = prefix;
+			route_settings.upstreams = (std::vector<std::string>)route_config["upstreams"];
+			if (route_config.HasKey("strip_prefix"))
+			{
+				route_settings.strip_prefix = static_cast<bool>(route_config["strip_prefix"]);
+			}
+			if (route_config.HasKey("connect_timeout_ms"))
+			{
+				route_settings.connect_timeout = std::chrono::milliseconds(static_cast<int>(route_config["connect_timeout_ms"]));
+			}
+			if (route_config.HasKey("timeout_ms"))
+			{
+				route_settings.timeout = std::chrono::milliseconds(static_cast<int>(route_config["timeout_ms"]));
+			}
+			if (route_config.HasKey("max_idle_connections"))
+			{
+				route_settings.max_idle_connections = static_cast<int>(route_config["max_idle_connections"]);
+			}
+			if (route_config.HasKey("max_fails"))
+			{
+				route_settings.max_fails = static_cast<int>(route_config["max_fails"]);
+			}
+			if (route_config.HasKey("fail_timeout"))
+			{
+				route_settings.fail_timeout = std::chrono::seconds(static_cast<int>(route_config["fail_timeout"]));
+			}
+			if (!settings->reverse_proxy->AddRoute(route_settings))
+			{
+				throw std::runtime_error(std::string("Unable to set up proxy route ") + prefix);
+			}
 		}
 	}
-	response.SetHeader("content-type", "application/json");
-	auto api_object = jjson::Object();
-	api_object["status"] = "Success!!!";
-	api_object["message"] = "Upload Complete";
-	response.SetBody(api_object);
-	response.SetStatusCode(200);
-	Log(request, response);
-	return response;
+	auto running_settings = Settings();
+	if (running_settings)
+	{
+		// connections already open to an upstream that is still configured stay in use
+		settings->reverse_proxy->AdoptUpstreams(*running_settings->reverse_proxy);
+	}
+	return settings;
 }
 
-HttpResponse HttpServer::HandleGetUploads(HttpRequest&& request)
+void HttpServer::ApplyStartupConfig()
 {
-	HttpResponse response;
-	std::stringstream body_stream;
-	auto upload_dir = (std::string)_config["upload_dir"];
-	if (!fs::exists(fs::path(upload_dir)))
+	if (_config.HasKey("client_limits"))
 	{
-		response.SetHeader("content-type", "text/html;charset=utf-8");
-		body_stream << "<body><H1>500 Internal Server Error</H1><div>.</div></body>";
-		std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
-		response.SetBody(body_vec);
-		Log(request, response);
-		return response;
+		auto client_limits_config = _config["client_limits"];
+		ClientLimits limits;
+		if (client_limits_config.HasKey("max_connections"))
+		{
+			limits.max_connections = static_cast<int>(client_limits_config["max_connections"]);
+		}
+		if (client_limits_config.HasKey("requests_per_second"))
+		{
+			limits.requests_per_second = static_cast<double>(client_limits_config["requests_per_second"]);
+		}
+		if (client_limits_config.HasKey("burst"))
+		{
+			limits.burst = static_cast<int>(client_limits_config["burst"]);
+		}
+		if (client_limits_config.HasKey("table_size"))
+		{
+			limits.table_size = static_cast<int>(client_limits_config["table_size"]);
+		}
+		if (client_limits_config.HasKey("sketch_width"))
+		{
+			limits.sketch_width = static_cast<int>(client_limits_config["sketch_width"]);
+		}
+		if (client_limits_config.HasKey("idle_timeout"))
+		{
+			limits.idle_timeout = std::chrono::seconds(static_cast<int>(client_limits_config["idle_timeout"]));
+		}
+		_client_limiter.Init(limits);
 	}
-	body_stream << "<!DOCTYPE html><htm><body><H1>List of Uploads</H1><div><ul>";
-	for (auto& p : fs::directory_iterator(upload_dir))
+	auto cache_max_bytes = RESPONSE_CACHE_DEFAULT_MAX_BYTES;
+	auto cache_shards = RESPONSE_CACHE_DEFAULT_SHARDS;
+	if (_config.HasKey("response_cache"))
 	{
-		std::string file_name = p.path().filename().string();
-		// ignore hidden file
-		if (file_name[0] == '.')
+		auto cache_config = _config["response_cache"];
+		if (cache_config.HasKey("max_bytes"))
 		{
-			continue;
+			cache_max_bytes = static_cast<int>(cache_config["max_bytes"]);
+		}
+		if (cache_config.HasKey("shards"))
+		{
+			cache_shards = static_cast<int>(cache_config["shards"]);
 		}
-		file_name.erase(std::remove(file_name.begin(), file_name.end(), '\"'), file_name.end());
-		body_stream << R"(<li><a href="/upload/)" << file_name << R"(">)" << p.path().filename() << "</li>";
 	}
-	body_stream << "</ul></div></body></html>";
-	response.SetHeader("content-type", "text/html;charset=utf-8");
-	response.SetHeader("server", (std::string)_config["server_name"]);
-	response.SetHeader("date", GetDate());
-	response.SetHeader("connection", request.GetHeader("Connection").value_or("close"));
-	std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
-	response.SetBody(body_vec);
-	response.SetStatusCode(200);
-	Log(request, response);
-	return response;
-}
-
-void HttpServer::ParseConfigFile(std::string file_name)
-{
-	if (!fs::exists(fs::path(file_name)))
+	_response_cache.Init(cache_max_bytes, cache_shards);
+	auto file_cache_entries = FILE_CACHE_DEFAULT_MAX_ENTRIES;
+	auto file_cache_shards = FILE_CACHE_DEFAULT_SHARDS;
+	auto file_cache_ttl = FILE_CACHE_DEFAULT_TTL;
+	if (_config.HasKey("file_cache"))
 	{
-		std::cout << "Config file could not be found!!\n";
-		exit(EXIT_FAILURE);
+		auto file_cache_config = _config["file_cache"];
+		if (file_cache_config.HasKey("max_entries"))
+		{
+			file_cache_entries = static_cast<int>(file_cache_config["max_entries"]);
+		}
+		if (file_cache_config.HasKey("shards"))
+		{
+			file_cache_shards = static_cast<int>(file_cache_config["shards"]);
+		}
+		if (file_cache_config.HasKey("ttl_ms"))
+		{
+			file_cache_ttl = std::chrono::milliseconds(static_cast<int>(file_cache_config["ttl_ms"]));
+		}
 	}
-
-	std::ifstream config_file(file_name);
-	if (!config_file.is_open())
+	_file_cache.Init(file_cache_entries, file_cache_shards, file_cache_ttl);
+	auto blocking_threads = EVENT_LOOP_DEFAULT_BLOCKING_THREADS;
+	if (_config.HasKey("event_loop") && _config["event_loop"].HasKey("blocking_threads"))
 	{
-		std::cout << "Error Opening Config file!\n";
-		exit(EXIT_FAILURE);
+		blocking_threads = static_cast<int>(_config["event_loop"]["blocking_threads"]);
 	}
-
-	std::string config_string;
-	std::string line;
-	while (std::getline(config_file, line))
+	_event_loop.Start(blocking_threads);
+	if (_config.HasKey("tls"))
 	{
-		config_string.append(line);
+		auto tls_config = _config["tls"];
+		if (!tls_config.HasKey("certificate") || !tls_config.HasKey("private_key"))
+		{
+			throw std::runtime_error("tls requires certificate and private_key in config file");
+		}
+		TlsConfig config;
+		config.certificate_file = (std::string)tls_config["certificate"];
+		config.private_key_file = (std::string)tls_config["private_key"];
+		if (tls_config.HasKey("session_cache_size"))
+		{
+			config.session_cache_size = static_cast<int>(tls_config["session_cache_size"]);
+		}
+		if (tls_config.HasKey("session_timeout"))
+		{
+			config.session_timeout = static_cast<int>(tls_config["session_timeout"]);
+		}
+		if (tls_config.HasKey("ticket_key_file"))
+		{
+			config.ticket_key_file = (std::string)tls_config["ticket_key_file"];
+		}
+		if (tls_config.HasKey("ktls"))
+		{
+			config.enable_ktls = static_cast<bool>(tls_config["ktls"]);
+		}
+		_tls_context = std::make_unique<TlsContext>();
+		if (!_tls_context->Init(config))
+		{
+			throw std::runtime_error("Unable to set up TLS");
+		}
 	}
-
-	_config = jjson::value::parse_from_string(config_string);
-	if (!_config.is_valid())
+	if (_config.HasKey("priority"))
+	{
+		auto priority_config = _config["priority"];
+		auto policy = SchedulingPolicy::WeightedFair;
+		if (priority_config.HasKey("policy"))
+		{
+			auto policy_name = (std::string)priority_config["policy"];
+			if (policy_name != "weighted" && policy_name != "strict")
+			{
+				throw std::runtime_error("priority policy must be weighted or strict");
+			}
+			policy = policy_name == "strict" ? SchedulingPolicy::Strict : SchedulingPolicy::WeightedFair;
+		}
+		std::vector<LaneConfig> lane_configs;
+		auto lane_names = priority_config.HasKey("lanes") ? (std::vector<std::string>)priority_config["lanes"] : std::vector<std::string>();
+		for (auto& lane_name : lane_names)
+		{
+			LaneConfig lane_config{ lane_name };
+			if (priority_config.HasKey(lane_name))
+			{
+				auto lane_settings = priority_config[lane_name];
+				if (lane_settings.HasKey("routes"))
+				{
+					lane_config.routes = (std::vector<std::string>)lane_settings["routes"];
+				}
+				if (lane_settings.HasKey("weight"))
+				{
+					lane_config.weight = static_cast<int>(lane_settings["weight"]);
+				}
+				if (lane_settings.HasKey("max_concurrency"))
+				{
+					lane_config.max_concurrency = static_cast<int>(lane_settings["max_concurrency"]);
+				}
+			}
+			if (lane_config.weight <= 0 || lane_config.max_concurrency < 0)
+			{
+				throw std::runtime_error("priority lane " + lane_name + " needs a positive weight and max_concurrency >= 0");
+			}
+			lane_configs.push_back(lane_config);
+		}
+		_request_queue.Configure(lane_configs, policy);
+		if (priority_config.HasKey("handler_threads"))
+		{
+			_handler_threads = static_cast<int>(priority_config["handler_threads"]);
+			if (_handler_threads <= 0)
+			{
+				throw std::runtime_error("priority handler_threads must be a positive number");
+			}
+		}
+	}
+	if (_config.HasKey("tracing") && _config["tracing"].HasKey("ring_events"))
+	{
+		auto ring_events = static_cast<int>(_config["tracing"]["ring_events"]);
+		if (ring_events <= 0)
+		{
+			throw std::runtime_error("tracing ring_events must be a positive number");
+		}
+		RequestTracer::SetRingEvents(ring_events);
+	}
+	if (_config.HasKey("websocket"))
 	{
-		std::cout << "Error Parsing Config file. Please verify valid JSON\n";
-		exit(EXIT_FAILURE);
+		auto websocket_config = _config["websocket"];
+		if (websocket_config.HasKey("ping_interval"))
+		{
+			_websocket_settings.ping_interval = std::chrono::seconds(static_cast<int>(websocket_config["ping_interval"]));
+		}
+		auto max_message_size = static_cast<int>(_websocket_settings.max_message_size);
+		if (websocket_config.HasKey("max_message_size"))
+		{
+			max_message_size = static_cast<int>(websocket_config["max_message_size"]);
+		}
+		auto max_queued_bytes = static_cast<int>(_websocket_settings.max_queued_bytes);
+		if (websocket_config.HasKey("max_queued_bytes"))
+		{
+			max_queued_bytes = static_cast<int>(websocket_config["max_queued_bytes"]);
+		}
+		if (max_message_size <= 0 || max_queued_bytes <= 0 || _websocket_settings.ping_interval.count() <= 0)
+		{
+			throw std::runtime_error("websocket ping_interval, max_message_size and max_queued_bytes must be positive numbers");
+		}
+		_websocket_settings.max_message_size = max_message_size;
+		_websocket_settings.max_queued_bytes = max_queued_bytes;
 	}
-	if (!_config.HasKey("port"))
+	if (_config.HasKey("event_stream"))
 	{
-		std::cout << "port is required in config file\n";
-		exit(EXIT_FAILURE);
+		auto event_stream_config = _config["event_stream"];
+		if (event_stream_config.HasKey("max_queued"))
+		{
+			auto max_queued = static_cast<int>(event_stream_config["max_queued"]);
+			if (max_queued <= 0)
+			{
+				throw std::runtime_error("event_stream max_queued must be a positive number");
+			}
+			_event_stream_settings.max_queued = max_queued;
+		}
+		if (event_stream_config.HasKey("slow_subscribers"))
+		{
+			auto policy_name = (std::string)event_stream_config["slow_subscribers"];
+			if (policy_name != "drop" && policy_name != "coalesce")
+			{
+				throw std::runtime_error("event_stream slow_subscribers must be drop or coalesce");
+			}
+			_event_stream_settings.slow_subscribers =
+				policy_name == "coalesce" ? SlowSubscriberPolicy::Coalesce : SlowSubscriberPolicy::Drop;
+		}
+		if (event_stream_config.HasKey("heartbeat_interval"))
+		{
+			_event_stream_settings.heartbeat_interval = std::chrono::seconds(static_cast<int>(event_stream_config["heartbeat_interval"]));
+			if (_event_stream_settings.heartbeat_interval.count() <= 0)
+			{
+				throw std::runtime_error("event_stream heartbeat_interval must be a positive number");
+			}
+		}
 	}
-	if (!_config.HasKey("web_dir"))
+	if (_config.HasKey("http2"))
 	{
-		std::cout << "web_dir location is required in config file\n";
-		exit(EXIT_FAILURE);
+		auto http2_config = _config["http2"];
+		if (http2_config.HasKey("max_request_body"))
+		{
+			auto max_request_body = static_cast<int>(http2_config["max_request_body"]);
+			if (max_request_body <= 0)
+			{
+				throw std::runtime_error("http2 max_request_body must be a positive number");
+			}
+			_http2_max_request_body = max_request_body;
+		}
 	}
-	std::string web_dir = (std::string)_config["web_dir"];
-	if (!fs::exists(fs::path(web_dir)))
+	if (_config.HasKey("drain_timeout"))
 	{
-		std::cout << "web dir could not be found!\n";
-		exit(EXIT_FAILURE);
+		_drain_timeout = std::chrono::seconds(static_cast<int>(_config["drain_timeout"]));
 	}
-	if (_config.HasKey("allowed_methods"))
+}
+
+void HttpServer::ReloadConfig()
+{
+	std::cout << "[HttpServer] - Reloading " << _config_file_name << "\n";
+	try
 	{
-		_allowed_methods = (std::vector<std::string>)_config["allowed_methods"];
+		auto config = ReadConfigFile(_config_file_name);
+		auto settings = ParseSettings(config);
+		_settings.store(settings);
+		_load_shedder.SetThresholds(settings->load_shedding_target, settings->load_shedding_interval);
+		RequestTracer::SetSampleRate(settings->trace_sample_rate);
+		_upload_index.Open(settings->upload_dir);
+		// requests already running finish with the settings they started with
+		std::cout << "[HttpServer] - Config reloaded\n";
 	}
-	else
+	catch (const std::exception& e)
 	{
-		_allowed_methods = Methods;
+		std::cout << "[HttpServer] - Config not reloaded, keeping running settings (" << e.what() << ")\n";
 	}
-	std::cout << "Config file loaded!\n";
-}
\ No newline at end of file
+}
@@ -0,0 +1,156 @@
+#include "ListenerHandoff.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	// sent along with the descriptor, and back by the receiver once it has the path
+	constexpr char HandoffMessage = 'L';
+	constexpr char HandoffAck = 'A';
+
+	bool MakeAddress(const std::string& path, struct sockaddr_un& address)
+	{
+		if (path.empty() || path.size() >= sizeof(address.sun_path))
+		{
+			return false;
+		}
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		memcpy(address.sun_path, path.c_str(), path.size());
+		return true;
+	}
+
+	bool WaitReadable(int fd, std::chrono::milliseconds timeout)
+	{
+		struct pollfd poll_fd = { fd, POLLIN, 0 };
+		return poll(&poll_fd, 1, static_cast<int>(timeout.count())) == 1;
+	}
+}  // namespace
+
+ListenerHandoff::~ListenerHandoff()
+{
+	if (_socket_fd != -1)
+	{
+		close(_socket_fd);
+		unlink(_path.c_str());
+	}
+}
+
+int ListenerHandoff::Receive(const std::string& path, std::chrono::milliseconds timeout)
+{
+	struct sockaddr_un address;
+	if (!MakeAddress(path, address))
+	{
+		return -1;
+	}
+	int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (socket_fd < 0)
+	{
+		return -1;
+	}
+	if (connect(socket_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || !WaitReadable(socket_fd, timeout))
+	{
+		close(socket_fd);
+		return -1;
+	}
+	char message = 0;
+	struct iovec io_vector = { &message, sizeof(message) };
+	alignas(struct cmsghdr) char control_buffer[CMSG_SPACE(sizeof(int))];
+	struct msghdr message_header = {};
+	message_header.msg_iov = &io_vector;
+	message_header.msg_iovlen = 1;
+	message_header.msg_control = control_buffer;
+	message_header.msg_controllen = sizeof(control_buffer);
+	int listen_fd = -1;
+	if (recvmsg(socket_fd, &message_header, MSG_CMSG_CLOEXEC) == 1 && message == HandoffMessage)
+	{
+		auto control_message = CMSG_FIRSTHDR(&message_header);
+		if (control_message && control_message->cmsg_level == SOL_SOCKET && control_message->cmsg_type == SCM_RIGHTS)
+		{
+			memcpy(&listen_fd, CMSG_DATA(control_message), sizeof(listen_fd));
+		}
+	}
+	if (listen_fd != -1 && write(socket_fd, &HandoffAck, sizeof(HandoffAck)) != sizeof(HandoffAck))
+	{
+		// without the acknowledgement the old server keeps accepting, serving from both is harmless
+		std::cout << "[ListenerHandoff] - Unable to acknowledge handoff\n";
+	}
+	close(socket_fd);
+	return listen_fd;
+}
+
+bool ListenerHandoff::Listen(const std::string& path)
+{
+	struct sockaddr_un address;
+	if (!MakeAddress(path, address))
+	{
+		return false;
+	}
+	_socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (_socket_fd < 0)
+	{
+		return false;
+	}
+	// a server that is still running got its socket asked for already, anything left is stale
+	unlink(path.c_str());
+	if (bind(_socket_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(_socket_fd, 1) < 0)
+	{
+		close(_socket_fd);
+		_socket_fd = -1;
+		return false;
+	}
+	_path = path;
+	return true;
+}
+
+bool ListenerHandoff::Offer(int listen_fd, std::chrono::milliseconds timeout)
+{
+	if (_socket_fd == -1 || !WaitReadable(_socket_fd, timeout))
+	{
+		return false;
+	}
+	int peer_fd = accept4(_socket_fd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (peer_fd < 0)
+	{
+		return false;
+	}
+	char message = HandoffMessage;
+	struct iovec io_vector = { &message, sizeof(message) };
+	alignas(struct cmsghdr) char control_buffer[CMSG_SPACE(sizeof(int))] = {};
+	struct msghdr message_header = {};
+	message_header.msg_iov = &io_vector;
+	message_header.msg_iovlen = 1;
+	message_header.msg_control = control_buffer;
+	message_header.msg_controllen = sizeof(control_buffer);
+	auto control_message = CMSG_FIRSTHDR(&message_header);
+	control_message->cmsg_level = SOL_SOCKET;
+	control_message->cmsg_type = SCM_RIGHTS;
+	control_message->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(control_message), &listen_fd, sizeof(listen_fd));
+	char ack = 0;
+	auto handed_over = sendmsg(peer_fd, &message_header, MSG_NOSIGNAL) == 1 && WaitReadable(peer_fd, HANDOFF_TIMEOUT) &&
+					   read(peer_fd, &ack, sizeof(ack)) == 1 && ack == HandoffAck;
+	close(peer_fd);
+	if (!handed_over)
+	{
+		std::cout << "[ListenerHandoff] - Replacement did not take over, still serving\n";
+	}
+	return handed_over;
+}
+
+void ListenerHandoff::Release()
+{
+	if (_socket_fd != -1)
+	{
+		close(_socket_fd);
+		_socket_fd = -1;
+	}
+}
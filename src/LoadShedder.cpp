@@ -0,0 +1,35 @@
+#include "LoadShedder.h"
+
+void LoadShedder::SetThresholds(std::chrono::milliseconds target, std::chrono::milliseconds interval)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_target = target;
+	_interval = interval;
+}
+
+bool LoadShedder::ShouldShed(std::chrono::steady_clock::time_point enqueue_time, std::chrono::steady_clock::time_point now)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto sojourn_time = now - enqueue_time;
+	if (sojourn_time < _target)
+	{
+		// the queue got close to empty, whatever built up was a burst
+		_first_above_time = {};
+		_overloaded = false;
+	}
+	else if (_first_above_time == std::chrono::steady_clock::time_point{})
+	{
+		_first_above_time = now + _interval;
+	}
+	else if (now >= _first_above_time)
+	{
+		_overloaded = true;
+	}
+	auto max_sojourn_time = _overloaded ? _target : _interval;
+	if (sojourn_time <= max_sojourn_time)
+	{
+		return false;
+	}
+	_shed_count++;
+	return true;
+}
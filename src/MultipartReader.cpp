@@ -0,0 +1,282 @@
+#include "MultipartReader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace
+{
+	// RFC 2046 section 5.1.1
+	constexpr size_t MaxBoundaryLength = 70;
+
+	std::string ToLower(std::string text)
+	{
+		std::transform(text.begin(),
+					   text.end(),
+					   text.begin(),
+					   [](unsigned char character)
+					   {
+						   return std::tolower(character);
+					   });
+		return text;
+	}
+
+	std::string Trim(const std::string& text)
+	{
+		auto start = text.find_first_not_of(" \t");
+		if (start == std::string::npos)
+		{
+			return std::string();
+		}
+		auto end = text.find_last_not_of(" \t");
+		return text.substr(start, end - start + 1);
+	}
+
+	// value of a parameter starting at position, quoted or a bare token. position is left after it
+	std::string ReadParameterValue(const std::string& text, size_t& position)
+	{
+		std::string value;
+		if (position < text.size() && text[position] == '"')
+		{
+			for (position++; position < text.size() && text[position] != '"'; position++)
+			{
+				if (text[position] == '\\' && position + 1 < text.size())
+				{
+					position++;
+				}
+				value += text[position];
+			}
+			position++;
+			return value;
+		}
+		while (position < text.size() && text[position] != ';')
+		{
+			value += text[position++];
+		}
+		return Trim(value);
+	}
+
+	// lower cased parameter names of a header value like form-data; name="a"; filename="b"
+	std::unordered_map<std::string, std::string> ParseParameters(const std::string& header_value)
+	{
+		std::unordered_map<std::string, std::string> parameters;
+		auto position = header_value.find(';');
+		while (position != std::string::npos && position < header_value.size())
+		{
+			auto name_start = position + 1;
+			auto equals = header_value.find('=', name_start);
+			if (equals == std::string::npos)
+			{
+				break;
+			}
+			auto name = ToLower(Trim(header_value.substr(name_start, equals - name_start)));
+			position = equals + 1;
+			while (position < header_value.size() && (header_value[position] == ' ' || header_value[position] == '\t'))
+			{
+				position++;
+			}
+			parameters[name] = ReadParameterValue(header_value, position);
+			position = header_value.find(';', position);
+		}
+		return parameters;
+	}
+}  // namespace
+
+MultipartReader::MultipartReader(const std::string& boundary, const BodyReader& body_reader)
+  : _delimiter("\r\n--" + boundary)
+  , _body_reader(body_reader)
+  // the first delimiter may open the body without a CRLF in front, so one is made up
+  , _input({ '\r', '\n' })
+{
+	_skip_table.fill(_delimiter.size());
+	for (size_t i = 0; i + 1 < _delimiter.size(); i++)
+	{
+		_skip_table[static_cast<unsigned char>(_delimiter[i])] = _delimiter.size() - 1 - i;
+	}
+}
+
+std::optional<std::string> MultipartReader::GetBoundary(const std::string& content_type)
+{
+	auto parameters = ParseParameters(content_type);
+	auto boundary_itr = parameters.find("boundary");
+	if (boundary_itr == parameters.end() || boundary_itr->second.empty() || boundary_itr->second.size() > MaxBoundaryLength)
+	{
+		return std::nullopt;
+	}
+	return boundary_itr->second;
+}
+
+std::optional<MultipartPart> MultipartReader::NextPart()
+{
+	// the preamble, or what the caller did not read of the last part
+	while (_state == State::Body)
+	{
+		auto body_part = ReadPartBody();
+		if (!body_part.has_value())
+		{
+			return std::nullopt;
+		}
+	}
+	if (_state != State::Delimiter)
+	{
+		return std::nullopt;
+	}
+	while (_input.size() - _position < 2)
+	{
+		if (!Fill())
+		{
+			Fail();
+			return std::nullopt;
+		}
+	}
+	if (_input[_position] == '-' && _input[_position + 1] == '-')
+	{
+		// close delimiter, the epilogue is left for the connection to discard
+		_state = State::Done;
+		return std::nullopt;
+	}
+	auto padding = ReadLine();
+	if (!padding.has_value() || !Trim(padding.value()).empty())
+	{
+		Fail();
+		return std::nullopt;
+	}
+	return ReadHeaders();
+}
+
+std::optional<std::vector<unsigned char>> MultipartReader::ReadPartBody()
+{
+	if (_state != State::Body)
+	{
+		return _state == State::Failed ? std::nullopt : std::optional<std::vector<unsigned char>>(std::vector<unsigned char>());
+	}
+	auto delimiter_length = _delimiter.size();
+	while (true)
+	{
+		auto delimiter_position = FindDelimiter();
+		if (delimiter_position != std::string::npos)
+		{
+			auto body_start = _input.begin() + _position;
+			std::vector<unsigned char> body_part(body_start, body_start + delimiter_position);
+			_position += delimiter_position + delimiter_length;
+			_state = State::Delimiter;
+			return body_part;
+		}
+		// all but a tail that could be the start of a delimiter split across reads
+		auto available = _input.size() - _position;
+		if (available >= delimiter_length)
+		{
+			auto body_start = _input.begin() + _position;
+			auto length = available - (delimiter_length - 1);
+			std::vector<unsigned char> body_part(body_start, body_start + length);
+			_position += length;
+			return body_part;
+		}
+		if (!Fill())
+		{
+			return Fail();
+		}
+	}
+}
+
+size_t MultipartReader::FindDelimiter() const
+{
+	auto pattern = reinterpret_cast<const unsigned char*>(_delimiter.data());
+	auto pattern_length = _delimiter.size();
+	auto text = _input.data() + _position;
+	auto text_length = _input.size() - _position;
+	size_t offset = 0;
+	while (offset + pattern_length <= text_length)
+	{
+		auto last = text[offset + pattern_length - 1];
+		if (last == pattern[pattern_length - 1] && memcmp(text + offset, pattern, pattern_length - 1) == 0)
+		{
+			return offset;
+		}
+		offset += _skip_table[last];
+	}
+	return std::string::npos;
+}
+
+bool MultipartReader::Fill()
+{
+	auto body_part = _body_reader();
+	if (!body_part.has_value() || body_part->empty())
+	{
+		return false;
+	}
+	if (_position > _input.size() / 2)
+	{
+		_input.erase(_input.begin(), _input.begin() + _position);
+		_position = 0;
+	}
+	_input.insert(_input.end(), body_part->begin(), body_part->end());
+	return true;
+}
+
+std::optional<std::string> MultipartReader::ReadLine()
+{
+	while (true)
+	{
+		auto line_start = _input.begin() + _position;
+		auto line_end = std::search(line_start, _input.end(), std::begin("\r\n"), std::begin("\r\n") + 2);
+		if (line_end != _input.end())
+		{
+			std::string line(line_start, line_end);
+			_position += line.size() + 2;
+			return line;
+		}
+		if (_input.size() - _position > MULTIPART_MAX_HEADER_SIZE || !Fill())
+		{
+			return std::nullopt;
+		}
+	}
+}
+
+std::optional<MultipartPart> MultipartReader::ReadHeaders()
+{
+	MultipartPart part;
+	size_t header_size = 0;
+	while (true)
+	{
+		auto line = ReadLine();
+		if (!line.has_value())
+		{
+			Fail();
+			return std::nullopt;
+		}
+		if (line->empty())
+		{
+			break;
+		}
+		header_size += line->size();
+		auto colon = line->find(':');
+		if (colon == std::string::npos || header_size > MULTIPART_MAX_HEADER_SIZE)
+		{
+			Fail();
+			return std::nullopt;
+		}
+		part.headers[ToLower(Trim(line->substr(0, colon)))] = Trim(line->substr(colon + 1));
+	}
+	auto disposition_itr = part.headers.find("content-disposition");
+	if (disposition_itr != part.headers.end())
+	{
+		auto parameters = ParseParameters(disposition_itr->second);
+		part.name = parameters["name"];
+		auto file_name_itr = parameters.find("filename");
+		if (file_name_itr != parameters.end())
+		{
+			part.file_name = file_name_itr->second;
+		}
+	}
+	_state = State::Body;
+	return part;
+}
+
+std::optional<std::vector<unsigned char>> MultipartReader::Fail()
+{
+	_state = State::Failed;
+	return std::nullopt;
+}
@@ -0,0 +1,209 @@
+#include "RequestTracer.h"
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+std::atomic<uint64_t> RequestTracer::_sample_interval = 0;
+
+namespace
+{
+	struct TraceEvent
+	{
+		uint64_t trace_id;
+		const char* stage;
+		const char* thread_name;
+		pid_t thread_id;
+		std::chrono::steady_clock::time_point start;
+		std::chrono::steady_clock::time_point end;
+	};
+
+	// written by one thread at a time, the lock is only ever contended by a dump
+	struct TraceRing
+	{
+		std::mutex mutex;
+		std::vector<TraceEvent> events;
+		size_t capacity = 0;
+		// oldest event once the ring is full
+		size_t next = 0;
+	};
+
+	struct TraceRegistry
+	{
+		std::mutex mutex;
+		std::vector<TraceRing*> rings;
+		// rings of threads that have exited, taken over by new ones so their number stays that of live threads
+		std::vector<TraceRing*> free_rings;
+	};
+
+	TraceRegistry& Registry()
+	{
+		// never destroyed, threads still running at exit may record into their rings
+		static auto registry = new TraceRegistry();
+		return *registry;
+	}
+
+	std::atomic<size_t> ring_events = TRACE_DEFAULT_RING_EVENTS;
+	std::atomic<uint64_t> sample_counter = 0;
+	std::atomic<uint64_t> last_trace_id = 0;
+
+	thread_local const char* thread_name = "worker";
+	// set once the thread's ring is handed back, spans ending later are dropped
+	thread_local bool thread_ring_released = false;
+
+	struct ThreadRing
+	{
+		TraceRing* ring = nullptr;
+		pid_t thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+		~ThreadRing()
+		{
+			thread_ring_released = true;
+			if (ring)
+			{
+				auto& registry = Registry();
+				std::lock_guard<std::mutex> lock(registry.mutex);
+				registry.free_rings.push_back(ring);
+			}
+		}
+	};
+
+	thread_local ThreadRing thread_ring;
+
+	TraceRing* LocalRing()
+	{
+		if (thread_ring_released)
+		{
+			return nullptr;
+		}
+		if (!thread_ring.ring)
+		{
+			auto& registry = Registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			if (!registry.free_rings.empty())
+			{
+				thread_ring.ring = registry.free_rings.back();
+				registry.free_rings.pop_back();
+			}
+			else
+			{
+				thread_ring.ring = new TraceRing();
+				thread_ring.ring->capacity = std::max<size_t>(ring_events.load(), 1);
+				registry.rings.push_back(thread_ring.ring);
+			}
+		}
+		return thread_ring.ring;
+	}
+
+	// microseconds, the unit of trace-event timestamps
+	double Microseconds(std::chrono::steady_clock::duration duration)
+	{
+		return std::chrono::duration<double, std::micro>(duration).count();
+	}
+}  // namespace
+
+void RequestTracer::SetSampleRate(double sample_rate)
+{
+	_sample_interval = sample_rate <= 0 ? 0 : std::max<uint64_t>(std::llround(1 / sample_rate), 1);
+}
+
+void RequestTracer::SetRingEvents(size_t events)
+{
+	ring_events = events;
+}
+
+uint64_t RequestTracer::NextSample(uint64_t sample_interval)
+{
+	if (sample_counter.fetch_add(1, std::memory_order_relaxed) % sample_interval != 0)
+	{
+		return 0;
+	}
+	return last_trace_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void RequestTracer::Record(
+	uint64_t trace_id, const char* stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	auto ring = LocalRing();
+	if (!ring)
+	{
+		return;
+	}
+	TraceEvent event{ trace_id, stage, thread_name, thread_ring.thread_id, start, end };
+	std::lock_guard<std::mutex> lock(ring->mutex);
+	if (ring->events.size() < ring->capacity)
+	{
+		ring->events.push_back(event);
+		return;
+	}
+	ring->events[ring->next] = event;
+	ring->next = (ring->next + 1) % ring->capacity;
+}
+
+void RequestTracer::NameThread(const char* name)
+{
+	thread_name = name;
+}
+
+std::string RequestTracer::Dump()
+{
+	std::vector<TraceEvent> events;
+	{
+		auto& registry = Registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		for (auto ring : registry.rings)
+		{
+			std::lock_guard<std::mutex> ring_lock(ring->mutex);
+			events.insert(events.end(), ring->events.begin(), ring->events.end());
+		}
+	}
+	std::sort(events.begin(),
+			  events.end(),
+			  [](const TraceEvent& a, const TraceEvent& b)
+			  {
+				  return a.start < b.start;
+			  });
+	auto process_id = getpid();
+	std::map<pid_t, const char*> thread_names;
+	// first and last moment of each request, shown as one slice spanning the threads it passed through
+	std::map<uint64_t, std::pair<const TraceEvent*, std::chrono::steady_clock::time_point>> requests;
+	std::stringstream trace_stream;
+	trace_stream << std::fixed << std::setprecision(3);
+	trace_stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	trace_stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << process_id << ",\"args\":{\"name\":\"jHttpServe\"}}";
+	for (auto& event : events)
+	{
+		thread_names[event.thread_id] = event.thread_name;
+		auto request_itr = requests.try_emplace(event.trace_id, &event, event.end).first;
+		request_itr->second.second = std::max(request_itr->second.second, event.end);
+		trace_stream << ",{\"name\":\"" << event.stage << "\",\"cat\":\"stage\",\"ph\":\"X\",\"ts\":"
+					 << Microseconds(event.start.time_since_epoch()) << ",\"dur\":" << Microseconds(event.end - event.start)
+					 << ",\"pid\":" << process_id << ",\"tid\":" << event.thread_id << ",\"args\":{\"request\":" << event.trace_id
+					 << "}}";
+	}
+	for (auto& [thread_id, name] : thread_names)
+	{
+		trace_stream << ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << process_id << ",\"tid\":" << thread_id
+					 << ",\"args\":{\"name\":\"" << name << "\"}}";
+	}
+	for (auto& [trace_id, request] : requests)
+	{
+		auto [first_event, end] = request;
+		trace_stream << ",{\"name\":\"request\",\"cat\":\"request\",\"ph\":\"b\",\"id\":" << trace_id
+					 << ",\"ts\":" << Microseconds(first_event->start.time_since_epoch()) << ",\"pid\":" << process_id
+					 << ",\"tid\":" << first_event->thread_id << "}";
+		trace_stream << ",{\"name\":\"request\",\"cat\":\"request\",\"ph\":\"e\",\"id\":" << trace_id
+					 << ",\"ts\":" << Microseconds(end.time_since_epoch()) << ",\"pid\":" << process_id
+					 << ",\"tid\":" << first_event->thread_id << "}";
+	}
+	trace_stream << "]}";
+	return trace_stream.str();
+}
@@ -0,0 +1,252 @@
+#include "ResponseCache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <iostream>
+#include <utility>
+
+namespace
+{
+	// statuses cacheable by default (RFC 7231 section 6.1) that the server has reason phrases for
+	const std::vector<int> CacheableStatusCodes = { 200, 204, 301, 404, 405, 410, 501 };
+	// rough cost of the bookkeeping around each entry and header, counted against the budget
+	constexpr size_t EntryOverhead = 256;
+	constexpr size_t HeaderOverhead = 64;
+
+	bool HeaderHasToken(const std::optional<std::string>& header_value, const std::string& token)
+	{
+		if (!header_value.has_value())
+		{
+			return false;
+		}
+		auto value = header_value.value();
+		std::transform(value.begin(),
+					   value.end(),
+					   value.begin(),
+					   [](unsigned char c)
+					   {
+						   return std::tolower(c);
+					   });
+		return value.find(token) != std::string::npos;
+	}
+}  // namespace
+
+void ResponseCache::Init(size_t max_bytes, size_t shard_count)
+{
+	_shard_count = std::bit_ceil(std::max<size_t>(shard_count, 1));
+	_shard_max_bytes = max_bytes / _shard_count;
+	_shards = std::make_unique<CacheShard[]>(_shard_count);
+	_refresh_thread = std::jthread(std::bind_front(&ResponseCache::RunRefreshes, this));
+}
+
+HttpResponse ResponseCache::Serve(HttpRequest&& request, const CachePolicy& policy, const Handler& handler)
+{
+	if (!_shards || !IsCacheable(request))
+	{
+		return handler(std::move(request));
+	}
+	auto key = Key(request, policy);
+	auto now = std::chrono::steady_clock::now();
+	auto& shard = ShardFor(key);
+	std::shared_ptr<const CachedResponse> cached_response;
+	bool refresh = false;
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto entry_itr = shard.entries.find(key);
+		if (entry_itr != shard.entries.end())
+		{
+			auto& entry = entry_itr->second;
+			if (now < entry.stale_until)
+			{
+				cached_response = entry.response;
+				shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru_position);
+				if (now >= entry.expires && !entry.refreshing)
+				{
+					entry.refreshing = true;
+					refresh = true;
+				}
+			}
+			else if (!entry.refreshing)
+			{
+				RemoveLocked(shard, entry_itr);
+			}
+		}
+	}
+	if (cached_response)
+	{
+		if (refresh)
+		{
+			_stale_hits++;
+			// the copy outlives the connection, so it must not read from it
+			HttpRequest refresh_request(request);
+			refresh_request.SetBodyReader(nullptr);
+			_refresh_queue.Send(
+				[this, key, refresh_request = std::move(refresh_request), policy, handler]() mutable
+				{
+					Refresh(key, std::move(refresh_request), policy, handler);
+				});
+		}
+		else
+		{
+			_hits++;
+		}
+		return ToResponse(*cached_response);
+	}
+	_misses++;
+	auto response = handler(std::move(request));
+	if (!IsCacheable(response))
+	{
+		return response;
+	}
+	auto stored_response = Store(key, response, policy);
+	if (!stored_response)
+	{
+		return response;
+	}
+	return ToResponse(*stored_response);
+}
+
+CacheStats ResponseCache::Stats() const
+{
+	CacheStats stats = { _hits, _stale_hits, _misses, _refreshes, 0 };
+	for (size_t shard_index = 0; shard_index < _shard_count; shard_index++)
+	{
+		std::lock_guard<std::mutex> lock(_shards[shard_index].mutex);
+		stats.bytes += _shards[shard_index].bytes;
+	}
+	return stats;
+}
+
+bool ResponseCache::IsCacheable(const HttpRequest& request)
+{
+	auto method = request.GetMethod();
+	return (method == "GET" || method == "HEAD") && request.GetBodyBuffer().empty() && !request.HasBodyReader();
+}
+
+bool ResponseCache::IsCacheable(const HttpResponse& response)
+{
+	auto cache_control = response.GetHeader("Cache-Control");
+	return std::find(CacheableStatusCodes.begin(), CacheableStatusCodes.end(), response.GetStatusCode()) != CacheableStatusCodes.end() &&
+		   !response.HasBodyReader() && !response.GetFileBody().has_value() && !response.GetStaticBody().has_value() &&
+		   !response.GetHeader("Set-Cookie").has_value() &&
+		   !HeaderHasToken(cache_control, "no-store") && !HeaderHasToken(cache_control, "private") &&
+		   !HeaderHasToken(cache_control, "no-cache");
+}
+
+std::string ResponseCache::Key(const HttpRequest& request, const CachePolicy& policy)
+{
+	auto key = request.GetMethod() + " " + request.GetTarget();
+	for (auto& header_name : policy.vary_headers)
+	{
+		key += "\n" + header_name + ":" + request.GetHeader(header_name).value_or("");
+	}
+	return key;
+}
+
+HttpResponse ResponseCache::ToResponse(const CachedResponse& cached_response)
+{
+	HttpResponse response;
+	response.SetStatusCode(cached_response.status_code);
+	for (auto& [name, value] : cached_response.headers)
+	{
+		response.SetHeader(name, value);
+	}
+	response.SetPrepared(cached_response.message_buffer, cached_response.header_length);
+	return response;
+}
+
+ResponseCache::CacheShard& ResponseCache::ShardFor(const std::string& key)
+{
+	return _shards[std::hash<std::string>{}(key) & (_shard_count - 1)];
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::Store(const std::string& key, const HttpResponse& response, const CachePolicy& policy)
+{
+	auto cached_response = std::make_shared<CachedResponse>();
+	cached_response->status_code = response.GetStatusCode();
+	cached_response->headers = response.GetHeaders();
+	auto message_buffer = response.ToHeaderBuffer();
+	cached_response->header_length = message_buffer.size();
+	auto& body = response.GetBodyBuffer();
+	message_buffer.insert(message_buffer.end(), body.begin(), body.end());
+	// the key is held by both the map and the recency list
+	auto entry_size = EntryOverhead + 2 * key.size() + message_buffer.size();
+	for (auto& [name, value] : cached_response->headers)
+	{
+		entry_size += HeaderOverhead + name.size() + value.size();
+	}
+	cached_response->message_buffer = std::make_shared<const std::vector<unsigned char>>(std::move(message_buffer));
+	if (entry_size > _shard_max_bytes)
+	{
+		return nullptr;
+	}
+	auto now = std::chrono::steady_clock::now();
+	auto& shard = ShardFor(key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto entry_itr = shard.entries.find(key);
+	if (entry_itr != shard.entries.end())
+	{
+		RemoveLocked(shard, entry_itr);
+	}
+	while (shard.bytes + entry_size > _shard_max_bytes && !shard.lru.empty())
+	{
+		RemoveLocked(shard, shard.entries.find(shard.lru.back()));
+	}
+	shard.lru.push_front(key);
+	shard.entries.emplace(key,
+						  CacheEntry{ cached_response,
+									  now + policy.ttl,
+									  now + policy.ttl + policy.stale_while_revalidate,
+									  entry_size,
+									  false,
+									  shard.lru.begin() });
+	shard.bytes += entry_size;
+	return cached_response;
+}
+
+void ResponseCache::Refresh(const std::string& key, HttpRequest&& request, const CachePolicy& policy, const Handler& handler)
+{
+	_refreshes++;
+	bool stored = false;
+	try
+	{
+		auto response = handler(std::move(request));
+		stored = IsCacheable(response) && Store(key, response, policy);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "[ResponseCache] - refresh failed (" << e.what() << ")\n";
+	}
+	if (stored)
+	{
+		return;
+	}
+	// the stale copy is kept until it runs out, so a later request can try again
+	auto& shard = ShardFor(key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto entry_itr = shard.entries.find(key);
+	if (entry_itr != shard.entries.end())
+	{
+		entry_itr->second.refreshing = false;
+	}
+}
+
+void ResponseCache::RemoveLocked(CacheShard& shard, std::unordered_map<std::string, CacheEntry>::iterator entry_itr)
+{
+	shard.bytes -= entry_itr->second.size;
+	shard.lru.erase(entry_itr->second.lru_position);
+	shard.entries.erase(entry_itr);
+}
+
+void ResponseCache::RunRefreshes(std::stop_token stop_token)
+{
+	while (!stop_token.stop_requested())
+	{
+		auto refresh_task = _refresh_queue.TryReceive(std::chrono::milliseconds(500));
+		if (refresh_task.has_value())
+		{
+			refresh_task.value()();
+		}
+	}
+}
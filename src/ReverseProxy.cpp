@@ -0,0 +1,676 @@
+#include "ReverseProxy.h"
+
+#include <netdb.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <utility>
+
+namespace
+{
+	const std::vector<std::string> HopByHopHeaders = { "connection", "keep-alive",		  "proxy-authenticate", "proxy-authorization",
+													   "te",		 "trailer",			  "transfer-encoding",	"upgrade",
+													   "proxy-connection" };
+
+	std::string ToLower(std::string value)
+	{
+		std::transform(value.begin(),
+					   value.end(),
+					   value.begin(),
+					   [](unsigned char c)
+					   {
+						   return std::tolower(c);
+					   });
+		return value;
+	}
+
+	std::string Trim(const std::string& value)
+	{
+		auto first = value.find_first_not_of(" \t");
+		if (first == std::string::npos)
+		{
+			return "";
+		}
+		return value.substr(first, value.find_last_not_of(" \t") - first + 1);
+	}
+
+	// lower cased tokens of a comma separated header such as Connection
+	std::vector<std::string> HeaderTokens(const std::optional<std::string>& header_value)
+	{
+		std::vector<std::string> tokens;
+		if (!header_value.has_value())
+		{
+			return tokens;
+		}
+		std::stringstream token_stream(header_value.value());
+		std::string token;
+		while (std::getline(token_stream, token, ','))
+		{
+			tokens.push_back(ToLower(Trim(token)));
+		}
+		return tokens;
+	}
+
+	bool Contains(const std::vector<std::string>& values, const std::string& value)
+	{
+		return std::find(values.begin(), values.end(), value) != values.end();
+	}
+
+	// one request/response exchange on an upstream connection, shared with the
+	// response body reader so the connection outlives the handler that opened it
+	struct ProxyExchange
+	{
+		ProxyExchange(Upstream& upstream, size_t max_idle_connections)
+		  : upstream(&upstream)
+		  , max_idle_connections(max_idle_connections)
+		  , decoder(input_buffer,
+					[this](ReceiveBuffer& buffer)
+					{
+						return Fill(buffer);
+					})
+		{
+			upstream.outstanding++;
+		};
+		~ProxyExchange()
+		{
+			Finish();
+		};
+		long Fill(ReceiveBuffer& buffer)
+		{
+			auto read_result = socket->ReadInto(buffer);
+			auto read_error = std::get_if<ReadError>(&read_result);
+			if (read_error)
+			{
+				timed_out = *read_error == ReadError::TimeOut;
+				return *read_error == ReadError::ConnectionClosed ? 0 : -1;
+			}
+			return static_cast<long>(std::get<size_t>(read_result));
+		}
+		// hands the connection back to the pool when the response was read cleanly to its end
+		void Finish()
+		{
+			if (!upstream)
+			{
+				return;
+			}
+			if (socket && reusable && decoder.IsComplete() && input_buffer.empty())
+			{
+				std::lock_guard<std::mutex> lock(upstream->idle_mutex);
+				if (upstream->idle_sockets.size() < max_idle_connections)
+				{
+					upstream->idle_sockets.push_back(std::move(socket));
+				}
+			}
+			if (socket)
+			{
+				socket->Close();
+			}
+			upstream->outstanding--;
+			upstream = nullptr;
+		}
+
+		Upstream* upstream;
+		size_t max_idle_connections;
+		std::unique_ptr<jSocket> socket;
+		// taken from the pool rather than freshly connected
+		bool reused = false;
+		bool reusable = false;
+		bool timed_out = false;
+		ReceiveBuffer input_buffer;
+		BodyDecoder decoder;
+	};
+
+	enum class HeadResult
+	{
+		Complete,
+		ConnectionClosed,
+		TimedOut,
+		Invalid
+	};
+
+	HeadResult ReadResponseHead(ProxyExchange& exchange, std::string& head)
+	{
+		const std::string header_terminator = "\r\n\r\n";
+		size_t search_start = 0;
+		while (true)
+		{
+			auto& input_buffer = exchange.input_buffer;
+			auto header_end =
+				std::search(input_buffer.begin() + search_start, input_buffer.end(), header_terminator.begin(), header_terminator.end());
+			if (header_end != input_buffer.end())
+			{
+				head.assign(input_buffer.begin(), header_end + 2);
+				input_buffer.erase(input_buffer.begin(), header_end + header_terminator.size());
+				return HeadResult::Complete;
+			}
+			if (input_buffer.size() > PROXY_MAX_RESPONSE_HEADER_SIZE)
+			{
+				return HeadResult::Invalid;
+			}
+			search_start = input_buffer.size() < header_terminator.size() ? 0 : input_buffer.size() - header_terminator.size() + 1;
+			auto filled = exchange.Fill(input_buffer);
+			if (filled == 0)
+			{
+				return input_buffer.empty() ? HeadResult::ConnectionClosed : HeadResult::Invalid;
+			}
+			if (filled < 0)
+			{
+				return exchange.timed_out ? HeadResult::TimedOut : HeadResult::Invalid;
+			}
+		}
+	}
+}  // namespace
+
+bool ReverseProxy::AddRoute(const ProxyRouteConfig& config)
+{
+	if (config.prefix.empty() || config.prefix.front() != '/')
+	{
+		std::cout << "[ReverseProxy] - route prefix " << config.prefix << " must start with /\n";
+		return false;
+	}
+	auto route = std::make_unique<ProxyRoute>();
+	route->config = config;
+	for (auto& upstream_name : config.upstreams)
+	{
+		auto port_start = upstream_name.rfind(':');
+		if (port_start == std::string::npos)
+		{
+			std::cout << "[ReverseProxy] - upstream " << upstream_name << " needs a port\n";
+			return false;
+		}
+		auto host = upstream_name.substr(0, port_start);
+		auto port = upstream_name.substr(port_start + 1);
+		struct addrinfo hints = {};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		struct addrinfo* address_info = nullptr;
+		if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address_info) != 0 || !address_info)
+		{
+			std::cout << "[ReverseProxy] - unable to resolve upstream " << upstream_name << "\n";
+			return false;
+		}
+		auto upstream = std::make_shared<Upstream>();
+		upstream->name = upstream_name;
+		upstream->address = *reinterpret_cast<struct sockaddr_in*>(address_info->ai_addr);
+		freeaddrinfo(address_info);
+		route->upstreams.push_back(std::move(upstream));
+	}
+	if (route->upstreams.empty())
+	{
+		std::cout << "[ReverseProxy] - route " << config.prefix << " has no upstreams\n";
+		return false;
+	}
+	_routes.push_back(std::move(route));
+	return true;
+}
+
+void ReverseProxy::AdoptUpstreams(const ReverseProxy& previous)
+{
+	for (auto& route : _routes)
+	{
+		auto previous_route_itr = std::find_if(previous._routes.begin(),
+											   previous._routes.end(),
+											   [&route](auto& previous_route)
+											   {
+												   return previous_route->config.prefix == route->config.prefix;
+											   });
+		if (previous_route_itr == previous._routes.end())
+		{
+			continue;
+		}
+		for (auto& upstream : route->upstreams)
+		{
+			for (auto& previous_upstream : (*previous_route_itr)->upstreams)
+			{
+				if (previous_upstream->name == upstream->name)
+				{
+					upstream = previous_upstream;
+					break;
+				}
+			}
+		}
+	}
+}
+
+std::optional<HttpResponse> ReverseProxy::Forward(HttpRequest& request, const std::string& client_name, const std::string& server_name)
+{
+	auto route = FindRoute(request.GetTarget());
+	if (!route)
+	{
+		return std::nullopt;
+	}
+	auto framing = BodyFraming::None;
+	uintmax_t content_length = 0;
+	auto content_length_header = request.GetHeader("Content-Length");
+	if (Contains(HeaderTokens(request.GetHeader("Transfer-Encoding")), "chunked"))
+	{
+		framing = BodyFraming::Chunked;
+	}
+	else if (content_length_header.has_value())
+	{
+		// already validated when the request was framed
+		content_length = std::strtoull(content_length_header->c_str(), nullptr, 10);
+		framing = content_length > 0 ? BodyFraming::ContentLength : BodyFraming::None;
+	}
+	else if (!request.GetBodyBuffer().empty())
+	{
+		// HTTP/2 requests need not carry a content-length
+		content_length = request.GetBodyBuffer().size();
+		framing = BodyFraming::ContentLength;
+	}
+	auto is_head = request.GetMethod() == "HEAD";
+
+	Upstream* failed_upstream = nullptr;
+	// a second attempt is only made while the request body is untouched
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		auto upstream = PickUpstream(*route, failed_upstream);
+		auto exchange = std::make_shared<ProxyExchange>(*upstream, route->config.max_idle_connections);
+		exchange->socket = TakeIdleSocket(*upstream);
+		exchange->reused = exchange->socket != nullptr;
+		if (!exchange->socket)
+		{
+			exchange->socket = jSocket::Connect(upstream->address, route->config.connect_timeout);
+			if (!exchange->socket)
+			{
+				std::cout << "[ReverseProxy] - unable to connect to " << upstream->name << "\n";
+				MarkFailed(*route, *upstream);
+				failed_upstream = upstream;
+				continue;
+			}
+			exchange->socket->SetTimeout(route->config.timeout);
+		}
+		if (!exchange->socket->Write(BuildRequestHead(request, *route, *upstream, client_name, server_name, framing, content_length)))
+		{
+			if (exchange->reused)
+			{
+				continue;
+			}
+			MarkFailed(*route, *upstream);
+			return ErrorResponse(502);
+		}
+
+		if (framing != BodyFraming::None)
+		{
+			// each chunk's closing CRLF goes out in front of the next chunk's size line
+			std::string chunk_prefix;
+			while (true)
+			{
+				auto body_part = request.ReadBody();
+				if (!body_part.has_value())
+				{
+					std::cout << "[ReverseProxy] - request body broke off\n";
+					auto response = ErrorResponse(400);
+					response.SetHeader("connection", "close");
+					return response;
+				}
+				bool sent = true;
+				if (framing == BodyFraming::ContentLength && !body_part->empty())
+				{
+					sent = exchange->socket->Write(body_part.value());
+				}
+				else if (framing == BodyFraming::Chunked)
+				{
+					std::stringstream size_stream;
+					size_stream << chunk_prefix << std::hex << body_part->size() << "\r\n" << (body_part->empty() ? "\r\n" : "");
+					auto size_line = size_stream.str();
+					sent = exchange->socket->Write(std::vector<unsigned char>(size_line.begin(), size_line.end()), body_part.value());
+					chunk_prefix = "\r\n";
+				}
+				if (!sent)
+				{
+					std::cout << "[ReverseProxy] - unable to send request body to " << upstream->name << "\n";
+					MarkFailed(*route, *upstream);
+					return ErrorResponse(502);
+				}
+				if (body_part->empty())
+				{
+					break;
+				}
+			}
+		}
+
+		std::string head;
+		HeadResult head_result;
+		int status_code = 0;
+		std::string http_version;
+		std::string reason_phrase;
+		std::vector<std::pair<std::string, std::string>> headers;
+		while ((head_result = ReadResponseHead(*exchange, head)) == HeadResult::Complete)
+		{
+			// status-line (RFC 7230 section 3.1.2)
+			auto line_end = head.find("\r\n");
+			std::istringstream status_line_stream(head.substr(0, line_end));
+			status_line_stream >> http_version >> status_code;
+			std::getline(status_line_stream, reason_phrase);
+			if (http_version.rfind("HTTP/1.", 0) != 0 || status_code < 100 || status_code > 599)
+			{
+				head_result = HeadResult::Invalid;
+				break;
+			}
+			// interim responses are not passed on, upgrades are not proxied
+			if (status_code >= 200)
+			{
+				break;
+			}
+			if (status_code == 101)
+			{
+				head_result = HeadResult::Invalid;
+				break;
+			}
+		}
+		if (head_result == HeadResult::ConnectionClosed && exchange->reused && framing == BodyFraming::None)
+		{
+			// the pooled connection was closed by the upstream before it saw the request
+			continue;
+		}
+		if (head_result == HeadResult::TimedOut)
+		{
+			std::cout << "[ReverseProxy] - " << upstream->name << " timed out\n";
+			MarkFailed(*route, *upstream);
+			return ErrorResponse(504);
+		}
+		if (head_result != HeadResult::Complete)
+		{
+			std::cout << "[ReverseProxy] - invalid response from " << upstream->name << "\n";
+			MarkFailed(*route, *upstream);
+			return ErrorResponse(502);
+		}
+
+		auto line_start = head.find("\r\n") + 2;
+		while (line_start < head.size())
+		{
+			auto line_end = head.find("\r\n", line_start);
+			auto line = head.substr(line_start, line_end - line_start);
+			line_start = line_end + 2;
+			auto name_end = line.find(':');
+			if (name_end == std::string::npos || name_end == 0)
+			{
+				continue;
+			}
+			headers.emplace_back(line.substr(0, name_end), Trim(line.substr(name_end + 1)));
+		}
+		HttpResponse response;
+		response.SetStatusCode(status_code);
+		response.SetReasonPhrase(Trim(reason_phrase));
+		std::vector<std::string> connection_tokens;
+		std::optional<std::string> response_content_length;
+		bool response_chunked = false;
+		for (auto& [name, value] : headers)
+		{
+			auto lower_name = ToLower(name);
+			if (lower_name == "connection")
+			{
+				auto tokens = HeaderTokens(value);
+				connection_tokens.insert(connection_tokens.end(), tokens.begin(), tokens.end());
+			}
+			else if (lower_name == "transfer-encoding")
+			{
+				response_chunked = response_chunked || Contains(HeaderTokens(value), "chunked");
+			}
+			else if (lower_name == "content-length")
+			{
+				response_content_length = value;
+			}
+		}
+		for (auto& [name, value] : headers)
+		{
+			auto lower_name = ToLower(name);
+			if (!Contains(HopByHopHeaders, lower_name) && !Contains(connection_tokens, lower_name) && lower_name != "content-length")
+			{
+				response.SetHeader(name, value);
+			}
+		}
+		exchange->reusable = http_version == "HTTP/1.1" && !Contains(connection_tokens, "close");
+		upstream->failures = 0;
+
+		// message body length (RFC 7230 section 3.3.3)
+		if (is_head || status_code == 204 || status_code == 304)
+		{
+			if (response_content_length.has_value())
+			{
+				response.SetHeader("content-length", response_content_length.value());
+			}
+			exchange->decoder.Start(BodyFraming::None);
+		}
+		else if (response_chunked)
+		{
+			exchange->decoder.Start(BodyFraming::Chunked);
+		}
+		else if (response_content_length.has_value())
+		{
+			try
+			{
+				size_t parsed_length = 0;
+				auto length = std::stoull(response_content_length.value(), &parsed_length);
+				if (parsed_length != response_content_length->size())
+				{
+					throw std::invalid_argument("content-length");
+				}
+				exchange->decoder.Start(BodyFraming::ContentLength, length);
+				if (!exchange->decoder.IsComplete())
+				{
+					response.SetBody(
+						[exchange]() -> std::optional<std::vector<unsigned char>>
+						{
+							auto body_part = exchange->decoder.Read();
+							if (!body_part.has_value())
+							{
+								std::cout << "[ReverseProxy] - response body from " << exchange->upstream->name << " broke off\n";
+								exchange->reusable = false;
+							}
+							if (!body_part.has_value() || body_part->empty() || exchange->decoder.IsComplete())
+							{
+								exchange->Finish();
+							}
+							return body_part;
+						},
+						length);
+					return response;
+				}
+			}
+			catch (...)
+			{
+				std::cout << "[ReverseProxy] - invalid content-length from " << upstream->name << "\n";
+				MarkFailed(*route, *upstream);
+				return ErrorResponse(502);
+			}
+			response.SetBody(std::vector<unsigned char>());
+			return response;
+		}
+		else
+		{
+			exchange->reusable = false;
+			exchange->decoder.Start(BodyFraming::UntilClose);
+		}
+		if (exchange->decoder.IsComplete())
+		{
+			return response;
+		}
+		// the length is not known up front, the body is passed on chunked
+		response.SetBody(
+			[exchange]() -> std::optional<std::vector<unsigned char>>
+			{
+				auto body_part = exchange->decoder.Read();
+				if (!body_part.has_value())
+				{
+					std::cout << "[ReverseProxy] - response body from " << exchange->upstream->name << " broke off\n";
+					exchange->reusable = false;
+				}
+				if (!body_part.has_value() || body_part->empty())
+				{
+					exchange->Finish();
+				}
+				return body_part;
+			},
+			std::nullopt);
+		return response;
+	}
+	return ErrorResponse(502);
+}
+
+std::optional<std::string> ReverseProxy::MatchRoute(const std::string& target) const
+{
+	auto route = FindRoute(target);
+	if (!route)
+	{
+		return std::nullopt;
+	}
+	return route->config.prefix;
+}
+
+ProxyRoute* ReverseProxy::FindRoute(const std::string& target) const
+{
+	ProxyRoute* longest_match = nullptr;
+	for (auto& route : _routes)
+	{
+		auto& prefix = route->config.prefix;
+		if (target.compare(0, prefix.size(), prefix) != 0)
+		{
+			continue;
+		}
+		// /api covers /api, /api/x and /api?x but not /apix
+		auto boundary = prefix.back() == '/' || target.size() == prefix.size() || target[prefix.size()] == '/' ||
+						target[prefix.size()] == '?';
+		if (boundary && (!longest_match || prefix.size() > longest_match->config.prefix.size()))
+		{
+			longest_match = route.get();
+		}
+	}
+	return longest_match;
+}
+
+Upstream* ReverseProxy::PickUpstream(ProxyRoute& route, const Upstream* avoid)
+{
+	auto now = Now();
+	auto upstream_count = route.upstreams.size();
+	auto start = route.next_upstream++;
+	Upstream* least_loaded = nullptr;
+	Upstream* least_loaded_ejected = nullptr;
+	for (size_t i = 0; i < upstream_count; i++)
+	{
+		auto upstream = route.upstreams[(start + i) % upstream_count].get();
+		auto& best = upstream->ejected_until > now || upstream == avoid ? least_loaded_ejected : least_loaded;
+		if (!best || upstream->outstanding < best->outstanding)
+		{
+			best = upstream;
+		}
+	}
+	// with every upstream ejected, sending anyway doubles as the probe that brings one back
+	return least_loaded ? least_loaded : least_loaded_ejected;
+}
+
+std::unique_ptr<jSocket> ReverseProxy::TakeIdleSocket(Upstream& upstream)
+{
+	std::lock_guard<std::mutex> lock(upstream.idle_mutex);
+	while (!upstream.idle_sockets.empty())
+	{
+		auto socket = std::move(upstream.idle_sockets.back());
+		upstream.idle_sockets.pop_back();
+		if (socket->IsIdle())
+		{
+			return socket;
+		}
+	}
+	return nullptr;
+}
+
+void ReverseProxy::MarkFailed(ProxyRoute& route, Upstream& upstream)
+{
+	if (++upstream.failures < route.config.max_fails)
+	{
+		return;
+	}
+	upstream.failures = 0;
+	upstream.ejected_until = Now() + std::chrono::nanoseconds(route.config.fail_timeout).count();
+	std::cout << "[ReverseProxy] - ejecting upstream " << upstream.name << " for " << route.config.fail_timeout.count() << "s\n";
+	std::lock_guard<std::mutex> lock(upstream.idle_mutex);
+	upstream.idle_sockets.clear();
+}
+
+std::vector<unsigned char> ReverseProxy::BuildRequestHead(const HttpRequest& request,
+														  const ProxyRoute& route,
+														  const Upstream& upstream,
+														  const std::string& client_name,
+														  const std::string& server_name,
+														  BodyFraming framing,
+														  uintmax_t content_length) const
+{
+	auto target = request.GetTarget();
+	if (route.config.strip_prefix)
+	{
+		target.erase(0, route.config.prefix.size());
+		if (target.empty() || target.front() != '/')
+		{
+			target.insert(0, "/");
+		}
+	}
+	std::stringstream head_stream;
+	head_stream << request.GetMethod() << " " << target << " HTTP/1.1\r\n";
+	auto connection_tokens = HeaderTokens(request.GetHeader("Connection"));
+	for (auto& [name, value] : request.GetHeaders())
+	{
+		auto lower_name = ToLower(name);
+		if (Contains(HopByHopHeaders, lower_name) || Contains(connection_tokens, lower_name) || lower_name == "content-length" ||
+			lower_name == "x-forwarded-for" || lower_name == "via" || lower_name.front() == ':')
+		{
+			continue;
+		}
+		head_stream << name << ": " << value << "\r\n";
+	}
+	if (!request.GetHeader("Host").has_value())
+	{
+		head_stream << "host: " << upstream.name << "\r\n";
+	}
+	auto forwarded_for = request.GetHeader("X-Forwarded-For");
+	head_stream << "x-forwarded-for: " << (forwarded_for.has_value() ? forwarded_for.value() + ", " : "") << client_name << "\r\n";
+	auto via = request.GetHeader("Via");
+	head_stream << "via: " << (via.has_value() ? via.value() + ", " : "") << "1.1 " << server_name << "\r\n";
+	head_stream << "connection: keep-alive\r\n";
+	if (framing == BodyFraming::Chunked)
+	{
+		head_stream << "transfer-encoding: chunked\r\n";
+	}
+	else if (framing == BodyFraming::ContentLength)
+	{
+		head_stream << "content-length: " << content_length << "\r\n";
+	}
+	head_stream << "\r\n";
+	auto head = head_stream.str();
+	return std::vector<unsigned char>(head.begin(), head.end());
+}
+
+HttpResponse ReverseProxy::ErrorResponse(int status_code)
+{
+	HttpResponse response;
+	response.SetStatusCode(status_code);
+	response.SetHeader("content-type", "text/html;charset=utf-8");
+	std::stringstream body_stream;
+	body_stream << "<body><div><H1>" << status_code << " " << ResponseCodes[status_code] << "</H1>";
+	switch (status_code)
+	{
+	case 502:
+		body_stream << "The upstream server could not be reached or sent an invalid response.";
+		break;
+
+	case 504:
+		body_stream << "The upstream server did not respond in time.";
+		break;
+
+	default:
+		break;
+	}
+	body_stream << "</div></body>";
+	std::vector<unsigned char> body_vec((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
+	response.SetBody(body_vec);
+	return response;
+}
+
+int64_t ReverseProxy::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -8,12 +8,12 @@ void RouteMap::RegisterRoute(std::string route_key, std::function<HttpResponse(H
 }
 bool RouteMap::HasRoute(std::string route)
 {
-	auto route_handler = routes.find(route);
-	return route_handler != routes.end();
+	return routes.find(route) != routes.end() || async_routes.find(route) != async_routes.end();
 }
 void RouteMap::UnregisterRoute(std::string route_key)
 {
 	routes.erase(route_key);
+	async_routes.erase(route_key);
 }
 std::optional<std::function<HttpResponse(HttpRequest&&)>> RouteMap::GetRouteHandler(std::string route)
 {
@@ -24,6 +24,19 @@ std::optional<std::function<HttpResponse(HttpRequest&&)>> RouteMap::GetRouteHand
 	}
 	return route_handler->second;
 }
+void RouteMap::RegisterAsyncRoute(std::string route_key, std::function<Task<HttpResponse>(HttpRequest&&)> route_handler)
+{
+	async_routes.emplace(std::make_pair(route_key, route_handler));
+}
+std::optional<std::function<Task<HttpResponse>(HttpRequest&&)>> RouteMap::GetAsyncRouteHandler(std::string route)
+{
+	auto route_handler = async_routes.find(route);
+	if (route_handler == async_routes.end())
+	{
+		return {};
+	}
+	return route_handler->second;
+}
 std::string RouteMap::GetRoutes()
 {
 	std::stringstream route_stream;
@@ -31,5 +44,9 @@ std::string RouteMap::GetRoutes()
 	{
 		route_stream << route_itr.first << "\n";
 	}
+	for (auto route_itr : async_routes)
+	{
+		route_stream << route_itr.first << "\n";
+	}
 	return route_stream.str();
 }
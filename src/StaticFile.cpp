@@ -0,0 +1,271 @@
+#include "StaticFile.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+	std::string Trim(const std::string& value)
+	{
+		auto start = value.find_first_not_of(" \t");
+		if (start == std::string::npos)
+		{
+			return "";
+		}
+		auto end = value.find_last_not_of(" \t");
+		return value.substr(start, end - start + 1);
+	}
+
+	std::vector<std::string> SplitList(const std::string& value)
+	{
+		std::vector<std::string> items;
+		std::stringstream list_stream(value);
+		std::string item;
+		while (std::getline(list_stream, item, ','))
+		{
+			item = Trim(item);
+			if (!item.empty())
+			{
+				items.emplace_back(item);
+			}
+		}
+		return items;
+	}
+
+	std::optional<uintmax_t> ParseNumber(const std::string& value)
+	{
+		if (value.empty() || !std::all_of(value.begin(), value.end(), ::isdigit))
+		{
+			return std::nullopt;
+		}
+		try
+		{
+			return std::stoull(value);
+		}
+		catch (...)
+		{
+			return std::nullopt;
+		}
+	}
+}  // namespace
+
+StaticFile::StaticFile(const std::string& path, std::shared_ptr<FileHandle> file, const struct stat& file_stat)
+  : _path(path)
+  , _file(std::move(file))
+  , _mtime(file_stat.st_mtime)
+  , _size(static_cast<uintmax_t>(file_stat.st_size))
+{
+	std::stringstream etag_stream;
+	etag_stream << '"' << std::hex << file_stat.st_ino << "-" << file_stat.st_size << "-" << file_stat.st_mtime << '"';
+	_etag = etag_stream.str();
+	_last_modified = FormatHttpDate(_mtime);
+}
+
+std::optional<StaticFile> StaticFile::Open(const std::string& path)
+{
+	auto file = FileHandle::Open(path);
+	if (!file)
+	{
+		return std::nullopt;
+	}
+	struct stat file_stat;
+	if (fstat(file->Get(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+	{
+		return std::nullopt;
+	}
+	return StaticFile(path, std::move(file), file_stat);
+}
+
+std::string StaticFile::FormatHttpDate(std::time_t time)
+{
+	std::stringstream date_stream;
+	date_stream << std::put_time(std::gmtime(&time), "%a, %d %b %Y %OH:%M:%S GMT");
+	return date_stream.str();
+}
+
+std::optional<std::time_t> StaticFile::ParseHttpDate(const std::string& date)
+{
+	// IMF-fixdate, obsolete RFC 850 and asctime formats (RFC 7231 section 7.1.1.1)
+	static const char* formats[] = { "%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT", "%a %b %e %H:%M:%S %Y" };
+	auto trimmed_date = Trim(date);
+	for (auto format : formats)
+	{
+		struct tm time_parts = {};
+		auto parse_end = strptime(trimmed_date.c_str(), format, &time_parts);
+		if (parse_end != nullptr && *parse_end == '\0')
+		{
+			return timegm(&time_parts);
+		}
+	}
+	return std::nullopt;
+}
+
+bool StaticFile::ETagMatches(const std::string& header_value, const std::string& etag, bool weak_comparison)
+{
+	if (Trim(header_value) == "*")
+	{
+		return true;
+	}
+	for (auto candidate : SplitList(header_value))
+	{
+		if (candidate.rfind("W/", 0) == 0)
+		{
+			if (!weak_comparison)
+			{
+				continue;
+			}
+			candidate.erase(0, 2);
+		}
+		if (candidate == etag)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+std::optional<int> StaticFile::EvaluatePreconditions(const HttpRequest& request, const std::string& etag, std::time_t mtime)
+{
+	auto method = request.GetMethod();
+	auto safe_method = method == "GET" || method == "HEAD";
+	// If-None-Match takes precedence over If-Modified-Since (RFC 7232 section 3.3)
+	auto if_none_match = request.GetHeader("If-None-Match");
+	if (if_none_match.has_value())
+	{
+		if (!ETagMatches(if_none_match.value(), etag, true))
+		{
+			return std::nullopt;
+		}
+		return safe_method ? 304 : 412;
+	}
+	// only a GET or HEAD may be answered from a cache's copy, other methods ignore the date
+	auto if_modified_since = request.GetHeader("If-Modified-Since");
+	if (safe_method && if_modified_since.has_value())
+	{
+		auto since = ParseHttpDate(if_modified_since.value());
+		if (since.has_value() && mtime <= since.value())
+		{
+			return 304;
+		}
+	}
+	return std::nullopt;
+}
+
+std::optional<int> StaticFile::EvaluatePreconditions(const HttpRequest& request) const
+{
+	return EvaluatePreconditions(request, _etag, _mtime);
+}
+
+bool StaticFile::IfRangeMatches(const HttpRequest& request) const
+{
+	return IfRangeMatches(request, _etag, _mtime);
+}
+
+bool StaticFile::IfRangeMatches(const HttpRequest& request, const std::string& etag, std::time_t mtime)
+{
+	auto if_range = request.GetHeader("If-Range");
+	if (!if_range.has_value())
+	{
+		return true;
+	}
+	auto validator = Trim(if_range.value());
+	if (validator.rfind("W/", 0) == 0)
+	{
+		return false;
+	}
+	if (!validator.empty() && validator[0] == '"')
+	{
+		return ETagMatches(validator, etag, false);
+	}
+	auto date = ParseHttpDate(validator);
+	return date.has_value() && date.value() == mtime;
+}
+
+std::optional<std::vector<ByteRange>> StaticFile::ParseRange(const std::string& range_header, uintmax_t size)
+{
+	auto range_value = Trim(range_header);
+	if (range_value.rfind("bytes=", 0) != 0)
+	{
+		return std::nullopt;
+	}
+	auto range_specs = SplitList(range_value.substr(6));
+	if (range_specs.empty() || range_specs.size() > MAX_BYTE_RANGES)
+	{
+		return std::nullopt;
+	}
+	std::vector<ByteRange> ranges;
+	for (auto& range_spec : range_specs)
+	{
+		auto dash = range_spec.find('-');
+		if (dash == std::string::npos)
+		{
+			return std::nullopt;
+		}
+		auto first_value = Trim(range_spec.substr(0, dash));
+		auto last_value = Trim(range_spec.substr(dash + 1));
+		if (first_value.empty())
+		{
+			// suffix-byte-range-spec : the final N bytes
+			auto suffix_length = ParseNumber(last_value);
+			if (!suffix_length.has_value())
+			{
+				return std::nullopt;
+			}
+			if (suffix_length.value() == 0 || size == 0)
+			{
+				continue;
+			}
+			auto length = std::min(suffix_length.value(), size);
+			ranges.push_back({ size - length, size - 1 });
+			continue;
+		}
+		auto first = ParseNumber(first_value);
+		auto last = last_value.empty() ? std::optional<uintmax_t>(UINTMAX_MAX) : ParseNumber(last_value);
+		if (!first.has_value() || !last.has_value() || last.value() < first.value())
+		{
+			return std::nullopt;
+		}
+		if (first.value() >= size)
+		{
+			continue;
+		}
+		ranges.push_back({ first.value(), std::min(last.value(), size - 1) });
+	}
+	return ranges;
+}
+
+std::optional<std::vector<unsigned char>> StaticFile::Read(uintmax_t offset, uintmax_t length) const
+{
+	std::vector<unsigned char> file_contents(length);
+	size_t bytes_read = 0;
+	while (bytes_read < length)
+	{
+		auto result =
+			pread(_file->Get(), file_contents.data() + bytes_read, length - bytes_read, static_cast<off_t>(offset + bytes_read));
+		if (result <= 0)
+		{
+			return std::nullopt;
+		}
+		bytes_read += result;
+	}
+	return file_contents;
+}
+
+std::optional<std::vector<unsigned char>> StaticFile::Read() const
+{
+	return Read(0, _size);
+}
+
+FileBody StaticFile::Body(uintmax_t offset, uintmax_t length) const
+{
+	return FileBody{ _file, offset, length };
+}
+
+FileBody StaticFile::Body() const
+{
+	return Body(0, _size);
+}
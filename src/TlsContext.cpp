@@ -0,0 +1,175 @@
+#include "TlsContext.h"
+
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	// ALPN identifiers in wire format, in order of preference
+	const unsigned char AlpnProtocols[] = { 2, 'h', '2', 8, 'h', 't', 't', 'p', '/', '1', '.', '1' };
+	const unsigned char SessionIdContext[] = "jHttpServe";
+
+	std::string LastTlsError()
+	{
+		char error_buffer[256];
+		ERR_error_string_n(ERR_get_error(), error_buffer, sizeof(error_buffer));
+		return error_buffer;
+	}
+}  // namespace
+
+TlsContext::~TlsContext()
+{
+	if (_context)
+	{
+		SSL_CTX_free(_context);
+	}
+}
+
+bool TlsContext::Init(const TlsConfig& config)
+{
+	_context = SSL_CTX_new(TLS_server_method());
+	if (!_context)
+	{
+		std::cout << "[TlsContext] - unable to create context (" << LastTlsError() << ")\n";
+		return false;
+	}
+	SSL_CTX_set_min_proto_version(_context, TLS1_2_VERSION);
+	SSL_CTX_set_app_data(_context, this);
+	if (SSL_CTX_use_certificate_chain_file(_context, config.certificate_file.c_str()) != 1)
+	{
+		std::cout << "[TlsContext] - unable to load certificate " << config.certificate_file << " (" << LastTlsError() << ")\n";
+		return false;
+	}
+	if (SSL_CTX_use_PrivateKey_file(_context, config.private_key_file.c_str(), SSL_FILETYPE_PEM) != 1 ||
+		SSL_CTX_check_private_key(_context) != 1)
+	{
+		std::cout << "[TlsContext] - unable to load private key " << config.private_key_file << " (" << LastTlsError() << ")\n";
+		return false;
+	}
+
+	// stateful resumption : one cache for the whole server, not per connection
+	SSL_CTX_set_session_id_context(_context, SessionIdContext, sizeof(SessionIdContext) - 1);
+	SSL_CTX_set_session_cache_mode(_context, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(_context, config.session_cache_size);
+	SSL_CTX_set_timeout(_context, config.session_timeout);
+
+	// stateless resumption : tickets are on by default with a per process key,
+	// a key file lets several processes and restarts accept each other's tickets
+	if (!config.ticket_key_file.empty())
+	{
+		if (!LoadTicketKey(config.ticket_key_file))
+		{
+			return false;
+		}
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(_context, &TlsContext::TicketKeyCallback);
+	}
+
+	SSL_CTX_set_alpn_select_cb(_context, &TlsContext::AlpnSelectCallback, nullptr);
+
+#ifdef SSL_OP_ENABLE_KTLS
+	if (config.enable_ktls)
+	{
+		// record encryption moves into the kernel once the handshake is done,
+		// only honoured for ciphers the kernel supports
+		SSL_CTX_set_options(_context, SSL_OP_ENABLE_KTLS);
+		_ktls_enabled = true;
+	}
+#endif
+	std::cout << "[TlsContext] - TLS enabled" << (_ktls_enabled ? " with kernel TLS offload" : "") << "\n";
+	return true;
+}
+
+SSL* TlsContext::CreateSession(int socket_fd) const
+{
+	SSL* ssl = SSL_new(_context);
+	if (!ssl)
+	{
+		return nullptr;
+	}
+	if (SSL_set_fd(ssl, socket_fd) != 1)
+	{
+		SSL_free(ssl);
+		return nullptr;
+	}
+	SSL_set_accept_state(ssl);
+	return ssl;
+}
+
+bool TlsContext::LoadTicketKey(const std::string& file_name)
+{
+	std::ifstream key_file(file_name, std::ios::binary);
+	std::array<unsigned char, TLS_TICKET_KEY_SIZE> ticket_key;
+	if (!key_file.read(reinterpret_cast<char*>(ticket_key.data()), ticket_key.size()))
+	{
+		std::cout << "[TlsContext] - ticket key file " << file_name << " must contain " << TLS_TICKET_KEY_SIZE << " bytes\n";
+		return false;
+	}
+	_ticket_key = ticket_key;
+	return true;
+}
+
+int TlsContext::TicketKeyCallback(SSL* ssl,
+								  unsigned char key_name[16],
+								  unsigned char iv[EVP_MAX_IV_LENGTH],
+								  EVP_CIPHER_CTX* cipher_context,
+								  EVP_MAC_CTX* hmac_context,
+								  int encrypt)
+{
+	auto tls_context = static_cast<TlsContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+	if (!tls_context || !tls_context->_ticket_key.has_value())
+	{
+		return -1;
+	}
+	// key file layout : 16 byte name, 32 byte AES key, 32 byte HMAC key
+	auto& ticket_key = tls_context->_ticket_key.value();
+	auto name = ticket_key.data();
+	auto aes_key = ticket_key.data() + 16;
+	auto hmac_key = ticket_key.data() + 48;
+	OSSL_PARAM hmac_params[] = { OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, hmac_key, 32),
+								 OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+								 OSSL_PARAM_construct_end() };
+	if (encrypt)
+	{
+		std::memcpy(key_name, name, 16);
+		if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1 ||
+			EVP_EncryptInit_ex(cipher_context, EVP_aes_256_cbc(), nullptr, aes_key, iv) != 1 ||
+			EVP_MAC_CTX_set_params(hmac_context, hmac_params) != 1)
+		{
+			return -1;
+		}
+		return 1;
+	}
+	if (std::memcmp(key_name, name, 16) != 0)
+	{
+		// unknown key : fall back to a full handshake
+		return 0;
+	}
+	if (EVP_MAC_CTX_set_params(hmac_context, hmac_params) != 1 ||
+		EVP_DecryptInit_ex(cipher_context, EVP_aes_256_cbc(), nullptr, aes_key, iv) != 1)
+	{
+		return -1;
+	}
+	return 1;
+}
+
+int TlsContext::AlpnSelectCallback(SSL* ssl,
+								   const unsigned char** out,
+								   unsigned char* out_length,
+								   const unsigned char* in,
+								   unsigned int in_length,
+								   void* arg)
+{
+	unsigned char* selected;
+	if (SSL_select_next_proto(&selected, out_length, AlpnProtocols, sizeof(AlpnProtocols), in, in_length) != OPENSSL_NPN_NEGOTIATED)
+	{
+		return SSL_TLSEXT_ERR_NOACK;
+	}
+	*out = selected;
+	return SSL_TLSEXT_ERR_OK;
+}
@@ -0,0 +1,270 @@
+#include "UploadIndex.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr uint32_t WatchedEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ATTRIB;
+
+	std::optional<UploadEntry> ReadEntry(const fs::path& file_path)
+	{
+		struct stat file_stat;
+		if (stat(file_path.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+		{
+			return std::nullopt;
+		}
+		return UploadEntry{ file_path.filename().string(), static_cast<uintmax_t>(file_stat.st_size), file_stat.st_mtim.tv_sec };
+	}
+}  // namespace
+
+UploadIndex::~UploadIndex()
+{
+	if (_watch_thread.joinable())
+	{
+		_watch_thread.request_stop();
+		_watch_thread.join();
+	}
+	if (_inotify_fd != -1)
+	{
+		close(_inotify_fd);
+	}
+}
+
+void UploadIndex::Open(const fs::path& directory_path)
+{
+	// uploads are matched to the directory by their parent path, so it has to be spelled the same way
+	auto directory = directory_path.lexically_normal();
+	if (!directory.has_filename())
+	{
+		directory = directory.parent_path();
+	}
+	{
+		std::shared_lock lock(_mutex);
+		if (_directory == directory)
+		{
+			return;
+		}
+	}
+	if (_watch_thread.joinable())
+	{
+		_watch_thread.request_stop();
+		_watch_thread.join();
+	}
+	if (_inotify_fd != -1)
+	{
+		close(_inotify_fd);
+		_inotify_fd = -1;
+	}
+	std::error_code error;
+	fs::create_directories(directory, error);
+	// watched before the scan so that nothing written in between is missed
+	_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_inotify_fd != -1 && inotify_add_watch(_inotify_fd, directory.c_str(), WatchedEvents) == -1)
+	{
+		close(_inotify_fd);
+		_inotify_fd = -1;
+	}
+	if (_inotify_fd == -1)
+	{
+		std::cout << "[UploadIndex] - Unable to watch " << directory << ", only uploads through the server are listed\n";
+	}
+	{
+		std::unique_lock lock(_mutex);
+		_directory = directory;
+		Scan();
+	}
+	std::cout << "[UploadIndex] - Indexed " << Size() << " uploads in " << directory << "\n";
+	if (_inotify_fd != -1)
+	{
+		_watch_thread = std::jthread(std::bind_front(&UploadIndex::Watch, this));
+	}
+}
+
+void UploadIndex::Update(const fs::path& file_path)
+{
+	auto entry = ReadEntry(file_path);
+	std::unique_lock lock(_mutex);
+	if (file_path.lexically_normal().parent_path() != _directory)
+	{
+		return;
+	}
+	if (entry.has_value())
+	{
+		Insert(std::move(entry.value()));
+	}
+	else
+	{
+		Remove(file_path.filename().string());
+	}
+}
+
+UploadPage UploadIndex::GetPage(UploadSort sort, bool descending, const std::string& cursor, size_t limit) const
+{
+	limit = std::clamp<size_t>(limit, 1, UPLOAD_INDEX_MAX_PAGE_SIZE);
+	auto cursor_key = ParseCursor(sort, cursor);
+	UploadPage page;
+	std::shared_lock lock(_mutex);
+	auto& order = _orders[static_cast<size_t>(sort)];
+	if (!descending)
+	{
+		auto key_itr = cursor_key.has_value() ? order.upper_bound(cursor_key.value()) : order.begin();
+		for (; key_itr != order.end() && page.entries.size() < limit; key_itr++)
+		{
+			page.entries.push_back(_entries.at(key_itr->second));
+		}
+		if (key_itr != order.end() && !page.entries.empty())
+		{
+			page.next_cursor = MakeCursor(*std::prev(key_itr));
+		}
+		return page;
+	}
+	// everything before the lower bound sorts ahead of the cursor, walk that part backwards
+	auto key_itr = cursor_key.has_value() ? order.lower_bound(cursor_key.value()) : order.end();
+	while (key_itr != order.begin() && page.entries.size() < limit)
+	{
+		key_itr--;
+		page.entries.push_back(_entries.at(key_itr->second));
+	}
+	if (key_itr != order.begin() && !page.entries.empty())
+	{
+		page.next_cursor = MakeCursor(*key_itr);
+	}
+	return page;
+}
+
+size_t UploadIndex::Size() const
+{
+	std::shared_lock lock(_mutex);
+	return _entries.size();
+}
+
+UploadIndex::SortKey UploadIndex::MakeKey(UploadSort sort, const UploadEntry& entry)
+{
+	switch (sort)
+	{
+	case UploadSort::Size:
+		return SortKey(static_cast<int64_t>(entry.size), entry.name);
+	case UploadSort::Modified:
+		return SortKey(entry.modified, entry.name);
+	default:
+		return SortKey(0, entry.name);
+	}
+}
+
+std::optional<UploadIndex::SortKey> UploadIndex::ParseCursor(UploadSort sort, const std::string& cursor)
+{
+	auto separator = cursor.find(':');
+	if (separator == std::string::npos)
+	{
+		return std::nullopt;
+	}
+	int64_t value = 0;
+	auto parse_result = std::from_chars(cursor.data(), cursor.data() + separator, value);
+	if (parse_result.ec != std::errc() || parse_result.ptr != cursor.data() + separator)
+	{
+		return std::nullopt;
+	}
+	return SortKey(sort == UploadSort::Name ? 0 : value, cursor.substr(separator + 1));
+}
+
+std::string UploadIndex::MakeCursor(const SortKey& key)
+{
+	return std::to_string(key.first) + ":" + key.second;
+}
+
+void UploadIndex::Scan()
+{
+	_entries.clear();
+	for (auto& order : _orders)
+	{
+		order.clear();
+	}
+	std::error_code error;
+	for (auto directory_itr = fs::directory_iterator(_directory, error); !error && directory_itr != fs::directory_iterator();
+		 directory_itr.increment(error))
+	{
+		auto entry = ReadEntry(directory_itr->path());
+		if (entry.has_value())
+		{
+			Insert(std::move(entry.value()));
+		}
+	}
+}
+
+void UploadIndex::Insert(UploadEntry&& entry)
+{
+	// hidden files are not listed
+	if (entry.name.empty() || entry.name[0] == '.')
+	{
+		return;
+	}
+	Remove(entry.name);
+	for (size_t sort = 0; sort < _orders.size(); sort++)
+	{
+		_orders[sort].insert(MakeKey(static_cast<UploadSort>(sort), entry));
+	}
+	auto name = entry.name;
+	_entries.emplace(std::move(name), std::move(entry));
+}
+
+void UploadIndex::Remove(const std::string& name)
+{
+	auto entry_itr = _entries.find(name);
+	if (entry_itr == _entries.end())
+	{
+		return;
+	}
+	for (size_t sort = 0; sort < _orders.size(); sort++)
+	{
+		_orders[sort].erase(MakeKey(static_cast<UploadSort>(sort), entry_itr->second));
+	}
+	_entries.erase(entry_itr);
+}
+
+void UploadIndex::Watch(std::stop_token stop_token)
+{
+	alignas(struct inotify_event) char event_buffer[16 * 1024];
+	while (!stop_token.stop_requested())
+	{
+		struct pollfd poll_fd = { _inotify_fd, POLLIN, 0 };
+		if (poll(&poll_fd, 1, 500) != 1)
+		{
+			continue;
+		}
+		auto bytes_read = read(_inotify_fd, event_buffer, sizeof(event_buffer));
+		if (bytes_read <= 0)
+		{
+			continue;
+		}
+		for (char* event_ptr = event_buffer; event_ptr < event_buffer + bytes_read;)
+		{
+			auto event = reinterpret_cast<struct inotify_event*>(event_ptr);
+			event_ptr += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				// events were dropped, only a fresh scan is sure to be right
+				std::unique_lock lock(_mutex);
+				Scan();
+				continue;
+			}
+			if (event->len == 0)
+			{
+				continue;
+			}
+			// the file is looked at as it is now, so a stale event cannot bring back a deleted upload
+			Update(_directory / event->name);
+		}
+	}
+}
@@ -0,0 +1,172 @@
+#include "UploadStore.h"
+
+#include <openssl/evp.h>
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr size_t DigestLength = 32;
+	// keeps the temporary names of links made at the same time apart
+	std::atomic<uint64_t> next_link_id = 0;
+
+	std::string ToHex(const unsigned char* data, size_t length)
+	{
+		static const char* HexDigits = "0123456789abcdef";
+		std::string hex;
+		for (size_t i = 0; i < length; i++)
+		{
+			hex += HexDigits[data[i] >> 4];
+			hex += HexDigits[data[i] & 0x0F];
+		}
+		return hex;
+	}
+
+	bool WriteAll(int fd, const unsigned char* data, size_t length)
+	{
+		while (length > 0)
+		{
+			auto bytes_written = write(fd, data, length);
+			if (bytes_written <= 0)
+			{
+				return false;
+			}
+			data += bytes_written;
+			length -= bytes_written;
+		}
+		return true;
+	}
+}  // namespace
+
+std::optional<std::string> UploadStore::Store(const std::string& name, const BodyReader& body_reader)
+{
+	auto digest = WriteBlob(body_reader);
+	if (!digest.has_value() || !Link(name.empty() ? digest.value() : name, digest.value()))
+	{
+		return std::nullopt;
+	}
+	return digest;
+}
+
+std::optional<std::string> UploadStore::GetDigest(const std::string& name) const
+{
+	std::error_code error;
+	auto target = fs::read_symlink(_upload_dir / fs::path(name).filename(), error);
+	if (error || target.parent_path() != UPLOAD_STORE_BLOB_DIR || !IsDigest(target.filename().string()))
+	{
+		return std::nullopt;
+	}
+	return target.filename().string();
+}
+
+std::optional<fs::path> UploadStore::GetBlobPath(const std::string& digest) const
+{
+	if (!IsDigest(digest))
+	{
+		return std::nullopt;
+	}
+	return _upload_dir / UPLOAD_STORE_BLOB_DIR / digest;
+}
+
+bool UploadStore::IsDigest(const std::string& digest)
+{
+	return digest.size() == DigestLength * 2 && std::all_of(digest.begin(),
+															  digest.end(),
+															  [](unsigned char character)
+															  {
+																  return std::isdigit(character) || (character >= 'a' && character <= 'f');
+															  });
+}
+
+std::optional<std::string> UploadStore::WriteBlob(const BodyReader& body_reader)
+{
+	auto blob_dir = _upload_dir / UPLOAD_STORE_BLOB_DIR;
+	std::error_code error;
+	fs::create_directories(blob_dir, error);
+	// written under a temporary name, the digest is only known at the end
+	auto temp_path = (blob_dir / ".upload-XXXXXX").string();
+	int temp_fd = mkstemp(temp_path.data());
+	if (temp_fd < 0)
+	{
+		std::cout << "[UploadStore] - Unable to create file in " << blob_dir << "\n";
+		return std::nullopt;
+	}
+	std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> hash_context(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+	// EVP picks the SHA extensions or AVX2 code paths of the CPU it runs on
+	auto written = hash_context && EVP_DigestInit_ex(hash_context.get(), EVP_sha256(), nullptr) == 1;
+	while (written)
+	{
+		auto body_part = body_reader();
+		if (!body_part.has_value())
+		{
+			written = false;
+			break;
+		}
+		if (body_part->empty())
+		{
+			break;
+		}
+		written = EVP_DigestUpdate(hash_context.get(), body_part->data(), body_part->size()) == 1 &&
+				  WriteAll(temp_fd, body_part->data(), body_part->size());
+	}
+	unsigned char digest_bytes[EVP_MAX_MD_SIZE];
+	unsigned int digest_length = 0;
+	written = written && EVP_DigestFinal_ex(hash_context.get(), digest_bytes, &digest_length) == 1;
+	close(temp_fd);
+	if (!written)
+	{
+		unlink(temp_path.c_str());
+		return std::nullopt;
+	}
+	auto digest = ToHex(digest_bytes, digest_length);
+	auto blob_path = blob_dir / digest;
+	struct stat blob_stat;
+	if (stat(blob_path.c_str(), &blob_stat) == 0)
+	{
+		// the same content is already stored, keep the copy that is there
+		unlink(temp_path.c_str());
+		return digest;
+	}
+	chmod(temp_path.c_str(), 0644);
+	if (rename(temp_path.c_str(), blob_path.c_str()) != 0)
+	{
+		unlink(temp_path.c_str());
+		return std::nullopt;
+	}
+	return digest;
+}
+
+bool UploadStore::Link(const std::string& name, const std::string& digest)
+{
+	auto file_name = fs::path(name).filename().string();
+	if (file_name.empty() || file_name[0] == '.')
+	{
+		return false;
+	}
+	// replaced with a rename so a reader never finds the name missing
+	auto link_path = _upload_dir / file_name;
+	auto temp_link_path = _upload_dir / (".link-" + std::to_string(getpid()) + "-" + std::to_string(next_link_id++));
+	auto target = fs::path(UPLOAD_STORE_BLOB_DIR) / digest;
+	if (symlink(target.c_str(), temp_link_path.c_str()) != 0)
+	{
+		return false;
+	}
+	if (rename(temp_link_path.c_str(), link_path.c_str()) != 0)
+	{
+		unlink(temp_link_path.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,271 @@
+#include "WebSocketCodec.h"
+
+#include <openssl/evp.h>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+#include <cstring>
+
+namespace
+{
+	// RFC 6455 section 1.3
+	const std::string AcceptGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	constexpr size_t MaxControlPayload = 125;
+
+	// well formed UTF-8 without overlong forms, surrogates or code points past U+10FFFF (RFC 3629)
+	bool IsValidUtf8(const std::vector<unsigned char>& text)
+	{
+		size_t position = 0;
+		while (position < text.size())
+		{
+			auto lead = text[position];
+			if (lead < 0x80)
+			{
+				position++;
+				continue;
+			}
+			size_t length;
+			uint32_t code_point;
+			if ((lead & 0xE0) == 0xC0)
+			{
+				length = 2;
+				code_point = lead & 0x1F;
+			}
+			else if ((lead & 0xF0) == 0xE0)
+			{
+				length = 3;
+				code_point = lead & 0x0F;
+			}
+			else if ((lead & 0xF8) == 0xF0)
+			{
+				length = 4;
+				code_point = lead & 0x07;
+			}
+			else
+			{
+				return false;
+			}
+			if (position + length > text.size())
+			{
+				return false;
+			}
+			for (size_t i = 1; i < length; i++)
+			{
+				if ((text[position + i] & 0xC0) != 0x80)
+				{
+					return false;
+				}
+				code_point = (code_point << 6) | (text[position + i] & 0x3F);
+			}
+			const uint32_t shortest[] = { 0, 0, 0x80, 0x800, 0x10000 };
+			if (code_point < shortest[length] || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF))
+			{
+				return false;
+			}
+			position += length;
+		}
+		return true;
+	}
+}  // namespace
+
+std::string WebSocketAcceptKey(const std::string& client_key)
+{
+	auto key_material = client_key + AcceptGuid;
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_length = 0;
+	if (EVP_Digest(key_material.data(), key_material.size(), digest, &digest_length, EVP_sha1(), nullptr) != 1)
+	{
+		return std::string();
+	}
+	// 4 output characters for every 3 bytes, and the terminator EVP_EncodeBlock writes
+	std::string accept_key(4 * ((digest_length + 2) / 3) + 1, '\0');
+	auto encoded_length = EVP_EncodeBlock(reinterpret_cast<unsigned char*>(accept_key.data()), digest, static_cast<int>(digest_length));
+	accept_key.resize(encoded_length);
+	return accept_key;
+}
+
+void UnmaskWebSocketPayload(unsigned char* data, size_t length, const unsigned char mask[4], size_t position)
+{
+	// the key turned so that its first byte lines up with data[0]
+	unsigned char key[4] = { mask[position % 4], mask[(position + 1) % 4], mask[(position + 2) % 4], mask[(position + 3) % 4] };
+	uint32_t key_word;
+	memcpy(&key_word, key, sizeof(key_word));
+	size_t offset = 0;
+	// every block is a multiple of 4 bytes long, so the key stays lined up from one to the next
+#if defined(__AVX2__)
+	auto key_vector = _mm256_set1_epi32(static_cast<int>(key_word));
+	for (; offset + 32 <= length; offset += 32)
+	{
+		auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + offset), _mm256_xor_si256(block, key_vector));
+	}
+#endif
+#if defined(__SSE2__)
+	auto key_vector_128 = _mm_set1_epi32(static_cast<int>(key_word));
+	for (; offset + 16 <= length; offset += 16)
+	{
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + offset), _mm_xor_si128(block, key_vector_128));
+	}
+#elif defined(__ARM_NEON)
+	auto key_vector_128 = vreinterpretq_u8_u32(vdupq_n_u32(key_word));
+	for (; offset + 16 <= length; offset += 16)
+	{
+		vst1q_u8(data + offset, veorq_u8(vld1q_u8(data + offset), key_vector_128));
+	}
+#endif
+	uint64_t key_double_word = (static_cast<uint64_t>(key_word) << 32) | key_word;
+	for (; offset + 8 <= length; offset += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + offset, sizeof(word));
+		word ^= key_double_word;
+		memcpy(data + offset, &word, sizeof(word));
+	}
+	for (; offset < length; offset++)
+	{
+		data[offset] ^= key[offset % 4];
+	}
+}
+
+std::vector<unsigned char> EncodeWebSocketFrame(WebSocketOpcode opcode, const unsigned char* payload, size_t length, bool fin)
+{
+	std::vector<unsigned char> frame;
+	frame.reserve(length + 10);
+	frame.push_back((fin ? 0x80 : 0x00) | static_cast<unsigned char>(opcode));
+	if (length < 126)
+	{
+		frame.push_back(static_cast<unsigned char>(length));
+	}
+	else if (length <= 0xFFFF)
+	{
+		frame.push_back(126);
+		frame.push_back(static_cast<unsigned char>(length >> 8));
+		frame.push_back(static_cast<unsigned char>(length));
+	}
+	else
+	{
+		frame.push_back(127);
+		for (int shift = 56; shift >= 0; shift -= 8)
+		{
+			frame.push_back(static_cast<unsigned char>(static_cast<uint64_t>(length) >> shift));
+		}
+	}
+	frame.insert(frame.end(), payload, payload + length);
+	return frame;
+}
+
+WebSocketDecoder::Result WebSocketDecoder::Decode(const unsigned char* data, size_t length, size_t& consumed, WebSocketMessage& message)
+{
+	consumed = 0;
+	while (true)
+	{
+		auto frame = data + consumed;
+		auto available = length - consumed;
+		if (available < 2)
+		{
+			return Result::NeedMore;
+		}
+		auto fin = (frame[0] & 0x80) != 0;
+		auto opcode = static_cast<WebSocketOpcode>(frame[0] & 0x0F);
+		// no extension was negotiated that could give the reserved bits a meaning
+		if ((frame[0] & 0x70) != 0 || (frame[1] & 0x80) == 0)
+		{
+			return Fail(WebSocketCloseCode::ProtocolError);
+		}
+		size_t header_length = 2;
+		uint64_t payload_length = frame[1] & 0x7F;
+		if (payload_length == 126)
+		{
+			header_length = 4;
+			if (available < header_length)
+			{
+				return Result::NeedMore;
+			}
+			payload_length = (static_cast<uint64_t>(frame[2]) << 8) | frame[3];
+		}
+		else if (payload_length == 127)
+		{
+			header_length = 10;
+			if (available < header_length)
+			{
+				return Result::NeedMore;
+			}
+			payload_length = 0;
+			for (size_t i = 2; i < 10; i++)
+			{
+				payload_length = (payload_length << 8) | frame[i];
+			}
+		}
+		auto is_control = (frame[0] & 0x08) != 0;
+		if (is_control)
+		{
+			if (!fin || payload_length > MaxControlPayload ||
+				(opcode != WebSocketOpcode::Close && opcode != WebSocketOpcode::Ping && opcode != WebSocketOpcode::Pong))
+			{
+				return Fail(WebSocketCloseCode::ProtocolError);
+			}
+		}
+		else
+		{
+			auto is_continuation = opcode == WebSocketOpcode::Continuation;
+			if ((opcode != WebSocketOpcode::Text && opcode != WebSocketOpcode::Binary && !is_continuation) ||
+				is_continuation != _fragmented_opcode.has_value())
+			{
+				return Fail(WebSocketCloseCode::ProtocolError);
+			}
+			// refused from the header alone, before any of the payload is buffered
+			if (payload_length > _max_message_size - _fragments.size())
+			{
+				return Fail(WebSocketCloseCode::MessageTooBig);
+			}
+		}
+		header_length += 4;
+		if (available < header_length || available - header_length < payload_length)
+		{
+			return Result::NeedMore;
+		}
+		auto mask = frame + header_length - 4;
+		auto payload = frame + header_length;
+		consumed += header_length + payload_length;
+		if (is_control)
+		{
+			message.opcode = opcode;
+			message.payload.assign(payload, payload + payload_length);
+			UnmaskWebSocketPayload(message.payload.data(), message.payload.size(), mask);
+			return Result::Message;
+		}
+		auto fragment_start = _fragments.size();
+		_fragments.insert(_fragments.end(), payload, payload + payload_length);
+		UnmaskWebSocketPayload(_fragments.data() + fragment_start, payload_length, mask);
+		if (opcode != WebSocketOpcode::Continuation)
+		{
+			_fragmented_opcode = opcode;
+		}
+		if (!fin)
+		{
+			continue;
+		}
+		message.opcode = _fragmented_opcode.value();
+		message.payload = std::move(_fragments);
+		_fragments.clear();
+		_fragmented_opcode.reset();
+		if (message.opcode == WebSocketOpcode::Text && !IsValidUtf8(message.payload))
+		{
+			return Fail(WebSocketCloseCode::InvalidPayload);
+		}
+		return Result::Message;
+	}
+}
+
+WebSocketDecoder::Result WebSocketDecoder::Fail(WebSocketCloseCode error_code)
+{
+	_error_code = error_code;
+	return Result::Error;
+}
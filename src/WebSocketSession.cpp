@@ -0,0 +1,220 @@
+#include "WebSocketSession.h"
+
+#include <sys/epoll.h>
+
+#include <iostream>
+#include <utility>
+
+WebSocketSession::WebSocketSession(EventLoop& event_loop,
+								   std::unique_ptr<jSocket> socket,
+								   const std::string& path,
+								   const MessageHandler& message_handler,
+								   const WebSocketSettings& settings)
+  : _event_loop(event_loop)
+  , _socket(std::move(socket))
+  , _path(path)
+  , _message_handler(message_handler)
+  , _settings(settings)
+  , _decoder(settings.max_message_size)
+{
+}
+
+void WebSocketSession::Start(std::vector<unsigned char>&& input)
+{
+	_input = std::move(input);
+	// started on the loop thread, everything the session does from here on runs there
+	_event_loop.Post(
+		[self = shared_from_this()]()
+		{
+			Spawn<bool>(self->Run(self), [](std::optional<bool>&&, std::exception_ptr) {});
+		});
+}
+
+bool WebSocketSession::Send(const std::string& text)
+{
+	return Queue(WebSocketOpcode::Text, reinterpret_cast<const unsigned char*>(text.data()), text.size());
+}
+
+bool WebSocketSession::SendBinary(const std::vector<unsigned char>& data)
+{
+	return Queue(WebSocketOpcode::Binary, data.data(), data.size());
+}
+
+void WebSocketSession::Close(WebSocketCloseCode close_code)
+{
+	QueueClose(close_code);
+	_event_loop.Notify(_socket->GetFd());
+}
+
+Task<bool> WebSocketSession::Run(std::shared_ptr<WebSocketSession> self)
+{
+	auto socket_fd = _socket->GetFd();
+	auto keep_running = HandleInput();
+	while (keep_running && !_overflowed && Flush())
+	{
+		uint32_t events = EPOLLIN | EPOLLRDHUP | (HasOutput() ? EPOLLOUT : 0);
+		// also woken by Notify when a frame was queued from elsewhere
+		auto ready = co_await _event_loop.WaitFor(socket_fd, events, _settings.ping_interval);
+		if (ready)
+		{
+			keep_running = ReadAvailable() && HandleInput();
+			continue;
+		}
+		if (_ping_outstanding)
+		{
+			std::cout << "[WebSocketSession] - No answer to ping, closing\n";
+			QueueClose(WebSocketCloseCode::GoingAway);
+			break;
+		}
+		_ping_outstanding = true;
+		Queue(WebSocketOpcode::Ping, nullptr, 0);
+	}
+	// a close frame queued on the way out gets its chance to leave
+	Flush();
+	_socket->Shutdown();
+	_is_open = false;
+	co_return true;
+}
+
+bool WebSocketSession::Queue(WebSocketOpcode opcode, const unsigned char* payload, size_t length)
+{
+	auto frame = EncodeWebSocketFrame(opcode, payload, length);
+	{
+		std::lock_guard<std::mutex> lock(_output_mutex);
+		if (_close_sent)
+		{
+			return false;
+		}
+		if (!_output.empty() && _output.size() + frame.size() > _settings.max_queued_bytes)
+		{
+			// the client does not read what it is sent, it is closed rather than buffered for without end
+			std::cout << "[WebSocketSession] - Client fell " << _output.size() << " bytes behind, closing\n";
+			_overflowed = true;
+			AppendClose(WebSocketCloseCode::PolicyViolation);
+		}
+		else
+		{
+			_output.insert(_output.end(), frame.begin(), frame.end());
+		}
+	}
+	_event_loop.Notify(_socket->GetFd());
+	return true;
+}
+
+void WebSocketSession::QueueClose(WebSocketCloseCode close_code)
+{
+	std::lock_guard<std::mutex> lock(_output_mutex);
+	AppendClose(close_code);
+}
+
+void WebSocketSession::AppendClose(WebSocketCloseCode close_code)
+{
+	if (_close_sent)
+	{
+		return;
+	}
+	// nothing may follow a close frame
+	_close_sent = true;
+	unsigned char payload[2] = { static_cast<unsigned char>(static_cast<uint16_t>(close_code) >> 8),
+								 static_cast<unsigned char>(close_code) };
+	auto frame = EncodeWebSocketFrame(WebSocketOpcode::Close, payload, sizeof(payload));
+	_output.insert(_output.end(), frame.begin(), frame.end());
+}
+
+bool WebSocketSession::HasOutput()
+{
+	std::lock_guard<std::mutex> lock(_output_mutex);
+	return !_output.empty();
+}
+
+bool WebSocketSession::Flush()
+{
+	std::lock_guard<std::mutex> lock(_output_mutex);
+	if (_output.empty())
+	{
+		return true;
+	}
+	auto bytes_written = _socket->TryWrite(_output.data(), _output.size());
+	if (!bytes_written.has_value())
+	{
+		return false;
+	}
+	_output.erase(_output.begin(), _output.begin() + bytes_written.value());
+	return true;
+}
+
+bool WebSocketSession::ReadAvailable()
+{
+	// the wake up may have come from Notify, a read with nothing there gives TimeOut
+	while (true)
+	{
+		auto read_result = _socket->TryRead(WEBSOCKET_READ_SIZE);
+		auto read_error = std::get_if<ReadError>(&read_result);
+		if (read_error)
+		{
+			return *read_error == ReadError::TimeOut;
+		}
+		auto& data_buffer = std::get<std::vector<unsigned char>>(read_result);
+		_input.insert(_input.end(), data_buffer.begin(), data_buffer.end());
+		_ping_outstanding = false;
+		// a short plain read took all there was. TLS reads stop at a record, the next one may be there already
+		if (data_buffer.size() < WEBSOCKET_READ_SIZE && !_socket->IsTls())
+		{
+			return true;
+		}
+	}
+}
+
+bool WebSocketSession::HandleInput()
+{
+	size_t position = 0;
+	auto keep_running = true;
+	while (keep_running)
+	{
+		size_t consumed = 0;
+		WebSocketMessage message;
+		auto result = _decoder.Decode(_input.data() + position, _input.size() - position, consumed, message);
+		position += consumed;
+		if (result == WebSocketDecoder::Result::NeedMore)
+		{
+			break;
+		}
+		if (result == WebSocketDecoder::Result::Error)
+		{
+			QueueClose(_decoder.ErrorCode());
+			keep_running = false;
+			break;
+		}
+		switch (message.opcode)
+		{
+		case WebSocketOpcode::Ping:
+			Queue(WebSocketOpcode::Pong, message.payload.data(), message.payload.size());
+			break;
+
+		case WebSocketOpcode::Pong:
+			break;
+
+		case WebSocketOpcode::Close:
+		{
+			// the client's code is echoed, a close without one is answered with a plain normal closure
+			auto close_code = WebSocketCloseCode::Normal;
+			if (message.payload.size() >= 2)
+			{
+				close_code = static_cast<WebSocketCloseCode>((message.payload[0] << 8) | message.payload[1]);
+			}
+			QueueClose(message.payload.size() == 1 ? WebSocketCloseCode::ProtocolError : close_code);
+			keep_running = false;
+			break;
+		}
+
+		default:
+			if (_message_handler)
+			{
+				_message_handler(*this, std::move(message));
+			}
+			break;
+		}
+	}
+	_input.erase(_input.begin(), _input.begin() + position);
+	return keep_running;
+}
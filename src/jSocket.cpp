@@ -1,5 +1,15 @@
 #include "jSocket.h"
 
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#ifdef __linux__
+	#include <sys/sendfile.h>
+#endif
+
+#include <fcntl.h>
+#include <poll.h>
+
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <sstream>
@@ -29,7 +39,7 @@ jSocket::jSocket(int raw_socket_fd, PROTO proto)
 
 jSocket::~jSocket()
 {
-	close(_socket_fd);
+	Close();
 }
 
 void jSocket::CreateSocket()
@@ -40,6 +50,34 @@ void jSocket::CreateSocket()
 		perror("socket failed");
 		exit(EXIT_FAILURE);
 	}
+	if (IsTcp() && _options.reuse_address)
+	{
+		// a restart can bind while connections of the last run are still in TIME_WAIT
+		int reuse_address = 1;
+		setsockopt(_socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse_address, sizeof(reuse_address));
+	}
+}
+
+bool jSocket::AdoptListener(int listen_fd)
+{
+	socklen_t address_length = sizeof(address);
+	int accepting = 0;
+	socklen_t option_length = sizeof(accepting);
+	if (getsockname(listen_fd, (struct sockaddr*)&address, &address_length) < 0 || address.sin_family != AF_INET ||
+		getsockopt(listen_fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &option_length) < 0 || !accepting)
+	{
+		return false;
+	}
+	_socket_fd = listen_fd;
+	_proto = PROTO::TCP;
+	fcntl(_socket_fd, F_SETFL, fcntl(_socket_fd, F_GETFL) | O_NONBLOCK);
+	ApplyListenerOptions();
+	// listening again only resizes the backlog, queued connections stay
+	listen(_socket_fd, _options.backlog);
+	_reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	_port = ntohs(address.sin_port);
+	std::cout << "[jSocket] - Listening on * " << _port << " (inherited)\n";
+	return true;
 }
 
 bool jSocket::Bind()
@@ -72,66 +110,732 @@ bool jSocket::IsSCTP() const
 	return _proto == PROTO::SCTP;
 };
 
+std::string jSocket::GetPeerName() const
+{
+	char address_buffer[INET_ADDRSTRLEN] = { 0 };
+	inet_ntop(AF_INET, &address.sin_addr, address_buffer, sizeof(address_buffer));
+	return address_buffer;
+}
+
 void jSocket::Listen()
 {
 	if (IsUdp())
 	{
 		throw std::runtime_error("[jSocket] - Listen not supported on UDP socket");
 	}
-	if (listen(_socket_fd, SOMAXCONN) < 0)
+	ApplyListenerOptions();
+	if (listen(_socket_fd, _options.backlog) < 0)
 	{
 		perror("listen");
 		exit(EXIT_FAILURE);
 	}
+	// another process may share the socket and take a connection poll reported first
+	fcntl(_socket_fd, F_SETFL, fcntl(_socket_fd, F_GETFL) | O_NONBLOCK);
+	_reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
 	std::cout << "[jSocket] - Listening on * " << _port << "\n";
 }
 
-std::unique_ptr<jSocket> jSocket::Accept(std::chrono::milliseconds time_out)
+std::unique_ptr<jSocket> jSocket::Connect(const struct sockaddr_in& peer_address, std::chrono::milliseconds timeout)
+{
+	int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+	if (socket_fd < 0)
+	{
+		return nullptr;
+	}
+	// non-blocking only while connecting, so the attempt can be given up on after the timeout
+	auto socket_flags = fcntl(socket_fd, F_GETFL);
+	fcntl(socket_fd, F_SETFL, socket_flags | O_NONBLOCK);
+	if (connect(socket_fd, (struct sockaddr*)&peer_address, sizeof(peer_address)) < 0)
+	{
+		struct pollfd poll_fd = { socket_fd, POLLOUT, 0 };
+		int connect_error = errno;
+		if (connect_error == EINPROGRESS && poll(&poll_fd, 1, static_cast<int>(timeout.count())) == 1)
+		{
+			socklen_t error_length = sizeof(connect_error);
+			getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &connect_error, &error_length);
+		}
+		else if (connect_error == EINPROGRESS)
+		{
+			connect_error = ETIMEDOUT;
+		}
+		if (connect_error != 0)
+		{
+			close(socket_fd);
+			errno = connect_error;
+			return nullptr;
+		}
+	}
+	fcntl(socket_fd, F_SETFL, socket_flags);
+	int no_delay = 1;
+	setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	try
+	{
+		return std::make_unique<jSocket>(socket_fd, PROTO::TCP);
+	}
+	catch (const std::exception&)
+	{
+		close(socket_fd);
+		return nullptr;
+	}
+}
+
+void jSocket::SetTimeout(std::chrono::milliseconds timeout)
+{
+	struct timeval time_value;
+	time_value.tv_sec = timeout.count() / 1000;
+	time_value.tv_usec = (timeout.count() % 1000) * 1000;
+	setsockopt(_socket_fd, SOL_SOCKET, SO_RCVTIMEO, &time_value, sizeof(time_value));
+	setsockopt(_socket_fd, SOL_SOCKET, SO_SNDTIMEO, &time_value, sizeof(time_value));
+	_timeout_ms = timeout.count() > 0 ? static_cast<int>(timeout.count()) : -1;
+}
+
+bool jSocket::IsIdle() const
+{
+	// an idle keep-alive peer sends nothing, readable means it closed or misbehaved
+	struct pollfd poll_fd = { _socket_fd, POLLIN, 0 };
+	return _socket_fd >= 0 && poll(&poll_fd, 1, 0) == 0;
+}
+
+std::vector<std::unique_ptr<jSocket>> jSocket::Accept()
 {
 	if (IsUdp())
 	{
 		throw std::runtime_error("[jSocket] - Accept not supported on UDP socket");
 	}
+	std::vector<std::unique_ptr<jSocket>> accepted_sockets;
+	// the listener is non-blocking, the backlog is drained until it runs dry or the batch is full
+	while (accepted_sockets.size() < std::max<size_t>(_options.accept_batch, 1))
+	{
+		int accepted_socket_fd = accept4(_socket_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (accepted_socket_fd < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (accepted_socket_fd < 0)
+		{
+			if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+			{
+				// the connection stays queued and the listener readable, left there the acceptor would spin on it
+				ShedConnection();
+			}
+			// another process may share the socket and take a connection poll reported first
+			else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED)
+			{
+				perror("accept");
+			}
+			break;
+		}
+		std::unique_ptr<jSocket> accepted_socket;
+		try
+		{
+			accepted_socket = std::make_unique<jSocket>(accepted_socket_fd, _proto);
+		}
+		catch (const std::exception&)
+		{
+			// the peer reset before it was accepted, only this connection is lost
+			close(accepted_socket_fd);
+			continue;
+		}
+		accepted_socket->_non_blocking = true;
+		accepted_socket->_options = _options;
+		accepted_socket->ApplyConnectionOptions();
+		accepted_sockets.emplace_back(std::move(accepted_socket));
+	}
+	return accepted_sockets;
+}
 
-	int accepted_socket_fd = accept(_socket_fd, nullptr, nullptr);
-	if (accepted_socket_fd < 0)
+void jSocket::ShedConnection()
+{
+	auto accepted = false;
+	if (_reserve_fd >= 0)
 	{
-		perror("accept");
-		return nullptr;
+		close(_reserve_fd);
+		int shed_socket_fd = accept4(_socket_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (shed_socket_fd >= 0)
+		{
+			accepted = true;
+			close(shed_socket_fd);
+		}
+		_reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	}
+	auto now = std::chrono::steady_clock::now();
+	if (accepted)
+	{
+		_shed_connections++;
+	}
+	else
+	{
+		// no spare descriptor, or the system is out of memory for sockets too. let the queue be for a while
+		_accept_paused_until = now + ACCEPT_BACKOFF;
+	}
+	if (now - _shed_logged >= ACCEPT_SHED_LOG_INTERVAL)
+	{
+		std::cout << "[jSocket] - Out of file descriptors, " << _shed_connections << " connections closed unserved since the last report\n";
+		_shed_connections = 0;
+		_shed_logged = now;
 	}
-	auto accepted_socket = std::make_unique<jSocket>(accepted_socket_fd, _proto);
-	return accepted_socket;
 }
 
-ReadResult jSocket::Read()
+void jSocket::ApplyListenerOptions()
 {
-	unsigned char read_buffer[1024] = { 0 };
-	std::vector<unsigned char> data_buffer;
-	auto read_start = std::chrono::steady_clock::now();
+	// buffer sizes are inherited by accepted connections and have to be set before listen to affect window scaling
+	if (_options.receive_buffer > 0)
+	{
+		setsockopt(_socket_fd, SOL_SOCKET, SO_RCVBUF, &_options.receive_buffer, sizeof(_options.receive_buffer));
+	}
+	if (_options.send_buffer > 0)
+	{
+		setsockopt(_socket_fd, SOL_SOCKET, SO_SNDBUF, &_options.send_buffer, sizeof(_options.send_buffer));
+	}
+	if (_options.defer_accept > 0)
+	{
+		setsockopt(_socket_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &_options.defer_accept, sizeof(_options.defer_accept));
+	}
+	if (_options.fast_open > 0 && setsockopt(_socket_fd, IPPROTO_TCP, TCP_FASTOPEN, &_options.fast_open, sizeof(_options.fast_open)) < 0)
+	{
+		std::cout << "[jSocket] - TCP Fast Open is not available\n";
+	}
+}
 
-	int bytes_read;
+void jSocket::ApplyConnectionOptions()
+{
+	if (_options.no_delay)
+	{
+		// responses leave in whole writes, Nagle would only hold the last segment back for a delayed ACK
+		int no_delay = 1;
+		setsockopt(_socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	}
+	if (!_options.keep_alive)
+	{
+		return;
+	}
+	int keep_alive = 1;
+	setsockopt(_socket_fd, SOL_SOCKET, SO_KEEPALIVE, &keep_alive, sizeof(keep_alive));
+	if (_options.keep_alive_idle > 0)
+	{
+		setsockopt(_socket_fd, IPPROTO_TCP, TCP_KEEPIDLE, &_options.keep_alive_idle, sizeof(_options.keep_alive_idle));
+	}
+	if (_options.keep_alive_interval > 0)
+	{
+		setsockopt(_socket_fd, IPPROTO_TCP, TCP_KEEPINTVL, &_options.keep_alive_interval, sizeof(_options.keep_alive_interval));
+	}
+	if (_options.keep_alive_count > 0)
+	{
+		setsockopt(_socket_fd, IPPROTO_TCP, TCP_KEEPCNT, &_options.keep_alive_count, sizeof(_options.keep_alive_count));
+	}
+}
+
+ReadResult jSocket::Read(size_t max_length)
+{
+	return ReadCopy(max_length, true);
+}
 
+ReadResult jSocket::TryRead(size_t max_length)
+{
+	return ReadCopy(max_length, false);
+}
+
+ReadResult jSocket::ReadCopy(size_t max_length, bool wait)
+{
+	// read into a pooled slab, so the result is allocated once at the size that arrived and never zero filled
+	PooledSlab slab(max_length);
+	struct iovec io_vector = { slab.data(), max_length };
+	auto read_result = ReadV(&io_vector, 1, wait);
+	auto read_error = std::get_if<ReadError>(&read_result);
+	if (read_error)
+	{
+		return *read_error;
+	}
+	return std::vector<unsigned char>(slab.data(), slab.data() + std::get<size_t>(read_result));
+}
 
-	bytes_read = read(_socket_fd, read_buffer, 1024);
-	if (bytes_read == 0)
+std::variant<size_t, ReadError> jSocket::ReadInto(ReceiveBuffer& buffer)
+{
+	auto used = buffer.size();
+	if (buffer.capacity() - used < RECEIVE_MIN_SPACE)
 	{
-		return ReadError::ConnectionClosed;
+		buffer.reserve(BufferPool::BlockSize(used + RECEIVE_MIN_SPACE));
 	}
-	if (bytes_read == -1)
+	// elements are not initialized, growing to the capacity only exposes the free space to read into
+	buffer.resize(buffer.capacity());
+	auto space = buffer.size() - used;
+	// whatever does not fit spills into a slab, one call takes all that has arrived
+	PooledSlab slab(RECEIVE_SLAB_SIZE);
+	struct iovec io_vectors[2] = { { buffer.data() + used, space }, { slab.data(), slab.size() } };
+	auto read_result = ReadV(io_vectors, 2, true);
+	auto bytes_read = std::get_if<size_t>(&read_result);
+	buffer.resize(used + (bytes_read ? std::min(*bytes_read, space) : 0));
+	if (bytes_read && *bytes_read > space)
 	{
-		return ReadError::UnknownError;
+		buffer.insert(buffer.end(), slab.data(), slab.data() + (*bytes_read - space));
 	}
-	data_buffer.insert(data_buffer.end(), read_buffer, read_buffer + bytes_read);
+	return read_result;
+}
 
-	return data_buffer;
+std::variant<size_t, ReadError> jSocket::ReadV(struct iovec* io_vectors, int count, bool wait)
+{
+	if (_ssl)
+	{
+		return TlsRead(io_vectors, count, wait);
+	}
+	while (true)
+	{
+		auto bytes_read = readv(_socket_fd, io_vectors, count);
+		if (bytes_read > 0)
+		{
+			return static_cast<size_t>(bytes_read);
+		}
+		if (bytes_read == 0)
+		{
+			return ReadError::ConnectionClosed;
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			return ReadError::UnknownError;
+		}
+		// a blocking socket has already waited out its receive timeout
+		if (!wait || !_non_blocking || !WaitFor(POLLIN))
+		{
+			return ReadError::TimeOut;
+		}
+	}
 }
 
-void jSocket::Write(const std::vector<unsigned char>& data_buffer)
+std::variant<size_t, ReadError> jSocket::TlsRead(struct iovec* io_vectors, int count, bool wait)
 {
-	auto bytes_written = write(_socket_fd, data_buffer.data(), static_cast<int>(data_buffer.size()));
+	size_t total_read = 0;
+	int vector_index = 0;
+	while (vector_index < count)
+	{
+		int bytes_read;
+		int ssl_error;
+		{
+			std::lock_guard<std::mutex> lock(_tls_mutex);
+			if (!_handshake_complete)
+			{
+				bytes_read = SSL_do_handshake(_ssl);
+				if (bytes_read == 1)
+				{
+					_handshake_complete = true;
+#ifndef OPENSSL_NO_KTLS
+					_ktls_send = BIO_get_ktls_send(SSL_get_wbio(_ssl));
+#endif
+					continue;
+				}
+			}
+			else
+			{
+				auto& io_vector = io_vectors[vector_index];
+				if (io_vector.iov_len == 0)
+				{
+					vector_index++;
+					continue;
+				}
+				bytes_read = SSL_read(_ssl, io_vector.iov_base, static_cast<int>(io_vector.iov_len));
+				if (bytes_read > 0)
+				{
+					total_read += bytes_read;
+					// the next vector is only filled from a record that is already decrypted
+					if (static_cast<size_t>(bytes_read) < io_vector.iov_len || SSL_pending(_ssl) == 0)
+					{
+						return total_read;
+					}
+					vector_index++;
+					continue;
+				}
+			}
+			ssl_error = SSL_get_error(_ssl, bytes_read);
+		}
+		if (!wait && (ssl_error == SSL_ERROR_WANT_READ || ssl_error == SSL_ERROR_WANT_WRITE))
+		{
+			// the rest of the record is not there yet, the caller comes back when the socket is ready
+			if (total_read > 0)
+			{
+				return total_read;
+			}
+			return ReadError::TimeOut;
+		}
+		// wait without holding the lock so writers on other threads can proceed
+		if (ssl_error == SSL_ERROR_WANT_READ && WaitFor(POLLIN))
+		{
+			continue;
+		}
+		if (ssl_error == SSL_ERROR_WANT_WRITE && WaitFor(POLLOUT))
+		{
+			continue;
+		}
+		ERR_clear_error();
+		return ssl_error == SSL_ERROR_ZERO_RETURN ? ReadError::ConnectionClosed : ReadError::UnknownError;
+	}
+	return total_read;
+}
+
+bool jSocket::Write(const std::vector<unsigned char>& data_buffer)
+{
+	if (_ssl)
+	{
+		std::lock_guard<std::mutex> lock(_tls_mutex);
+		return TlsWrite(data_buffer.data(), data_buffer.size());
+	}
+	struct iovec io_vector = { const_cast<unsigned char*>(data_buffer.data()), data_buffer.size() };
+	return WriteV(&io_vector, 1);
+}
+
+bool jSocket::Write(const std::vector<unsigned char>& header_buffer, const std::vector<unsigned char>& body_buffer)
+{
+	return Write(header_buffer, body_buffer.data(), body_buffer.size());
+}
+
+bool jSocket::Write(const std::vector<unsigned char>& header_buffer, const unsigned char* body, size_t body_length)
+{
+	if (_ssl)
+	{
+		std::lock_guard<std::mutex> lock(_tls_mutex);
+		return TlsWrite(header_buffer.data(), header_buffer.size()) && TlsWrite(body, body_length);
+	}
+	struct iovec io_vectors[2] = { { const_cast<unsigned char*>(header_buffer.data()), header_buffer.size() },
+								   { const_cast<unsigned char*>(body), body_length } };
+	return WriteV(io_vectors, 2);
+}
+
+std::optional<size_t> jSocket::TryWrite(const unsigned char* data, size_t length)
+{
+	if (_ssl)
+	{
+		std::lock_guard<std::mutex> lock(_tls_mutex);
+		return TlsTryWrite(data, length);
+	}
+	while (true)
+	{
+		auto bytes_written = send(_socket_fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (bytes_written >= 0)
+		{
+			return static_cast<size_t>(bytes_written);
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			return 0;
+		}
+		return std::nullopt;
+	}
+}
+
+bool jSocket::WriteV(struct iovec* io_vectors, int count)
+{
+	while (count > 0)
+	{
+		auto bytes_written = writev(_socket_fd, io_vectors, count);
+		if (bytes_written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == EAGAIN && WaitFor(POLLOUT))
+			{
+				continue;
+			}
+			return false;
+		}
+		// skip whatever was fully written and advance into a partial vector
+		while (count > 0 && static_cast<size_t>(bytes_written) >= io_vectors->iov_len)
+		{
+			bytes_written -= io_vectors->iov_len;
+			io_vectors++;
+			count--;
+		}
+		if (count > 0)
+		{
+			io_vectors->iov_base = static_cast<unsigned char*>(io_vectors->iov_base) + bytes_written;
+			io_vectors->iov_len -= bytes_written;
+		}
+	}
+	return true;
+}
+
+std::optional<size_t> jSocket::TlsTryWrite(const unsigned char* data, size_t length)
+{
+	size_t offset = 0;
+	while (offset < length)
+	{
+		auto bytes_written = SSL_write(_ssl, data + offset, static_cast<int>(std::min<size_t>(length - offset, INT32_MAX)));
+		if (bytes_written > 0)
+		{
+			offset += bytes_written;
+			continue;
+		}
+		auto ssl_error = SSL_get_error(_ssl, bytes_written);
+		if (ssl_error == SSL_ERROR_WANT_WRITE || ssl_error == SSL_ERROR_WANT_READ)
+		{
+			// a record already made from the front of what is left goes out with the next call
+			return offset;
+		}
+		ERR_clear_error();
+		return std::nullopt;
+	}
+	return offset;
+}
+
+bool jSocket::TlsWrite(const unsigned char* data, size_t length)
+{
+	size_t offset = 0;
+	while (offset < length)
+	{
+		auto bytes_written = SSL_write(_ssl, data + offset, static_cast<int>(std::min<size_t>(length - offset, INT32_MAX)));
+		if (bytes_written > 0)
+		{
+			offset += bytes_written;
+			continue;
+		}
+		auto ssl_error = SSL_get_error(_ssl, bytes_written);
+		if ((ssl_error == SSL_ERROR_WANT_WRITE && WaitFor(POLLOUT)) || (ssl_error == SSL_ERROR_WANT_READ && WaitFor(POLLIN)))
+		{
+			continue;
+		}
+		ERR_clear_error();
+		return false;
+	}
+	return true;
+}
+
+bool jSocket::SendFile(int file_fd, uintmax_t offset, uintmax_t length)
+{
+	if (_ssl)
+	{
+		std::lock_guard<std::mutex> lock(_tls_mutex);
+#if !defined(OPENSSL_NO_KTLS) && OPENSSL_VERSION_NUMBER >= 0x30000000L
+		if (_ktls_send)
+		{
+			// records are built by the kernel, file pages never reach userspace
+			while (length > 0)
+			{
+				auto bytes_sent = SSL_sendfile(_ssl, file_fd, static_cast<off_t>(offset), length, 0);
+				if (bytes_sent > 0)
+				{
+					offset += bytes_sent;
+					length -= bytes_sent;
+					continue;
+				}
+				if (SSL_get_error(_ssl, static_cast<int>(bytes_sent)) == SSL_ERROR_WANT_WRITE && WaitFor(POLLOUT))
+				{
+					continue;
+				}
+				ERR_clear_error();
+				return false;
+			}
+			return true;
+		}
+#endif
+		std::vector<unsigned char> file_buffer(std::min<uintmax_t>(length, 64 * 1024));
+		while (length > 0)
+		{
+			auto bytes_read = pread(file_fd, file_buffer.data(), std::min<uintmax_t>(length, file_buffer.size()), static_cast<off_t>(offset));
+			if (bytes_read <= 0 || !TlsWrite(file_buffer.data(), bytes_read))
+			{
+				return false;
+			}
+			offset += bytes_read;
+			length -= bytes_read;
+		}
+		return true;
+	}
+#ifdef __linux__
+	auto file_offset = static_cast<off_t>(offset);
+	while (length > 0)
+	{
+		auto bytes_sent = sendfile(_socket_fd, file_fd, &file_offset, length);
+		if (bytes_sent > 0)
+		{
+			length -= bytes_sent;
+			continue;
+		}
+		if (bytes_sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (bytes_sent < 0 && errno == EAGAIN && WaitFor(POLLOUT))
+		{
+			continue;
+		}
+		return false;
+	}
+	return true;
+#else
+	std::vector<unsigned char> file_buffer(std::min<uintmax_t>(length, 64 * 1024));
+	while (length > 0)
+	{
+		auto bytes_read = pread(file_fd, file_buffer.data(), std::min<uintmax_t>(length, file_buffer.size()), static_cast<off_t>(offset));
+		if (bytes_read <= 0)
+		{
+			return false;
+		}
+		struct iovec io_vector = { file_buffer.data(), static_cast<size_t>(bytes_read) };
+		if (!WriteV(&io_vector, 1))
+		{
+			return false;
+		}
+		offset += bytes_read;
+		length -= bytes_read;
+	}
+	return true;
+#endif
+}
+
+bool jSocket::SpliceTo(int file_fd, uintmax_t offset, uintmax_t length)
+{
+#ifdef __linux__
+	if (!_ssl)
+	{
+		// socket pages are moved into the pipe and on into the page cache, the body is never copied to userspace
+		int pipe_fds[2];
+		if (pipe2(pipe_fds, O_CLOEXEC) != 0)
+		{
+			return false;
+		}
+		// a larger pipe moves more per round trip, the default of 64K is kept when the limit is lower
+		fcntl(pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+		auto file_offset = static_cast<loff_t>(offset);
+		auto spliced = true;
+		while (length > 0 && spliced)
+		{
+			auto bytes_in = splice(_socket_fd, nullptr, pipe_fds[1], nullptr, std::min<uintmax_t>(length, SPLICE_PIPE_SIZE), SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (bytes_in < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (bytes_in < 0 && errno == EAGAIN && WaitFor(POLLIN))
+			{
+				continue;
+			}
+			if (bytes_in <= 0)
+			{
+				spliced = false;
+				break;
+			}
+			length -= bytes_in;
+			while (bytes_in > 0)
+			{
+				auto bytes_out = splice(pipe_fds[0], nullptr, file_fd, &file_offset, bytes_in, SPLICE_F_MOVE);
+				if (bytes_out < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (bytes_out <= 0)
+				{
+					spliced = false;
+					break;
+				}
+				bytes_in -= bytes_out;
+			}
+		}
+		close(pipe_fds[0]);
+		close(pipe_fds[1]);
+		return spliced;
+	}
+#endif
+	while (length > 0)
+	{
+		auto read_result = Read(std::min<uintmax_t>(length, 64 * 1024));
+		if (!std::holds_alternative<std::vector<unsigned char>>(read_result))
+		{
+			return false;
+		}
+		auto& data_buffer = std::get<std::vector<unsigned char>>(read_result);
+		size_t buffer_written = 0;
+		while (buffer_written < data_buffer.size())
+		{
+			auto bytes_written = pwrite(file_fd,
+										data_buffer.data() + buffer_written,
+										data_buffer.size() - buffer_written,
+										static_cast<off_t>(offset + buffer_written));
+			if (bytes_written <= 0)
+			{
+				return false;
+			}
+			buffer_written += bytes_written;
+		}
+		offset += buffer_written;
+		length -= buffer_written;
+	}
+	return true;
+}
+
+bool jSocket::StartTls(const TlsContext& tls_context)
+{
+	// non-blocking so a pending read never holds the TLS lock against writers
+	fcntl(_socket_fd, F_SETFL, fcntl(_socket_fd, F_GETFL) | O_NONBLOCK);
+	_non_blocking = true;
+	// handshake flights go out as several small records, Nagle would hold the
+	// last one back for a delayed ACK
+	int no_delay = 1;
+	setsockopt(_socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	_ssl = tls_context.CreateSession(_socket_fd);
+	if (_ssl)
+	{
+		// TryWrite hands back what fit and is called again with the rest, which may have moved in memory
+		SSL_set_mode(_ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	}
+	return _ssl != nullptr;
+}
+
+bool jSocket::WaitFor(short events)
+{
+	struct pollfd poll_fd = { _socket_fd, events, 0 };
+	while (true)
+	{
+		auto timeout_ms = _timeout_ms;
+		if ((events & POLLIN) && _read_deadline.has_value())
+		{
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(_read_deadline.value() - std::chrono::steady_clock::now());
+			auto remaining_ms = static_cast<int>(std::max<int64_t>(remaining.count(), 0));
+			timeout_ms = timeout_ms < 0 ? remaining_ms : std::min(timeout_ms, remaining_ms);
+		}
+		auto result = poll(&poll_fd, 1, timeout_ms);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		return result > 0 && (poll_fd.revents & (events | POLLHUP)) && !(poll_fd.revents & (POLLERR | POLLNVAL));
+	}
+}
+
+void jSocket::Shutdown()
+{
+	// unlike close, this wakes up a thread blocked reading the socket
+	if (_socket_fd >= 0)
+	{
+		shutdown(_socket_fd, SHUT_RDWR);
+	}
 }
 
 void jSocket::Close()
 {
-	close(_socket_fd);
-}
\ No newline at end of file
+	if (_ssl)
+	{
+		std::lock_guard<std::mutex> lock(_tls_mutex);
+		if (_handshake_complete)
+		{
+			SSL_shutdown(_ssl);
+		}
+		SSL_free(_ssl);
+		_ssl = nullptr;
+	}
+	if (_socket_fd >= 0)
+	{
+		close(_socket_fd);
+		_socket_fd = -1;
+	}
+	if (_reserve_fd >= 0)
+	{
+		close(_reserve_fd);
+		_reserve_fd = -1;
+	}
+}
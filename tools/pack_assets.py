@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+# Packs a directory of static assets into a C++ source compiled into the server.
+#
+#   tools/pack_assets.py <asset dir> <output .cpp>
+#
+# Run by the EMBED_WEB_ASSETS build option. Every file becomes an EmbeddedAsset
+# (include/AssetBundle.h) with its content type, a strong ETag taken from its
+# contents, its Last-Modified date and, for text, a gzip variant when that is
+# smaller. The assets are laid out in the slots of a minimal perfect hash over
+# their request paths, so the server finds one with two hashes and a compare.
+import email.utils
+import gzip
+import hashlib
+import os
+import sys
+
+CONTENT_TYPES = {
+    ".html": "text/html;charset=utf-8",
+    ".htm": "text/html;charset=utf-8",
+    ".css": "text/css;charset=utf-8",
+    ".js": "text/javascript;charset=utf-8",
+    ".json": "application/json",
+    ".txt": "text/plain;charset=utf-8",
+    ".xml": "application/xml",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".jpeg": "image/jpeg",
+    ".gif": "image/gif",
+    ".webp": "image/webp",
+    ".ico": "image/x-icon",
+    ".woff2": "font/woff2",
+    ".wasm": "application/wasm",
+}
+COMPRESSIBLE = ("text/", "application/json", "application/xml", "image/svg+xml", "image/x-icon")
+MASK = 0xFFFFFFFF
+
+
+def path_hash(seed, path):
+    # same as AssetPathHash in include/AssetBundle.h
+    value = 0x811C9DC5 ^ seed
+    for byte in path.encode():
+        value ^= byte
+        value = (value * 0x01000193) & MASK
+    value ^= value >> 16
+    value = (value * 0x85EBCA6B) & MASK
+    value ^= value >> 13
+    value = (value * 0xC2B2AE35) & MASK
+    value ^= value >> 16
+    return value
+
+
+def perfect_hash(paths):
+    # hash and displace: the largest buckets are placed first, each trying seeds until its paths land in free slots
+    slot_count = len(paths)
+    seed_count = max(1, (slot_count + 1) // 2)
+    buckets = [[] for _ in range(seed_count)]
+    for path in paths:
+        buckets[path_hash(0, path) % seed_count].append(path)
+    seeds = [0] * seed_count
+    slots = [None] * slot_count
+    for bucket_index in sorted(range(seed_count), key=lambda index: -len(buckets[index])):
+        bucket = buckets[bucket_index]
+        if not bucket:
+            continue
+        seed = 1
+        while True:
+            candidate = [path_hash(seed, path) % slot_count for path in bucket]
+            if len(set(candidate)) == len(candidate) and all(slots[slot] is None for slot in candidate):
+                break
+            seed += 1
+        seeds[bucket_index] = seed
+        for path, slot in zip(bucket, candidate):
+            slots[slot] = path
+    return seeds, slots
+
+
+def c_string(text):
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def c_bytes(name, data):
+    lines = []
+    for start in range(0, len(data), 16):
+        lines.append("\t\t" + ", ".join("0x%02x" % byte for byte in data[start:start + 16]) + ",")
+    # a zero length array is not valid C++
+    return "\tconst unsigned char %s[] = {\n%s\n\t};\n" % (name, "\n".join(lines) if lines else "\t\t0")
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: pack_assets.py <asset dir> <output .cpp>")
+    asset_dir, output_file = sys.argv[1], sys.argv[2]
+    assets = {}
+    for directory, _, file_names in os.walk(asset_dir):
+        for file_name in file_names:
+            file_path = os.path.join(directory, file_name)
+            path = "/" + os.path.relpath(file_path, asset_dir).replace(os.sep, "/")
+            with open(file_path, "rb") as asset_file:
+                data = asset_file.read()
+            content_type = CONTENT_TYPES.get(os.path.splitext(file_name)[1].lower(), "application/octet-stream")
+            gzip_data = b""
+            if content_type.startswith(COMPRESSIBLE):
+                # mtime 0 keeps the output the same from one build to the next
+                compressed = gzip.compress(data, compresslevel=9, mtime=0)
+                if len(compressed) < len(data):
+                    gzip_data = compressed
+            assets[path] = {
+                "content_type": content_type,
+                "etag": '"' + hashlib.sha256(data).hexdigest()[:32] + '"',
+                "last_modified": email.utils.formatdate(os.stat(file_path).st_mtime, usegmt=True),
+                "data": data,
+                "gzip_data": gzip_data,
+            }
+    seeds, slots = perfect_hash(sorted(assets))
+
+    out = ["// generated by tools/pack_assets.py, do not edit\n", '#include "AssetBundle.h"\n', "\nnamespace\n{\n"]
+    entries = []
+    for slot, path in enumerate(slots):
+        asset = assets[path]
+        out.append(c_bytes("AssetData%d" % slot, asset["data"]))
+        gzip_reference = "nullptr, 0"
+        if asset["gzip_data"]:
+            out.append(c_bytes("AssetGzipData%d" % slot, asset["gzip_data"]))
+            gzip_reference = "AssetGzipData%d, %d" % (slot, len(asset["gzip_data"]))
+        entries.append("\t\t{ %s, %s, %s, %s, AssetData%d, %d, %s }," % (
+            c_string(path), c_string(asset["content_type"]), c_string(asset["etag"]), c_string(asset["last_modified"]),
+            slot, len(asset["data"]), gzip_reference))
+    if entries:
+        out.append("\tconst EmbeddedAsset Assets[] = {\n%s\n\t};\n" % "\n".join(entries))
+        out.append("\tconst uint32_t Seeds[] = { %s };\n" % ", ".join(str(seed) for seed in seeds))
+        out.append("}  // namespace\n\nextern const AssetBundleIndex EmbeddedAssetIndex = { Assets, %d, Seeds, %d };\n" % (len(slots), len(seeds)))
+    else:
+        out.append("}  // namespace\n\nextern const AssetBundleIndex EmbeddedAssetIndex = { nullptr, 0, nullptr, 0 };\n")
+
+    with open(output_file, "w") as output:
+        output.write("".join(out))
+
+
+if __name__ == "__main__":
+    main()